@@ -0,0 +1,426 @@
+/*
+ *  SLAMTEC LIDAR
+ *  Scan Decoding Benchmark App
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "sl_lidar.h"
+#include "sl_lidar_driver.h"
+#include "sl_lidar_emulator.h"
+#include "sl_scan_decoder.h"
+
+using namespace sl;
+
+void print_usage(int argc, const char * argv[])
+{
+    printf("Usage:\n"
+           " %s [--passes <count>] [--runs <count>] [--cpu <index>] [--capture <file>]\n"
+           "  --passes   times each recorded stream is decoded by each path in a run (default 200)\n"
+           "  --runs     runs of each path, taking turns, the best and the median one are reported (default 5)\n"
+           "  --cpu      pin the benchmark to this cpu once the streams are recorded\n"
+           "  --capture  decode the scan recorded in this capture file instead of recording\n"
+           "             one per scan mode from the built in emulator\n"
+           , argv[0]);
+}
+
+// Plays recorded bytes back from memory, the tail of the recording is handed out even if shorter than waited for.
+// Being final, calls made through a MemoryChannel are bound at compile time, calls made through an IChannel stay virtual
+class MemoryChannel final : public IChannel
+{
+public:
+    explicit MemoryChannel(const std::vector<sl_u8> & data) : _data(data), _pos(0), _drained(false) {}
+
+    bool open() { _pos = 0; _drained = false; return true; }
+    void close() {}
+    void flush() {}
+
+    bool waitForData(size_t size, sl_u32 timeoutInMs, size_t * actualReady)
+    {
+        size_t remaining = _data.size() - _pos;
+        if (actualReady) *actualReady = remaining;
+        _drained = remaining == 0;
+        return !_drained;
+    }
+
+    int write(const void * data, size_t size) { return (int)size; }
+
+    int read(void * buffer, size_t size)
+    {
+        size = std::min(size, _data.size() - _pos);
+        memcpy(buffer, &_data[_pos], size);
+        _pos += size;
+        return (int)size;
+    }
+
+    void clearReadCache() {}
+
+    bool drained() const { return _drained; }
+
+private:
+    const std::vector<sl_u8> & _data;
+    size_t _pos;
+    bool _drained;
+};
+
+// What the driver did before the decoders were specialised: the answer type is looked at for every frame
+class GenericScanDecoder
+{
+public:
+    union frame_t
+    {
+        StandardScanDecoder::frame_t      standard;
+        CapsuleScanDecoder::frame_t       capsule;
+        DenseCapsuleScanDecoder::frame_t  dense;
+        HqScanDecoder::frame_t            hq;
+        UltraCapsuleScanDecoder::frame_t  ultra;
+    };
+
+    enum {
+        MAX_NODES_PER_FRAME = 96,
+    };
+
+    explicit GenericScanDecoder(sl_u8 ansType) : _ansType(ansType) {}
+
+    bool take(ScanRxWindow & window, frame_t & frame, ScanDecodeStats & stats)
+    {
+        switch (_ansType) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT:                 return _standard.take(window, frame.standard, stats);
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:        return _capsule.take(window, frame.capsule, stats);
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:  return _dense.take(window, frame.dense, stats);
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:              return _hq.take(window, frame.hq, stats);
+        default:                                            return _ultra.take(window, frame.ultra, stats);
+        }
+    }
+
+    void onTimeout(ScanRxWindow & window, ScanDecodeStats & stats)
+    {
+        switch (_ansType) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT:                 _standard.onTimeout(window, stats); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:        _capsule.onTimeout(window, stats); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:  _dense.onTimeout(window, stats); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:              _hq.onTimeout(window, stats); break;
+        default:                                            _ultra.onTimeout(window, stats); break;
+        }
+    }
+
+    void decode(const frame_t & frame, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+    {
+        switch (_ansType) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT:                 _standard.decode(frame.standard, nodebuffer, nodeCount); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:        _capsule.decode(frame.capsule, nodebuffer, nodeCount); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:  _dense.decode(frame.dense, nodebuffer, nodeCount); break;
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:              _hq.decode(frame.hq, nodebuffer, nodeCount); break;
+        default:                                            _ultra.decode(frame.ultra, nodebuffer, nodeCount); break;
+        }
+    }
+
+private:
+    sl_u8 _ansType;
+    StandardScanDecoder _standard;
+    CapsuleScanDecoder _capsule;
+    DenseCapsuleScanDecoder _dense;
+    HqScanDecoder _hq;
+    UltraCapsuleScanDecoder _ultra;
+};
+
+// Counts what is decoded, the checksum shows that both paths decoded the same samples
+struct CountingSink
+{
+    explicit CountingSink(const MemoryChannel & channel) : channel(channel), samples(0), rotations(0), checksum(0) {}
+
+    bool isScanning() const { return !channel.drained(); }
+
+    void onScanNodes(const sl_lidar_response_measurement_node_hq_t * nodes, size_t count)
+    {
+        for (size_t pos = 0; pos < count; ++pos) {
+            if (nodes[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) ++rotations;
+            checksum = checksum * 31 + nodes[pos].dist_mm_q2 + nodes[pos].angle_z_q14;
+        }
+        samples += count;
+    }
+
+    const MemoryChannel & channel;
+    sl_u64 samples;
+    sl_u64 rotations;
+    sl_u64 checksum;
+};
+
+struct PathResult
+{
+    double seconds;
+    sl_u64 samples;
+    sl_u64 rotations;
+    sl_u64 checksum;
+};
+
+template <class TDecoder>
+static PathResult run_specialized(const std::vector<sl_u8> & stream, int passes)
+{
+    PathResult result = {};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        MemoryChannel channel(stream);
+        CountingSink sink(channel);
+        ScanRxWindow window;
+        ScanDecodeStats stats;
+        TDecoder decoder;
+        decodeScanStream(decoder, channel, window, stats, sink, 0);
+
+        result.samples += sink.samples;
+        result.rotations += sink.rotations;
+        result.checksum = sink.checksum;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Kept out of line so the channel is only known as an IChannel, as it is inside the driver
+__attribute__((noinline)) static void decode_generic(GenericScanDecoder & decoder, IChannel & channel, ScanRxWindow & window, ScanDecodeStats & stats, CountingSink & sink)
+{
+    decodeScanStream(decoder, channel, window, stats, sink, 0);
+}
+
+static PathResult run_generic(const std::vector<sl_u8> & stream, sl_u8 ansType, int passes)
+{
+    PathResult result = {};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        MemoryChannel channel(stream);
+        CountingSink sink(channel);
+        ScanRxWindow window;
+        ScanDecodeStats stats;
+        GenericScanDecoder decoder(ansType);
+        decode_generic(decoder, channel, window, stats, sink);
+
+        result.samples += sink.samples;
+        result.rotations += sink.rotations;
+        result.checksum = sink.checksum;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static PathResult run_specialized(const std::vector<sl_u8> & stream, sl_u8 ansType, int passes)
+{
+    switch (ansType) {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT:                 return run_specialized<StandardScanDecoder>(stream, passes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:        return run_specialized<CapsuleScanDecoder>(stream, passes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:  return run_specialized<DenseCapsuleScanDecoder>(stream, passes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:              return run_specialized<HqScanDecoder>(stream, passes);
+    default:                                            return run_specialized<UltraCapsuleScanDecoder>(stream, passes);
+    }
+}
+
+// Best and median run time of a path, sorts seconds
+static void report(const char * path, std::vector<double> & seconds, sl_u64 samplesPerRun, size_t streamBytes, int passes)
+{
+    std::sort(seconds.begin(), seconds.end());
+    double best = seconds.front();
+    double median = seconds[seconds.size() / 2];
+    printf("  %-12s %8.1f MB/s  %8.2f Msamples/s  %6.1f ns/sample  (median %6.1f ns/sample)\n", path,
+           streamBytes * (double)passes / best / 1e6, samplesPerRun / best / 1e6,
+           best * 1e9 / samplesPerRun, median * 1e9 / samplesPerRun);
+}
+
+static bool bench_stream(const std::vector<sl_u8> & stream, sl_u8 ansType, int passes, int runs)
+{
+    std::vector<double> specializedSeconds, genericSeconds;
+    PathResult specialized = {}, generic = {};
+    bool identical = true;
+
+    // the paths take turns, so a change of clock speed or load during the runs weighs on both alike
+    for (int run = 0; run < runs; ++run) {
+        if (run & 1) {
+            generic = run_generic(stream, ansType, passes);
+            specialized = run_specialized(stream, ansType, passes);
+        }
+        else {
+            specialized = run_specialized(stream, ansType, passes);
+            generic = run_generic(stream, ansType, passes);
+        }
+        specializedSeconds.push_back(specialized.seconds);
+        genericSeconds.push_back(generic.seconds);
+        identical = identical && specialized.samples == generic.samples && specialized.checksum == generic.checksum;
+    }
+
+    printf("answer type 0x%02X: %u bytes, %llu samples, %llu rotations per pass, best of %d runs\n", ansType, (unsigned)stream.size(),
+           (unsigned long long)(specialized.samples / passes), (unsigned long long)(specialized.rotations / passes), runs);
+    report("specialized", specializedSeconds, specialized.samples, stream.size(), passes);
+    report("generic", genericSeconds, generic.samples, stream.size(), passes);
+    printf("  speedup %.2fx best, %.2fx median\n", genericSeconds.front() / specializedSeconds.front(),
+           genericSeconds[runs / 2] / specializedSeconds[runs / 2]);
+
+    if (!identical) {
+        fprintf(stderr, "Error, the paths decoded different samples\n");
+        return false;
+    }
+    return true;
+}
+
+// The bytes the lidar sent after the answer header of the first scan in a capture file, and the answer type of that scan
+static bool load_scan_stream(const char * path, std::vector<sl_u8> & stream, sl_u8 & ansType)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+
+    std::vector<sl_u8> received;
+    sl_u8 magic[8];
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, "SLCAP01", 8) == 0;
+
+    sl_u8 header[8 + 1 + 4];
+    while (valid && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        sl_u32 size = header[9] | (header[10] << 8) | (header[11] << 16) | ((sl_u32)header[12] << 24);
+        std::vector<sl_u8> payload(size);
+        if (fread(payload.data(), 1, size, file) != size) break;
+        if (header[8] == 0) received.insert(received.end(), payload.begin(), payload.end());
+    }
+    fclose(file);
+
+    for (size_t pos = 0; valid && pos + sizeof(sl_lidar_ans_header_t) < received.size(); ++pos) {
+        const sl_lidar_ans_header_t * answer = reinterpret_cast<const sl_lidar_ans_header_t *>(&received[pos]);
+        if (answer->syncByte1 != SL_LIDAR_ANS_SYNC_BYTE1 || answer->syncByte2 != SL_LIDAR_ANS_SYNC_BYTE2) continue;
+        if ((answer->size_q30_subtype >> SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT) != SL_LIDAR_ANS_PKTFLAG_LOOP) continue;
+
+        switch (answer->type) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+            ansType = answer->type;
+            stream.assign(received.begin() + pos + sizeof(sl_lidar_ans_header_t), received.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+// Records a scan of the emulator in its typical mode to a capture file
+static bool record_emulator_scan(sl_u16 typicalScanMode, int rotations, const std::string & path)
+{
+    LidarEmulatorConfig config;
+    config.typical_scan_mode = typicalScanMode;
+    config.rate_scale = 0;
+    Result<ILidarEmulator *> emulator = createLidarEmulator(config);
+    if (!emulator) return false;
+
+    Result<IChannel *> serial = createSerialPortChannel((*emulator)->getDevicePath(), config.baudrate);
+    Result<IChannel *> channel = serial ? createCaptureChannel(*serial, path) : Result<IChannel *>(SL_RESULT_OPERATION_FAIL);
+    Result<ILidarDriver *> drv = createLidarDriver();
+
+    bool recorded = false;
+    if (channel && drv && SL_IS_OK((*drv)->connect(*channel))) {
+        (*drv)->setMotorSpeed();
+        if (SL_IS_OK((*drv)->startScan(0, 1))) {
+            static sl_lidar_response_measurement_node_hq_t nodes[8192];
+            recorded = true;
+            for (int rotation = 0; rotation < rotations && recorded; ++rotation) {
+                size_t count = _countof(nodes);
+                recorded = SL_IS_OK((*drv)->grabScanDataHq(nodes, count));
+            }
+            (*drv)->stop();
+        }
+        (*drv)->setMotorSpeed(0);
+    }
+
+    if (drv) delete *drv;
+    if (channel) delete *channel;
+    delete *emulator;
+    return recorded;
+}
+
+int main(int argc, const char * argv[]) {
+    const char * opt_capture = NULL;
+    int opt_passes = 200;
+    int opt_runs = 5;
+    int opt_cpu = -1;
+
+    for (int pos = 1; pos < argc; ++pos) {
+        bool hasValue = pos + 1 < argc;
+        if (strcmp(argv[pos], "--passes") == 0 && hasValue) {
+            opt_passes = std::max(1, atoi(argv[++pos]));
+        }
+        else if (strcmp(argv[pos], "--runs") == 0 && hasValue) {
+            opt_runs = std::max(1, atoi(argv[++pos]));
+        }
+        else if (strcmp(argv[pos], "--cpu") == 0 && hasValue) {
+            opt_cpu = atoi(argv[++pos]);
+        }
+        else if (strcmp(argv[pos], "--capture") == 0 && hasValue) {
+            opt_capture = argv[++pos];
+        }
+        else {
+            print_usage(argc, argv);
+            return -1;
+        }
+    }
+
+    std::vector<std::string> captures;
+    if (opt_capture) {
+        captures.push_back(opt_capture);
+    }
+    else {
+        const char * tmpdir = getenv("TMPDIR");
+        LidarEmulatorConfig config;
+        for (sl_u16 mode = 0; mode < config.scan_modes.size(); ++mode) {
+            std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/decode_bench_" + std::to_string(mode) + ".slcap";
+            if (!record_emulator_scan(mode, 20, path)) {
+                fprintf(stderr, "Error, cannot record scan mode %u of the emulator\n", mode);
+                return -2;
+            }
+            captures.push_back(path);
+        }
+    }
+
+    // pinned only now, recording needs the emulator thread to run alongside
+    if (opt_cpu >= 0) {
+        LidarThreadConfig config;
+        config.cpu_mask = 1ull << opt_cpu;
+        if (opt_cpu >= 64 || SL_IS_FAIL(configureCurrentThread(config))) {
+            fprintf(stderr, "Error, cannot pin the benchmark to cpu %d\n", opt_cpu);
+            return -5;
+        }
+    }
+
+    bool identical = true;
+    for (size_t pos = 0; pos < captures.size(); ++pos) {
+        std::vector<sl_u8> stream;
+        sl_u8 ansType = 0;
+        if (!load_scan_stream(captures[pos].c_str(), stream, ansType)) {
+            fprintf(stderr, "Error, no scan found in %s\n", captures[pos].c_str());
+            return -3;
+        }
+        identical = bench_stream(stream, ansType, opt_passes, opt_runs) && identical;
+        if (!opt_capture) remove(captures[pos].c_str());
+    }
+    return identical ? 0 : -4;
+}
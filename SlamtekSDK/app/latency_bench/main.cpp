@@ -0,0 +1,189 @@
+/*
+ *  SLAMTEC LIDAR
+ *  Command Latency Benchmark App
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "sl_lidar.h"
+#include "sl_lidar_driver.h"
+#include "sl_lidar_emulator.h"
+
+using namespace sl;
+
+void print_usage(int argc, const char * argv[])
+{
+    printf("Usage:\n"
+           " %s [--runs <count>] [--port <device> [--baud <rate>]]\n"
+           "  --runs  number of measurements per phase (default 10)\n"
+           "  --port  benchmark the lidar on this serial port instead of the built in emulator\n"
+           "  --baud  baudrate of --port (default 1000000)\n"
+           , argv[0]);
+}
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char * phase, std::vector<double> samples)
+{
+    if (samples.empty()) {
+        printf("%-22s no successful runs\n", phase);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    printf("%-22s min %8.1f ms  median %8.1f ms  max %8.1f ms  (%u runs)\n",
+           phase, samples.front(), samples[samples.size() / 2], samples.back(), (unsigned)samples.size());
+}
+
+// Blocks until the first complete rotation is delivered
+static bool grab_first_scan(ILidarDriver * drv)
+{
+    static sl_lidar_response_measurement_node_hq_t nodes[8192];
+    size_t count = sizeof(nodes) / sizeof(nodes[0]);
+    return SL_IS_OK(drv->grabScanDataHq(nodes, count)) && count > 0;
+}
+
+int main(int argc, const char * argv[]) {
+    const char * opt_port = NULL;
+    sl_u32 opt_baud = 1000000;
+    int opt_runs = 10;
+
+    for (int pos = 1; pos < argc; ++pos) {
+        bool hasValue = pos + 1 < argc;
+        if (strcmp(argv[pos], "--runs") == 0 && hasValue) {
+            opt_runs = atoi(argv[++pos]);
+        }
+        else if (strcmp(argv[pos], "--port") == 0 && hasValue) {
+            opt_port = argv[++pos];
+        }
+        else if (strcmp(argv[pos], "--baud") == 0 && hasValue) {
+            opt_baud = (sl_u32)strtoul(argv[++pos], NULL, 10);
+        }
+        else {
+            print_usage(argc, argv);
+            return -1;
+        }
+    }
+
+    ILidarEmulator * emulator = NULL;
+    std::string port;
+    if (opt_port) {
+        port = opt_port;
+    }
+    else {
+        Result<ILidarEmulator *> created = createLidarEmulator();
+        if (!created) {
+            fprintf(stderr, "Error, cannot start the emulator: %x\n", (sl_result)created);
+            return -2;
+        }
+        emulator = *created;
+        port = emulator->getDevicePath();
+        opt_baud = LidarEmulatorConfig().baudrate;
+    }
+
+    printf("Benchmarking %s on %s at %u bps\n", emulator ? "the emulated lidar" : "a lidar", port.c_str(), opt_baud);
+
+    std::vector<double> connectToScan, scanModes, stopToRestart, switchMode;
+
+    for (int run = 0; run < opt_runs; ++run) {
+        double start = now_ms();
+
+        Result<IChannel *> channel = createSerialPortChannel(port, opt_baud);
+        Result<ILidarDriver *> drv = createLidarDriver();
+        if (!channel || !drv) {
+            fprintf(stderr, "Error, cannot create the driver\n");
+            return -3;
+        }
+
+        sl_lidar_response_device_info_t devinfo;
+        if (SL_IS_FAIL((*drv)->connect(*channel)) || SL_IS_FAIL((*drv)->getDeviceInfo(devinfo))) {
+            fprintf(stderr, "Error, cannot connect to %s\n", port.c_str());
+            return -4;
+        }
+
+        (*drv)->setMotorSpeed();
+        if (SL_IS_OK((*drv)->startScan(0, 1)) && grab_first_scan(*drv)) {
+            connectToScan.push_back(now_ms() - start);
+        }
+
+        start = now_ms();
+        if (SL_IS_OK((*drv)->stop())) {
+            (*drv)->setMotorSpeed();
+            if (SL_IS_OK((*drv)->startScan(0, 1)) && grab_first_scan(*drv)) {
+                stopToRestart.push_back(now_ms() - start);
+            }
+        }
+
+        // the typical mode is running, express is offered by every model
+        sl_u32 gap = 0;
+        if (SL_IS_OK((*drv)->switchScanMode(SL_LIDAR_CONF_SCAN_COMMAND_EXPRESS, DEFAULT_MOTOR_SPEED, NULL, &gap))) {
+            switchMode.push_back(gap);
+        }
+
+        (*drv)->stop();
+        (*drv)->setMotorSpeed(0);
+        delete *drv;
+        delete *channel;
+
+        // a fresh driver has no conf answers cached yet, so every mode is queried from the lidar
+        channel = createSerialPortChannel(port, opt_baud);
+        drv = createLidarDriver();
+        if (!channel || !drv || SL_IS_FAIL((*drv)->connect(*channel))) {
+            fprintf(stderr, "Error, cannot reconnect to %s\n", port.c_str());
+            return -4;
+        }
+
+        std::vector<LidarScanMode> modes;
+        start = now_ms();
+        if (SL_IS_OK((*drv)->getAllSupportedScanModes(modes))) {
+            scanModes.push_back(now_ms() - start);
+        }
+
+        delete *drv;
+        delete *channel;
+    }
+
+    report("connect to first scan", connectToScan);
+    report("stop to restart", stopToRestart);
+    report("switch scan mode", switchMode);
+    report("list scan modes, cold", scanModes);
+
+    if (emulator) {
+        LidarEmulatorStats stats;
+        emulator->getStats(stats);
+        printf("Emulator served %llu commands, %llu checksum errors\n",
+               (unsigned long long)stats.commands_received, (unsigned long long)stats.checksum_errors);
+        delete emulator;
+    }
+    return 0;
+}
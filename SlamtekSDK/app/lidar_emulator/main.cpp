@@ -0,0 +1,112 @@
+/*
+ *  SLAMTEC LIDAR
+ *  Lidar Emulator App
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sl_lidar.h"
+#include "sl_lidar_driver.h"
+#include "sl_lidar_emulator.h"
+
+using namespace sl;
+
+void print_usage(int argc, const char * argv[])
+{
+    printf("Usage:\n"
+           " %s [--frequency <Hz>] [--rate-scale <factor>] [--typical-mode <id>] [--link <path>]\n"
+           "  --frequency     revolutions per second (default 10)\n"
+           "  --rate-scale    speeds the sample stream up, 0 streams as fast as the reader drains it (default 1)\n"
+           "  --typical-mode  scan mode reported as typical: 0 Standard, 1 Express, 2 Boost, 3 DenseBoost, 4 HQ (default 3)\n"
+           "  --link          also make the emulated port available under this path, e.g. /tmp/ttyLIDAR\n"
+           , argv[0]);
+}
+
+bool ctrl_c_pressed;
+void ctrlc(int)
+{
+    ctrl_c_pressed = true;
+}
+
+int main(int argc, const char * argv[]) {
+    LidarEmulatorConfig config;
+    const char * opt_link = NULL;
+
+    for (int pos = 1; pos < argc; ++pos) {
+        bool hasValue = pos + 1 < argc;
+        if (strcmp(argv[pos], "--frequency") == 0 && hasValue) {
+            config.scan_frequency = (float)atof(argv[++pos]);
+        }
+        else if (strcmp(argv[pos], "--rate-scale") == 0 && hasValue) {
+            config.rate_scale = (float)atof(argv[++pos]);
+        }
+        else if (strcmp(argv[pos], "--typical-mode") == 0 && hasValue) {
+            config.typical_scan_mode = (sl_u16)strtoul(argv[++pos], NULL, 10);
+        }
+        else if (strcmp(argv[pos], "--link") == 0 && hasValue) {
+            opt_link = argv[++pos];
+        }
+        else {
+            print_usage(argc, argv);
+            return -1;
+        }
+    }
+
+    Result<ILidarEmulator *> emulator = createLidarEmulator(config);
+    if (!emulator) {
+        fprintf(stderr, "Error, cannot start the emulator: %x\n", (sl_result)emulator);
+        return -2;
+    }
+
+    std::string port = (*emulator)->getDevicePath();
+    if (opt_link) {
+        unlink(opt_link);
+        if (symlink(port.c_str(), opt_link)) {
+            fprintf(stderr, "Error, cannot link %s to %s\n", opt_link, port.c_str());
+        }
+    }
+
+    printf("Emulated SLAMTEC LIDAR on %s%s%s\n", port.c_str(), opt_link ? " and " : "", opt_link ? opt_link : "");
+    fflush(stdout);
+
+    signal(SIGINT, ctrlc);
+    signal(SIGTERM, ctrlc);
+
+    while (!ctrl_c_pressed) {
+        usleep(100 * 1000);
+    }
+
+    LidarEmulatorStats stats;
+    (*emulator)->getStats(stats);
+    printf("Served %llu commands, %llu samples, %llu bytes\n",
+           (unsigned long long)stats.commands_received, (unsigned long long)stats.samples_sent, (unsigned long long)stats.bytes_sent);
+
+    if (opt_link) unlink(opt_link);
+    delete *emulator;
+    return 0;
+}
@@ -292,7 +292,8 @@ int main(int argc, const char * argv[]) {
             break;
         }
 
-		delay(3000);
+		// wait for the motor to reach its speed rather than a fixed time
+		drv->waitForStableRotation(3000);
 
         if (SL_IS_FAIL(capture_and_display(drv))) {
             fprintf(stderr, "Error, cannot grab scan data.\n");
@@ -0,0 +1,161 @@
+/*
+ *  Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sl_types.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace sl {
+
+    /**
+    * The clock latency timestamps are taken with: microseconds of std::chrono::steady_clock, so that code
+    * outside the SDK can take timestamps to compare with the driver's
+    */
+    static inline sl_u64 latencyClockUs()
+    {
+        return (sl_u64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+    * What a LatencyHistogram recorded over a period, in microseconds. The percentiles are the upper bound of
+    * the bucket they fall in, at most 1/32 above the actual value
+    */
+    struct LatencySummary
+    {
+        sl_u64  count;
+        sl_u64  p50_us;
+        sl_u64  p99_us;
+        sl_u64  max_us;
+    };
+
+    /**
+    * Log-linear histogram of durations in the manner of HdrHistogram: exact below 32us, then 32 buckets per
+    * power of two up to MAX_US. Recording takes two relaxed atomic adds and a compare-exchange on a new maximum,
+    * so the acquisition thread never waits for a reader. Summarizing with reset empties it bucket by bucket,
+    * a value recorded meanwhile lands in this period or the next one but is never lost
+    */
+    class LatencyHistogram
+    {
+    public:
+        enum {
+            SUB_BITS = 5,
+            SUB_BUCKETS = 1 << SUB_BITS,
+            // larger durations are recorded as this, about 19 hours
+            MAX_BITS = 36,
+            BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * SUB_BUCKETS,
+        };
+
+        LatencyHistogram()
+            : _max(0)
+        {
+            for (size_t pos = 0; pos < BUCKETS; ++pos) _buckets[pos] = 0;
+        }
+
+        void record(sl_u64 us)
+        {
+            const sl_u64 maxUs = ((sl_u64)1 << MAX_BITS) - 1;
+            if (us > maxUs) us = maxUs;
+
+            _buckets[_bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+
+            sl_u64 seen = _max.load(std::memory_order_relaxed);
+            while (us > seen && !_max.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+        }
+
+        // the time from a latencyClockUs timestamp until now, timestamps from the future count as 0
+        void recordSince(sl_u64 startUs)
+        {
+            sl_u64 now = latencyClockUs();
+            record(now > startUs ? now - startUs : 0);
+        }
+
+        LatencySummary summarize(bool reset)
+        {
+            sl_u64 counts[BUCKETS];
+            LatencySummary summary;
+            summary.count = 0;
+            for (size_t pos = 0; pos < BUCKETS; ++pos) {
+                counts[pos] = reset ? _buckets[pos].exchange(0, std::memory_order_relaxed) : _buckets[pos].load(std::memory_order_relaxed);
+                summary.count += counts[pos];
+            }
+            summary.max_us = reset ? _max.exchange(0, std::memory_order_relaxed) : _max.load(std::memory_order_relaxed);
+            summary.p50_us = _percentile(counts, summary.count, 50, summary.max_us);
+            summary.p99_us = _percentile(counts, summary.count, 99, summary.max_us);
+            return summary;
+        }
+
+    private:
+        static size_t _bucketOf(sl_u64 us)
+        {
+            if (us < SUB_BUCKETS) return (size_t)us;
+
+            size_t exponent = SUB_BITS;
+            while ((us >> (exponent + 1)) != 0) ++exponent;
+            // the SUB_BITS bits below the leading one pick the bucket within the power of two
+            size_t sub = (size_t)(us >> (exponent - SUB_BITS)) - SUB_BUCKETS;
+            return SUB_BUCKETS + (exponent - SUB_BITS) * SUB_BUCKETS + sub;
+        }
+
+        // the largest value that falls in the bucket
+        static sl_u64 _bucketTop(size_t bucket)
+        {
+            if (bucket < SUB_BUCKETS) return bucket;
+
+            size_t exponent = SUB_BITS + (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+            sl_u64 sub = SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+            return ((sub + 1) << (exponent - SUB_BITS)) - 1;
+        }
+
+        static sl_u64 _percentile(const sl_u64 * counts, sl_u64 total, sl_u64 percent, sl_u64 maxUs)
+        {
+            if (!total) return 0;
+
+            sl_u64 rank = (total * percent + 99) / 100;
+            sl_u64 seen = 0;
+            for (size_t pos = 0; pos < BUCKETS; ++pos) {
+                seen += counts[pos];
+                if (seen >= rank) {
+                    sl_u64 top = _bucketTop(pos);
+                    // the max is exact, a bucket reaching past it is not
+                    return top < maxUs ? top : maxUs;
+                }
+            }
+            return maxUs;
+        }
+
+        std::atomic<sl_u64> _buckets[BUCKETS];
+        std::atomic<sl_u64> _max;
+    };
+
+}
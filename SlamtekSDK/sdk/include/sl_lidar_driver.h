@@ -52,9 +52,16 @@
 
 
 #include "sl_lidar_cmd.h"
+#include "sl_latency_histogram.h"
 
 #include <string>
 
+#ifndef SL_LIDAR_DEFAULT_SCAN_CAPACITY
+// Samples per rotation the scan buffers of a new driver hold, see ILidarDriver::setScanCapacity.
+// Define it at build time to size every driver for the target without calling it
+#define SL_LIDAR_DEFAULT_SCAN_CAPACITY 8192
+#endif
+
 namespace sl {
 
 #ifdef DEPRECATED
@@ -180,6 +187,12 @@ namespace sl {
         */
         virtual void clearReadCache() = 0;
 
+        /**
+        * File descriptor that turns readable whenever waitForData would find data, for serving
+        * several channels from one poll loop. -1 if the channel has none
+        */
+        virtual int getPollFd() { return -1; }
+
     private:
 
     };
@@ -196,6 +209,54 @@ namespace sl {
         virtual void setDTR(bool dtr) = 0;
     };
 
+    /**
+    * Fault injection settings, rates are per-byte probabilities in [0, 1]
+    */
+    struct FaultInjectionConfig
+    {
+        // Probability that a byte gets one or more bits flipped
+        float   corrupt_rate;
+
+        // Probability that a byte is dropped from the stream
+        float   drop_rate;
+
+        // Probability that a random byte is inserted before a byte
+        float   insert_rate;
+
+        // Number of consecutive bytes affected once a fault is triggered
+        sl_u32  burst_length;
+
+        // Number of bytes passed through untouched before faults start (e.g. to spare the connection handshake)
+        sl_u64  skip_bytes;
+
+        // Seed of the pseudo random generator, the same seed replays the same faults
+        sl_u32  seed;
+    };
+
+    /**
+    * Counters of the faults injected so far
+    */
+    struct FaultInjectionStats
+    {
+        sl_u64  bytes_passed;
+        sl_u64  bytes_corrupted;
+        sl_u64  bytes_dropped;
+        sl_u64  bytes_inserted;
+    };
+
+    /**
+    * Abstract interface of a channel corrupting the data read from another channel
+    */
+    class IFaultInjectionChannel : public IChannel
+    {
+    public:
+        virtual ~IFaultInjectionChannel() {}
+
+    public:
+        virtual void setFaultConfig(const FaultInjectionConfig& config) = 0;
+        virtual FaultInjectionStats getFaultStats() = 0;
+    };
+
     /**
     * Create a serial channel
     * \param device Serial port device
@@ -220,6 +281,37 @@ namespace sl {
     */
     Result<IChannel*> createUdpChannel(const std::string& ip, int port);
 
+    /**
+    * Create a fault injection channel
+    * Everything read from the inner channel is corrupted according to the config, writes are passed through untouched
+    * \param inner The channel to read from, the fault injection channel takes ownership of it
+    * \param config The fault rates
+    */
+    Result<IFaultInjectionChannel*> createFaultInjectionChannel(IChannel* inner, const FaultInjectionConfig& config);
+
+    /**
+    * Create a capture channel
+    * Every byte read from or written to the inner channel is appended to a capture file together with a timestamp.
+    * The file is a sequence of records: timestamp in microseconds since open (u64), direction (u8, 0 = from lidar,
+    * 1 = to lidar), payload length (u32) and the payload, preceded by an 8 byte magic "SLCAP01\0". All integers are little endian.
+    * Opening the channel again, as a reconnect does, appends to the file and restarts the timestamps from 0
+    * \param inner The channel to talk to, the capture channel takes ownership of it
+    * \param path The capture file, truncated when the channel is first opened
+    */
+    Result<IChannel*> createCaptureChannel(IChannel* inner, const std::string& path);
+
+    /**
+    * Create a replay channel
+    * Data recorded by a capture channel is fed back in order. Each write consumes the next recorded write,
+    * data recorded after it only becomes readable once the driver has sent it, so request/response exchanges replay faithfully.
+    * A write that differs from the recorded one fails, and nothing more is read, so the driver times out rather than
+    * decoding answers to commands it did not send.
+    * The file is loaded here, SL_RESULT_INVALID_DATA is returned if it cannot be read or is not a capture.
+    * \param path The capture file
+    * \param realtime Release the data with the recorded timing, or as fast as it is read if false
+    */
+    Result<IChannel*> createReplayChannel(const std::string& path, bool realtime = false);
+
     enum MotorCtrlSupport
     {
         MotorCtrlSupportNone = 0,
@@ -250,6 +342,132 @@ namespace sl {
         sl_u16 min_speed;
     };
 
+    /**
+    * Counters maintained by the data acquisition thread
+    */
+    struct LidarDriverStats
+    {
+        // Frames that carried a valid header but failed their checksum
+        sl_u64  checksum_failures;
+
+        // Bytes discarded while searching for the next valid frame
+        sl_u64  resync_bytes_skipped;
+
+        // Capsules whose samples never got published, either lost on the wire
+        // (estimated from the angle gap) or discarded because continuity could not be proven
+        sl_u64  capsules_lost;
+
+        // Measurement packets decoded: capsules, or single nodes in standard mode. A value that stops
+        // growing while scanning means the stream has stalled
+        sl_u64  packets_received;
+
+        // Most samples a single rotation has held, including those beyond the scan capacity.
+        // A scan capacity a little above it is all the lidar needs
+        sl_u64  max_scan_nodes;
+
+        // Samples discarded because their rotation did not fit the scan capacity
+        sl_u64  scan_nodes_dropped;
+
+        // Bytes taken from the channel while scanning, and the reads that took them
+        sl_u64  bytes_read;
+        sl_u64  read_calls;
+
+        // Samples decoded, and how many of them carried no distance because nothing was hit
+        sl_u64  nodes_decoded;
+        sl_u64  zero_distance_nodes;
+
+        // Full rotations handed over to grabScanDataHq, and those replaced by the next one before being grabbed
+        sl_u64  revolutions_published;
+        sl_u64  revolutions_overwritten;
+
+        // Fewest samples a published rotation has held, and the sum over all of them, which divided by
+        // revolutions_published gives the average. max_scan_nodes is the most
+        sl_u64  min_scan_nodes;
+        sl_u64  published_nodes;
+
+        // Rotations per second of the running scan, measured between published rotations and
+        // smoothed over the last few of them. 0 until two rotations have been published
+        float   rotation_frequency;
+    };
+
+    /**
+    * How stale scans are by the time they move on, per stage of the acquisition path
+    */
+    struct LidarLatencyStats
+    {
+        // From reading the last byte of a frame until the decoder hands its samples on
+        LatencySummary  decode;
+
+        // From reading the last sample of a rotation until the rotation is published, which takes the first
+        // sample of the next one to arrive
+        LatencySummary  publish;
+
+        // From publishing a rotation until grabScanDataHq hands it over
+        LatencySummary  grab;
+    };
+
+    /**
+    * The answers a lidar gives while being probed that never change for a given unit and firmware.
+    * Exporting them after the first connection and importing them on the next one to the same unit
+    * lets the driver skip those queries.
+    */
+    struct LidarCapabilities
+    {
+        LidarCapabilities() : conf_commands_supported(false) {}
+
+        // Whether the lidar answers GET_LIDAR_CONF
+        bool conf_commands_supported;
+
+        // GET_LIDAR_CONF answers keyed by conf type and scan mode id (0 for types that do not take one)
+        std::map<std::pair<sl_u32, sl_u16>, std::vector<sl_u8> > conf_answers;
+    };
+
+    enum LidarSchedPolicy
+    {
+        // Keep whatever the thread inherited from the one creating it
+        LidarSchedPolicyInherit = 0,
+        // Real-time policies as set by chrt -f and chrt -r
+        LidarSchedPolicyFifo = 1,
+        LidarSchedPolicyRoundRobin = 2,
+    };
+
+    /**
+    * How the thread decoding the scan stream is scheduled, so that other load on the host cannot starve it.
+    * Real-time policies need CAP_SYS_NICE or an RLIMIT_RTPRIO, locking memory CAP_IPC_LOCK or an RLIMIT_MEMLOCK
+    * covering the whole process. Linux only, other platforms accept the default configuration
+    */
+    struct LidarThreadConfig
+    {
+        LidarThreadConfig() : policy(LidarSchedPolicyInherit), priority(0), cpu_mask(0), lock_memory(false) {}
+
+        LidarSchedPolicy policy;
+
+        // 1 (lowest) to 99 for the real-time policies, 0 otherwise
+        int priority;
+
+        // Bit n lets the thread run on cpu n, as taskset takes it. 0 keeps the inherited set
+        sl_u64 cpu_mask;
+
+        // Lock every page of the process into RAM (mlockall), so the thread never waits on a page fault
+        bool lock_memory;
+    };
+
+    /**
+    * Sees every rotation the driver publishes, on the thread that decoded it: the acquisition thread, or the one
+    * calling pumpScanData. It must return quickly, the stream is not read meanwhile
+    */
+    class IScanObserver
+    {
+    public:
+        virtual ~IScanObserver() {}
+
+    public:
+        /// \param nodes       The rotation as the lidar sent it, only valid during the call
+        /// \param count       Number of nodes
+        /// \param readUs      When its last byte was read, in latencyClockUs time
+        virtual void onScanPublished(const sl_lidar_response_measurement_node_hq_t* nodes, size_t count, sl_u64 readUs) = 0;
+    };
+
     class ILidarDriver
     {
     public:
@@ -360,6 +578,19 @@ namespace sl {
         /// \param timeout       The operation timeout value (in millisecond) for the serial port communication 
         virtual sl_result stop(sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
 
+        /// Switch a running scan to another scan mode and motor speed without stopping the motor.
+        /// The answer to the new scan command is picked out of the tail of the old stream rather than waiting for
+        /// the line to go quiet, so the data pauses for little more than a command round trip. Keeping the scan mode
+        /// and changing only the motor speed does not interrupt the stream at all.
+        ///
+        /// \param scanMode         The scan mode id to switch to (use getAllSupportedScanModes to get supported modes)
+        /// \param motorSpeed       The motor speed to run at, as for setMotorSpeed
+        /// \param outUsedScanMode  The scan mode now running
+        /// \param outGapMs         If set, waits for the first full rotation after the switch and returns the time since
+        ///                         the last rotation published before it
+        /// \param timeout          The operation timeout value (in millisecond), applied to each wait
+        virtual sl_result switchScanMode(sl_u16 scanMode, sl_u16 motorSpeed = DEFAULT_MOTOR_SPEED, LidarScanMode* outUsedScanMode = nullptr, sl_u32* outGapMs = nullptr, sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
+
         /// Wait and grab a complete 0-360 degree scan data previously received. 
         /// The grabbed scan data returned by this interface always has the following charactistics:
         ///
@@ -418,6 +649,80 @@ namespace sl {
         /// \param requiredBaudRate   The new baudrate required to be used. It MUST matches with the baudrate of the binded channel.
         /// \param baudRateDetected   The actual baudrate detected by the LIDAR system
         virtual sl_result negotiateSerialBaudRate(sl_u32 requiredBaudRate, sl_u32* baudRateDetected = NULL) = 0;
+
+        /// Retrieve the counters maintained by the data acquisition thread
+        ///
+        /// \param stats        The counters since the driver was created
+        virtual sl_result getDriverStats(LidarDriverStats& stats) = 0;
+
+        /// Retrieve the latency histograms maintained by the data acquisition thread
+        ///
+        /// \param stats        What was recorded since the driver was created or last reset
+        /// \param reset        Empty the histograms, so that the next call covers the time from now on
+        virtual sl_result getLatencyStats(LidarLatencyStats& stats, bool reset) = 0;
+
+        /// When the last byte of the rotation last handed over by grabScanDataHq was read, in latencyClockUs time.
+        /// 0 before the first one
+        virtual sl_u64 getGrabbedScanTimestamp() = 0;
+
+        /// Hand every rotation published from now on to observer as well, nullptr for none. Once this returns the
+        /// previous observer is no longer called, so it may be destroyed
+        ///
+        /// \param observer    Not owned, it must outlive its registration
+        virtual sl_result setScanObserver(IScanObserver* observer) = 0;
+
+        /// Set how many samples a rotation may hold. The scan buffers are allocated from the heap for this capacity
+        /// right away and kept until it changes, samples beyond it are dropped and counted in
+        /// LidarDriverStats::scan_nodes_dropped. Fails while scanning, and with SL_RESULT_INSUFFICIENT_MEMORY
+        /// keeping the previous capacity when the buffers cannot be allocated
+        ///
+        /// \param nodes        Samples per rotation, SL_LIDAR_DEFAULT_SCAN_CAPACITY unless set
+        virtual sl_result setScanCapacity(size_t nodes) = 0;
+
+        /// Retrieve the samples per rotation the scan buffers hold, and grabScanDataHq returns at most
+        virtual size_t getScanCapacity() = 0;
+
+        /// Wait for the motor to settle after startScan, judged from the scan data instead of a fixed delay.
+        /// The rotation counts as settled once two consecutive rotations hold nearly the same number of samples
+        ///
+        /// \param timeoutInMs   Time to wait for the motor to settle
+        virtual sl_result waitForStableRotation(sl_u32 timeoutInMs = DEFAULT_TIMEOUT) = 0;
+
+        /// Retrieve the static answers learnt from the lidar since connecting
+        ///
+        /// \param caps        Filled with every cacheable answer seen so far
+        virtual sl_result exportCapabilities(LidarCapabilities& caps) = 0;
+
+        /// Seed the driver with answers exported from an earlier connection to the same unit and firmware.
+        /// Queries covered by them are answered locally until the next connect. Must be called after connect.
+        ///
+        /// \param caps        Answers previously obtained from exportCapabilities
+        virtual sl_result importCapabilities(const LidarCapabilities& caps) = 0;
+
+        /// Leave reading the scan stream to the caller instead of a data acquisition thread per driver.
+        /// While enabled, starting a scan spawns no thread and the data only moves when pumpScanData is called,
+        /// typically once the channel's getPollFd turns readable. Can only be changed while not scanning
+        ///
+        /// \param enable       true to pump from outside, false for the acquisition thread
+        virtual sl_result setExternalPump(bool enable) = 0;
+
+        /// Decode what the channel holds right now without waiting for more, publishing the rotations it completes
+        /// to grabScanDataHq. Safe to call from another thread than the one issuing commands.
+        ///
+        /// \param scansPublished   If set, the number of full rotations completed by this call
+        virtual sl_result pumpScanData(size_t* scansPublished = nullptr) = 0;
+
+        /// Schedule the data acquisition thread as chrt and taskset would. Applied to the running thread right away
+        /// and to every one started later. Must not be called concurrently with commands stopping the scan
+        ///
+        /// \param config       The scheduling to ask for
+        virtual sl_result setAcquisitionThreadConfig(const LidarThreadConfig& config) = 0;
+
+        /// Retrieve the scheduling the running acquisition thread actually got, as read back from the OS.
+        /// Fails if there is no such thread, i.e. while not scanning or when pumped from outside
+        ///
+        /// \param effective    The scheduling in effect
+        virtual sl_result getAcquisitionThreadConfig(LidarThreadConfig& effective) = 0;
 };
 
     /**
@@ -448,4 +753,12 @@ namespace sl {
     * delete *channel;
     */
     Result<ILidarDriver*> createLidarDriver();
+
+    /**
+    * Schedule the calling thread, for threads that decode scan data on behalf of drivers (see ILidarDriver::pumpScanData).
+    * Every part is attempted even if an earlier one is refused
+    * \param config     The scheduling to ask for
+    * \param effective  If set, receives the scheduling the thread ended up with
+    */
+    sl_result configureCurrentThread(const LidarThreadConfig& config, LidarThreadConfig* effective = nullptr);
 }
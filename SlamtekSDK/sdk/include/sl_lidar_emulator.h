@@ -0,0 +1,123 @@
+/*
+ *  Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sl_lidar_driver.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace sl {
+
+    /**
+    * A scan mode offered by the emulator, reported through the GET_LIDAR_CONF scan mode queries.
+    * The position in LidarEmulatorConfig::scan_modes is the mode id.
+    */
+    struct LidarEmulatorScanMode
+    {
+        std::string name;
+        // SL_LIDAR_ANS_TYPE_MEASUREMENT, _CAPSULED, _CAPSULED_ULTRA, _DENSE_CAPSULED or _HQ, selects the wire format
+        sl_u8 ans_type;
+        float us_per_sample;
+        float max_distance; // meters
+    };
+
+    struct LidarEmulatorConfig
+    {
+        // An S2 class device offering every stream format the driver knows about
+        LidarEmulatorConfig();
+
+        sl_lidar_response_device_info_t device_info;
+        sl_lidar_response_device_health_t health;
+        sl_u8 mac_addr[6];
+
+        std::vector<LidarEmulatorScanMode> scan_modes;
+        sl_u16 typical_scan_mode;
+
+        // Answer GET_LIDAR_CONF at all, false behaves like firmware older than 1.24
+        bool support_conf_commands;
+
+        // Revolutions per second at rate_scale 1
+        float scan_frequency;
+
+        // Speeds up (or slows down) the sample stream and the rotation together, so a scan keeps the same
+        // number of samples. 0 streams as fast as the reader drains the pty.
+        float rate_scale;
+
+        // Reported back by the auto baudrate detection
+        sl_u32 baudrate;
+
+        // Distance in mm for an angle in degrees, 0 means no return. Defaults to a 4m x 6m room around the lidar
+        std::function<float(float)> distance_profile;
+    };
+
+    struct LidarEmulatorStats
+    {
+        sl_u64 commands_received;
+        sl_u64 checksum_errors;
+        sl_u64 bytes_sent;
+        sl_u64 samples_sent;
+        // PWM or rpm of the last motor command, 0 until one arrives. The emulated rotation does not follow it
+        sl_u16 last_motor_speed;
+    };
+
+    /**
+    * A protocol level RPLidar stand-in on a pseudo terminal.
+    * The emulator serves from creation until it is deleted. Point a serial channel at getDevicePath().
+    */
+    class ILidarEmulator
+    {
+    public:
+        virtual ~ILidarEmulator() {}
+
+    public:
+        /**
+        * The pty device to open in place of a real serial port, e.g. /dev/pts/3
+        */
+        virtual std::string getDevicePath() const = 0;
+
+        virtual void getStats(LidarEmulatorStats& stats) = 0;
+
+        /**
+        * Cut the link for durationMs, as an unplugged cable would: nothing is sent and whatever arrives is lost.
+        * The emulated lidar keeps spinning and scanning meanwhile, so the samples of that period are lost too
+        */
+        virtual void simulateDropout(sl_u32 durationMs) = 0;
+    };
+
+    /**
+    * Create and start a lidar emulator
+    * Only available on Linux, SL_RESULT_OPERATION_NOT_SUPPORT is returned elsewhere.
+    */
+    Result<ILidarEmulator*> createLidarEmulator(const LidarEmulatorConfig& config = LidarEmulatorConfig());
+}
@@ -0,0 +1,140 @@
+/*
+ *  Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sl_types.h"
+#include "sl_latency_histogram.h"
+
+#include <atomic>
+#include <string>
+
+#ifndef SL_TRACE_COMPILED
+// Define as 0 to compile the trace points out altogether
+#define SL_TRACE_COMPILED 1
+#endif
+
+#if defined(__GNUC__)
+#define SL_TRACE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define SL_TRACE_UNLIKELY(x) (x)
+#endif
+
+#ifndef SL_TRACE_RING_EVENTS
+// Events each thread keeps, the oldest are overwritten. They take 32 bytes each, allocated when the thread first records one
+#define SL_TRACE_RING_EVENTS 32768
+#endif
+
+namespace sl {
+
+    namespace internal {
+        extern std::atomic<bool> traceEnabled;
+
+        void traceRecord(const char * name, sl_u64 beginUs, sl_u64 endUs, sl_u64 arg);
+    }
+
+    /**
+    * Trace recorder for the stages a rotation goes through, exported in the Chrome trace event format that
+    * chrome://tracing and Perfetto open. Every thread records into a ring of its own without taking a lock,
+    * and while tracing is off a trace point costs a single load and branch. Timestamps are latencyClockUs
+    */
+    void setTraceEnabled(bool enabled);
+
+    static inline bool isTraceEnabled()
+    {
+        return internal::traceEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * Names the calling thread in the exported trace
+    */
+    void setTraceThreadName(const char * name);
+
+    /**
+    * The events every thread still holds as a Chrome trace JSON document. May be called while tracing goes on
+    */
+    std::string exportChromeTrace();
+
+    /**
+    * Forgets the events recorded so far
+    */
+    void clearTrace();
+
+    /**
+    * Records the span of its own lifetime as a complete event. name must outlive the trace, a string literal.
+    * The flag is loaded once, the destructor tests the value the constructor saw, so a scope never records half
+    * an event when tracing is switched meanwhile and the disabled path falls through on a single condition
+    */
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char * name)
+            : _name(name)
+            , _arg(0)
+            , _beginUs(0)
+            , _recording(isTraceEnabled())
+        {
+            if (SL_TRACE_UNLIKELY(_recording)) _beginUs = latencyClockUs();
+        }
+
+        ~TraceScope()
+        {
+            if (SL_TRACE_UNLIKELY(_recording)) internal::traceRecord(_name, _beginUs, latencyClockUs(), _arg);
+        }
+
+        // shown as the count of the event, e.g. the bytes read or samples handled
+        void setArg(sl_u64 arg) { _arg = arg; }
+
+        // records nothing after all, for a scope that found no work
+        void discard() { _recording = false; }
+
+    private:
+        TraceScope(const TraceScope &);
+        TraceScope & operator=(const TraceScope &);
+
+        const char *    _name;
+        sl_u64          _arg;
+        sl_u64          _beginUs;
+        bool            _recording;
+    };
+
+}
+
+// A scope named var tracing the rest of the block, the count to show for it, and dropping it. Compiled out, value is not evaluated
+#if SL_TRACE_COMPILED
+#define SL_TRACE_SCOPE(var, name) sl::TraceScope var(name)
+#define SL_TRACE_ARG(var, value) var.setArg(value)
+#define SL_TRACE_DISCARD(var) var.discard()
+#else
+#define SL_TRACE_SCOPE(var, name)
+#define SL_TRACE_ARG(var, value) ((void)sizeof(value))
+#define SL_TRACE_DISCARD(var) ((void)0)
+#endif
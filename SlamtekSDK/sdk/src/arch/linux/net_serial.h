@@ -63,6 +63,8 @@ public:
 
     virtual size_t rxqueue_count();
 
+    virtual int getPollFd() { return isOpened() ? serial_fd : -1; }
+
     virtual void setDTR();
     virtual void clearDTR();
 
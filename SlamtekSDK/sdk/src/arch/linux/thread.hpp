@@ -35,6 +35,7 @@
 #include "arch/linux/arch_linux.h"
 
 #include <sched.h>
+#include <sys/mman.h>
 
 namespace rp{ namespace hal{
 
@@ -50,6 +51,18 @@ Thread Thread::create(thread_proc_t proc, void * data)
     return newborn;
 }
 
+Thread Thread::current()
+{
+    Thread self;
+    self._handle = (_word_size_t)pthread_self();
+    return self;
+}
+
+u_result Thread::lockMemory()
+{
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
 u_result Thread::terminate()
 {
     if (!this->_handle) return RESULT_OK;
@@ -72,27 +85,30 @@ u_result Thread::setPriority( priority_val_t p)
         return RESULT_OPERATION_FAIL;
     }   
 
-    //int pthread_priority = 0 ;
+    int pthread_priority_max = sched_get_priority_max(SCHED_RR);
+    int pthread_priority_min = sched_get_priority_min(SCHED_RR);
+    int pthread_priority = 0;
 
     switch(p)
     {
     case PRIORITY_REALTIME:
-        //pthread_priority = pthread_priority_max;
+        pthread_priority = pthread_priority_max;
         current_policy = SCHED_RR;
         break;
     case PRIORITY_HIGH:
-        //pthread_priority = (pthread_priority_max + pthread_priority_min)/2;
+        pthread_priority = (pthread_priority_max + pthread_priority_min)/2;
         current_policy = SCHED_RR;
         break;
     case PRIORITY_NORMAL:
     case PRIORITY_LOW:
     case PRIORITY_IDLE:
-        //pthread_priority = 0;
+        // the time sharing policy only takes priority 0
+        pthread_priority = 0;
         current_policy = SCHED_OTHER;
         break;
     }
 
-    current_param.__sched_priority = current_policy;
+    current_param.sched_priority = pthread_priority;
     if ( (ans = pthread_setschedparam( (pthread_t) this->_handle, current_policy, &current_param)) )
     {
         return RESULT_OPERATION_FAIL;
@@ -112,25 +128,136 @@ Thread::priority_val_t Thread::getPriority()
         return PRIORITY_NORMAL;
     }   
 
-    int pthread_priority_max = sched_get_priority_max(SCHED_RR);
-    int pthread_priority_min = sched_get_priority_min(SCHED_RR);
+    if (current_policy != SCHED_RR && current_policy != SCHED_FIFO)
+    {
+        return PRIORITY_NORMAL;
+    }
+
+    int pthread_priority_max = sched_get_priority_max(current_policy);
+    int pthread_priority_min = sched_get_priority_min(current_policy);
 
-    if (current_param.__sched_priority ==(pthread_priority_max ))
+    if (current_param.sched_priority ==(pthread_priority_max ))
     {
         return PRIORITY_REALTIME;
     }
-    if (current_param.__sched_priority >=(pthread_priority_max + pthread_priority_min)/2)
+    if (current_param.sched_priority >=(pthread_priority_max + pthread_priority_min)/2)
     {
         return PRIORITY_HIGH;
     }
     return PRIORITY_NORMAL;
 }
 
+u_result Thread::setSchedPolicy(sched_policy_t policy, int priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    int posix_policy = SCHED_OTHER;
+    switch (policy)
+    {
+    case SCHED_POLICY_FIFO:
+        posix_policy = SCHED_FIFO;
+        break;
+    case SCHED_POLICY_RR:
+        posix_policy = SCHED_RR;
+        break;
+    default:
+        break;
+    }
+
+    if (priority < sched_get_priority_min(posix_policy) || priority > sched_get_priority_max(posix_policy))
+    {
+        return RESULT_INVALID_DATA;
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    // EPERM without CAP_SYS_NICE or a matching RLIMIT_RTPRIO
+    if (pthread_setschedparam((pthread_t)this->_handle, posix_policy, &param))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+u_result Thread::getSchedPolicy(sched_policy_t & policy, int & priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    int posix_policy;
+    struct sched_param param;
+    if (pthread_getschedparam((pthread_t)this->_handle, &posix_policy, &param))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+
+    switch (posix_policy)
+    {
+    case SCHED_FIFO:
+        policy = SCHED_POLICY_FIFO;
+        break;
+    case SCHED_RR:
+        policy = SCHED_POLICY_RR;
+        break;
+    default:
+        policy = SCHED_POLICY_NORMAL;
+        break;
+    }
+    priority = param.sched_priority;
+    return RESULT_OK;
+}
+
+u_result Thread::setAffinity(_u64 cpuMask)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!cpuMask || (cpu < 64 && (cpuMask & ((_u64)1 << cpu))))
+        {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+
+    // EINVAL if none of the cpus is online or allowed by the cpuset of the process
+    if (pthread_setaffinity_np((pthread_t)this->_handle, sizeof(cpus), &cpus))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+u_result Thread::getAffinity(_u64 & cpuMask)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    cpu_set_t cpus;
+    if (pthread_getaffinity_np((pthread_t)this->_handle, sizeof(cpus), &cpus))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+
+    cpuMask = 0;
+    for (int cpu = 0; cpu < 64; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &cpus))
+        {
+            cpuMask |= (_u64)1 << cpu;
+        }
+    }
+    return RESULT_OK;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
     
     pthread_join((pthread_t)(this->_handle), NULL);
+    // a thread can only be joined once, later calls must see it as gone like on win32
+    this->_handle = 0;
     return RESULT_OK;
 }
 
@@ -34,6 +34,8 @@
 
 #include "arch/macOS/arch_macOS.h"
 
+#include <sched.h>
+
 namespace rp{ namespace hal{
 
 Thread Thread::create(thread_proc_t proc, void * data)
@@ -48,6 +50,19 @@ Thread Thread::create(thread_proc_t proc, void * data)
     return newborn;
 }
 
+Thread Thread::current()
+{
+    Thread self;
+    self._handle = (_word_size_t)pthread_self();
+    return self;
+}
+
+u_result Thread::lockMemory()
+{
+    // no mlockall on macOS
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
 u_result Thread::terminate()
 {
     if (!this->_handle) return RESULT_OK;
@@ -68,11 +83,73 @@ Thread::priority_val_t Thread::getPriority()
 	return PRIORITY_NORMAL;
 }
 
+u_result Thread::setSchedPolicy(sched_policy_t policy, int priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    int posix_policy = SCHED_OTHER;
+    switch (policy)
+    {
+    case SCHED_POLICY_FIFO:
+        posix_policy = SCHED_FIFO;
+        break;
+    case SCHED_POLICY_RR:
+        posix_policy = SCHED_RR;
+        break;
+    default:
+        break;
+    }
+
+    if (priority < sched_get_priority_min(posix_policy) || priority > sched_get_priority_max(posix_policy))
+    {
+        return RESULT_INVALID_DATA;
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    if (pthread_setschedparam((pthread_t)this->_handle, posix_policy, &param))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+u_result Thread::getSchedPolicy(sched_policy_t & policy, int & priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    int posix_policy;
+    struct sched_param param;
+    if (pthread_getschedparam((pthread_t)this->_handle, &posix_policy, &param))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+
+    policy = posix_policy == SCHED_FIFO ? SCHED_POLICY_FIFO : (posix_policy == SCHED_RR ? SCHED_POLICY_RR : SCHED_POLICY_NORMAL);
+    priority = param.sched_priority;
+    return RESULT_OK;
+}
+
+u_result Thread::setAffinity(_u64 cpuMask)
+{
+    // macOS only takes affinity hints between threads, not cpu sets
+    return cpuMask ? RESULT_OPERATION_NOT_SUPPORT : RESULT_OK;
+}
+
+u_result Thread::getAffinity(_u64 & cpuMask)
+{
+    cpuMask = 0;
+    return RESULT_OK;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
     
     pthread_join((pthread_t)(this->_handle), NULL);
+    // a thread can only be joined once, later calls must see it as gone like on win32
+    this->_handle = 0;
     return RESULT_OK;
 }
 
@@ -183,7 +183,8 @@ int raw_serial::recvdata(unsigned char * data, size_t size)
 
 void raw_serial::flush( _u32 flags)
 {
-    PurgeComm(_serial_handle, PURGE_TXABORT | PURGE_RXABORT | PURGE_TXCLEAR | PURGE_RXCLEAR );
+    // input only, like tcflush(TCIFLUSH) on the other platforms: a command written just before must still go out
+    PurgeComm(_serial_handle, PURGE_RXABORT | PURGE_RXCLEAR );
 }
 
 int raw_serial::waitforsent(_u32 timeout, size_t * returned_size)
@@ -47,6 +47,20 @@ Thread Thread::create(thread_proc_t proc, void * data)
     return newborn;
 }
 
+Thread Thread::current()
+{
+    // a pseudo handle that always refers to the calling thread, it needs no closing
+    Thread self;
+    self._handle = (_word_size_t)GetCurrentThread();
+    return self;
+}
+
+u_result Thread::lockMemory()
+{
+    // the working set can only be locked page range by page range with VirtualLock
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
 u_result Thread::terminate()
 {
     if (!this->_handle) return RESULT_OK;
@@ -123,6 +137,56 @@ Thread::priority_val_t Thread::getPriority()
 	return PRIORITY_NORMAL;
 }
 
+u_result Thread::setSchedPolicy(sched_policy_t policy, int priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+    // there is no real-time scheduling class for threads, setPriority is the closest
+    return policy == SCHED_POLICY_NORMAL && priority == 0 ? RESULT_OK : RESULT_OPERATION_NOT_SUPPORT;
+}
+
+u_result Thread::getSchedPolicy(sched_policy_t & policy, int & priority)
+{
+    policy = SCHED_POLICY_NORMAL;
+    priority = 0;
+    return RESULT_OK;
+}
+
+u_result Thread::setAffinity(_u64 cpuMask)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+
+    DWORD_PTR threadMask = cpuMask ? (DWORD_PTR)cpuMask : processMask;
+    return SetThreadAffinityMask(reinterpret_cast<HANDLE>(this->_handle), threadMask) ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+u_result Thread::getAffinity(_u64 & cpuMask)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    // setting a mask is the only way to read one, so put the old one straight back
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+
+    DWORD_PTR previous = SetThreadAffinityMask(reinterpret_cast<HANDLE>(this->_handle), processMask);
+    if (!previous)
+    {
+        return RESULT_OPERATION_FAIL;
+    }
+    SetThreadAffinityMask(reinterpret_cast<HANDLE>(this->_handle), previous);
+
+    cpuMask = previous;
+    return RESULT_OK;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
@@ -73,6 +73,9 @@ public:
     virtual void clearDTR() = 0;
     virtual void cancelOperation() {}
 
+    // descriptor to poll for readability, -1 where the platform has none
+    virtual int getPollFd() { return -1; }
+
     virtual bool isOpened()
     {
         return _is_serial_opened;
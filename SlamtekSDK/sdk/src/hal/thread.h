@@ -52,6 +52,13 @@ public:
 		PRIORITY_IDLE     = 4,
 	};
 
+    enum sched_policy_t
+    {
+        SCHED_POLICY_NORMAL = 0,
+        SCHED_POLICY_FIFO   = 1,
+        SCHED_POLICY_RR     = 2,
+    };
+
     template <class T, u_result (T::*PROC)(void)>
     static Thread create_member(T * pthis)
     {
@@ -65,6 +72,12 @@ public:
 	}
 	static Thread create(thread_proc_t proc, void * data = NULL );
 
+    // The calling thread, for configuring itself. Never join or terminate it
+    static Thread current();
+
+    // Keeps every page of the process in RAM from now on, so no thread stalls on a page fault
+    static u_result lockMemory();
+
 public:
     ~Thread() { }
     Thread():  _data(NULL),_func(NULL),_handle(0)  {}
@@ -75,6 +88,14 @@ public:
 	u_result setPriority( priority_val_t p);
 	priority_val_t getPriority();
 
+    // Scheduling policy with an explicit priority, as chrt sets it. The real-time policies take priorities 1 to 99
+    u_result setSchedPolicy(sched_policy_t policy, int priority);
+    u_result getSchedPolicy(sched_policy_t & policy, int & priority);
+
+    // Bit n of cpuMask lets the thread run on cpu n, as taskset sets it. 0 allows every cpu
+    u_result setAffinity(_u64 cpuMask);
+    u_result getAffinity(_u64 & cpuMask);
+
     bool operator== ( const Thread & right) { return this->_handle == right._handle; }
 protected:
     Thread( thread_proc_t proc, void * data ): _data(data),_func(proc), _handle(0)  {}
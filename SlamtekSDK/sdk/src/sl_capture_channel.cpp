@@ -0,0 +1,398 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "sl_lidar_driver.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace sl {
+
+    namespace {
+        const char CAPTURE_MAGIC[8] = { 'S', 'L', 'C', 'A', 'P', '0', '1', '\0' };
+
+        enum {
+            CAPTURE_DIR_RX = 0,
+            CAPTURE_DIR_TX = 1,
+
+            CAPTURE_RECORD_HEADER_SIZE = 8 + 1 + 4,
+        };
+
+        sl_u64 captureNowUs()
+        {
+            return (sl_u64)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void putLE(sl_u8* dest, sl_u64 value, size_t bytes)
+        {
+            for (size_t pos = 0; pos < bytes; ++pos) {
+                dest[pos] = (sl_u8)(value >> (8 * pos));
+            }
+        }
+
+        sl_u64 getLE(const sl_u8* src, size_t bytes)
+        {
+            sl_u64 value = 0;
+            for (size_t pos = 0; pos < bytes; ++pos) {
+                value |= ((sl_u64)src[pos]) << (8 * pos);
+            }
+            return value;
+        }
+    }
+
+    class CaptureChannel : public IChannel
+    {
+    public:
+        CaptureChannel(IChannel* inner, const std::string& path)
+            : _inner(inner)
+            , _path(path)
+            , _file(NULL)
+            , _created(false)
+            , _startUs(0)
+        {}
+
+        ~CaptureChannel()
+        {
+            _closeFile();
+            delete _inner;
+        }
+
+        bool open()
+        {
+            if (!_inner->open())
+                return false;
+
+            rp::hal::AutoLocker l(_lock);
+            _closeFile();
+            // reopening after a reconnect appends, what was recorded before the link went down is kept
+            _file = fopen(_path.c_str(), _created ? "ab" : "wb");
+            if (!_file) {
+                _inner->close();
+                return false;
+            }
+            if (!_created) {
+                fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), _file);
+                _created = true;
+            }
+            _startUs = captureNowUs();
+            return true;
+        }
+
+        void close()
+        {
+            _inner->close();
+            rp::hal::AutoLocker l(_lock);
+            _closeFile();
+        }
+
+        void flush()
+        {
+            _inner->flush();
+        }
+
+        bool waitForData(size_t size, sl_u32 timeoutInMs, size_t* actualReady)
+        {
+            return _inner->waitForData(size, timeoutInMs, actualReady);
+        }
+
+        int write(const void* data, size_t size)
+        {
+            int ans = _inner->write(data, size);
+            if (ans > 0) _record(CAPTURE_DIR_TX, data, (size_t)ans);
+            return ans;
+        }
+
+        int read(void* buffer, size_t size)
+        {
+            int ans = _inner->read(buffer, size);
+            if (ans > 0) _record(CAPTURE_DIR_RX, buffer, (size_t)ans);
+            return ans;
+        }
+
+        void clearReadCache()
+        {
+            _inner->clearReadCache();
+        }
+
+        int getPollFd()
+        {
+            return _inner->getPollFd();
+        }
+
+    private:
+        void _record(sl_u8 direction, const void* data, size_t size)
+        {
+            sl_u8 header[CAPTURE_RECORD_HEADER_SIZE];
+            header[8] = direction;
+            putLE(header + 9, size, 4);
+
+            rp::hal::AutoLocker l(_lock);
+            if (!_file) return;
+            putLE(header, captureNowUs() - _startUs, 8);
+            fwrite(header, 1, sizeof(header), _file);
+            fwrite(data, 1, size, _file);
+        }
+
+        void _closeFile()
+        {
+            if (_file) {
+                fclose(_file);
+                _file = NULL;
+            }
+        }
+
+    private:
+        IChannel*       _inner;
+        std::string     _path;
+        FILE*           _file;
+        bool            _created;
+        sl_u64          _startUs;
+        rp::hal::Locker _lock;
+    };
+
+    class ReplayChannel : public IChannel
+    {
+    public:
+        ReplayChannel(const std::string& path, bool realtime)
+            : _path(path)
+            , _realtime(realtime)
+            , _loaded(false)
+            , _cursor(0)
+            , _recordPos(0)
+            , _timeBaseUs(0)
+            , _diverged(false)
+        {}
+
+        bool open()
+        {
+            rp::hal::AutoLocker l(_lock);
+            if (!_loaded && !_load())
+                return false;
+
+            _cursor = 0;
+            _recordPos = 0;
+            _timeBaseUs = captureNowUs();
+            _diverged = false;
+            return true;
+        }
+
+        void close()
+        {
+            // wake up anyone waiting for data that will never come
+            _evt.set();
+        }
+
+        void flush()
+        {
+        }
+
+        bool waitForData(size_t size, sl_u32 timeoutInMs, size_t* actualReady)
+        {
+            sl_u64 startUs = captureNowUs();
+            sl_u64 timeoutUs = (sl_u64)timeoutInMs * 1000;
+
+            for (;;) {
+                sl_u64 nextDueUs = 0;
+                size_t available;
+                {
+                    rp::hal::AutoLocker l(_lock);
+                    available = _available(size, nextDueUs);
+                }
+                if (actualReady) *actualReady = available;
+                if (available >= size) return true;
+
+                sl_u64 nowUs = captureNowUs();
+                if (nowUs - startUs >= timeoutUs) return false;
+
+                // sleep until the next record is due, a write unblocks the stream, or the timeout
+                sl_u64 waitUs = timeoutUs - (nowUs - startUs);
+                if (nextDueUs) waitUs = std::min(waitUs, nextDueUs > nowUs ? nextDueUs - nowUs : 0);
+                _evt.wait((unsigned long)std::max<sl_u64>((waitUs + 999) / 1000, 1));
+            }
+        }
+
+        int write(const void* data, size_t size)
+        {
+            int ans = (int)size;
+            {
+                rp::hal::AutoLocker l(_lock);
+                for (size_t pos = _cursor; !_diverged && pos < _records.size(); ++pos) {
+                    const Record& record = _records[pos];
+                    if (record.direction != CAPTURE_DIR_TX) continue;
+
+                    // a command the capture did not record gets no answer from here on, so the driver times out
+                    if (record.size != size || memcmp(&_data[record.offset], data, size)) {
+                        _diverged = true;
+                        break;
+                    }
+
+                    // data the driver skipped over before sending this command is dropped, as a real device would move on
+                    _cursor = pos + 1;
+                    _recordPos = 0;
+                    if (_realtime) _timeBaseUs = captureNowUs() - record.timestampUs;
+                    break;
+                }
+                if (_diverged) ans = -1;
+            }
+            _evt.set();
+            return ans;
+        }
+
+        int read(void* buffer, size_t size)
+        {
+            rp::hal::AutoLocker l(_lock);
+            sl_u8* dest = static_cast<sl_u8*>(buffer);
+            size_t copied = 0;
+            sl_u64 nowUs = captureNowUs();
+
+            while (!_diverged && copied < size && _cursor < _records.size()) {
+                const Record& record = _records[_cursor];
+                if (record.direction != CAPTURE_DIR_RX || !_isDue(record, nowUs)) break;
+
+                size_t toCopy = std::min(size - copied, record.size - _recordPos);
+                memcpy(dest + copied, &_data[record.offset + _recordPos], toCopy);
+                copied += toCopy;
+                _recordPos += toCopy;
+                if (_recordPos == record.size) {
+                    ++_cursor;
+                    _recordPos = 0;
+                }
+            }
+            return (int)copied;
+        }
+
+        void clearReadCache()
+        {
+        }
+
+    private:
+        struct Record
+        {
+            sl_u64  timestampUs;
+            sl_u8   direction;
+            size_t  offset;
+            size_t  size;
+        };
+
+        bool _load()
+        {
+            FILE* file = fopen(_path.c_str(), "rb");
+            if (!file) return false;
+
+            std::vector<sl_u8> content;
+            sl_u8 chunk[4096];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+                content.insert(content.end(), chunk, chunk + got);
+            }
+            fclose(file);
+
+            if (content.size() < sizeof(CAPTURE_MAGIC) || memcmp(&content[0], CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)))
+                return false;
+
+            size_t pos = sizeof(CAPTURE_MAGIC);
+            while (pos + CAPTURE_RECORD_HEADER_SIZE <= content.size()) {
+                Record record;
+                record.timestampUs = getLE(&content[pos], 8);
+                record.direction = content[pos + 8];
+                record.size = (size_t)getLE(&content[pos + 9], 4);
+                record.offset = pos + CAPTURE_RECORD_HEADER_SIZE;
+                if (record.offset + record.size > content.size()) break; // truncated capture, keep what is complete
+                _records.push_back(record);
+                pos = record.offset + record.size;
+            }
+
+            _data.swap(content);
+            _loaded = true;
+            return true;
+        }
+
+        bool _isDue(const Record& record, sl_u64 nowUs) const
+        {
+            return !_realtime || record.timestampUs + _timeBaseUs <= nowUs;
+        }
+
+        size_t _available(size_t wanted, sl_u64& nextDueUs) const
+        {
+            size_t available = 0;
+            sl_u64 nowUs = captureNowUs();
+            nextDueUs = 0;
+            if (_diverged) return 0;
+
+            for (size_t pos = _cursor; pos < _records.size() && available < wanted; ++pos) {
+                const Record& record = _records[pos];
+                if (record.direction != CAPTURE_DIR_RX) break;
+                if (!_isDue(record, nowUs)) {
+                    nextDueUs = record.timestampUs + _timeBaseUs;
+                    break;
+                }
+                available += record.size - (pos == _cursor ? _recordPos : 0);
+            }
+            return available;
+        }
+
+    private:
+        std::string         _path;
+        bool                _realtime;
+        bool                _loaded;
+        std::vector<sl_u8>  _data;
+        std::vector<Record> _records;
+        size_t              _cursor;
+        size_t              _recordPos;
+        sl_u64              _timeBaseUs;
+        bool                _diverged;
+        rp::hal::Locker     _lock;
+        rp::hal::Event      _evt;
+    };
+
+    Result<IChannel*> createCaptureChannel(IChannel* inner, const std::string& path)
+    {
+        if (!inner) return SL_RESULT_INVALID_DATA;
+        return new CaptureChannel(inner, path);
+    }
+
+    Result<IChannel*> createReplayChannel(const std::string& path, bool realtime)
+    {
+        ReplayChannel* channel = new ReplayChannel(path, realtime);
+
+        // load up front so a missing or malformed capture is reported here rather than as a silent lidar
+        if (!channel->open()) {
+            delete channel;
+            return SL_RESULT_INVALID_DATA;
+        }
+        return channel;
+    }
+}
@@ -0,0 +1,214 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+#include "sl_lidar_driver.h"
+#include <vector>
+#include <algorithm>
+
+namespace sl {
+
+    class FaultInjectionChannel : public IFaultInjectionChannel
+    {
+    public:
+        FaultInjectionChannel(IChannel* inner, const FaultInjectionConfig& config)
+            : _inner(inner)
+            , _config(config)
+            , _rngState(config.seed ? config.seed : 1)
+            , _burstRemain(0)
+            , _burstKind(FAULT_NONE)
+        {
+            memset(&_stats, 0, sizeof(_stats));
+        }
+
+        ~FaultInjectionChannel()
+        {
+            delete _inner;
+        }
+
+        bool open()
+        {
+            _pending.clear();
+            return _inner->open();
+        }
+
+        void close()
+        {
+            _inner->close();
+        }
+
+        void flush()
+        {
+            _inner->flush();
+        }
+
+        bool waitForData(size_t size, sl_u32 timeoutInMs, size_t* actualReady)
+        {
+            size_t pending = _pending.size();
+            if (pending >= size) {
+                if (actualReady) *actualReady = pending;
+                return true;
+            }
+
+            size_t innerReady = 0;
+            bool ans = _inner->waitForData(size - pending, timeoutInMs, &innerReady);
+            if (actualReady) *actualReady = pending + innerReady;
+            return ans;
+        }
+
+        int write(const void* data, size_t size)
+        {
+            return _inner->write(data, size);
+        }
+
+        int read(void* buffer, size_t size)
+        {
+            if (_pending.empty()) {
+                sl_u8 raw[512];
+                int got = _inner->read(raw, std::min(size, sizeof(raw)));
+                if (got <= 0) return got;
+                _inject(raw, (size_t)got);
+            }
+
+            size_t toCopy = std::min(size, _pending.size());
+            memcpy(buffer, &_pending[0], toCopy);
+            _pending.erase(_pending.begin(), _pending.begin() + toCopy);
+            return (int)toCopy;
+        }
+
+        void clearReadCache()
+        {
+            _pending.clear();
+            _inner->clearReadCache();
+        }
+
+        void setFaultConfig(const FaultInjectionConfig& config)
+        {
+            rp::hal::AutoLocker l(_lock);
+            _config = config;
+            _rngState = config.seed ? config.seed : 1;
+            _burstRemain = 0;
+        }
+
+        FaultInjectionStats getFaultStats()
+        {
+            rp::hal::AutoLocker l(_lock);
+            return _stats;
+        }
+
+    private:
+        enum FaultKind
+        {
+            FAULT_NONE = 0,
+            FAULT_CORRUPT,
+            FAULT_DROP,
+            FAULT_INSERT,
+        };
+
+        // xorshift32, deterministic for a given seed
+        sl_u32 _nextRandom()
+        {
+            _rngState ^= _rngState << 13;
+            _rngState ^= _rngState >> 17;
+            _rngState ^= _rngState << 5;
+            return _rngState;
+        }
+
+        bool _roll(float rate)
+        {
+            if (rate <= 0.0f) return false;
+            return (_nextRandom() & 0xFFFFFF) < (sl_u32)(rate * 0x1000000);
+        }
+
+        void _inject(const sl_u8* data, size_t size)
+        {
+            rp::hal::AutoLocker l(_lock);
+            for (size_t pos = 0; pos < size; ++pos) {
+                sl_u8 current = data[pos];
+
+                if (_stats.bytes_passed + _stats.bytes_dropped < _config.skip_bytes) {
+                    ++_stats.bytes_passed;
+                    _pending.push_back(current);
+                    continue;
+                }
+
+                if (!_burstRemain) {
+                    if (_roll(_config.drop_rate)) _burstKind = FAULT_DROP;
+                    else if (_roll(_config.corrupt_rate)) _burstKind = FAULT_CORRUPT;
+                    else if (_roll(_config.insert_rate)) _burstKind = FAULT_INSERT;
+                    else _burstKind = FAULT_NONE;
+
+                    if (_burstKind != FAULT_NONE)
+                        _burstRemain = std::max<sl_u32>(_config.burst_length, 1);
+                }
+
+                FaultKind kind = _burstRemain ? _burstKind : FAULT_NONE;
+                if (_burstRemain) --_burstRemain;
+
+                switch (kind) {
+                case FAULT_DROP:
+                    ++_stats.bytes_dropped;
+                    continue;
+                case FAULT_CORRUPT:
+                    current ^= (sl_u8)((_nextRandom() % 255) + 1);
+                    ++_stats.bytes_corrupted;
+                    break;
+                case FAULT_INSERT:
+                    _pending.push_back((sl_u8)_nextRandom());
+                    ++_stats.bytes_inserted;
+                    break;
+                default:
+                    break;
+                }
+                ++_stats.bytes_passed;
+                _pending.push_back(current);
+            }
+        }
+
+    private:
+        IChannel*               _inner;
+        FaultInjectionConfig    _config;
+        FaultInjectionStats     _stats;
+        sl_u32                  _rngState;
+        sl_u32                  _burstRemain;
+        FaultKind               _burstKind;
+        std::vector<sl_u8>      _pending;
+        rp::hal::Locker         _lock;
+    };
+
+    Result<IFaultInjectionChannel*> createFaultInjectionChannel(IChannel* inner, const FaultInjectionConfig& config)
+    {
+        if (!inner) return SL_RESULT_INVALID_DATA;
+        return new FaultInjectionChannel(inner, config);
+    }
+}
@@ -40,7 +40,12 @@
 #include "hal/event.h"
 #include "sl_lidar_driver.h"
 #include "sl_crc.h" 
+#include "sl_scan_decoder.h"
+#include "sl_trace.h"
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -62,14 +67,6 @@ namespace sl {
         fprintf(stderr, "*WARN* YOU ARE USING DEPRECATED API: %s, PLEASE MOVE TO %s\n", fn, replacement);
     }*/
 
-    static void convert(const sl_lidar_response_measurement_node_t& from, sl_lidar_response_measurement_node_hq_t& to)
-    {
-        to.angle_z_q14 = (((from.angle_q6_checkbit) >> SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) << 8) / 90;  //transfer to q14 Z-angle
-        to.dist_mm_q2 = from.distance_q2;
-        to.flag = (from.sync_quality & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT);  // trasfer syncbit to HQ flag field
-        to.quality = (from.sync_quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;  //remove the last two bits and then make quality from 0-63 to 0-255
-    }
-
     /*
     static void convert(const sl_lidar_response_measurement_node_hq_t& from, sl_lidar_response_measurement_node_t& to)
     {
@@ -78,42 +75,6 @@ namespace sl {
         to.distance_q2 = from.dist_mm_q2 > sl_u16(-1) ? sl_u16(0) : sl_u16(from.dist_mm_q2);
     }*/
 
-    static sl_u32 _varbitscale_decode(sl_u32 scaled, sl_u32 & scaleLevel)
-    {
-        static const sl_u32 VBS_SCALED_BASE[] = {
-            SL_LIDAR_VARBITSCALE_X16_DEST_VAL,
-            SL_LIDAR_VARBITSCALE_X8_DEST_VAL,
-            SL_LIDAR_VARBITSCALE_X4_DEST_VAL,
-            SL_LIDAR_VARBITSCALE_X2_DEST_VAL,
-            0,
-        };
-
-        static const sl_u32 VBS_SCALED_LVL[] = {
-            4,
-            3,
-            2,
-            1,
-            0,
-        };
-
-        static const sl_u32 VBS_TARGET_BASE[] = {
-            (0x1 << SL_LIDAR_VARBITSCALE_X16_SRC_BIT),
-            (0x1 << SL_LIDAR_VARBITSCALE_X8_SRC_BIT),
-            (0x1 << SL_LIDAR_VARBITSCALE_X4_SRC_BIT),
-            (0x1 << SL_LIDAR_VARBITSCALE_X2_SRC_BIT),
-            0,
-        };
-
-        for (size_t i = 0; i < _countof(VBS_SCALED_BASE); ++i) {
-            int remain = ((int)scaled - (int)VBS_SCALED_BASE[i]);
-            if (remain >= 0) {
-                scaleLevel = VBS_SCALED_LVL[i];
-                return VBS_TARGET_BASE[i] + (remain << scaleLevel);
-            }
-        }
-        return 0;
-    }
-
     static inline float getAngle(const sl_lidar_response_measurement_node_t& node)
     {
         return (node.angle_q6_checkbit >> SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) / 64.f;
@@ -209,6 +170,60 @@ namespace sl {
         return SL_RESULT_OK;
     }
 
+    // mlockall covers the whole process, so once is enough for every thread asking for it
+    static std::atomic<bool> memoryLocked(false);
+
+    static sl_result readThreadConfig(rp::hal::Thread& thread, LidarThreadConfig& effective)
+    {
+        rp::hal::Thread::sched_policy_t policy;
+        sl_result ans = thread.getSchedPolicy(policy, effective.priority);
+        if (SL_IS_FAIL(ans)) return ans;
+        effective.policy = (policy == rp::hal::Thread::SCHED_POLICY_FIFO) ? LidarSchedPolicyFifo
+                         : (policy == rp::hal::Thread::SCHED_POLICY_RR) ? LidarSchedPolicyRoundRobin : LidarSchedPolicyInherit;
+
+        ans = thread.getAffinity(effective.cpu_mask);
+        if (SL_IS_FAIL(ans)) return ans;
+
+        effective.lock_memory = memoryLocked;
+        return SL_RESULT_OK;
+    }
+
+    // Applies every part of config even if an earlier one is refused, and returns the first refusal
+    static sl_result applyThreadConfig(rp::hal::Thread& thread, const LidarThreadConfig& config)
+    {
+        sl_result first = SL_RESULT_OK;
+
+        if (config.policy != LidarSchedPolicyInherit) {
+            rp::hal::Thread::sched_policy_t policy = (config.policy == LidarSchedPolicyFifo) ? rp::hal::Thread::SCHED_POLICY_FIFO : rp::hal::Thread::SCHED_POLICY_RR;
+            sl_result ans = thread.setSchedPolicy(policy, config.priority);
+            if (SL_IS_FAIL(ans) && SL_IS_OK(first)) first = ans;
+        }
+
+        if (config.cpu_mask) {
+            sl_result ans = thread.setAffinity(config.cpu_mask);
+            if (SL_IS_FAIL(ans) && SL_IS_OK(first)) first = ans;
+        }
+
+        if (config.lock_memory && !memoryLocked) {
+            sl_result ans = rp::hal::Thread::lockMemory();
+            if (SL_IS_OK(ans)) memoryLocked = true;
+            else if (SL_IS_OK(first)) first = ans;
+        }
+
+        return first;
+    }
+
+    sl_result configureCurrentThread(const LidarThreadConfig& config, LidarThreadConfig* effective)
+    {
+        rp::hal::Thread self = rp::hal::Thread::current();
+        sl_result ans = applyThreadConfig(self, config);
+        if (effective) {
+            sl_result read = readThreadConfig(self, *effective);
+            if (SL_IS_OK(ans)) ans = read;
+        }
+        return ans;
+    }
+
     class SlamtecLidarDriver :public ILidarDriver
     {
     public:
@@ -217,13 +232,25 @@ namespace sl {
         };
 
         enum {
-             NORMAL_CAPSULE = 0,
-             DENSE_CAPSULE = 1,
+            A2A3_LIDAR_MINUM_MAJOR_ID  = 2,
+            TOF_LIDAR_MINUM_MAJOR_ID = 6,
         };
 
         enum {
-            A2A3_LIDAR_MINUM_MAJOR_ID  = 2,
-            TOF_LIDAR_MINUM_MAJOR_ID = 6,
+            // GET_LIDAR_CONF queries allowed in flight at once while prefetching
+            CONF_PIPELINE_DEPTH = 4,
+            // silence after STOP that shows the lidar has ceased streaming, covers usb-serial latency timers
+            STOP_QUIET_MS = 10,
+            // upper bound on waiting for that silence, the fixed delay STOP used to cost
+            STOP_DRAIN_MAX_MS = 100,
+            // consecutive rotations whose sample counts differ by less than 1/N count as a settled motor
+            ROTATION_STABLE_TOLERANCE_DIV = 20,
+            // each rotation moves the measured rotation period 1/N of the way towards its own
+            ROTATION_PERIOD_SMOOTHING = 8,
+            // the protocol asks for 1ms between STOP and the next request
+            STOP_SETTLE_MS = 1,
+            // reads per pumpScanData call, so a channel that never runs dry cannot hog the caller
+            PUMP_MAX_READS = 16,
         };
 
     public:
@@ -234,8 +261,39 @@ namespace sl {
             , _isSupportingMotorCtrl(MotorCtrlSupportNone)
             , _cached_sampleduration_std(LEGACY_SAMPLE_DURATION)
             , _cached_sampleduration_express(LEGACY_SAMPLE_DURATION)
+            , _cached_scan_node_hq_buf(NULL)
             , _cached_scan_node_hq_count(0)
+            , _cached_scan_node_hq_buf_for_interval_retrieve(NULL)
             , _cached_scan_node_hq_count_for_interval_retrieve(0)
+            , _confSupportKnown(false)
+            , _confSupported(false)
+            , _rotationStableEvt(false, false)
+            , _lastRotationNodeCount(0)
+            , _scanModeId(SL_LIDAR_CONF_SCAN_COMMAND_STD)
+            , _lastPublishMs(0)
+            , _switchPending(false)
+            , _switchFromMs(0)
+            , _switchGapMs(0)
+            , _switchDoneEvt(false, false)
+            , _externalPump(false)
+            , _scanAnsType(SL_LIDAR_ANS_TYPE_MEASUREMENT)
+            , _scanCapacity(SL_LIDAR_DEFAULT_SCAN_CAPACITY)
+            , _scanBufferCapacity(0)
+            , _scan_assembly_buf(NULL)
+            , _scan_assembly_count(0)
+            , _scan_assembly_seen(0)
+            , _maxScanNodes(0)
+            , _scanNodesDropped(0)
+            , _scansPublished(0)
+            , _revolutionsOverwritten(0)
+            , _minScanNodes(0)
+            , _publishedNodes(0)
+            , _rotationPeriodMs(0)
+            , _scan_assembly_read_us(0)
+            , _cached_scan_read_us(0)
+            , _cached_scan_publish_us(0)
+            , _grabbed_scan_read_us(0)
+            , _scanObserver(nullptr)
         {}
 
         sl_result connect(IChannel* channel)
@@ -245,6 +303,10 @@ namespace sl {
             if (!channel) return SL_RESULT_OPERATION_FAIL;
             if (isConnected()) return SL_RESULT_ALREADY_DONE;
             _channel = channel;
+
+            // whatever was learnt belongs to the previous device
+            _confSupportKnown = false;
+            _confAnswers.clear();
             
             {
                 rp::hal::AutoLocker l(_lock);
@@ -264,8 +326,17 @@ namespace sl {
 
         void disconnect()
         {
-            if (_isConnected)
+            if (_isConnected) {
+                _isScanning = false;
+                // a pump under way must be done with the channel before it goes
+                {
+                    rp::hal::AutoLocker l(_pumpLock);
+                }
+                // closing the channel wakes a cache thread blocked on it
                 _channel->close();
+                _cachethread.join();
+                _isConnected = false;
+            }
         }
 
         bool isConnected()
@@ -299,6 +370,11 @@ namespace sl {
                 ans = getScanModeCount(modeCount);
                 if (!ans) return ans;
                 // 2. for loop to get all fields of each scan mode
+                std::vector<std::pair<sl_u32, sl_u16> > fields;
+                for (sl_u16 i = 0; i < modeCount; i++) {
+                    _appendScanModeConfKeys(fields, i);
+                }
+                _prefetchLidarConf(fields, timeoutInMs);
                 for (sl_u16 i = 0; i < modeCount; i++) {
                     LidarScanMode scanModeInfoTmp;
                     memset(&scanModeInfoTmp, 0, sizeof(scanModeInfoTmp));
@@ -367,6 +443,9 @@ namespace sl {
             if (ifSupportLidarConf) {
                 if (outUsedScanMode) {
                     outUsedScanMode->id = SL_LIDAR_CONF_SCAN_COMMAND_STD;
+                    std::vector<std::pair<sl_u32, sl_u16> > fields;
+                    _appendScanModeConfKeys(fields, outUsedScanMode->id);
+                    _prefetchLidarConf(fields);
                     ans = getLidarSampleDuration(outUsedScanMode->us_per_sample, outUsedScanMode->id);
                     if (!ans) return ans;
                     ans = getMaxDistance(outUsedScanMode->max_distance, outUsedScanMode->id);
@@ -404,16 +483,9 @@ namespace sl {
                 }
 
                 sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
-                if (header_size < sizeof(sl_lidar_response_measurement_node_t)) {
-                    return SL_RESULT_INVALID_DATA;
-                }
-                _isScanning = true;
-                _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheScanData);
-                if (_cachethread.getHandle() == 0) {
-                    return SL_RESULT_OPERATION_FAIL;
-                }
+                _scanModeId = SL_LIDAR_CONF_SCAN_COMMAND_STD;
+                return _startCacheThread(SL_LIDAR_ANS_TYPE_MEASUREMENT, header_size);
             }
-            return SL_RESULT_OK;
         }
 
         sl_result startScanExpress(bool force, sl_u16 scanMode, sl_u32 options = 0, LidarScanMode* outUsedScanMode = nullptr, sl_u32 timeout = DEFAULT_TIMEOUT)
@@ -431,6 +503,9 @@ namespace sl {
             if (outUsedScanMode) {
                 outUsedScanMode->id = scanMode;
                 if (ifSupportLidarConf) {
+                    std::vector<std::pair<sl_u32, sl_u16> > fields;
+                    _appendScanModeConfKeys(fields, scanMode);
+                    _prefetchLidarConf(fields, timeout);
                     ans = getLidarSampleDuration(outUsedScanMode->us_per_sample, outUsedScanMode->id);
                     if (!ans) return SL_RESULT_INVALID_DATA;
 
@@ -474,7 +549,6 @@ namespace sl {
                     scanReq.working_mode = sl_u8(scanMode);
 
                 scanReq.working_flags = options;
-				delay(5);
                 ans = _sendCommand(SL_LIDAR_CMD_EXPRESS_SCAN, &scanReq, sizeof(scanReq));
                 if (!ans) { 
                     ans = _sendCommand(SL_LIDAR_CMD_EXPRESS_SCAN, &scanReq, sizeof(scanReq));
@@ -494,44 +568,9 @@ namespace sl {
                 }
 
                 sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
-
-                if (scanAnsType == SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED) {
-                    if (header_size < sizeof(sl_lidar_response_capsule_measurement_nodes_t)) {
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                    _cached_capsule_flag = NORMAL_CAPSULE;
-                    _isScanning = true;
-                    _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheCapsuledScanData);
-                }
-                else if (scanAnsType == SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED) {
-                    if (header_size < sizeof(sl_lidar_response_capsule_measurement_nodes_t)) {
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                    _cached_capsule_flag = DENSE_CAPSULE;
-                    _isScanning = true;
-                    _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheCapsuledScanData);
-                }
-                else if (scanAnsType == SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ) {
-                    if (header_size < sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t)) {
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                    _isScanning = true;
-                    _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheHqScanData);
-                }
-                else {
-                    if (header_size < sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t)) {
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                    _isScanning = true;
-                    _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheUltraCapsuledScanData);
-                }
-
-                if (_cachethread.getHandle() == 0) {
-                    return SL_RESULT_OPERATION_FAIL;
-                }
+                _scanModeId = scanMode;
+                return _startCacheThread(scanAnsType, header_size);
             }
-            return SL_RESULT_OK;
-
         }
 
         sl_result stop(sl_u32 timeout = DEFAULT_TIMEOUT)
@@ -543,8 +582,10 @@ namespace sl {
                 rp::hal::AutoLocker l(_lock);
                 ans = _sendCommand(SL_LIDAR_CMD_STOP);
                 if (!ans) return ans;
+
+                // scan data already on its way would be mistaken for the answer to the next command
+                _waitLineQuiet(STOP_QUIET_MS, STOP_DRAIN_MAX_MS);
             }
-            delay(100);
 
             if(_isSupportingMotorCtrl == MotorCtrlSupportPwm)
                 setMotorSpeed(0);
@@ -552,6 +593,88 @@ namespace sl {
             return SL_RESULT_OK;
         }
        
+        sl_result switchScanMode(sl_u16 scanMode, sl_u16 motorSpeed = DEFAULT_MOTOR_SPEED, LidarScanMode* outUsedScanMode = nullptr, sl_u32* outGapMs = nullptr, sl_u32 timeout = DEFAULT_TIMEOUT)
+        {
+            Result<nullptr_t> ans = SL_RESULT_OK;
+            if (!isConnected() || !_isScanning) return SL_RESULT_OPERATION_FAIL;
+
+            // whether the new mode can be described without asking the lidar, which it only answers when idle
+            bool described = _confSupportKnown && (!_confSupported || _isScanModeCached(scanMode));
+            sl_u8 scanAnsType = 0;
+
+            if (scanMode == _scanModeId && (described || !outUsedScanMode)) {
+                // the lidar takes motor commands while it scans, so the stream keeps running
+                {
+                    rp::hal::AutoLocker l(_lock);
+                    _armSwitch();
+                    _resetRotationTracking();
+                }
+                ans = setMotorSpeed(motorSpeed);
+                if (!ans) return ans;
+                if (outUsedScanMode) {
+                    ans = _describeScanMode(scanMode, outUsedScanMode, scanAnsType, timeout);
+                    if (!ans) return ans;
+                }
+            }
+            else {
+                _disableDataGrabbing();
+                {
+                    // only once the old stream is gone, or one of its rotations would end the switch and be grabbed as the new mode's
+                    rp::hal::AutoLocker l(_lock);
+                    _armSwitch();
+                    _cached_scan_node_hq_count = 0;
+                    _cached_scan_node_hq_count_for_interval_retrieve = 0;
+                    _dataEvt.set(false);
+                    ans = _sendCommand(SL_LIDAR_CMD_STOP);
+                    if (!ans) return ans;
+                    if (!described) _waitLineQuiet(STOP_QUIET_MS, STOP_DRAIN_MAX_MS);
+                }
+
+                if (described) {
+                    delay(STOP_SETTLE_MS);
+                }
+                else {
+                    // learn every mode while the line is free, so the next switch takes the short way
+                    std::vector<LidarScanMode> modes;
+                    getAllSupportedScanModes(modes, timeout);
+                }
+
+                ans = _describeScanMode(scanMode, outUsedScanMode, scanAnsType, timeout);
+                if (!ans) return ans;
+
+                ans = setMotorSpeed(motorSpeed);
+                if (!ans) return ans;
+
+                rp::hal::AutoLocker l(_lock);
+                if (scanAnsType == SL_LIDAR_ANS_TYPE_MEASUREMENT && scanMode == SL_LIDAR_CONF_SCAN_COMMAND_STD) {
+                    ans = _sendCommand(SL_LIDAR_CMD_SCAN);
+                }
+                else {
+                    sl_lidar_payload_express_scan_t scanReq;
+                    memset(&scanReq, 0, sizeof(scanReq));
+                    if (_confSupported || (scanMode != SL_LIDAR_CONF_SCAN_COMMAND_STD && scanMode != SL_LIDAR_CONF_SCAN_COMMAND_EXPRESS))
+                        scanReq.working_mode = sl_u8(scanMode);
+                    ans = _sendCommand(SL_LIDAR_CMD_EXPRESS_SCAN, &scanReq, sizeof(scanReq));
+                }
+                if (!ans) return ans;
+
+                sl_lidar_ans_header_t response_header;
+                ans = _waitScanAnswerHeader(scanAnsType, &response_header, timeout);
+                if (!ans) return ans;
+
+                _scanModeId = scanMode;
+                ans = _startCacheThread(scanAnsType, response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
+                if (!ans) return ans;
+            }
+
+            if (outGapMs) {
+                if (_switchDoneEvt.wait(timeout) != rp::hal::Event::EVENT_OK) return SL_RESULT_OPERATION_TIMEOUT;
+                rp::hal::AutoLocker l(_lock);
+                *outGapMs = _switchGapMs;
+            }
+            return SL_RESULT_OK;
+        }
+
         sl_result grabScanDataHq(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, sl_u32 timeout = DEFAULT_TIMEOUT)
         {
             switch (_dataEvt.wait(timeout))
@@ -564,12 +687,16 @@ namespace sl {
                 if (_cached_scan_node_hq_count == 0) return SL_RESULT_OPERATION_TIMEOUT; //consider as timeout
 
                 rp::hal::AutoLocker l(_lock);
+                SL_TRACE_SCOPE(trace, "grab");
 
                 size_t size_to_copy = std::min(count, _cached_scan_node_hq_count);
+                SL_TRACE_ARG(trace, size_to_copy);
                 memcpy(nodebuffer, _cached_scan_node_hq_buf, size_to_copy * sizeof(sl_lidar_response_measurement_node_hq_t));
 
                 count = size_to_copy;
                 _cached_scan_node_hq_count = 0;
+                _grabLatency.recordSince(_cached_scan_publish_us);
+                _grabbed_scan_read_us = _cached_scan_read_us;
             }
             return SL_RESULT_OK;
 
@@ -583,7 +710,6 @@ namespace sl {
         {
             Result<nullptr_t> ans = SL_RESULT_OK;
             _disableDataGrabbing();
-			delay(20);
             {
                 rp::hal::AutoLocker l(_lock);
                 ans = _sendCommand(SL_LIDAR_CMD_GET_DEVICE_INFO);
@@ -666,7 +792,6 @@ namespace sl {
                 rp::hal::AutoLocker l(_lock);
                 ans = _sendCommand(SL_LIDAR_CMD_GET_DEVICE_HEALTH);
                 if (!ans) return ans;
-                delay(50);
                 ans = _waitResponse(health, SL_LIDAR_ANS_TYPE_DEVHEALTH);
                 
             }
@@ -690,6 +815,8 @@ namespace sl {
 
         sl_result ascendScanData(sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t count)
         {
+            SL_TRACE_SCOPE(trace, "ascend");
+            SL_TRACE_ARG(trace, count);
             return ascendScanData_<sl_lidar_response_measurement_node_hq_t>(nodebuffer, count);
         }
 
@@ -740,6 +867,13 @@ namespace sl {
                 if (!ans) return ans;
                 break;
             }
+
+            // the rotation has to settle again at the new speed, also when the scan itself keeps running
+            {
+                rp::hal::AutoLocker r(_rotationLock);
+                _lastRotationNodeCount = 0;
+                _rotationStableEvt.set(false);
+            }
             return SL_RESULT_OK;
         }
 
@@ -797,14 +931,23 @@ namespace sl {
         sl_result checkSupportConfigCommands(bool& outSupport, sl_u32 timeoutInMs = DEFAULT_TIMEOUT)
         {
             Result<nullptr_t> ans = SL_RESULT_OK;
+            if (_confSupportKnown) {
+                outSupport = _confSupported;
+                return SL_RESULT_OK;
+            }
+
             sl_lidar_response_device_info_t devinfo;
             ans = getDeviceInfo(devinfo, timeoutInMs);
             if (!ans) return ans;
 
             sl_u16 modecount;
             ans = getScanModeCount(modecount, 250);
-            if ((sl_result)ans == SL_RESULT_OK)
+            if ((sl_result)ans == SL_RESULT_OK) {
                 outSupport = true;
+                // a missing answer may just be a slow reply, so only a positive one is remembered
+                _confSupported = true;
+                _confSupportKnown = true;
+            }
 
             return SL_RESULT_OK;
         }
@@ -842,7 +985,6 @@ namespace sl {
 				if (IS_FAIL(ans = _sendCommand(SL_LIDAR_CMD_SET_LIDAR_CONF, &requestPkt[0], requestPkt.size()))) {//
 					return ans;
 				}
-				delay(20);
 				// waiting for confirmation
 				sl_lidar_ans_header_t response_header;
 				if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
@@ -859,7 +1001,6 @@ namespace sl {
 				if (!_channel->waitForData(header_size, timeout)) {
 					return SL_RESULT_OPERATION_TIMEOUT;
 				}
-				delay(100);
 				struct _sl_lidar_response_set_lidar_conf {
 					sl_u32 type;
 					sl_u32 result;
@@ -874,7 +1015,9 @@ namespace sl {
 
         sl_result getLidarConf(sl_u32 type, std::vector<sl_u8> &outputBuf, const std::vector<sl_u8> &reserve = std::vector<sl_u8>(), sl_u32 timeout = DEFAULT_TIMEOUT)
         {
+            // zeroed so that the same query is sent byte for byte every time, which replaying a capture relies on
             sl_lidar_payload_get_scan_conf_t query;
+            memset(&query, 0, sizeof(query));
             query.type = type;
             int sizeVec = reserve.size();
 
@@ -882,55 +1025,28 @@ namespace sl {
             if (sizeVec > maxLen) sizeVec = maxLen;
 
             if (sizeVec > 0)
-                memcpy(query.reserved, &reserve[0], reserve.size());
+                memcpy(query.reserved, &reserve[0], sizeVec);
 
             Result<nullptr_t> ans = SL_RESULT_OK;
+            std::pair<sl_u32, sl_u16> cacheKey = _confCacheKey(type, reserve);
+            bool cacheable = _isConfCacheable(type);
             { 
                 rp::hal::AutoLocker l(_lock);
-                ans = _sendCommand(SL_LIDAR_CMD_GET_LIDAR_CONF, &query, sizeof(query));
-                if (!ans) return ans;
-				delay(50);
-                // waiting for confirmation
-                sl_lidar_ans_header_t response_header;
-                ans = _waitResponseHeader(&response_header, timeout);
-                if (!ans)return ans;
-
-                // verify whether we got a correct header
-                if (response_header.type != SL_LIDAR_ANS_TYPE_GET_LIDAR_CONF) {
-                    return SL_RESULT_INVALID_DATA;
-                }
-
-                sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
-                if (header_size < sizeof(type)) {
-                    return SL_RESULT_INVALID_DATA;
-                }
-				//delay(100);
-                if (!_channel->waitForData(header_size, timeout)) {
-                    return SL_RESULT_OPERATION_TIMEOUT;
-                }
-
-                std::vector<sl_u8> dataBuf;
-                dataBuf.resize(header_size);
-                _channel->read(reinterpret_cast<sl_u8 *>(&dataBuf[0]), header_size);
-
-                //check if returned type is same as asked type
-                sl_u32 replyType = -1;
-                memcpy(&replyType, &dataBuf[0], sizeof(type));
-                if (replyType != type) {
-                    return SL_RESULT_INVALID_DATA;
+                if (cacheable) {
+                    std::map<std::pair<sl_u32, sl_u16>, std::vector<sl_u8> >::const_iterator cached = _confAnswers.find(cacheKey);
+                    if (cached != _confAnswers.end()) {
+                        outputBuf = cached->second;
+                        return SL_RESULT_OK;
+                    }
                 }
 
-                //copy all the payload into &outputBuf
-                int payLoadLen = header_size - sizeof(type);
+                ans = _sendCommand(SL_LIDAR_CMD_GET_LIDAR_CONF, &query, sizeof(query));
+                if (!ans) return ans;
 
-                //do consistency check
-                if (payLoadLen <= 0) {
-                    return SL_RESULT_INVALID_DATA;
-                }
-                //copy all payLoadLen bytes to outputBuf
-                outputBuf.resize(payLoadLen);
-                memcpy(&outputBuf[0], &dataBuf[0] + sizeof(type), payLoadLen);
+                ans = _waitLidarConfAnswer(type, outputBuf, timeout);
+                if (!ans) return ans;
 
+                if (cacheable) _confAnswers[cacheKey] = outputBuf;
             }
 
             return SL_RESULT_OK;
@@ -1013,8 +1129,6 @@ namespace sl {
             stop();
             _channel->flush();
 
-            // wait for a while
-            delay(10);
             _channel->clearReadCache();
 
             // sending magic byte to let the target LIDAR start baudrate measurement
@@ -1067,9 +1181,179 @@ namespace sl {
             return RESULT_OPERATION_TIMEOUT;
         }
 
+        sl_result getDriverStats(LidarDriverStats& stats)
+        {
+            stats.checksum_failures = _decodeStats.checksum_failures;
+            stats.resync_bytes_skipped = _decodeStats.resync_bytes_skipped;
+            stats.capsules_lost = _decodeStats.capsules_lost;
+            stats.packets_received = _decodeStats.packets_received;
+            stats.bytes_read = _decodeStats.bytes_read;
+            stats.read_calls = _decodeStats.read_calls;
+            stats.nodes_decoded = _decodeStats.nodes_decoded;
+            stats.zero_distance_nodes = _decodeStats.zero_distance_nodes;
+
+            rp::hal::AutoLocker l(_lock);
+            stats.max_scan_nodes = _maxScanNodes;
+            stats.scan_nodes_dropped = _scanNodesDropped;
+            stats.revolutions_published = _scansPublished;
+            stats.revolutions_overwritten = _revolutionsOverwritten;
+            stats.min_scan_nodes = _minScanNodes;
+            stats.published_nodes = _publishedNodes;
+            stats.rotation_frequency = _rotationPeriodMs > 0 ? 1000.f / _rotationPeriodMs : 0.f;
+            return SL_RESULT_OK;
+        }
+
+        sl_result getLatencyStats(LidarLatencyStats& stats, bool reset)
+        {
+            stats.decode = _decodeLatency.summarize(reset);
+            stats.publish = _publishLatency.summarize(reset);
+            stats.grab = _grabLatency.summarize(reset);
+            return SL_RESULT_OK;
+        }
+
+        sl_u64 getGrabbedScanTimestamp()
+        {
+            rp::hal::AutoLocker l(_lock);
+            return _grabbed_scan_read_us;
+        }
+
+        sl_result setScanObserver(IScanObserver* observer)
+        {
+            rp::hal::AutoLocker l(_observerLock);
+            _scanObserver = observer;
+            return SL_RESULT_OK;
+        }
+
+        sl_result setScanCapacity(size_t nodes)
+        {
+            if (!nodes || nodes > (size_t)-1 / (3 * sizeof(sl_lidar_response_measurement_node_hq_t))) return SL_RESULT_INVALID_DATA;
+
+            // a scan starting meanwhile would size its buffers for the old capacity
+            rp::hal::AutoLocker l(_lock);
+            if (_isScanning) return SL_RESULT_OPERATION_FAIL;
+
+            size_t previous = _scanCapacity;
+            _scanCapacity = nodes;
+            if (!_allocateScanBuffers()) {
+                _scanCapacity = previous;
+                return SL_RESULT_INSUFFICIENT_MEMORY;
+            }
+            return SL_RESULT_OK;
+        }
+
+        size_t getScanCapacity()
+        {
+            rp::hal::AutoLocker l(_lock);
+            return _scanCapacity;
+        }
+
+        sl_result waitForStableRotation(sl_u32 timeoutInMs = DEFAULT_TIMEOUT)
+        {
+            if (!_isScanning) return SL_RESULT_OPERATION_FAIL;
+
+            switch (_rotationStableEvt.wait(timeoutInMs))
+            {
+            case rp::hal::Event::EVENT_OK:
+                return SL_RESULT_OK;
+            case rp::hal::Event::EVENT_TIMEOUT:
+                return SL_RESULT_OPERATION_TIMEOUT;
+            default:
+                return SL_RESULT_OPERATION_FAIL;
+            }
+        }
+
+        sl_result exportCapabilities(LidarCapabilities& caps)
+        {
+            rp::hal::AutoLocker l(_lock);
+            // any answer at all proves the lidar supports conf commands
+            caps.conf_commands_supported = (_confSupportKnown && _confSupported) || !_confAnswers.empty();
+            caps.conf_answers = _confAnswers;
+            return SL_RESULT_OK;
+        }
+
+        sl_result importCapabilities(const LidarCapabilities& caps)
+        {
+            if (!isConnected()) return SL_RESULT_OPERATION_FAIL;
+
+            rp::hal::AutoLocker l(_lock);
+            _confSupported = caps.conf_commands_supported;
+            _confSupportKnown = true;
+            for (std::map<std::pair<sl_u32, sl_u16>, std::vector<sl_u8> >::const_iterator it = caps.conf_answers.begin(); it != caps.conf_answers.end(); ++it) {
+                if (_isConfCacheable(it->first.first) && !it->second.empty()) _confAnswers[it->first] = it->second;
+            }
+            return SL_RESULT_OK;
+        }
+
+        sl_result setExternalPump(bool enable)
+        {
+            if (_isScanning) return SL_RESULT_OPERATION_FAIL;
+            _externalPump = enable;
+            return SL_RESULT_OK;
+        }
+
+        sl_result pumpScanData(size_t* scansPublished = nullptr)
+        {
+            if (scansPublished) *scansPublished = 0;
+            if (!_externalPump) return SL_RESULT_OPERATION_NOT_SUPPORT;
+
+            rp::hal::AutoLocker pump(_pumpLock);
+            if (!_isConnected || !_isScanning) return SL_RESULT_OPERATION_FAIL;
+
+            size_t publishedBefore = _scansPublished;
+            _decodeRxWindow();
+            for (int reads = 0; reads < PUMP_MAX_READS && _fillRxWindow(); ++reads) {
+                _decodeRxWindow();
+            }
+
+            if (scansPublished) *scansPublished = _scansPublished - publishedBefore;
+            return SL_RESULT_OK;
+        }
+
+        sl_result setAcquisitionThreadConfig(const LidarThreadConfig& config)
+        {
+            rp::hal::AutoLocker l(_lock);
+            _threadConfig = config;
+            if (!_cachethread.getHandle()) return SL_RESULT_OK;
+            return applyThreadConfig(_cachethread, config);
+        }
+
+        sl_result getAcquisitionThreadConfig(LidarThreadConfig& effective)
+        {
+            rp::hal::AutoLocker l(_lock);
+            if (!_cachethread.getHandle()) return SL_RESULT_OPERATION_FAIL;
+            return readThreadConfig(_cachethread, effective);
+        }
+
     private:
-        
-        sl_result  _sendCommand(sl_u16 cmd, const void * payload = NULL, size_t payloadsize = 0 )
+
+        // Conf entries describing the unit itself, as opposed to its current state
+        static bool _isConfCacheable(sl_u32 type)
+        {
+            switch (type) {
+            case SL_LIDAR_CONF_SCAN_MODE_COUNT:
+            case SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE:
+            case SL_LIDAR_CONF_SCAN_MODE_MAX_DISTANCE:
+            case SL_LIDAR_CONF_SCAN_MODE_ANS_TYPE:
+            case SL_LIDAR_CONF_SCAN_MODE_TYPICAL:
+            case SL_LIDAR_CONF_SCAN_MODE_NAME:
+            case SL_LIDAR_CONF_LIDAR_MAC_ADDR:
+            case SL_LIDAR_CONF_DESIRED_ROT_FREQ:
+            case SL_LIDAR_CONF_MIN_ROT_FREQ:
+            case SL_LIDAR_CONF_MAX_ROT_FREQ:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        static std::pair<sl_u32, sl_u16> _confCacheKey(sl_u32 type, const std::vector<sl_u8>& reserve)
+        {
+            sl_u16 modeId = 0;
+            if (reserve.size() >= sizeof(modeId)) memcpy(&modeId, &reserve[0], sizeof(modeId));
+            return std::make_pair(type, modeId);
+        }
+
+        sl_result  _sendCommand(sl_u16 cmd, const void * payload = NULL, size_t payloadsize = 0, bool discardPendingRx = true)
         {
             sl_u8 checksum = 0;
 
@@ -1079,7 +1363,7 @@ namespace sl {
             if (payloadsize && payload) {
                 cmd |= SL_LIDAR_CMDFLAG_HAS_PAYLOAD;
             }
-			_channel->flush();
+            if (discardPendingRx) _channel->flush();
             cmd_packet.push_back(SL_LIDAR_CMD_SYNC_BYTE);
             cmd_packet.push_back(cmd);
 			
@@ -1105,608 +1389,311 @@ namespace sl {
                 packet[pos] = cmd_packet[pos];
             }
             _channel->write(packet, cmd_packet.size());
-            delay(1);
             return SL_RESULT_OK;
         }
 
-        sl_result _waitResponseHeader(sl_lidar_ans_header_t * header, sl_u32 timeout = DEFAULT_TIMEOUT)
+        // Discards incoming bytes until the line has been silent for quietMs, giving up after maxMs
+        void _waitLineQuiet(sl_u32 quietMs, sl_u32 maxMs)
         {
-            int  recvPos = 0;
+            sl_u8 discard[256];
             sl_u32 startTs = getms();
-            sl_u8  recvBuffer[sizeof(sl_lidar_ans_header_t)];
-            sl_u8  *headerBuffer = reinterpret_cast<sl_u8 *>(header);
-            sl_u32 waitTime;
+            while (getms() - startTs < maxMs) {
+                size_t ready = 0;
+                if (!_channel->waitForData(1, quietMs, &ready)) return;
+                _channel->read(discard, std::max<size_t>(1, std::min(ready, sizeof(discard))));
+            }
+        }
 
-            while ((waitTime = getms() - startTs) <= timeout) {
-                size_t remainSize = sizeof(sl_lidar_ans_header_t) - recvPos;
-                size_t recvSize;
+        // Reads the answer to a GET_LIDAR_CONF query that has already been sent
+        sl_result _waitLidarConfAnswer(sl_u32 type, std::vector<sl_u8> &outputBuf, sl_u32 timeout)
+        {
+            sl_lidar_ans_header_t response_header;
+            sl_result ans = _waitResponseHeader(&response_header, timeout);
+            if (IS_FAIL(ans)) return ans;
 
-                bool ans = _channel->waitForData(remainSize, timeout - waitTime, &recvSize);
-                if (!ans) return SL_RESULT_OPERATION_TIMEOUT;
+            // verify whether we got a correct header
+            if (response_header.type != SL_LIDAR_ANS_TYPE_GET_LIDAR_CONF) {
+                return SL_RESULT_INVALID_DATA;
+            }
 
-                if (recvSize > remainSize) recvSize = remainSize;
+            sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
+            if (header_size < sizeof(type)) {
+                return SL_RESULT_INVALID_DATA;
+            }
+            if (!_channel->waitForData(header_size, timeout)) {
+                return SL_RESULT_OPERATION_TIMEOUT;
+            }
 
-                recvSize = _channel->read(recvBuffer, recvSize);
+            std::vector<sl_u8> dataBuf;
+            dataBuf.resize(header_size);
+            _channel->read(reinterpret_cast<sl_u8 *>(&dataBuf[0]), header_size);
 
-                for (size_t pos = 0; pos < recvSize; ++pos) {
-                    sl_u8 currentByte = recvBuffer[pos];
-                    switch (recvPos) {
-                    case 0:
-                        if (currentByte != SL_LIDAR_ANS_SYNC_BYTE1) {
-                            continue;
-                        }
-
-                        break;
-                    case 1:
-                        if (currentByte != SL_LIDAR_ANS_SYNC_BYTE2) {
-                            recvPos = 0;
-                            continue;
-                        }
-                        break;
-                    }
-                    headerBuffer[recvPos++] = currentByte;
-
-                    if (recvPos == sizeof(sl_lidar_ans_header_t)) {
-                        return SL_RESULT_OK;
-                    }
-                }
+            //check if returned type is same as asked type
+            sl_u32 replyType = -1;
+            memcpy(&replyType, &dataBuf[0], sizeof(type));
+            if (replyType != type) {
+                return SL_RESULT_INVALID_DATA;
             }
 
-            return SL_RESULT_OPERATION_TIMEOUT;
-        }
+            //copy all the payload into &outputBuf
+            int payLoadLen = header_size - sizeof(type);
 
-        template <typename T>
-        sl_result _waitResponse(T &payload ,sl_u8 ansType, sl_u32 timeout = DEFAULT_TIMEOUT)
-        {
-            sl_lidar_ans_header_t response_header;
-            Result<nullptr_t> ans = SL_RESULT_OK;
-            //delay(100);
-            ans = _waitResponseHeader(&response_header, timeout);
-            if (!ans) 
-                return ans;
-            // verify whether we got a correct header
-            if (response_header.type != ansType) {
+            //do consistency check
+            if (payLoadLen <= 0) {
                 return SL_RESULT_INVALID_DATA;
             }
-           // delay(50);
-            sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
-            if (header_size < sizeof(T)) {
-                return SL_RESULT_INVALID_DATA;
-            }
-            if (!_channel->waitForData(header_size, timeout)) {
-                return SL_RESULT_OPERATION_TIMEOUT;
-            }
-            _channel->read(reinterpret_cast<sl_u8 *>(&payload), sizeof(T));
+            //copy all payLoadLen bytes to outputBuf
+            outputBuf.resize(payLoadLen);
+            memcpy(&outputBuf[0], &dataBuf[0] + sizeof(type), payLoadLen);
             return SL_RESULT_OK;
         }
 
-        void _disableDataGrabbing()
+        static void _appendScanModeConfKeys(std::vector<std::pair<sl_u32, sl_u16> >& keys, sl_u16 scanModeID)
         {
-            //_clearRxDataCache();
-            _isScanning = false;
-            _cachethread.join();
+            keys.push_back(std::make_pair((sl_u32)SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE, scanModeID));
+            keys.push_back(std::make_pair((sl_u32)SL_LIDAR_CONF_SCAN_MODE_MAX_DISTANCE, scanModeID));
+            keys.push_back(std::make_pair((sl_u32)SL_LIDAR_CONF_SCAN_MODE_ANS_TYPE, scanModeID));
+            keys.push_back(std::make_pair((sl_u32)SL_LIDAR_CONF_SCAN_MODE_NAME, scanModeID));
         }
-        
-#define  MAX_SCAN_NODES  (8192)
-        sl_result _waitNode(sl_lidar_response_measurement_node_t * node, sl_u32 timeout = DEFAULT_TIMEOUT)
-        {
-            int  recvPos = 0;
-            sl_u32 startTs = getms();
-            sl_u8  recvBuffer[sizeof(sl_lidar_response_measurement_node_t)];
-            sl_u8 *nodeBuffer = (sl_u8*)node;
-            sl_u32 waitTime;
 
-            while ((waitTime = getms() - startTs) <= timeout) {
-                size_t remainSize = sizeof(sl_lidar_response_measurement_node_t) - recvPos;
-                size_t recvSize;
-
-                bool ans = _channel->waitForData(remainSize, timeout - waitTime, &recvSize);
-                if (!ans) return SL_RESULT_OPERATION_FAIL;
-
-                if (recvSize > remainSize) recvSize = remainSize;
-
-                recvSize = _channel->read(recvBuffer, recvSize);
-
-                for (size_t pos = 0; pos < recvSize; ++pos) {
-                    sl_u8 currentByte = recvBuffer[pos];
-                    switch (recvPos) {
-                    case 0: // expect the sync bit and its reverse in this byte
-                    {
-                        sl_u8 tmp = (currentByte >> 1);
-                        if ((tmp ^ currentByte) & 0x1) {
-                            // pass
-                        }
-                        else {
-                            continue;
-                        }
-
-                    }
-                    break;
-                    case 1: // expect the highest bit to be 1
-                    {
-                        if (currentByte & SL_LIDAR_RESP_MEASUREMENT_CHECKBIT) {
-                            // pass
-                        }
-                        else {
-                            recvPos = 0;
-                            continue;
-                        }
-                    }
-                    break;
-                    }
-                    nodeBuffer[recvPos++] = currentByte;
+        // Fills the conf cache for the given keys by sending the queries back to back instead of one
+        // round trip at a time. The lidar answers in order, so answers are matched to queries by position.
+        // Best effort: whatever could not be fetched is left to the regular getLidarConf path.
+        void _prefetchLidarConf(const std::vector<std::pair<sl_u32, sl_u16> >& keys, sl_u32 timeout = DEFAULT_TIMEOUT)
+        {
+            rp::hal::AutoLocker l(_lock);
 
-                    if (recvPos == sizeof(sl_lidar_response_measurement_node_t)) {
-                        return SL_RESULT_OK;
-                    }
-                }
+            std::vector<std::pair<sl_u32, sl_u16> > pending;
+            for (size_t pos = 0; pos < keys.size(); ++pos) {
+                if (!_isConfCacheable(keys[pos].first) || _confAnswers.count(keys[pos])) continue;
+                if (std::find(pending.begin(), pending.end(), keys[pos]) != pending.end()) continue;
+                pending.push_back(keys[pos]);
             }
 
-            return SL_RESULT_OPERATION_TIMEOUT;
-        }
+            size_t sent = 0, received = 0;
+            while (received < pending.size()) {
+                while (sent < pending.size() && sent - received < CONF_PIPELINE_DEPTH) {
+                    sl_lidar_payload_get_scan_conf_t query;
+                    memset(&query, 0, sizeof(query));
+                    query.type = pending[sent].first;
+                    memcpy(query.reserved, &pending[sent].second, sizeof(pending[sent].second));
+                    // only the first query may discard stale input, later ones would throw away answers in flight
+                    _sendCommand(SL_LIDAR_CMD_GET_LIDAR_CONF, &query, sizeof(query), sent == 0);
+                    ++sent;
+                }
 
-        sl_result _waitScanData(sl_lidar_response_measurement_node_t * nodebuffer, size_t & count, sl_u32 timeout = DEFAULT_TIMEOUT)
-        {
-            if (!_isConnected) {
-                count = 0;
-                return SL_RESULT_OPERATION_FAIL;
+                std::vector<sl_u8> answer;
+                if (IS_FAIL(_waitLidarConfAnswer(pending[received].first, answer, timeout))) break;
+                _confAnswers[pending[received]] = answer;
+                ++received;
             }
 
-            size_t   recvNodeCount = 0;
-            sl_u32     startTs = getms();
-            sl_u32     waitTime;
-            Result<nullptr_t> ans = SL_RESULT_OK;
-
-            while ((waitTime = getms() - startTs) <= timeout && recvNodeCount < count) {
-                sl_lidar_response_measurement_node_t node;
-                ans = _waitNode(&node, timeout - waitTime);
-                if (!ans) return ans;
-
-                nodebuffer[recvNodeCount++] = node;
-
-                if (recvNodeCount == count) return SL_RESULT_OK;
+            if (received < sent) {
+                // late answers must not be taken for the reply to the next command
+                _waitLineQuiet(STOP_QUIET_MS, timeout);
             }
-            count = recvNodeCount;
-            return SL_RESULT_OPERATION_TIMEOUT;
         }
 
-        sl_result _cacheScanData()
+        void _resetRotationTracking()
         {
+            rp::hal::AutoLocker r(_rotationLock);
+            _lastRotationNodeCount = 0;
+            _rotationPeriodMs = 0;
+            _rotationStableEvt.set(false);
+        }
 
-            sl_lidar_response_measurement_node_t      local_buf[256];
-            size_t                                   count = 256;
-            sl_lidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-            size_t                                   scan_count = 0;
-            Result<nullptr_t>                        ans = SL_RESULT_OK;
-            memset(local_scan, 0, sizeof(local_scan));
-
-            _waitScanData(local_buf, count); // // always discard the first data since it may be incomplete
-
-            while (_isScanning) {
-                ans = _waitScanData(local_buf, count);
-   
-                if (!ans) {
-                    if ((sl_result)ans != SL_RESULT_OPERATION_TIMEOUT) {
-                        _isScanning = false;
-                        return SL_RESULT_OPERATION_FAIL;
-                    }
-                }
-
-                for (size_t pos = 0; pos < count; ++pos) {
-                    if (local_buf[pos].sync_quality & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) {
-                        // only publish the data when it contains a full 360 degree scan 
-
-                        if ((local_scan[0].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                            _lock.lock();
-                            memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(sl_lidar_response_measurement_node_hq_t));
-                            _cached_scan_node_hq_count = scan_count;
-                            _dataEvt.set();
-                            _lock.unlock();
-                        }
-                        scan_count = 0;
-                    }
+        // Makes the next published rotation end a switch, timed from the last one published before it. Called with _lock held
+        void _armSwitch()
+        {
+            _switchPending = true;
+            _switchFromMs = _lastPublishMs ? _lastPublishMs : getms();
+            _switchDoneEvt.set(false);
+        }
 
-                    sl_lidar_response_measurement_node_hq_t nodeHq;
-                    convert(local_buf[pos], nodeHq);
-                    local_scan[scan_count++] = nodeHq;
-                    if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
+        // Called with _lock held whenever a full rotation is published. While the motor is still
+        // speeding up each rotation takes longer and so holds more samples than the next one.
+        void _trackRotation(size_t nodeCount)
+        {
+            rp::hal::AutoLocker r(_rotationLock);
+            ++_scansPublished;
+            sl_u32 now = getms();
+            if (_lastRotationNodeCount) {
+                // a rotation was published before in this scan, so the interval is a full rotation
+                float periodMs = (float)(sl_u32)(now - _lastPublishMs);
+                _rotationPeriodMs += _rotationPeriodMs > 0 ? (periodMs - _rotationPeriodMs) / ROTATION_PERIOD_SMOOTHING : periodMs;
+            }
+            _lastPublishMs = now;
+            if (_switchPending) {
+                _switchPending = false;
+                _switchGapMs = _lastPublishMs - _switchFromMs;
+                _switchDoneEvt.set();
+            }
 
-                    //for interval retrieve
-                    {
-                        rp::hal::AutoLocker l(_lock);
-                        _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = nodeHq;
-                        if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
-                    }
+            if (_lastRotationNodeCount) {
+                size_t diff = nodeCount > _lastRotationNodeCount ? nodeCount - _lastRotationNodeCount : _lastRotationNodeCount - nodeCount;
+                if (diff * ROTATION_STABLE_TOLERANCE_DIV < _lastRotationNodeCount) {
+                    _rotationStableEvt.set();
                 }
             }
-            _isScanning = false;
-            return SL_RESULT_OK;
+            _lastRotationNodeCount = nodeCount;
         }
 
-        void _ultraCapsuleToNormal(const sl_lidar_response_ultra_capsule_measurement_nodes_t & capsule, sl_lidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
+        // Starts the thread decoding the stream announced by a scan answer, or leaves the stream to
+        // pumpScanData when pumped from outside. Called with _lock held
+        sl_result _startCacheThread(sl_u8 ansType, sl_u32 headerSize)
         {
-            nodeCount = 0;
-            if (_is_previous_capsuledataRdy) {
-                int diffAngle_q8;
-                int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
-                int prevStartAngle_q8 = ((_cached_previous_ultracapsuledata.start_angle_sync_q6 & 0x7FFF) << 2);
-
-                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
-                if (prevStartAngle_q8 > currentStartAngle_q8) {
-                    diffAngle_q8 += (360 << 8);
-                }
-
-                int angleInc_q16 = (diffAngle_q8 << 3) / 3;
-                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
-                for (size_t pos = 0; pos < _countof(_cached_previous_ultracapsuledata.ultra_cabins); ++pos) {
-                    int dist_q2[3];
-                    int angle_q6[3];
-                    int syncBit[3];
-
-
-                    sl_u32 combined_x3 = _cached_previous_ultracapsuledata.ultra_cabins[pos].combined_x3;
-
-                    // unpack ...
-                    int dist_major = (combined_x3 & 0xFFF);
-
-                    // signed partical integer, using the magic shift here
-                    // DO NOT TOUCH
-
-                    int dist_predict1 = (((int)(combined_x3 << 10)) >> 22);
-                    int dist_predict2 = (((int)combined_x3) >> 22);
-
-                    int dist_major2;
-
-                    sl_u32 scalelvl1 = 0, scalelvl2 = 0;
-
-                    // prefetch next ...
-                    if (pos == _countof(_cached_previous_ultracapsuledata.ultra_cabins) - 1) {
-                        dist_major2 = (capsule.ultra_cabins[0].combined_x3 & 0xFFF);
-                    }
-                    else {
-                        dist_major2 = (_cached_previous_ultracapsuledata.ultra_cabins[pos + 1].combined_x3 & 0xFFF);
-                    }
-
-                    // decode with the var bit scale ...
-                    dist_major = _varbitscale_decode(dist_major, scalelvl1);
-                    dist_major2 = _varbitscale_decode(dist_major2, scalelvl2);
-
-
-                    int dist_base1 = dist_major;
-                    int dist_base2 = dist_major2;
-
-                    if ((!dist_major) && dist_major2) {
-                        dist_base1 = dist_major2;
-                        scalelvl1 = scalelvl2;
-                    }
-
-
-                    dist_q2[0] = (dist_major << 2);
-                    if ((dist_predict1 == (int)0xFFFFFE00) || (dist_predict1 == (int)0x1FF)) {
-                        dist_q2[1] = 0;
-                    }
-                    else {
-                        dist_predict1 = (dist_predict1 << scalelvl1);
-                        dist_q2[1] = (dist_predict1 + dist_base1) << 2;
-
-                    }
-
-                    if ((dist_predict2 == (int)0xFFFFFE00) || (dist_predict2 == (int)0x1FF)) {
-                        dist_q2[2] = 0;
-                    }
-                    else {
-                        dist_predict2 = (dist_predict2 << scalelvl2);
-                        dist_q2[2] = (dist_predict2 + dist_base2) << 2;
-                    }
-
-
-                    for (int cpos = 0; cpos < 3; ++cpos) {
-                        syncBit[cpos] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
-
-                        int offsetAngleMean_q16 = (int)(7.5 * 3.1415926535 * (1 << 16) / 180.0);
-
-                        if (dist_q2[cpos] >= (50 * 4))
-                        {
-                            const int k1 = 98361;
-                            const int k2 = int(k1 / dist_q2[cpos]);
-
-                            offsetAngleMean_q16 = (int)(8 * 3.1415926535 * (1 << 16) / 180) - (k2 << 6) - (k2 * k2 * k2) / 98304;
-                        }
-
-                        angle_q6[cpos] = ((currentAngle_raw_q16 - int(offsetAngleMean_q16 * 180 / 3.14159265)) >> 10);
-                        currentAngle_raw_q16 += angleInc_q16;
-
-                        if (angle_q6[cpos] < 0) angle_q6[cpos] += (360 << 6);
-                        if (angle_q6[cpos] >= (360 << 6)) angle_q6[cpos] -= (360 << 6);
-
-                        sl_lidar_response_measurement_node_hq_t node;
-
-                        node.flag = (syncBit[cpos] | ((!syncBit[cpos]) << 1));
-                        node.quality = dist_q2[cpos] ? (0x2F << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
-                        node.angle_z_q14 = sl_u16((angle_q6[cpos] << 8) / 90);
-                        node.dist_mm_q2 = dist_q2[cpos];
-
-                        nodebuffer[nodeCount++] = node;
-                    }
-
-                }
+            if (!_allocateScanBuffers()) return SL_RESULT_INSUFFICIENT_MEMORY;
+
+            _resetScanStream();
+            _resetRotationTracking();
+            _scanAnsType = ansType;
+            _scan_assembly_count = 0;
+            _scan_assembly_seen = 0;
+            _scan_assembly_buf[0].flag = 0;
+
+            switch (ansType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT:
+                return _startDecoding<StandardScanDecoder>(headerSize);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+                return _startDecoding<CapsuleScanDecoder>(headerSize);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+                return _startDecoding<DenseCapsuleScanDecoder>(headerSize);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+                return _startDecoding<HqScanDecoder>(headerSize);
+            default:
+                return _startDecoding<UltraCapsuleScanDecoder>(headerSize);
             }
-
-            _cached_previous_ultracapsuledata = capsule;
-            _is_previous_capsuledataRdy = true;
         }
 
-        sl_result _waitCapsuledNode(sl_lidar_response_capsule_measurement_nodes_t & node, sl_u32 timeout = DEFAULT_TIMEOUT)
+        // Sizes the scan buffers for the capacity asked for, they are only reallocated when it has changed since
+        // they were last allocated. Called with _lock held
+        bool _allocateScanBuffers()
         {
-            int  recvPos = 0;
-            sl_u32 startTs = getms();
-            sl_u8  recvBuffer[sizeof(sl_lidar_response_capsule_measurement_nodes_t)];
-            sl_u8 *nodeBuffer = (sl_u8*)&node;
-            sl_u32 waitTime;
-            while ((waitTime = getms() - startTs) <= timeout) {
-                size_t remainSize = sizeof(sl_lidar_response_capsule_measurement_nodes_t) - recvPos;
-                size_t recvSize;
-                bool ans = _channel->waitForData(remainSize, timeout - waitTime, &recvSize);
-                if (!ans) return SL_RESULT_OPERATION_TIMEOUT;
-
-                if (recvSize > remainSize) recvSize = remainSize;
-                recvSize = _channel->read(recvBuffer, recvSize);
-
-                for (size_t pos = 0; pos < recvSize; ++pos) {
-                    sl_u8 currentByte = recvBuffer[pos];
+            if (_scanBufferCapacity == _scanCapacity) return true;
+
+            // one block for the published rotation, the interval retrieve cache and the rotation being assembled
+            _cached_scan_node_hq_count = 0;
+            _cached_scan_node_hq_count_for_interval_retrieve = 0;
+            _scanBuffers.reset();
+            _scanBufferCapacity = 0;
+            _scanBuffers.reset(new (std::nothrow) sl_lidar_response_measurement_node_hq_t[_scanCapacity * 3]);
+            if (!_scanBuffers) return false;
+
+            _scanBufferCapacity = _scanCapacity;
+            _cached_scan_node_hq_buf = _scanBuffers.get();
+            _cached_scan_node_hq_buf_for_interval_retrieve = _cached_scan_node_hq_buf + _scanCapacity;
+            _scan_assembly_buf = _cached_scan_node_hq_buf_for_interval_retrieve + _scanCapacity;
+            return true;
+        }
 
-                    switch (recvPos) {
-                    case 0: // expect the sync bit 1
-                    {
-                        sl_u8 tmp = (currentByte >> 4);
-                        if (tmp == SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_1) {
-                            // pass
-                        }
-                        else {
-                            _is_previous_capsuledataRdy = false;
-                            continue;
-                        }
+        template <class TDecoder>
+        sl_result _startDecoding(sl_u32 headerSize)
+        {
+            if (headerSize < sizeof(typename TDecoder::frame_t)) {
+                return SL_RESULT_INVALID_DATA;
+            }
+            _isScanning = true;
+            if (_externalPump) return SL_RESULT_OK;
 
-                    }
-                    break;
-                    case 1: // expect the sync bit 2
-                    {
-                        sl_u8 tmp = (currentByte >> 4);
-                        if (tmp == SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
-                            // pass
-                        }
-                        else {
-                            recvPos = 0;
-                            _is_previous_capsuledataRdy = false;
-                            continue;
-                        }
-                    }
-                    break;
-                    }
-                    nodeBuffer[recvPos++] = currentByte;
-                    if (recvPos == sizeof(sl_lidar_response_capsule_measurement_nodes_t)) {
-                        // calc the checksum ...
-                        sl_u8 checksum = 0;
-                        sl_u8 recvChecksum = ((node.s_checksum_1 & 0xF) | (node.s_checksum_2 << 4));
-                        for (size_t cpos = offsetof(sl_lidar_response_capsule_measurement_nodes_t, start_angle_sync_q6);
-                            cpos < sizeof(sl_lidar_response_capsule_measurement_nodes_t); ++cpos)
-                        {
-                            checksum ^= nodeBuffer[cpos];
-                        }
-                        if (recvChecksum == checksum) {
-                            // only consider vaild if the checksum matches...
-                            if (node.start_angle_sync_q6 & SL_LIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) {
-                                // this is the first capsule frame in logic, discard the previous cached data...
-                                _scan_node_synced = false;
-                                _is_previous_capsuledataRdy = false;
-                                return SL_RESULT_OK;
-                            }
-                            return SL_RESULT_OK;
-                        }
-                        _is_previous_capsuledataRdy = false;
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                }
+            _cachethread = CLASS_THREAD(SlamtecLidarDriver, _cacheScanData<TDecoder>);
+            if (_cachethread.getHandle() == 0) {
+                return SL_RESULT_OPERATION_FAIL;
             }
-            _is_previous_capsuledataRdy = false;
-            return SL_RESULT_OPERATION_TIMEOUT;
+            // a refusal leaves the thread as it was, getAcquisitionThreadConfig tells what it got
+            applyThreadConfig(_cachethread, _threadConfig);
+            return SL_RESULT_OK;
         }
-        void _capsuleToNormal(const sl_lidar_response_capsule_measurement_nodes_t & capsule, sl_lidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
-        {
-            nodeCount = 0;
-            if (_is_previous_capsuledataRdy) {
-                int diffAngle_q8;
-                int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
-                int prevStartAngle_q8 = ((_cached_previous_capsuledata.start_angle_sync_q6 & 0x7FFF) << 2);
-
-                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
-                if (prevStartAngle_q8 > currentStartAngle_q8) {
-                    diffAngle_q8 += (360 << 8);
-                }
 
-                int angleInc_q16 = (diffAngle_q8 << 3);
-                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
-                for (size_t pos = 0; pos < _countof(_cached_previous_capsuledata.cabins); ++pos) {
-                    int dist_q2[2];
-                    int angle_q6[2];
-                    int syncBit[2];
-
-                    dist_q2[0] = (_cached_previous_capsuledata.cabins[pos].distance_angle_1 & 0xFFFC);
-                    dist_q2[1] = (_cached_previous_capsuledata.cabins[pos].distance_angle_2 & 0xFFFC);
-
-                    int angle_offset1_q3 = ((_cached_previous_capsuledata.cabins[pos].offset_angles_q3 & 0xF) | ((_cached_previous_capsuledata.cabins[pos].distance_angle_1 & 0x3) << 4));
-                    int angle_offset2_q3 = ((_cached_previous_capsuledata.cabins[pos].offset_angles_q3 >> 4) | ((_cached_previous_capsuledata.cabins[pos].distance_angle_2 & 0x3) << 4));
-
-                    angle_q6[0] = ((currentAngle_raw_q16 - (angle_offset1_q3 << 13)) >> 10);
-                    syncBit[0] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
-                    currentAngle_raw_q16 += angleInc_q16;
-
-
-                    angle_q6[1] = ((currentAngle_raw_q16 - (angle_offset2_q3 << 13)) >> 10);
-                    syncBit[1] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
-                    currentAngle_raw_q16 += angleInc_q16;
-
-                    for (int cpos = 0; cpos < 2; ++cpos) {
-
-                        if (angle_q6[cpos] < 0) angle_q6[cpos] += (360 << 6);
-                        if (angle_q6[cpos] >= (360 << 6)) angle_q6[cpos] -= (360 << 6);
-
-                        sl_lidar_response_measurement_node_hq_t node;
-
-                        node.angle_z_q14 = sl_u16((angle_q6[cpos] << 8) / 90);
-                        node.flag = (syncBit[cpos] | ((!syncBit[cpos]) << 1));
-                        node.quality = dist_q2[cpos] ? (0x2f << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
-                        node.dist_mm_q2 = dist_q2[cpos];
-
-                        nodebuffer[nodeCount++] = node;
-                    }
+        bool _isScanModeCached(sl_u16 scanMode)
+        {
+            std::vector<std::pair<sl_u32, sl_u16> > fields;
+            _appendScanModeConfKeys(fields, scanMode);
 
-                }
+            rp::hal::AutoLocker l(_lock);
+            for (size_t pos = 0; pos < fields.size(); ++pos) {
+                if (_confAnswers.find(fields[pos]) == _confAnswers.end()) return false;
             }
-
-            _cached_previous_capsuledata = capsule;
-            _is_previous_capsuledataRdy = true;
+            return true;
         }
 
-        void _dense_capsuleToNormal(const sl_lidar_response_capsule_measurement_nodes_t & capsule, sl_lidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
+        // Fills in what startScanExpress reports about a scan mode and the answer type its stream uses
+        sl_result _describeScanMode(sl_u16 scanMode, LidarScanMode* outUsedScanMode, sl_u8& scanAnsType, sl_u32 timeout)
         {
-            static int lastNodeSyncBit = 0;
-            const sl_lidar_response_dense_capsule_measurement_nodes_t *dense_capsule = reinterpret_cast<const sl_lidar_response_dense_capsule_measurement_nodes_t*>(&capsule);
-            nodeCount = 0;
-            if (_is_previous_capsuledataRdy) {
-                int diffAngle_q8;
-                int currentStartAngle_q8 = ((dense_capsule->start_angle_sync_q6 & 0x7FFF) << 2);
-                int prevStartAngle_q8 = ((_cached_previous_dense_capsuledata.start_angle_sync_q6 & 0x7FFF) << 2);
-
-                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
-                if (prevStartAngle_q8 > currentStartAngle_q8) {
-                    diffAngle_q8 += (360 << 8);
-                }
-
-                int angleInc_q16 = (diffAngle_q8 << 8) / 40;
-                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
-                for (size_t pos = 0; pos < _countof(_cached_previous_dense_capsuledata.cabins); ++pos) {
-                    int dist_q2;
-                    int angle_q6;
-                    int syncBit;
-                    const int dist = static_cast<const int>(_cached_previous_dense_capsuledata.cabins[pos].distance);
-                    dist_q2 = dist << 2;
-                    angle_q6 = (currentAngle_raw_q16 >> 10);
-
-                    syncBit = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < (angleInc_q16<<1)) ? 1 : 0;
-                    syncBit = (syncBit^ lastNodeSyncBit)&syncBit;//Ensure that syncBit is exactly detected
-                    if (syncBit) {
-                        _scan_node_synced = true;
-                    }
-
-                    currentAngle_raw_q16 += angleInc_q16;
-
-                    if (angle_q6 < 0) angle_q6 += (360 << 6);
-                    if (angle_q6 >= (360 << 6)) angle_q6 -= (360 << 6);
+            Result<nullptr_t> ans = SL_RESULT_OK;
+            bool ifSupportLidarConf = false;
+            ans = checkSupportConfigCommands(ifSupportLidarConf);
+            if (!ans) return ans;
 
-                    
-                    sl_lidar_response_measurement_node_hq_t node;
-
-                    node.angle_z_q14 = sl_u16((angle_q6 << 8) / 90);
-                    node.flag = (syncBit | ((!syncBit) << 1));
-                    node.quality = dist_q2 ? (0x2f << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
-                    node.dist_mm_q2 = dist_q2;
-                    if(_scan_node_synced)
-                        nodebuffer[nodeCount++] = node;
-                    lastNodeSyncBit = syncBit;
-                }
-            }
-            else {
-                _scan_node_synced = false;
+            if (!ifSupportLidarConf) {
+                scanAnsType = scanMode == SL_LIDAR_CONF_SCAN_COMMAND_STD ? SL_LIDAR_ANS_TYPE_MEASUREMENT : SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED;
+                if (outUsedScanMode) outUsedScanMode->id = scanMode;
+                return SL_RESULT_OK;
             }
 
-            _cached_previous_dense_capsuledata = *dense_capsule;
-            _is_previous_capsuledataRdy = true;
+            ans = getScanModeAnsType(scanAnsType, scanMode, timeout);
+            if (!ans) return ans;
+            if (!outUsedScanMode) return SL_RESULT_OK;
+
+            outUsedScanMode->id = scanMode;
+            outUsedScanMode->ans_type = scanAnsType;
+            ans = getLidarSampleDuration(outUsedScanMode->us_per_sample, scanMode, timeout);
+            if (!ans) return ans;
+            ans = getMaxDistance(outUsedScanMode->max_distance, scanMode, timeout);
+            if (!ans) return ans;
+            return getScanModeName(outUsedScanMode->scan_mode, scanMode, timeout);
         }
 
-        sl_result _cacheCapsuledScanData()
+        // Reads up to and including the answer header of a scan command, skipping whatever the previous scan
+        // was still sending. Never reads past the header, the stream behind it belongs to the cache thread
+        sl_result _waitScanAnswerHeader(sl_u8 ansType, sl_lidar_ans_header_t * header, sl_u32 timeout)
         {
-            sl_lidar_response_capsule_measurement_nodes_t    capsule_node;
-            sl_lidar_response_measurement_node_hq_t          local_buf[256];
-            size_t                                           count = 256;
-            sl_lidar_response_measurement_node_hq_t          local_scan[MAX_SCAN_NODES];
-            size_t                                           scan_count = 0;
-            Result<nullptr_t>                                ans = SL_RESULT_OK;  
-            memset(local_scan, 0, sizeof(local_scan));
+            sl_u8 *window = reinterpret_cast<sl_u8 *>(header);
+            const size_t headerSize = sizeof(sl_lidar_ans_header_t);
+            size_t filled = 0;
+            sl_u32 startTs = getms();
+            sl_u32 waitTime;
+
+            while ((waitTime = getms() - startTs) <= timeout) {
+                size_t recvSize;
+                if (!_channel->waitForData(headerSize - filled, timeout - waitTime, &recvSize)) return SL_RESULT_OPERATION_TIMEOUT;
 
-            _waitCapsuledNode(capsule_node); // // always discard the first data since it may be incomplete
+                int got = _channel->read(window + filled, headerSize - filled);
+                if (got <= 0) continue;
+                filled += got;
+                if (filled < headerSize) continue;
 
-            while (_isScanning) {
-                ans = _waitCapsuledNode(capsule_node);
-                if (!ans) {
-                    if ((sl_result)ans != SL_RESULT_OPERATION_TIMEOUT && (sl_result)ans != SL_RESULT_INVALID_DATA) {
-                        _isScanning = false;
-                        return SL_RESULT_OPERATION_FAIL;
-                    }
-                    else {
-                        // current data is invalid, do not use it.
-                        continue;
-                    }
-                }
-                switch (_cached_capsule_flag) {
-                case NORMAL_CAPSULE:
-                    _capsuleToNormal(capsule_node, local_buf, count);
-                    break;
-                case DENSE_CAPSULE:
-                    _dense_capsuleToNormal(capsule_node, local_buf, count);
-                    break;
+                bool looping = ((header->size_q30_subtype >> SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT) & SL_LIDAR_ANS_PKTFLAG_LOOP) != 0;
+                if (header->syncByte1 == SL_LIDAR_ANS_SYNC_BYTE1 && header->syncByte2 == SL_LIDAR_ANS_SYNC_BYTE2 && header->type == ansType && looping) {
+                    return SL_RESULT_OK;
                 }
-                //
-
-                for (size_t pos = 0; pos < count; ++pos) {
-                    if (local_buf[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) {
-                        // only publish the data when it contains a full 360 degree scan 
-
-                        if ((local_scan[0].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                            _lock.lock();
-                            memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(sl_lidar_response_measurement_node_hq_t));
-                            _cached_scan_node_hq_count = scan_count;
-                            _dataEvt.set();
-                            _lock.unlock();
-                        }
-                        scan_count = 0;
-                    }
-                    local_scan[scan_count++] = local_buf[pos];
-                    if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
 
-                    //for interval retrieve
-                    {
-                        rp::hal::AutoLocker l(_lock);
-                        _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                        if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
-                    }
+                // slide to the next position a header could start at
+                size_t next = 1;
+                while (next < headerSize && !(window[next] == SL_LIDAR_ANS_SYNC_BYTE1 && (next + 1 == headerSize || window[next + 1] == SL_LIDAR_ANS_SYNC_BYTE2))) {
+                    ++next;
                 }
+                memmove(window, window + next, headerSize - next);
+                filled = headerSize - next;
             }
-            _isScanning = false;
 
-            return SL_RESULT_OK;
+            return SL_RESULT_OPERATION_TIMEOUT;
         }
 
-        sl_result _waitHqNode(sl_lidar_response_hq_capsule_measurement_nodes_t & node, sl_u32 timeout = DEFAULT_TIMEOUT)
+        sl_result _waitResponseHeader(sl_lidar_ans_header_t * header, sl_u32 timeout = DEFAULT_TIMEOUT)
         {
-            if (!_isConnected) {
-                return SL_RESULT_OPERATION_FAIL;
-            }
-
             int  recvPos = 0;
             sl_u32 startTs = getms();
-            sl_u8  recvBuffer[sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t)];
-            sl_u8 *nodeBuffer = (sl_u8*)&node;
+            sl_u8  recvBuffer[sizeof(sl_lidar_ans_header_t)];
+            sl_u8  *headerBuffer = reinterpret_cast<sl_u8 *>(header);
             sl_u32 waitTime;
 
             while ((waitTime = getms() - startTs) <= timeout) {
-                size_t remainSize = sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t) - recvPos;
+                size_t remainSize = sizeof(sl_lidar_ans_header_t) - recvPos;
                 size_t recvSize;
 
                 bool ans = _channel->waitForData(remainSize, timeout - waitTime, &recvSize);
-                if (!ans){
-                    return SL_RESULT_OPERATION_TIMEOUT;
-                }
+                if (!ans) return SL_RESULT_OPERATION_TIMEOUT;
+
                 if (recvSize > remainSize) recvSize = remainSize;
 
                 recvSize = _channel->read(recvBuffer, recvSize);
@@ -1714,252 +1701,195 @@ namespace sl {
                 for (size_t pos = 0; pos < recvSize; ++pos) {
                     sl_u8 currentByte = recvBuffer[pos];
                     switch (recvPos) {
-                    case 0: // expect the sync byte
-                    {
-                        sl_u8 tmp = (currentByte);
-                        if (tmp == SL_LIDAR_RESP_MEASUREMENT_HQ_SYNC) {
-                            // pass
+                    case 0:
+                        if (currentByte != SL_LIDAR_ANS_SYNC_BYTE1) {
+                            continue;
                         }
-                        else {
+
+                        break;
+                    case 1:
+                        if (currentByte != SL_LIDAR_ANS_SYNC_BYTE2) {
                             recvPos = 0;
-                            _is_previous_HqdataRdy = false;
                             continue;
                         }
+                        break;
                     }
-                    break;
-                    case sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t) - 1 - 4:
-                    {
-
-                    }
-                    break;
-                    case sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t) - 1:
-                    {
-
-                    }
-                    break;
-                    }
-                    nodeBuffer[recvPos++] = currentByte;
-                    if (recvPos == sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t)) {
-                        sl_u32 crcCalc2 = crc32::getResult(nodeBuffer, sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t) - 4);
-
-                        if (crcCalc2 == node.crc32) {
-                            _is_previous_HqdataRdy = true;
-                            return SL_RESULT_OK;
-                        }
-                        else {
-                            _is_previous_HqdataRdy = false;
-                            return SL_RESULT_INVALID_DATA;
-                        }
+                    headerBuffer[recvPos++] = currentByte;
 
+                    if (recvPos == sizeof(sl_lidar_ans_header_t)) {
+                        return SL_RESULT_OK;
                     }
                 }
             }
-            _is_previous_HqdataRdy = false;
+
             return SL_RESULT_OPERATION_TIMEOUT;
         }
 
-        void _HqToNormal(const sl_lidar_response_hq_capsule_measurement_nodes_t & node_hq, sl_lidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount)
+        template <typename T>
+        sl_result _waitResponse(T &payload ,sl_u8 ansType, sl_u32 timeout = DEFAULT_TIMEOUT)
         {
-            nodeCount = 0;
-            if (_is_previous_HqdataRdy) {
-                for (size_t pos = 0; pos < _countof(_cached_previous_Hqdata.node_hq); ++pos) {
-                    nodebuffer[nodeCount++] = node_hq.node_hq[pos];
-                }
+            sl_lidar_ans_header_t response_header;
+            Result<nullptr_t> ans = SL_RESULT_OK;
+            //delay(100);
+            ans = _waitResponseHeader(&response_header, timeout);
+            if (!ans) 
+                return ans;
+            // verify whether we got a correct header
+            if (response_header.type != ansType) {
+                return SL_RESULT_INVALID_DATA;
+            }
+           // delay(50);
+            sl_u32 header_size = (response_header.size_q30_subtype & SL_LIDAR_ANS_HEADER_SIZE_MASK);
+            if (header_size < sizeof(T)) {
+                return SL_RESULT_INVALID_DATA;
             }
-            _cached_previous_Hqdata = node_hq;
-            _is_previous_HqdataRdy = true;
+            if (!_channel->waitForData(header_size, timeout)) {
+                return SL_RESULT_OPERATION_TIMEOUT;
+            }
+            _channel->read(reinterpret_cast<sl_u8 *>(&payload), sizeof(T));
+            return SL_RESULT_OK;
+        }
 
+        void _disableDataGrabbing()
+        {
+            //_clearRxDataCache();
+            _isScanning = false;
+            _cachethread.join();
+            // a pump under way finishes its pass, the next one sees _isScanning cleared
+            rp::hal::AutoLocker l(_pumpLock);
         }
 
-        sl_result _cacheHqScanData()
+        // Adds decoded samples to the rotation being assembled, publishing it once the next one begins
+        void _onScanNodes(const sl_lidar_response_measurement_node_hq_t * nodes, size_t count)
         {
-            sl_lidar_response_hq_capsule_measurement_nodes_t    hq_node;
-            sl_lidar_response_measurement_node_hq_t   local_buf[256];
-            size_t                                   count = 256;
-            sl_lidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-            size_t                                   scan_count = 0;
-            Result<nullptr_t>                             ans = SL_RESULT_OK;
-            memset(local_scan, 0, sizeof(local_scan));
-            _waitHqNode(hq_node);
-            while (_isScanning) {
-                ans = _waitHqNode(hq_node);
-                if (!ans) {
-                    if ((sl_result)ans != SL_RESULT_OPERATION_TIMEOUT && (sl_result)ans != SL_RESULT_INVALID_DATA) {
-                        _isScanning = false;
-                        return SL_RESULT_OPERATION_FAIL;
-                    }
-                    else {
-                        // current data is invalid, do not use it.
-                        continue;
+            const sl_u64 readUs = _rxWindow.readUs;
+            for (size_t pos = 0; pos < count; ++pos) {
+                if (nodes[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) {
+                    // only publish the data when it contains a full 360 degree scan 
+
+                    if ((_scan_assembly_buf[0].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT)) {
+                        SL_TRACE_SCOPE(trace, "publish");
+                        SL_TRACE_ARG(trace, _scan_assembly_count);
+                        _lock.lock();
+                        // still there means nobody grabbed it
+                        if (_cached_scan_node_hq_count) ++_revolutionsOverwritten;
+                        memcpy(_cached_scan_node_hq_buf, _scan_assembly_buf, _scan_assembly_count * sizeof(sl_lidar_response_measurement_node_hq_t));
+                        _cached_scan_node_hq_count = _scan_assembly_count;
+                        _cached_scan_read_us = _scan_assembly_read_us;
+                        _cached_scan_publish_us = latencyClockUs();
+                        _publishLatency.record(_cached_scan_publish_us > _cached_scan_read_us ? _cached_scan_publish_us - _cached_scan_read_us : 0);
+                        _dataEvt.set();
+                        _trackRotation(_scan_assembly_count);
+                        _maxScanNodes = std::max<sl_u64>(_maxScanNodes, _scan_assembly_seen);
+                        _scanNodesDropped += _scan_assembly_seen - _scan_assembly_count;
+                        _minScanNodes = _minScanNodes ? std::min<sl_u64>(_minScanNodes, _scan_assembly_seen) : _scan_assembly_seen;
+                        _publishedNodes += _scan_assembly_seen;
+                        _lock.unlock();
+
+                        rp::hal::AutoLocker observer(_observerLock);
+                        if (_scanObserver) {
+                            SL_TRACE_SCOPE(observe, "observe");
+                            _scanObserver->onScanPublished(_scan_assembly_buf, _scan_assembly_count, _scan_assembly_read_us);
+                        }
                     }
+                    _scan_assembly_count = 0;
+                    _scan_assembly_seen = 0;
                 }
+                // samples beyond the capacity are dropped, but still count towards the high-water mark
+                ++_scan_assembly_seen;
+                if (_scan_assembly_count < _scanBufferCapacity) _scan_assembly_buf[_scan_assembly_count++] = nodes[pos];
+                _scan_assembly_read_us = readUs;
 
-                _HqToNormal(hq_node, local_buf, count);
-                for (size_t pos = 0; pos < count; ++pos){
-                    if (local_buf[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT){
-                        // only publish the data when it contains a full 360 degree scan 
-                        if ((local_scan[0].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                            _lock.lock();
-                            memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(sl_lidar_response_measurement_node_hq_t));
-                            _cached_scan_node_hq_count = scan_count;
-                            _dataEvt.set();
-                            _lock.unlock();
-                        }
-                        scan_count = 0;
-                    }
-                    local_scan[scan_count++] = local_buf[pos];
-                    if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
-                                                                             //for interval retrieve
-                    {
-                        rp::hal::AutoLocker l(_lock);
-                        _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                        if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
+                //for interval retrieve
+                {
+                    rp::hal::AutoLocker l(_lock);
+                    if (_cached_scan_node_hq_count_for_interval_retrieve < _scanBufferCapacity) { // prevent overflow
+                        _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = nodes[pos];
                     }
                 }
-
             }
-            return SL_RESULT_OK;
         }
-
-        sl_result _waitUltraCapsuledNode(sl_lidar_response_ultra_capsule_measurement_nodes_t & node, sl_u32 timeout = DEFAULT_TIMEOUT)
+        
+        // What decodeScanStream and decodeScanWindow report to
+        struct ScanSink
         {
-            if (!_isConnected) {
-                return SL_RESULT_OPERATION_FAIL;
-            }
-
-            int  recvPos = 0;
-            sl_u32 startTs = getms();
-            sl_u8  recvBuffer[sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t)];
-            sl_u8 *nodeBuffer = (sl_u8*)&node;
-            sl_u32 waitTime;
+            explicit ScanSink(SlamtecLidarDriver & driver) : driver(driver) {}
 
-            while ((waitTime = getms() - startTs) <= timeout) {
-                size_t remainSize = sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t) - recvPos;
-                size_t recvSize;
+            bool isScanning() const { return driver._isScanning; }
 
-                bool ans = _channel->waitForData(remainSize, timeout - waitTime, &recvSize);
-                if (!ans) {
-                    return SL_RESULT_OPERATION_TIMEOUT;
-                }
-                if (recvSize > remainSize) recvSize = remainSize;
+            void onScanNodes(const sl_lidar_response_measurement_node_hq_t * nodes, size_t count)
+            {
+                driver._decodeLatency.recordSince(driver._rxWindow.readUs);
+                driver._onScanNodes(nodes, count);
+            }
 
-                recvSize = _channel->read(recvBuffer, recvSize);
+            SlamtecLidarDriver & driver;
+        };
 
-                for (size_t pos = 0; pos < recvSize; ++pos) {
-                    sl_u8 currentByte = recvBuffer[pos];
-                    switch (recvPos) {
-                    case 0: // expect the sync bit 1
-                    {
-                        sl_u8 tmp = (currentByte >> 4);
-                        if (tmp == SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_1) {
-                            // pass
-                        }
-                        else {
-                            _is_previous_capsuledataRdy = false;
-                            continue;
-                        }
-                    }
-                    break;
-                    case 1: // expect the sync bit 2
-                    {
-                        sl_u8 tmp = (currentByte >> 4);
-                        if (tmp == SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
-                            // pass
-                        }
-                        else {
-                            recvPos = 0;
-                            _is_previous_capsuledataRdy = false;
-                            continue;
-                        }
-                    }
-                    break;
-                    }
-                    nodeBuffer[recvPos++] = currentByte;
-                    if (recvPos == sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t)) {
-                        // calc the checksum ...
-                        sl_u8 checksum = 0;
-                        sl_u8 recvChecksum = ((node.s_checksum_1 & 0xF) | (node.s_checksum_2 << 4));
-
-                        for (size_t cpos = offsetof(sl_lidar_response_ultra_capsule_measurement_nodes_t, start_angle_sync_q6);
-                            cpos < sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t); ++cpos) 
-                        {
-                            checksum ^= nodeBuffer[cpos];
-                        }
+        StandardScanDecoder & _decoder(StandardScanDecoder *) { return _standardDecoder; }
+        CapsuleScanDecoder & _decoder(CapsuleScanDecoder *) { return _capsuleDecoder; }
+        DenseCapsuleScanDecoder & _decoder(DenseCapsuleScanDecoder *) { return _denseCapsuleDecoder; }
+        HqScanDecoder & _decoder(HqScanDecoder *) { return _hqDecoder; }
+        UltraCapsuleScanDecoder & _decoder(UltraCapsuleScanDecoder *) { return _ultraCapsuleDecoder; }
 
-                        if (recvChecksum == checksum) {
-                            // only consider vaild if the checksum matches...
-                            if (node.start_angle_sync_q6 & SL_LIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) {
-                                // this is the first capsule frame in logic, discard the previous cached data...
-                                _is_previous_capsuledataRdy = false;
-                                return SL_RESULT_OK;
-                            }
-                            return SL_RESULT_OK;
-                        }
-                        _is_previous_capsuledataRdy = false;
-                        return SL_RESULT_INVALID_DATA;
-                    }
-                }
-            }
-            _is_previous_capsuledataRdy = false;
-            return SL_RESULT_OPERATION_TIMEOUT;
+        // Body of the cache thread, one instantiation per answer type
+        template <class TDecoder>
+        sl_result _cacheScanData()
+        {
+            setTraceThreadName("lidar acquisition");
+            ScanSink sink(*this);
+            decodeScanStream(_decoder((TDecoder *)NULL), *_channel, _rxWindow, _decodeStats, sink, DEFAULT_TIMEOUT);
+            return SL_RESULT_OK;
         }
 
-        sl_result _cacheUltraCapsuledScanData()
+        void _resetScanStream()
         {
-            sl_lidar_response_ultra_capsule_measurement_nodes_t    ultra_capsule_node;
-            sl_lidar_response_measurement_node_hq_t   local_buf[256];
-            size_t                                   count = 256;
-            sl_lidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-            size_t                                   scan_count = 0;
-            Result<nullptr_t>                        ans = SL_RESULT_OK;
-            memset(local_scan, 0, sizeof(local_scan));
-
-            _waitUltraCapsuledNode(ultra_capsule_node);
-
-            while (_isScanning) {
-                ans = _waitUltraCapsuledNode(ultra_capsule_node);
-                if (!ans) {
-                    if ((sl_result)ans != SL_RESULT_OPERATION_TIMEOUT && (sl_result)ans != SL_RESULT_INVALID_DATA) {
-                        _isScanning = false;
-                        return SL_RESULT_OPERATION_FAIL;
-                    }
-                    else {
-                        // current data is invalid, do not use it.
-                        continue;
-                    }
-                }
-
-                _ultraCapsuleToNormal(ultra_capsule_node, local_buf, count);
+            _rxWindow.reset();
+            _standardDecoder.reset();
+            _capsuleDecoder.reset();
+            _denseCapsuleDecoder.reset();
+            _hqDecoder.reset();
+            _ultraCapsuleDecoder.reset();
+        }
 
-                for (size_t pos = 0; pos < count; ++pos) {
-                    if (local_buf[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) {
-                        // only publish the data when it contains a full 360 degree scan 
+        // Moves what the channel holds into the rx window without waiting for more
+        bool _fillRxWindow()
+        {
+            // only ask for a single byte, waiting for more would block until it arrives
+            return _rxWindow.fill(*_channel, 1, 0, _decodeStats);
+        }
 
-                        if ((local_scan[0].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                            _lock.lock();
-                            memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(sl_lidar_response_measurement_node_hq_t));
-                            _cached_scan_node_hq_count = scan_count;
-                            _dataEvt.set();
-                            _lock.unlock();
-                        }
-                        scan_count = 0;
-                    }
-                    local_scan[scan_count++] = local_buf[pos];
-                    if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
+        // Decodes every complete packet in the rx window, what the cache thread does for a pumped driver.
+        // A packet cut off at the end of the window stays there for the next pass, so nothing counts as lost for
+        // want of data, unlike a timeout of the thread
+        template <class TDecoder>
+        void _decodeRxWindow()
+        {
+            ScanSink sink(*this);
+            decodeScanWindow(_decoder((TDecoder *)NULL), _rxWindow, _decodeStats, sink);
+        }
 
-                    //for interval retrieve
-                    {
-                        rp::hal::AutoLocker l(_lock);
-                        _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                        if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
-                    }
-                }
+        void _decodeRxWindow()
+        {
+            switch (_scanAnsType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT:
+                _decodeRxWindow<StandardScanDecoder>();
+                break;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+                _decodeRxWindow<CapsuleScanDecoder>();
+                break;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+                _decodeRxWindow<DenseCapsuleScanDecoder>();
+                break;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+                _decodeRxWindow<HqScanDecoder>();
+                break;
+            default:
+                _decodeRxWindow<UltraCapsuleScanDecoder>();
+                break;
             }
-
-            _isScanning = false;
-
-            return SL_RESULT_OK;
         }
+
         sl_result _clearRxDataCache()
         {
             if (!isConnected())
@@ -1978,21 +1908,77 @@ namespace sl {
         rp::hal::Thread         _cachethread;
         sl_u16                  _cached_sampleduration_std;
         sl_u16                  _cached_sampleduration_express;
-        bool                    _scan_node_synced;
 
-        sl_lidar_response_measurement_node_hq_t   _cached_scan_node_hq_buf[8192];
+        sl_lidar_response_measurement_node_hq_t * _cached_scan_node_hq_buf;
         size_t                                   _cached_scan_node_hq_count;
-        sl_u8                                    _cached_capsule_flag;
 
-        sl_lidar_response_measurement_node_hq_t   _cached_scan_node_hq_buf_for_interval_retrieve[8192];
+        sl_lidar_response_measurement_node_hq_t * _cached_scan_node_hq_buf_for_interval_retrieve;
         size_t                                   _cached_scan_node_hq_count_for_interval_retrieve;
 
-        sl_lidar_response_capsule_measurement_nodes_t       _cached_previous_capsuledata;
-        sl_lidar_response_dense_capsule_measurement_nodes_t _cached_previous_dense_capsuledata;
-        sl_lidar_response_ultra_capsule_measurement_nodes_t _cached_previous_ultracapsuledata;
-        sl_lidar_response_hq_capsule_measurement_nodes_t _cached_previous_Hqdata;
-        bool                                         _is_previous_capsuledataRdy;
-        bool                                         _is_previous_HqdataRdy;
+        // one decoder per answer type, the one of the running scan keeps its state across pumpScanData calls
+        StandardScanDecoder                          _standardDecoder;
+        CapsuleScanDecoder                           _capsuleDecoder;
+        DenseCapsuleScanDecoder                      _denseCapsuleDecoder;
+        HqScanDecoder                                _hqDecoder;
+        UltraCapsuleScanDecoder                      _ultraCapsuleDecoder;
+        ScanRxWindow                                 _rxWindow;
+        ScanDecodeStats                              _decodeStats;
+
+        bool                                         _confSupportKnown;
+        bool                                         _confSupported;
+        std::map<std::pair<sl_u32, sl_u16>, std::vector<sl_u8> > _confAnswers;
+
+        // taken inside _lock, or alone by setMotorSpeed which is called both with and without _lock
+        rp::hal::Locker                              _rotationLock;
+        rp::hal::Event                               _rotationStableEvt;
+        size_t                                       _lastRotationNodeCount;
+
+        sl_u16                                       _scanModeId;
+        // when the last rotation was published, and the gap across the last switchScanMode
+        sl_u32                                       _lastPublishMs;
+        bool                                         _switchPending;
+        sl_u32                                       _switchFromMs;
+        sl_u32                                       _switchGapMs;
+        rp::hal::Event                               _switchDoneEvt;
+
+        LidarThreadConfig                            _threadConfig;
+
+        // set by setExternalPump, _pumpLock is held for the length of a pumpScanData call
+        bool                                         _externalPump;
+        rp::hal::Locker                              _pumpLock;
+        sl_u8                                        _scanAnsType;
+
+        // samples per rotation asked for by setScanCapacity, and what the scan buffers were allocated for
+        size_t                                       _scanCapacity;
+        size_t                                       _scanBufferCapacity;
+        std::unique_ptr<sl_lidar_response_measurement_node_hq_t[]> _scanBuffers;
+
+        // the rotation being assembled from the stream until its last sample has arrived, _scan_assembly_seen
+        // also counts the samples that did not fit
+        sl_lidar_response_measurement_node_hq_t *    _scan_assembly_buf;
+        size_t                                       _scan_assembly_count;
+        size_t                                       _scan_assembly_seen;
+        sl_u64                                       _maxScanNodes;
+        sl_u64                                       _scanNodesDropped;
+        size_t                                       _scansPublished;
+        sl_u64                                       _revolutionsOverwritten;
+        sl_u64                                       _minScanNodes;
+        sl_u64                                       _publishedNodes;
+        // smoothed time a rotation takes in the running scan, 0 until two have been published
+        float                                        _rotationPeriodMs;
+
+        // latencyClockUs timestamps following a rotation from the read of its last sample to the consumer, see LidarLatencyStats
+        LatencyHistogram                             _decodeLatency;
+        LatencyHistogram                             _publishLatency;
+        LatencyHistogram                             _grabLatency;
+        sl_u64                                       _scan_assembly_read_us;
+        sl_u64                                       _cached_scan_read_us;
+        sl_u64                                       _cached_scan_publish_us;
+        sl_u64                                       _grabbed_scan_read_us;
+
+        // called after every publish, _observerLock is held while it is
+        IScanObserver *                              _scanObserver;
+        rp::hal::Locker                              _observerLock;
     };
 
     Result<ILidarDriver*> createLidarDriver()
@@ -0,0 +1,887 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/thread.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "sl_lidar_emulator.h"
+#include "sl_crc.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#endif
+
+namespace sl {
+
+    namespace {
+        // A rectangular room around the lidar
+        float defaultDistanceProfile(float angleDeg)
+        {
+            const float halfWidth = 2000.f, halfLength = 3000.f;
+            float rad = angleDeg * 3.14159265f / 180.f;
+            float c = std::fabs(std::cos(rad)), s = std::fabs(std::sin(rad));
+            float toWall = 1e9f;
+            if (c > 1e-6f) toWall = std::min(toWall, halfWidth / c);
+            if (s > 1e-6f) toWall = std::min(toWall, halfLength / s);
+            return toWall;
+        }
+
+        const sl_u32 VBS_SCALED_BASE[] = {
+            SL_LIDAR_VARBITSCALE_X16_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X8_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X4_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X2_DEST_VAL,
+            0,
+        };
+
+        const sl_u32 VBS_SCALED_LVL[] = { 4, 3, 2, 1, 0 };
+
+        const sl_u32 VBS_TARGET_BASE[] = {
+            (0x1 << SL_LIDAR_VARBITSCALE_X16_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X8_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X4_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X2_SRC_BIT),
+            0,
+        };
+
+        LidarEmulatorScanMode makeScanMode(const char* name, sl_u8 ansType, float usPerSample, float maxDistance)
+        {
+            LidarEmulatorScanMode mode;
+            mode.name = name;
+            mode.ans_type = ansType;
+            mode.us_per_sample = usPerSample;
+            mode.max_distance = maxDistance;
+            return mode;
+        }
+    }
+
+    LidarEmulatorConfig::LidarEmulatorConfig()
+        : typical_scan_mode(3)
+        , support_conf_commands(true)
+        , scan_frequency(10.f)
+        , rate_scale(1.f)
+        , baudrate(1000000)
+        , distance_profile(defaultDistanceProfile)
+    {
+        static const char serial[] = "SLEMULATOR000001";
+
+        device_info.model = 0x61;
+        device_info.firmware_version = (1 << 8) | 29;
+        device_info.hardware_version = 18;
+        memcpy(device_info.serialnum, serial, sizeof(device_info.serialnum));
+
+        health.status = SL_LIDAR_STATUS_OK;
+        health.error_code = 0;
+
+        // locally administered address
+        static const sl_u8 mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+        memcpy(mac_addr, mac, sizeof(mac_addr));
+
+        scan_modes.push_back(makeScanMode("Standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 500.f, 16.f));
+        scan_modes.push_back(makeScanMode("Express", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED, 250.f, 16.f));
+        scan_modes.push_back(makeScanMode("Boost", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 125.f, 25.f));
+        scan_modes.push_back(makeScanMode("DenseBoost", SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED, 31.25f, 30.f));
+        scan_modes.push_back(makeScanMode("HQ", SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ, 62.5f, 30.f));
+    }
+
+#if defined(__linux__)
+
+    class LidarEmulator : public ILidarEmulator
+    {
+    public:
+        enum {
+            AUTOBAUD_TRIGGER_COUNT = 16,
+        };
+
+        LidarEmulator(const LidarEmulatorConfig& config)
+            : _config(config)
+            , _masterFd(-1)
+            , _slaveFd(-1)
+            , _running(false)
+            , _interrupt(false)
+            , _parseState(PARSE_SYNC)
+            , _autobaudCount(0)
+            , _autobaudAnswered(false)
+            , _streamAnsType(0)
+            , _streamUsPerSample(0)
+            , _streamStartUs(0)
+            , _streamSampleIdx(0)
+            , _streamFirstFrame(false)
+            , _dropoutUntilUs(0)
+            , _commandsReceived(0)
+            , _checksumErrors(0)
+            , _bytesSent(0)
+            , _samplesSent(0)
+            , _lastMotorSpeed(0)
+        {
+        }
+
+        ~LidarEmulator()
+        {
+            _running = false;
+            _interrupt = true;
+            _streamEvt.set();
+            _commandThread.join();
+            _streamThread.join();
+
+            if (_slaveFd >= 0) ::close(_slaveFd);
+            if (_masterFd >= 0) ::close(_masterFd);
+        }
+
+        sl_result start()
+        {
+            _masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+            if (_masterFd < 0) return SL_RESULT_OPERATION_FAIL;
+            if (grantpt(_masterFd) || unlockpt(_masterFd)) return SL_RESULT_OPERATION_FAIL;
+
+            char name[128];
+            if (ptsname_r(_masterFd, name, sizeof(name))) return SL_RESULT_OPERATION_FAIL;
+            _devicePath = name;
+
+            // holding the slave open keeps the master readable while no client is connected,
+            // and puts the line into raw mode before the first client shows up
+            _slaveFd = ::open(name, O_RDWR | O_NOCTTY);
+            if (_slaveFd < 0) return SL_RESULT_OPERATION_FAIL;
+
+            struct termios tio;
+            if (tcgetattr(_slaveFd, &tio) == 0) {
+                cfmakeraw(&tio);
+                tcsetattr(_slaveFd, TCSANOW, &tio);
+            }
+
+            fcntl(_masterFd, F_SETFL, fcntl(_masterFd, F_GETFL) | O_NONBLOCK);
+
+            _running = true;
+            _commandThread = CLASS_THREAD(LidarEmulator, _commandProc);
+            _streamThread = CLASS_THREAD(LidarEmulator, _streamProc);
+            if (_commandThread.getHandle() == 0 || _streamThread.getHandle() == 0) return SL_RESULT_OPERATION_FAIL;
+            return SL_RESULT_OK;
+        }
+
+        std::string getDevicePath() const
+        {
+            return _devicePath;
+        }
+
+        void getStats(LidarEmulatorStats& stats)
+        {
+            stats.commands_received = _commandsReceived;
+            stats.checksum_errors = _checksumErrors;
+            stats.bytes_sent = _bytesSent;
+            stats.samples_sent = _samplesSent;
+            stats.last_motor_speed = _lastMotorSpeed;
+        }
+
+        void simulateDropout(sl_u32 durationMs)
+        {
+            _dropoutUntilUs = _nowUs() + (sl_u64)durationMs * 1000;
+        }
+
+    private:
+        enum ParseState
+        {
+            PARSE_SYNC,
+            PARSE_CMD,
+            PARSE_SIZE,
+            PARSE_PAYLOAD,
+            PARSE_CHECKSUM,
+        };
+
+        static sl_u64 _nowUs()
+        {
+            return (sl_u64)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        bool _inDropout() const
+        {
+            return _nowUs() < _dropoutUntilUs;
+        }
+
+        // Write a whole buffer to the pty. Gives up if the stream is being interrupted while the reader is not draining.
+        bool _writeAll(const void* data, size_t size)
+        {
+            const sl_u8* pos = static_cast<const sl_u8*>(data);
+            while (size) {
+                ssize_t written = ::write(_masterFd, pos, size);
+                if (written > 0) {
+                    pos += written;
+                    size -= written;
+                    _bytesSent += written;
+                    continue;
+                }
+                if (written < 0 && errno != EAGAIN && errno != EINTR) return false;
+                if (_interrupt || !_running) return false;
+
+                struct pollfd pfd = { _masterFd, POLLOUT, 0 };
+                poll(&pfd, 1, 10);
+            }
+            return true;
+        }
+
+        bool _writeResponse(sl_u8 ansType, const void* payload, size_t size, bool loop = false)
+        {
+            sl_lidar_ans_header_t header;
+            header.syncByte1 = SL_LIDAR_ANS_SYNC_BYTE1;
+            header.syncByte2 = SL_LIDAR_ANS_SYNC_BYTE2;
+            header.size_q30_subtype = (sl_u32)size | ((loop ? SL_LIDAR_ANS_PKTFLAG_LOOP : 0) << SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT);
+            header.type = ansType;
+
+            if (!_writeAll(&header, sizeof(header))) return false;
+            // a looping answer announces the frame size, the frames follow from the stream thread
+            return loop || _writeAll(payload, size);
+        }
+
+        // ---- command side ----
+
+        sl_result _commandProc()
+        {
+            sl_u8 buffer[512];
+            while (_running) {
+                struct pollfd pfd = { _masterFd, POLLIN, 0 };
+                if (poll(&pfd, 1, 50) <= 0) continue;
+
+                ssize_t got = ::read(_masterFd, buffer, sizeof(buffer));
+                if (_inDropout()) continue;
+                for (ssize_t pos = 0; pos < got; ++pos) {
+                    _onByte(buffer[pos]);
+                }
+            }
+            return SL_RESULT_OK;
+        }
+
+        void _onByte(sl_u8 byte)
+        {
+            switch (_parseState) {
+            case PARSE_SYNC:
+                if (byte == SL_LIDAR_CMD_SYNC_BYTE) {
+                    _autobaudCount = 0;
+                    _autobaudAnswered = false;
+                    _parseState = PARSE_CMD;
+                }
+                else if (byte == SL_LIDAR_AUTOBAUD_MAGICBYTE) {
+                    _onAutobaudByte();
+                }
+                break;
+
+            case PARSE_CMD:
+                _cmd = byte;
+                _payload.clear();
+                if (_cmd & SL_LIDAR_CMDFLAG_HAS_PAYLOAD) {
+                    _parseState = PARSE_SIZE;
+                }
+                else {
+                    _parseState = PARSE_SYNC;
+                    _onCommand();
+                }
+                break;
+
+            case PARSE_SIZE:
+                _payloadSize = byte;
+                _parseState = _payloadSize ? PARSE_PAYLOAD : PARSE_CHECKSUM;
+                break;
+
+            case PARSE_PAYLOAD:
+                _payload.push_back(byte);
+                if (_payload.size() == _payloadSize) _parseState = PARSE_CHECKSUM;
+                break;
+
+            case PARSE_CHECKSUM:
+            {
+                sl_u8 checksum = SL_LIDAR_CMD_SYNC_BYTE ^ _cmd ^ _payloadSize;
+                for (size_t pos = 0; pos < _payload.size(); ++pos) checksum ^= _payload[pos];
+
+                _parseState = PARSE_SYNC;
+                if (checksum == byte) {
+                    _onCommand();
+                }
+                else {
+                    ++_checksumErrors;
+                }
+            }
+            break;
+            }
+        }
+
+        // The driver keeps sending the magic byte until it sees an answer, reply with the detected rate once
+        void _onAutobaudByte()
+        {
+            if (_autobaudAnswered || ++_autobaudCount < AUTOBAUD_TRIGGER_COUNT) return;
+
+            _stopStream();
+            rp::hal::AutoLocker l(_writeLock);
+            sl_u32 bps = _config.baudrate;
+            _writeAll(&bps, sizeof(bps));
+            _autobaudAnswered = true;
+        }
+
+        void _onCommand()
+        {
+            ++_commandsReceived;
+
+            switch (_cmd) {
+            case SL_LIDAR_CMD_STOP:
+            case SL_LIDAR_CMD_RESET:
+                _stopStream();
+                break;
+
+            case SL_LIDAR_CMD_SCAN:
+            case SL_LIDAR_CMD_FORCE_SCAN:
+            {
+                float usPerSample = 500.f;
+                if (!_config.scan_modes.empty() && _config.scan_modes[0].ans_type == SL_LIDAR_ANS_TYPE_MEASUREMENT) {
+                    usPerSample = _config.scan_modes[0].us_per_sample;
+                }
+                _startStream(SL_LIDAR_ANS_TYPE_MEASUREMENT, usPerSample);
+            }
+            break;
+
+            case SL_LIDAR_CMD_EXPRESS_SCAN:
+            {
+                sl_u16 modeId = _payload.empty() ? 0 : _payload[0];
+                if (!_config.support_conf_commands) {
+                    // legacy firmware only knows the classic express capsules
+                    _startStream(SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED, 250.f);
+                }
+                else if (modeId < _config.scan_modes.size()) {
+                    _startStream(_config.scan_modes[modeId].ans_type, _config.scan_modes[modeId].us_per_sample);
+                }
+            }
+            break;
+
+            case SL_LIDAR_CMD_HQ_SCAN:
+                for (size_t pos = 0; pos < _config.scan_modes.size(); ++pos) {
+                    if (_config.scan_modes[pos].ans_type == SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ) {
+                        _startStream(SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ, _config.scan_modes[pos].us_per_sample);
+                        break;
+                    }
+                }
+                break;
+
+            case SL_LIDAR_CMD_GET_DEVICE_INFO:
+                _respond(SL_LIDAR_ANS_TYPE_DEVINFO, &_config.device_info, sizeof(_config.device_info));
+                break;
+
+            case SL_LIDAR_CMD_GET_DEVICE_HEALTH:
+                _respond(SL_LIDAR_ANS_TYPE_DEVHEALTH, &_config.health, sizeof(_config.health));
+                break;
+
+            case SL_LIDAR_CMD_GET_SAMPLERATE:
+            {
+                sl_lidar_response_sample_rate_t rate;
+                rate.std_sample_duration_us = 500;
+                rate.express_sample_duration_us = 250;
+                _respond(SL_LIDAR_ANS_TYPE_SAMPLE_RATE, &rate, sizeof(rate));
+            }
+            break;
+
+            case SL_LIDAR_CMD_GET_ACC_BOARD_FLAG:
+            {
+                sl_lidar_response_acc_board_flag_t flag;
+                flag.support_flag = SL_LIDAR_RESP_ACC_BOARD_FLAG_MOTOR_CTRL_SUPPORT_MASK;
+                _respond(SL_LIDAR_ANS_TYPE_ACC_BOARD_FLAG, &flag, sizeof(flag));
+            }
+            break;
+
+            case SL_LIDAR_CMD_GET_LIDAR_CONF:
+                if (_config.support_conf_commands) _onGetLidarConf();
+                break;
+
+            case SL_LIDAR_CMD_SET_LIDAR_CONF:
+                if (_config.support_conf_commands && _payload.size() >= sizeof(sl_u32)) {
+                    sl_u32 answer[2];
+                    memcpy(&answer[0], &_payload[0], sizeof(sl_u32));
+                    answer[1] = SL_RESULT_OPERATION_NOT_SUPPORT;
+                    _respond(SL_LIDAR_ANS_TYPE_SET_LIDAR_CONF, answer, sizeof(answer));
+                }
+                break;
+
+            case SL_LIDAR_CMD_SET_MOTOR_PWM:
+            case SL_LIDAR_CMD_HQ_MOTOR_SPEED_CTRL:
+                // needs no answer, only kept for getStats
+                if (_payload.size() >= sizeof(sl_u16)) {
+                    sl_u16 speed;
+                    memcpy(&speed, &_payload[0], sizeof(speed));
+                    _lastMotorSpeed = speed;
+                }
+                break;
+
+            default:
+                // baudrate confirmation needs no answer
+                break;
+            }
+        }
+
+        void _respond(sl_u8 ansType, const void* payload, size_t size)
+        {
+            rp::hal::AutoLocker l(_writeLock);
+            _writeResponse(ansType, payload, size);
+        }
+
+        void _onGetLidarConf()
+        {
+            if (_payload.size() < sizeof(sl_u32)) return;
+
+            sl_u32 type;
+            memcpy(&type, &_payload[0], sizeof(type));
+            sl_u16 modeId = 0;
+            if (_payload.size() >= sizeof(sl_u32) + sizeof(sl_u16)) {
+                memcpy(&modeId, &_payload[sizeof(sl_u32)], sizeof(modeId));
+            }
+            const LidarEmulatorScanMode* mode = modeId < _config.scan_modes.size() ? &_config.scan_modes[modeId] : NULL;
+
+            std::vector<sl_u8> answer(sizeof(type));
+            memcpy(&answer[0], &type, sizeof(type));
+
+            switch (type) {
+            case SL_LIDAR_CONF_SCAN_MODE_COUNT:
+                _append(answer, (sl_u16)_config.scan_modes.size());
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_TYPICAL:
+                _append(answer, _config.typical_scan_mode);
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE:
+                if (mode) _append(answer, (sl_u32)(mode->us_per_sample * 256.f));
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_MAX_DISTANCE:
+                if (mode) _append(answer, (sl_u32)(mode->max_distance * 256.f));
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_ANS_TYPE:
+                if (mode) _append(answer, mode->ans_type);
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_NAME:
+                if (mode) answer.insert(answer.end(), mode->name.c_str(), mode->name.c_str() + mode->name.size() + 1);
+                break;
+            case SL_LIDAR_CONF_LIDAR_MAC_ADDR:
+                answer.insert(answer.end(), _config.mac_addr, _config.mac_addr + sizeof(_config.mac_addr));
+                break;
+            case SL_LIDAR_CONF_DESIRED_ROT_FREQ:
+                _append(answer, (sl_u16)(_config.scan_frequency * 60.f));
+                _append(answer, (sl_u16)600);
+                break;
+            case SL_LIDAR_CONF_MIN_ROT_FREQ:
+                _append(answer, (sl_u16)(_config.scan_frequency * 30.f));
+                break;
+            case SL_LIDAR_CONF_MAX_ROT_FREQ:
+                _append(answer, (sl_u16)(_config.scan_frequency * 120.f));
+                break;
+            case SL_LIDAR_CONF_DETECTED_SERIAL_BPS:
+                _append(answer, _config.baudrate);
+                break;
+            default:
+                // unknown entries are answered with an empty payload, which the driver reports as invalid data
+                break;
+            }
+
+            _respond(SL_LIDAR_ANS_TYPE_GET_LIDAR_CONF, &answer[0], answer.size());
+        }
+
+        template <class T>
+        static void _append(std::vector<sl_u8>& buffer, T value)
+        {
+            const sl_u8* bytes = reinterpret_cast<const sl_u8*>(&value);
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+        }
+
+        // ---- stream side ----
+
+        static size_t _frameSize(sl_u8 ansType)
+        {
+            switch (ansType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT:                  return sizeof(sl_lidar_response_measurement_node_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:         return sizeof(sl_lidar_response_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:   return sizeof(sl_lidar_response_dense_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:   return sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:               return sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t);
+            default:                                             return 0;
+            }
+        }
+
+        static size_t _samplesPerFrame(sl_u8 ansType)
+        {
+            switch (ansType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT:                  return 1;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:         return 32;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:   return 40;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:   return 96;
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:               return 96;
+            default:                                             return 0;
+            }
+        }
+
+        void _startStream(sl_u8 ansType, float usPerSample)
+        {
+            if (!_frameSize(ansType) || usPerSample <= 0) return;
+
+            _interrupt = true;
+            {
+                rp::hal::AutoLocker l(_writeLock);
+                _interrupt = false;
+                _streamAnsType = ansType;
+                _streamUsPerSample = usPerSample;
+                _streamStartUs = _nowUs();
+                _streamSampleIdx = 0;
+                _streamFirstFrame = true;
+                _writeResponse(ansType, NULL, _frameSize(ansType), true);
+            }
+            _streamEvt.set();
+        }
+
+        void _stopStream()
+        {
+            _interrupt = true;
+            rp::hal::AutoLocker l(_writeLock);
+            _interrupt = false;
+            _streamAnsType = 0;
+        }
+
+        sl_result _streamProc()
+        {
+            std::vector<sl_u8> frame;
+            while (_running) {
+                sl_u32 waitMs = 0;
+                {
+                    rp::hal::AutoLocker l(_writeLock);
+                    if (!_streamAnsType) {
+                        waitMs = 50;
+                    }
+                    else {
+                        size_t perFrame = _samplesPerFrame(_streamAnsType);
+                        bool due = true;
+                        if (_config.rate_scale > 0) {
+                            double elapsedUs = (double)(_nowUs() - _streamStartUs) * _config.rate_scale;
+                            double frameDoneUs = (double)(_streamSampleIdx + perFrame) * _streamUsPerSample;
+                            if (frameDoneUs > elapsedUs) {
+                                due = false;
+                                waitMs = std::max<sl_u32>(1, (sl_u32)((frameDoneUs - elapsedUs) / _config.rate_scale / 1000.0));
+                            }
+                        }
+
+                        if (due && _inDropout()) {
+                            _streamSampleIdx += perFrame;
+                            waitMs = 1;
+                        }
+                        else if (due) {
+                            _buildFrame(frame);
+                            if (_writeAll(&frame[0], frame.size())) {
+                                _streamSampleIdx += perFrame;
+                                _samplesSent += perFrame;
+                                _streamFirstFrame = false;
+                            }
+                        }
+                    }
+                }
+                if (waitMs) _streamEvt.wait(waitMs);
+            }
+            return SL_RESULT_OK;
+        }
+
+        float _samplesPerRevolution() const
+        {
+            return 1000000.f / (_streamUsPerSample * _config.scan_frequency);
+        }
+
+        float _angleOf(sl_u64 sampleIdx) const
+        {
+            return (float)std::fmod((double)sampleIdx * 360.0 / _samplesPerRevolution(), 360.0);
+        }
+
+        bool _startsRevolution(sl_u64 sampleIdx) const
+        {
+            float perRev = _samplesPerRevolution();
+            return !sampleIdx || std::floor(sampleIdx / perRev) != std::floor((sampleIdx - 1) / perRev);
+        }
+
+        sl_u32 _distanceOf(sl_u64 sampleIdx, sl_u32 limitMm) const
+        {
+            float mm = _config.distance_profile(_angleOf(sampleIdx));
+            if (mm <= 0 || mm > limitMm) return 0;
+            return (sl_u32)mm;
+        }
+
+        // The ultra capsule decoder corrects every sample for the mirror offset of the ranging optics,
+        // which depends on the distance. Mirrors _ultraCapsuleToNormal in the driver.
+        static float _ultraAngleOffset(sl_u32 distMm)
+        {
+            const double pi = 3.1415926535;
+            int offsetAngleMean_q16 = (int)(7.5 * pi * (1 << 16) / 180.0);
+            int dist_q2 = (int)(distMm << 2);
+            if (dist_q2 >= (50 * 4)) {
+                const int k1 = 98361;
+                const int k2 = int(k1 / dist_q2);
+                offsetAngleMean_q16 = (int)(8 * pi * (1 << 16) / 180) - (k2 << 6) - (k2 * k2 * k2) / 98304;
+            }
+            return (float)(offsetAngleMean_q16 * 180 / pi / (1 << 16));
+        }
+
+        // Pick the distance seen at the angle the driver will report for this sample once it removed the offset
+        sl_u32 _ultraDistanceOf(sl_u64 sampleIdx, sl_u32 limitMm) const
+        {
+            float raw = _angleOf(sampleIdx);
+            sl_u32 dist = _distanceOf(sampleIdx, limitMm);
+            for (int pass = 0; pass < 2 && dist; ++pass) {
+                float angle = std::fmod(raw - _ultraAngleOffset(dist) + 360.f, 360.f);
+                float mm = _config.distance_profile(angle);
+                dist = (mm <= 0 || mm > limitMm) ? 0 : (sl_u32)mm;
+            }
+            return dist;
+        }
+
+        static sl_u16 _angleQ6(float angleDeg)
+        {
+            return (sl_u16)((int)(angleDeg * 64.f + 0.5f) % (360 << 6));
+        }
+
+        template <class TCapsule>
+        static void _sealCapsule(TCapsule& capsule)
+        {
+            const sl_u8* bytes = reinterpret_cast<const sl_u8*>(&capsule);
+            sl_u8 checksum = 0;
+            for (size_t pos = offsetof(TCapsule, start_angle_sync_q6); pos < sizeof(TCapsule); ++pos) {
+                checksum ^= bytes[pos];
+            }
+            capsule.s_checksum_1 = (SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_1 << 4) | (checksum & 0xF);
+            capsule.s_checksum_2 = (SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_2 << 4) | (checksum >> 4);
+        }
+
+        sl_u16 _capsuleStartAngle() const
+        {
+            sl_u16 start = _angleQ6(_angleOf(_streamSampleIdx));
+            // only the first capsule after the scan command carries the sync flag
+            if (_streamFirstFrame) start |= SL_LIDAR_RESP_MEASUREMENT_EXP_SYNCBIT;
+            return start;
+        }
+
+        static sl_u32 _varbitscaleEncode(sl_u32 dist, sl_u32& scaleLevel)
+        {
+            for (size_t i = 0; i < _countof(VBS_TARGET_BASE); ++i) {
+                if (dist >= VBS_TARGET_BASE[i]) {
+                    scaleLevel = VBS_SCALED_LVL[i];
+                    return std::min<sl_u32>(0xFFF, VBS_SCALED_BASE[i] + ((dist - VBS_TARGET_BASE[i]) >> scaleLevel));
+                }
+            }
+            scaleLevel = 0;
+            return 0;
+        }
+
+        // Same as the driver's decoder, the encoder needs the quantised value to predict against
+        static sl_u32 _varbitscaleDecode(sl_u32 scaled, sl_u32& scaleLevel)
+        {
+            for (size_t i = 0; i < _countof(VBS_SCALED_BASE); ++i) {
+                if (scaled >= VBS_SCALED_BASE[i]) {
+                    scaleLevel = VBS_SCALED_LVL[i];
+                    return VBS_TARGET_BASE[i] + ((scaled - VBS_SCALED_BASE[i]) << scaleLevel);
+                }
+            }
+            scaleLevel = 0;
+            return 0;
+        }
+
+        // The residual of a sample against its base in the 10 bit signed field, 0x1FF marks no return
+        static sl_u32 _ultraPredict(sl_u32 dist, sl_u32 base, sl_u32 scaleLevel)
+        {
+            if (!dist) return 0x1FF;
+            int predict = ((int)dist - (int)base) >> scaleLevel;
+            predict = std::max(-511, std::min(510, predict));
+            return (sl_u32)predict & 0x3FF;
+        }
+
+        void _buildFrame(std::vector<sl_u8>& frame)
+        {
+            const sl_u64 first = _streamSampleIdx;
+            frame.assign(_frameSize(_streamAnsType), 0);
+
+            switch (_streamAnsType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT:
+            {
+                sl_lidar_response_measurement_node_t node;
+                int sync = _startsRevolution(first) ? 1 : 0;
+                node.sync_quality = (sl_u8)(sync | ((!sync) << 1) | (0x2F << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT));
+                node.angle_q6_checkbit = (sl_u16)((_angleQ6(_angleOf(first)) << SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) | SL_LIDAR_RESP_MEASUREMENT_CHECKBIT);
+                node.distance_q2 = (sl_u16)(_distanceOf(first, 16383) << 2);
+                memcpy(&frame[0], &node, sizeof(node));
+            }
+            break;
+
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+            {
+                sl_lidar_response_capsule_measurement_nodes_t capsule;
+                memset(&capsule, 0, sizeof(capsule));
+                capsule.start_angle_sync_q6 = _capsuleStartAngle();
+                for (size_t pos = 0; pos < _countof(capsule.cabins); ++pos) {
+                    // no angle offsets, the decoder spreads the samples evenly up to the next capsule
+                    capsule.cabins[pos].distance_angle_1 = (sl_u16)(_distanceOf(first + 2 * pos, 16383) << 2);
+                    capsule.cabins[pos].distance_angle_2 = (sl_u16)(_distanceOf(first + 2 * pos + 1, 16383) << 2);
+                }
+                _sealCapsule(capsule);
+                memcpy(&frame[0], &capsule, sizeof(capsule));
+            }
+            break;
+
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+            {
+                sl_lidar_response_dense_capsule_measurement_nodes_t capsule;
+                memset(&capsule, 0, sizeof(capsule));
+                capsule.start_angle_sync_q6 = _capsuleStartAngle();
+                for (size_t pos = 0; pos < _countof(capsule.cabins); ++pos) {
+                    capsule.cabins[pos].distance = (sl_u16)_distanceOf(first + pos, 65535);
+                }
+                _sealCapsule(capsule);
+                memcpy(&frame[0], &capsule, sizeof(capsule));
+            }
+            break;
+
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+            {
+                sl_lidar_response_ultra_capsule_measurement_nodes_t capsule;
+                memset(&capsule, 0, sizeof(capsule));
+                capsule.start_angle_sync_q6 = _capsuleStartAngle();
+
+                const size_t cabins = _countof(capsule.ultra_cabins);
+                sl_u32 limitLevel;
+                const sl_u32 limit = _varbitscaleDecode(0xFFF, limitLevel);
+
+                // the third sample of the last cabin is predicted from the first sample of the next capsule
+                sl_u32 majors[33], levels[33];
+                for (size_t pos = 0; pos <= cabins; ++pos) {
+                    majors[pos] = _varbitscaleEncode(_ultraDistanceOf(first + 3 * pos, limit), levels[pos]);
+                }
+
+                for (size_t pos = 0; pos < cabins; ++pos) {
+                    sl_u32 level1, level2;
+                    sl_u32 base1 = _varbitscaleDecode(majors[pos], level1);
+                    sl_u32 base2 = _varbitscaleDecode(majors[pos + 1], level2);
+                    if (!base1 && base2) {
+                        base1 = base2;
+                        level1 = level2;
+                    }
+
+                    sl_u32 predict1 = _ultraPredict(_ultraDistanceOf(first + 3 * pos + 1, limit), base1, level1);
+                    sl_u32 predict2 = _ultraPredict(_ultraDistanceOf(first + 3 * pos + 2, limit), base2, level2);
+                    capsule.ultra_cabins[pos].combined_x3 = majors[pos] | (predict1 << 12) | (predict2 << 22);
+                }
+                _sealCapsule(capsule);
+                memcpy(&frame[0], &capsule, sizeof(capsule));
+            }
+            break;
+
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+            {
+                sl_lidar_response_hq_capsule_measurement_nodes_t capsule;
+                memset(&capsule, 0, sizeof(capsule));
+                capsule.sync_byte = SL_LIDAR_RESP_MEASUREMENT_HQ_SYNC;
+                capsule.time_stamp = _nowUs() - _streamStartUs;
+                for (size_t pos = 0; pos < _countof(capsule.node_hq); ++pos) {
+                    sl_lidar_response_measurement_node_hq_t& node = capsule.node_hq[pos];
+                    sl_u32 dist = _distanceOf(first + pos, 0x3FFFFFFF);
+                    node.angle_z_q14 = (sl_u16)(_angleOf(first + pos) * 16384.f / 90.f);
+                    node.dist_mm_q2 = dist << 2;
+                    node.quality = dist ? (0x2F << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
+                    node.flag = _startsRevolution(first + pos) ? SL_LIDAR_RESP_HQ_FLAG_SYNCBIT : 0;
+                }
+                capsule.crc32 = crc32::getResult(reinterpret_cast<sl_u8*>(&capsule), sizeof(capsule) - sizeof(capsule.crc32));
+                memcpy(&frame[0], &capsule, sizeof(capsule));
+            }
+            break;
+            }
+        }
+
+    private:
+        LidarEmulatorConfig _config;
+        std::string _devicePath;
+        int _masterFd;
+        int _slaveFd;
+
+        std::atomic<bool> _running;
+        // asks a blocked stream write to give up so a command can take over the line
+        std::atomic<bool> _interrupt;
+        rp::hal::Locker _writeLock;
+        rp::hal::Event _streamEvt;
+        rp::hal::Thread _commandThread;
+        rp::hal::Thread _streamThread;
+
+        // command parser, only touched by the command thread
+        ParseState _parseState;
+        sl_u8 _cmd;
+        size_t _payloadSize;
+        std::vector<sl_u8> _payload;
+        size_t _autobaudCount;
+        bool _autobaudAnswered;
+
+        // stream state, guarded by _writeLock
+        sl_u8 _streamAnsType;
+        float _streamUsPerSample;
+        sl_u64 _streamStartUs;
+        sl_u64 _streamSampleIdx;
+        bool _streamFirstFrame;
+
+        std::atomic<sl_u64> _dropoutUntilUs;
+
+        std::atomic<sl_u64> _commandsReceived;
+        std::atomic<sl_u64> _checksumErrors;
+        std::atomic<sl_u64> _bytesSent;
+        std::atomic<sl_u64> _samplesSent;
+        std::atomic<sl_u16> _lastMotorSpeed;
+    };
+
+    Result<ILidarEmulator*> createLidarEmulator(const LidarEmulatorConfig& config)
+    {
+        if (config.scan_frequency <= 0 || !config.distance_profile) return SL_RESULT_INVALID_DATA;
+
+        LidarEmulator* emulator = new LidarEmulator(config);
+        sl_result ans = emulator->start();
+        if (SL_IS_FAIL(ans)) {
+            delete emulator;
+            return ans;
+        }
+        return emulator;
+    }
+
+#else
+
+    Result<ILidarEmulator*> createLidarEmulator(const LidarEmulatorConfig& config)
+    {
+        return SL_RESULT_OPERATION_NOT_SUPPORT;
+    }
+
+#endif
+}
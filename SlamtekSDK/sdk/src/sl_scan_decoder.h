@@ -0,0 +1,706 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sdkcommon.h"
+#include "sl_lidar_driver.h"
+#include "sl_crc.h"
+#include "sl_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+// Framing and decoding of the measurement streams, one decoder class per answer type.
+// decodeScanStream is instantiated for a decoder and a channel type, so the compiler sees the
+// whole path from the channel read to the published sample and can inline all of it
+namespace sl {
+
+    struct ScanDecodeStats
+    {
+        ScanDecodeStats()
+            : checksum_failures(0)
+            , resync_bytes_skipped(0)
+            , capsules_lost(0)
+            , packets_received(0)
+            , bytes_read(0)
+            , read_calls(0)
+            , nodes_decoded(0)
+            , zero_distance_nodes(0)
+        {}
+
+        std::atomic<sl_u64> checksum_failures;
+        std::atomic<sl_u64> resync_bytes_skipped;
+        std::atomic<sl_u64> capsules_lost;
+        std::atomic<sl_u64> packets_received;
+        std::atomic<sl_u64> bytes_read;
+        std::atomic<sl_u64> read_calls;
+        std::atomic<sl_u64> nodes_decoded;
+        // samples without a distance, the lidar got no return for them
+        std::atomic<sl_u64> zero_distance_nodes;
+    };
+
+    // Bytes read from the channel and not decoded yet. Frames are searched for in place, so after a bad
+    // frame the search restarts one byte later inside what is buffered instead of throwing it away
+    class ScanRxWindow
+    {
+    public:
+        enum {
+            // larger than any frame, the HQ capsule being the largest at 781 bytes
+            CAPACITY = 1024,
+        };
+
+        ScanRxWindow() : pos(0), len(0), skipped(0), readUs(0) {}
+
+        void reset()
+        {
+            pos = len = skipped = 0;
+            readUs = 0;
+        }
+
+        size_t available() const { return len - pos; }
+
+        const sl_u8 * head() const { return buf + pos; }
+
+        void consume(size_t size) { pos += size; }
+
+        // step over a byte that does not start a valid frame
+        void skip()
+        {
+            ++pos;
+            ++skipped;
+        }
+
+        // Reads what the channel holds, waiting up to timeout for the needed bytes first.
+        // Everything that is ready is taken, it saves a read per frame
+        template <class TChannel>
+        bool fill(TChannel & channel, size_t needed, sl_u32 timeout, ScanDecodeStats & stats)
+        {
+            if (pos) {
+                memmove(buf, buf + pos, len - pos);
+                len -= pos;
+                pos = 0;
+            }
+            if (len == CAPACITY) return false;
+
+            size_t ready = 0;
+            if (!channel.waitForData(needed, timeout, &ready)) return false;
+
+            size_t toRead = std::min(std::max(ready, needed), (size_t)CAPACITY - len);
+            SL_TRACE_SCOPE(trace, "read");
+            int recvd = channel.read(buf + len, toRead);
+            ++stats.read_calls;
+            if (recvd <= 0) return false;
+            stats.bytes_read += recvd;
+            SL_TRACE_ARG(trace, recvd);
+            len += recvd;
+            readUs = latencyClockUs();
+            return true;
+        }
+
+        sl_u8   buf[CAPACITY];
+        size_t  pos;
+        size_t  len;
+        // bytes stepped over since the last frame taken
+        size_t  skipped;
+        // latencyClockUs of the last read. Every frame decodeScanWindow takes was completed by it, as each pass takes all there are
+        sl_u64  readUs;
+    };
+
+    static inline void convert(const sl_lidar_response_measurement_node_t& from, sl_lidar_response_measurement_node_hq_t& to)
+    {
+        to.angle_z_q14 = (((from.angle_q6_checkbit) >> SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) << 8) / 90;  //transfer to q14 Z-angle
+        to.dist_mm_q2 = from.distance_q2;
+        to.flag = (from.sync_quality & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT);  // trasfer syncbit to HQ flag field
+        to.quality = (from.sync_quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;  //remove the last two bits and then make quality from 0-63 to 0-255
+    }
+
+    static inline sl_u32 _varbitscale_decode(sl_u32 scaled, sl_u32 & scaleLevel)
+    {
+        static const sl_u32 VBS_SCALED_BASE[] = {
+            SL_LIDAR_VARBITSCALE_X16_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X8_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X4_DEST_VAL,
+            SL_LIDAR_VARBITSCALE_X2_DEST_VAL,
+            0,
+        };
+
+        static const sl_u32 VBS_SCALED_LVL[] = {
+            4,
+            3,
+            2,
+            1,
+            0,
+        };
+
+        static const sl_u32 VBS_TARGET_BASE[] = {
+            (0x1 << SL_LIDAR_VARBITSCALE_X16_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X8_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X4_SRC_BIT),
+            (0x1 << SL_LIDAR_VARBITSCALE_X2_SRC_BIT),
+            0,
+        };
+
+        for (size_t i = 0; i < _countof(VBS_SCALED_BASE); ++i) {
+            int remain = ((int)scaled - (int)VBS_SCALED_BASE[i]);
+            if (remain >= 0) {
+                scaleLevel = VBS_SCALED_LVL[i];
+                return VBS_TARGET_BASE[i] + (remain << scaleLevel);
+            }
+        }
+        return 0;
+    }
+
+    // SL_LIDAR_ANS_TYPE_MEASUREMENT: one 5 byte node per sample
+    class StandardScanDecoder
+    {
+    public:
+        typedef sl_lidar_response_measurement_node_t frame_t;
+
+        enum {
+            MAX_NODES_PER_FRAME = 1,
+        };
+
+        void reset() {}
+
+        bool take(ScanRxWindow & window, frame_t & node, ScanDecodeStats & stats)
+        {
+            while (window.available() >= sizeof(node)) {
+                const sl_u8 * head = window.head();
+                // the sync bit next to its inverse, then the check bit
+                if ((((head[0] >> 1) ^ head[0]) & 0x1) && (head[1] & SL_LIDAR_RESP_MEASUREMENT_CHECKBIT)) {
+                    memcpy(&node, head, sizeof(node));
+                    window.consume(sizeof(node));
+                    stats.resync_bytes_skipped += window.skipped;
+                    window.skipped = 0;
+                    return true;
+                }
+                window.skip();
+            }
+            return false;
+        }
+
+        void onTimeout(ScanRxWindow & window, ScanDecodeStats & stats)
+        {
+            stats.resync_bytes_skipped += window.skipped;
+            window.skipped = 0;
+        }
+
+        void decode(const frame_t & node, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+        {
+            convert(node, nodebuffer[0]);
+            nodeCount = 1;
+        }
+    };
+
+    // SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ: 96 ready made samples per capsule, guarded by a crc32
+    class HqScanDecoder
+    {
+    public:
+        typedef sl_lidar_response_hq_capsule_measurement_nodes_t frame_t;
+
+        enum {
+            MAX_NODES_PER_FRAME = 96,
+        };
+
+        void reset() {}
+
+        bool take(ScanRxWindow & window, frame_t & node, ScanDecodeStats & stats)
+        {
+            while (window.available() >= sizeof(node)) {
+                if (window.head()[0] == SL_LIDAR_RESP_MEASUREMENT_HQ_SYNC) {
+                    memcpy(&node, window.head(), sizeof(node));
+                    if (crc32::getResult((sl_u8 *)&node, sizeof(node) - 4) == node.crc32) {
+                        window.consume(sizeof(node));
+                        stats.resync_bytes_skipped += window.skipped;
+                        window.skipped = 0;
+                        return true;
+                    }
+                    ++stats.checksum_failures;
+                }
+                window.skip();
+            }
+            return false;
+        }
+
+        void onTimeout(ScanRxWindow & window, ScanDecodeStats & stats)
+        {
+            stats.resync_bytes_skipped += window.skipped;
+            window.skipped = 0;
+        }
+
+        void decode(const frame_t & node_hq, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+        {
+            memcpy(nodebuffer, node_hq.node_hq, sizeof(node_hq.node_hq));
+            nodeCount = _countof(node_hq.node_hq);
+        }
+    };
+
+    // Framing shared by the express capsule formats. A capsule is decoded against the one following it,
+    // so the previous one is kept, as long as nothing was lost in between
+    template <class TCapsule>
+    class CapsuleScanDecoderBase
+    {
+    public:
+        typedef TCapsule frame_t;
+
+        CapsuleScanDecoderBase()
+            : _previousReady(false)
+            , _lastAngle_q6(0)
+            , _angleStep_q6(0)
+        {
+            memset(&_previous, 0, sizeof(_previous));
+        }
+
+        void reset()
+        {
+            _previousReady = false;
+            _angleStep_q6 = 0;
+        }
+
+        bool take(ScanRxWindow & window, frame_t & node, ScanDecodeStats & stats)
+        {
+            const size_t frameSize = sizeof(TCapsule);
+
+            while (window.available() >= 2) {
+                const sl_u8 * head = window.head();
+                if ((head[0] >> 4) != SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_1 || (head[1] >> 4) != SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
+                    window.skip();
+                    continue;
+                }
+
+                if (window.available() < frameSize) break;
+
+                if (_isChecksumValid(head)) {
+                    memcpy(&node, head, frameSize);
+                    window.consume(frameSize);
+
+                    _checkContinuity(node.start_angle_sync_q6, window.skipped, stats);
+                    window.skipped = 0;
+
+                    if (node.start_angle_sync_q6 & SL_LIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) {
+                        // this is the first capsule frame in logic, discard the previous cached data...
+                        _previousReady = false;
+                    }
+                    return true;
+                }
+
+                ++stats.checksum_failures;
+                window.skip();
+            }
+            return false;
+        }
+
+        void onTimeout(ScanRxWindow & window, ScanDecodeStats & stats)
+        {
+            stats.resync_bytes_skipped += window.skipped;
+            window.skipped = 0;
+            if (_previousReady) ++stats.capsules_lost;
+            _previousReady = false;
+        }
+
+    protected:
+        static bool _isChecksumValid(const sl_u8 * frame)
+        {
+            const TCapsule * capsule = reinterpret_cast<const TCapsule *>(frame);
+            sl_u8 checksum = 0;
+            sl_u8 recvChecksum = ((capsule->s_checksum_1 & 0xF) | (capsule->s_checksum_2 << 4));
+            for (size_t cpos = offsetof(TCapsule, start_angle_sync_q6); cpos < sizeof(TCapsule); ++cpos) {
+                checksum ^= frame[cpos];
+            }
+            return recvChecksum == checksum;
+        }
+
+        // Decide whether the cached previous capsule can still be decoded against the one just received.
+        // That is only the case if nothing was lost in between, which shows as the start angle advancing
+        // by about one capsule's worth. The step is checked on every capsule, a capsule lost whole on its
+        // boundaries leaves no skipped bytes behind and must not be learnt as the new step.
+        void _checkContinuity(sl_u16 startAngleSyncQ6, size_t skippedBytes, ScanDecodeStats & stats)
+        {
+            int startAngle_q6 = (startAngleSyncQ6 & 0x7FFF);
+
+            stats.resync_bytes_skipped += skippedBytes;
+
+            if (_previousReady) {
+                int step_q6 = startAngle_q6 - _lastAngle_q6;
+                if (step_q6 < 0) step_q6 += (360 << 6);
+
+                // without a step learnt yet only skipped bytes tell of a loss
+                bool gap = _angleStep_q6 ? step_q6 > _angleStep_q6 + (_angleStep_q6 >> 1) : skippedBytes != 0;
+                if (gap) {
+                    // the cached capsule plus whatever went missing on the wire
+                    sl_u64 lost = 1;
+                    if (_angleStep_q6) {
+                        lost = (step_q6 + (_angleStep_q6 >> 1)) / _angleStep_q6;
+                    }
+                    stats.capsules_lost += lost;
+                    _previousReady = false;
+                }
+                else {
+                    _angleStep_q6 = step_q6;
+                }
+            }
+
+            _lastAngle_q6 = startAngle_q6;
+        }
+
+        TCapsule    _previous;
+        bool        _previousReady;
+        int         _lastAngle_q6;
+        int         _angleStep_q6;
+    };
+
+    // SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: 16 cabins of two samples
+    class CapsuleScanDecoder : public CapsuleScanDecoderBase<sl_lidar_response_capsule_measurement_nodes_t>
+    {
+    public:
+        enum {
+            MAX_NODES_PER_FRAME = 32,
+        };
+
+        void decode(const frame_t & capsule, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+        {
+            nodeCount = 0;
+            if (_previousReady) {
+                int diffAngle_q8;
+                int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
+                int prevStartAngle_q8 = ((_previous.start_angle_sync_q6 & 0x7FFF) << 2);
+
+                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
+                if (prevStartAngle_q8 > currentStartAngle_q8) {
+                    diffAngle_q8 += (360 << 8);
+                }
+
+                int angleInc_q16 = (diffAngle_q8 << 3);
+                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
+                for (size_t pos = 0; pos < _countof(_previous.cabins); ++pos) {
+                    int dist_q2[2];
+                    int angle_q6[2];
+                    int syncBit[2];
+
+                    dist_q2[0] = (_previous.cabins[pos].distance_angle_1 & 0xFFFC);
+                    dist_q2[1] = (_previous.cabins[pos].distance_angle_2 & 0xFFFC);
+
+                    int angle_offset1_q3 = ((_previous.cabins[pos].offset_angles_q3 & 0xF) | ((_previous.cabins[pos].distance_angle_1 & 0x3) << 4));
+                    int angle_offset2_q3 = ((_previous.cabins[pos].offset_angles_q3 >> 4) | ((_previous.cabins[pos].distance_angle_2 & 0x3) << 4));
+
+                    angle_q6[0] = ((currentAngle_raw_q16 - (angle_offset1_q3 << 13)) >> 10);
+                    syncBit[0] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
+                    currentAngle_raw_q16 += angleInc_q16;
+
+
+                    angle_q6[1] = ((currentAngle_raw_q16 - (angle_offset2_q3 << 13)) >> 10);
+                    syncBit[1] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
+                    currentAngle_raw_q16 += angleInc_q16;
+
+                    for (int cpos = 0; cpos < 2; ++cpos) {
+
+                        if (angle_q6[cpos] < 0) angle_q6[cpos] += (360 << 6);
+                        if (angle_q6[cpos] >= (360 << 6)) angle_q6[cpos] -= (360 << 6);
+
+                        sl_lidar_response_measurement_node_hq_t node;
+
+                        node.angle_z_q14 = sl_u16((angle_q6[cpos] << 8) / 90);
+                        node.flag = (syncBit[cpos] | ((!syncBit[cpos]) << 1));
+                        node.quality = dist_q2[cpos] ? (0x2f << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
+                        node.dist_mm_q2 = dist_q2[cpos];
+
+                        nodebuffer[nodeCount++] = node;
+                    }
+
+                }
+            }
+
+            _previous = capsule;
+            _previousReady = true;
+        }
+    };
+
+    // SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: 40 distances per capsule, evenly spread
+    class DenseCapsuleScanDecoder : public CapsuleScanDecoderBase<sl_lidar_response_dense_capsule_measurement_nodes_t>
+    {
+    public:
+        enum {
+            MAX_NODES_PER_FRAME = 40,
+        };
+
+        DenseCapsuleScanDecoder() : _scanNodeSynced(false), _lastNodeSyncBit(0) {}
+
+        void decode(const frame_t & dense_capsule, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+        {
+            nodeCount = 0;
+            if (_previousReady) {
+                int diffAngle_q8;
+                int currentStartAngle_q8 = ((dense_capsule.start_angle_sync_q6 & 0x7FFF) << 2);
+                int prevStartAngle_q8 = ((_previous.start_angle_sync_q6 & 0x7FFF) << 2);
+
+                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
+                if (prevStartAngle_q8 > currentStartAngle_q8) {
+                    diffAngle_q8 += (360 << 8);
+                }
+
+                int angleInc_q16 = (diffAngle_q8 << 8) / 40;
+                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
+                for (size_t pos = 0; pos < _countof(_previous.cabins); ++pos) {
+                    int dist_q2;
+                    int angle_q6;
+                    int syncBit;
+                    const int dist = static_cast<int>(_previous.cabins[pos].distance);
+                    dist_q2 = dist << 2;
+                    angle_q6 = (currentAngle_raw_q16 >> 10);
+
+                    syncBit = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < (angleInc_q16<<1)) ? 1 : 0;
+                    syncBit = (syncBit^ _lastNodeSyncBit)&syncBit;//Ensure that syncBit is exactly detected
+                    if (syncBit) {
+                        _scanNodeSynced = true;
+                    }
+
+                    currentAngle_raw_q16 += angleInc_q16;
+
+                    if (angle_q6 < 0) angle_q6 += (360 << 6);
+                    if (angle_q6 >= (360 << 6)) angle_q6 -= (360 << 6);
+
+
+                    sl_lidar_response_measurement_node_hq_t node;
+
+                    node.angle_z_q14 = sl_u16((angle_q6 << 8) / 90);
+                    node.flag = (syncBit | ((!syncBit) << 1));
+                    node.quality = dist_q2 ? (0x2f << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
+                    node.dist_mm_q2 = dist_q2;
+                    if(_scanNodeSynced)
+                        nodebuffer[nodeCount++] = node;
+                    _lastNodeSyncBit = syncBit;
+                }
+            }
+            else {
+                _scanNodeSynced = false;
+            }
+
+            _previous = dense_capsule;
+            _previousReady = true;
+        }
+
+    private:
+        // nothing is published before the first sync sample, the rotation before it is incomplete
+        bool    _scanNodeSynced;
+        int     _lastNodeSyncBit;
+    };
+
+    // SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: 32 cabins of three samples, predicted from their neighbours
+    class UltraCapsuleScanDecoder : public CapsuleScanDecoderBase<sl_lidar_response_ultra_capsule_measurement_nodes_t>
+    {
+    public:
+        enum {
+            MAX_NODES_PER_FRAME = 96,
+        };
+
+        void decode(const frame_t & capsule, sl_lidar_response_measurement_node_hq_t * nodebuffer, size_t & nodeCount)
+        {
+            nodeCount = 0;
+            if (_previousReady) {
+                int diffAngle_q8;
+                int currentStartAngle_q8 = ((capsule.start_angle_sync_q6 & 0x7FFF) << 2);
+                int prevStartAngle_q8 = ((_previous.start_angle_sync_q6 & 0x7FFF) << 2);
+
+                diffAngle_q8 = (currentStartAngle_q8)-(prevStartAngle_q8);
+                if (prevStartAngle_q8 > currentStartAngle_q8) {
+                    diffAngle_q8 += (360 << 8);
+                }
+
+                int angleInc_q16 = (diffAngle_q8 << 3) / 3;
+                int currentAngle_raw_q16 = (prevStartAngle_q8 << 8);
+                for (size_t pos = 0; pos < _countof(_previous.ultra_cabins); ++pos) {
+                    int dist_q2[3];
+                    int angle_q6[3];
+                    int syncBit[3];
+
+
+                    sl_u32 combined_x3 = _previous.ultra_cabins[pos].combined_x3;
+
+                    // unpack ...
+                    int dist_major = (combined_x3 & 0xFFF);
+
+                    // signed partical integer, using the magic shift here
+                    // DO NOT TOUCH
+
+                    int dist_predict1 = (((int)(combined_x3 << 10)) >> 22);
+                    int dist_predict2 = (((int)combined_x3) >> 22);
+
+                    int dist_major2;
+
+                    sl_u32 scalelvl1 = 0, scalelvl2 = 0;
+
+                    // prefetch next ...
+                    if (pos == _countof(_previous.ultra_cabins) - 1) {
+                        dist_major2 = (capsule.ultra_cabins[0].combined_x3 & 0xFFF);
+                    }
+                    else {
+                        dist_major2 = (_previous.ultra_cabins[pos + 1].combined_x3 & 0xFFF);
+                    }
+
+                    // decode with the var bit scale ...
+                    dist_major = _varbitscale_decode(dist_major, scalelvl1);
+                    dist_major2 = _varbitscale_decode(dist_major2, scalelvl2);
+
+
+                    int dist_base1 = dist_major;
+                    int dist_base2 = dist_major2;
+
+                    if ((!dist_major) && dist_major2) {
+                        dist_base1 = dist_major2;
+                        scalelvl1 = scalelvl2;
+                    }
+
+
+                    dist_q2[0] = (dist_major << 2);
+                    if ((dist_predict1 == (int)0xFFFFFE00) || (dist_predict1 == (int)0x1FF)) {
+                        dist_q2[1] = 0;
+                    }
+                    else {
+                        dist_predict1 = (dist_predict1 << scalelvl1);
+                        dist_q2[1] = (dist_predict1 + dist_base1) << 2;
+
+                    }
+
+                    if ((dist_predict2 == (int)0xFFFFFE00) || (dist_predict2 == (int)0x1FF)) {
+                        dist_q2[2] = 0;
+                    }
+                    else {
+                        dist_predict2 = (dist_predict2 << scalelvl2);
+                        dist_q2[2] = (dist_predict2 + dist_base2) << 2;
+                    }
+
+
+                    for (int cpos = 0; cpos < 3; ++cpos) {
+                        syncBit[cpos] = (((currentAngle_raw_q16 + angleInc_q16) % (360 << 16)) < angleInc_q16) ? 1 : 0;
+
+                        int offsetAngleMean_q16 = (int)(7.5 * 3.1415926535 * (1 << 16) / 180.0);
+
+                        if (dist_q2[cpos] >= (50 * 4))
+                        {
+                            const int k1 = 98361;
+                            const int k2 = int(k1 / dist_q2[cpos]);
+
+                            offsetAngleMean_q16 = (int)(8 * 3.1415926535 * (1 << 16) / 180) - (k2 << 6) - (k2 * k2 * k2) / 98304;
+                        }
+
+                        angle_q6[cpos] = ((currentAngle_raw_q16 - int(offsetAngleMean_q16 * 180 / 3.14159265)) >> 10);
+                        currentAngle_raw_q16 += angleInc_q16;
+
+                        if (angle_q6[cpos] < 0) angle_q6[cpos] += (360 << 6);
+                        if (angle_q6[cpos] >= (360 << 6)) angle_q6[cpos] -= (360 << 6);
+
+                        sl_lidar_response_measurement_node_hq_t node;
+
+                        node.flag = (syncBit[cpos] | ((!syncBit[cpos]) << 1));
+                        node.quality = dist_q2[cpos] ? (0x2F << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) : 0;
+                        node.angle_z_q14 = sl_u16((angle_q6[cpos] << 8) / 90);
+                        node.dist_mm_q2 = dist_q2[cpos];
+
+                        nodebuffer[nodeCount++] = node;
+                    }
+
+                }
+            }
+
+            _previous = capsule;
+            _previousReady = true;
+        }
+    };
+
+    // Decodes every complete frame in the window and hands the samples to sink.onScanNodes in batches, returns the
+    // number of frames. A frame cut off at the end of the window stays there for the next call
+    template <class TDecoder, class TSink>
+    sl_u64 decodeScanFrames(TDecoder & decoder, ScanRxWindow & window, ScanDecodeStats & stats, TSink & sink)
+    {
+        sl_lidar_response_measurement_node_hq_t nodes[256];
+        size_t count = 0;
+        typename TDecoder::frame_t frame;
+        sl_u64 frames = 0;
+
+        while (decoder.take(window, frame, stats)) {
+            ++stats.packets_received;
+            ++frames;
+
+            size_t decoded = 0;
+            decoder.decode(frame, nodes + count, decoded);
+            size_t zeroDistance = 0;
+            for (size_t pos = count; pos < count + decoded; ++pos) {
+                if (!nodes[pos].dist_mm_q2) ++zeroDistance;
+            }
+            stats.nodes_decoded += decoded;
+            if (zeroDistance) stats.zero_distance_nodes += zeroDistance;
+            count += decoded;
+            if (count + TDecoder::MAX_NODES_PER_FRAME > _countof(nodes)) {
+                sink.onScanNodes(nodes, count);
+                count = 0;
+            }
+        }
+        if (count) sink.onScanNodes(nodes, count);
+        return frames;
+    }
+
+    // decodeScanFrames, traced as a "decode" event counting the frames and covering their hand off to the sink.
+    // Tracing is looked at once per window rather than per frame, a window without a whole frame leaves no event
+    template <class TDecoder, class TSink>
+    void decodeScanWindow(TDecoder & decoder, ScanRxWindow & window, ScanDecodeStats & stats, TSink & sink)
+    {
+#if SL_TRACE_COMPILED
+        if (SL_TRACE_UNLIKELY(isTraceEnabled())) {
+            TraceScope trace("decode");
+            sl_u64 frames = decodeScanFrames(decoder, window, stats, sink);
+            if (frames) trace.setArg(frames);
+            else trace.discard();
+            return;
+        }
+#endif
+        decodeScanFrames(decoder, window, stats, sink);
+    }
+
+    // The acquisition loop: reads the channel and decodes until sink.isScanning() turns false.
+    // Waits at most timeout for the rest of a frame, a stream silent for longer is counted against the decoder
+    template <class TDecoder, class TChannel, class TSink>
+    void decodeScanStream(TDecoder & decoder, TChannel & channel, ScanRxWindow & window, ScanDecodeStats & stats, TSink & sink, sl_u32 timeout)
+    {
+        const size_t frameSize = sizeof(typename TDecoder::frame_t);
+
+        while (sink.isScanning()) {
+            decodeScanWindow(decoder, window, stats, sink);
+
+            size_t needed = window.available() < frameSize ? frameSize - window.available() : 1;
+            if (!window.fill(channel, needed, timeout, stats)) {
+                decoder.onTimeout(window, stats);
+            }
+        }
+    }
+}
@@ -99,6 +99,11 @@ namespace sl {
            
         }
 
+        int getPollFd()
+        {
+            return _closePending ? -1 : _rxtxSerial->getPollFd();
+        }
+
         void setDTR(bool dtr)
         {
             dtr ? _rxtxSerial->setDTR() : _rxtxSerial->clearDTR();
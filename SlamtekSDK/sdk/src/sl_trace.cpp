@@ -0,0 +1,276 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+#include "sl_trace.h"
+#include <new>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+namespace sl {
+
+    namespace internal {
+        std::atomic<bool> traceEnabled(false);
+    }
+
+    namespace {
+        // written with relaxed stores so that a reader copying a slot the writer is reusing races on atomics only
+        struct TraceSlot
+        {
+            std::atomic<const char *> name;
+            std::atomic<sl_u64> beginUs;
+            std::atomic<sl_u64> endUs;
+            std::atomic<sl_u64> arg;
+        };
+
+        struct TraceEvent
+        {
+            const char * name;
+            sl_u64 beginUs;
+            sl_u64 endUs;
+            sl_u64 arg;
+        };
+
+        // Written by its own thread only. writing is announced before a slot is filled and published is
+        // bumped once it is, so a reader tells the slots that may have changed while it copied them
+        struct TraceRing
+        {
+            explicit TraceRing(size_t tid)
+                : tid(tid)
+                , writing(0)
+                , published(0)
+                , clearedAt(0)
+                , retired(false)
+            {}
+
+            const size_t tid;
+            std::unique_ptr<TraceSlot[]> slots;
+            std::atomic<sl_u64> writing;
+            std::atomic<sl_u64> published;
+            // events before it were cleared
+            std::atomic<sl_u64> clearedAt;
+            // the thread has exited, the ring goes with the next clearTrace
+            std::atomic<bool> retired;
+            // guarded by the registry lock
+            std::string name;
+        };
+
+        struct TraceRegistry
+        {
+            TraceRegistry() : nextTid(1) {}
+
+            rp::hal::Locker lock;
+            std::vector<std::shared_ptr<TraceRing> > rings;
+            size_t nextTid;
+        };
+
+        // never destroyed, threads may still record while static destructors run
+        TraceRegistry & traceRegistry()
+        {
+            static TraceRegistry * registry = new TraceRegistry();
+            return *registry;
+        }
+
+        struct ThreadTrace
+        {
+            ThreadTrace() : failed(false) {}
+
+            ~ThreadTrace()
+            {
+                if (ring) ring->retired = true;
+            }
+
+            std::shared_ptr<TraceRing> ring;
+            std::string name;
+            // allocating the ring failed, this thread records nothing
+            bool failed;
+        };
+
+        thread_local ThreadTrace threadTrace;
+
+        TraceRing * threadRing()
+        {
+            if (threadTrace.ring) return threadTrace.ring.get();
+            if (threadTrace.failed) return NULL;
+
+            TraceRegistry & registry = traceRegistry();
+            rp::hal::AutoLocker l(registry.lock);
+            std::shared_ptr<TraceRing> ring(new (std::nothrow) TraceRing(registry.nextTid));
+            if (ring) ring->slots.reset(new (std::nothrow) TraceSlot[SL_TRACE_RING_EVENTS]);
+            if (!ring || !ring->slots) {
+                threadTrace.failed = true;
+                return NULL;
+            }
+            ++registry.nextTid;
+            ring->name = threadTrace.name;
+            registry.rings.push_back(ring);
+            threadTrace.ring = ring;
+            return ring.get();
+        }
+
+        // the events of a ring still intact after copying them
+        void copyRing(TraceRing & ring, std::vector<TraceEvent> & events)
+        {
+            sl_u64 end = ring.published.load(std::memory_order_acquire);
+            sl_u64 begin = end > SL_TRACE_RING_EVENTS ? end - SL_TRACE_RING_EVENTS : 0;
+            begin = std::max(begin, ring.clearedAt.load(std::memory_order_relaxed));
+
+            std::vector<TraceEvent> copied;
+            copied.reserve((size_t)(end > begin ? end - begin : 0));
+            for (sl_u64 pos = begin; pos < end; ++pos) {
+                const TraceSlot & slot = ring.slots[pos % SL_TRACE_RING_EVENTS];
+                TraceEvent event;
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.beginUs = slot.beginUs.load(std::memory_order_relaxed);
+                event.endUs = slot.endUs.load(std::memory_order_relaxed);
+                event.arg = slot.arg.load(std::memory_order_relaxed);
+                copied.push_back(event);
+            }
+
+            // slots at or below what the writer announced since then may have been reused under us
+            std::atomic_thread_fence(std::memory_order_acquire);
+            sl_u64 writing = ring.writing.load(std::memory_order_relaxed);
+            sl_u64 intactFrom = writing + 1 > SL_TRACE_RING_EVENTS ? writing + 1 - SL_TRACE_RING_EVENTS : 0;
+            for (size_t pos = 0; pos < copied.size(); ++pos) {
+                if (begin + pos >= intactFrom) events.push_back(copied[pos]);
+            }
+        }
+
+        void appendJsonString(std::string & out, const char * text)
+        {
+            out += '"';
+            for (; *text; ++text) {
+                if (*text == '"' || *text == '\\') out += '\\';
+                if ((unsigned char)*text < 0x20) continue;
+                out += *text;
+            }
+            out += '"';
+        }
+    }
+
+    namespace internal {
+        void traceRecord(const char * name, sl_u64 beginUs, sl_u64 endUs, sl_u64 arg)
+        {
+            TraceRing * ring = threadRing();
+            if (!ring) return;
+
+            sl_u64 pos = ring->published.load(std::memory_order_relaxed);
+            ring->writing.store(pos, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            TraceSlot & slot = ring->slots[pos % SL_TRACE_RING_EVENTS];
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.beginUs.store(beginUs, std::memory_order_relaxed);
+            slot.endUs.store(endUs, std::memory_order_relaxed);
+            slot.arg.store(arg, std::memory_order_relaxed);
+
+            ring->published.store(pos + 1, std::memory_order_release);
+        }
+    }
+
+    void setTraceEnabled(bool enabled)
+    {
+        internal::traceEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    void setTraceThreadName(const char * name)
+    {
+        threadTrace.name = name ? name : "";
+        if (threadTrace.ring) {
+            rp::hal::AutoLocker l(traceRegistry().lock);
+            threadTrace.ring->name = threadTrace.name;
+        }
+    }
+
+    std::string exportChromeTrace()
+    {
+        TraceRegistry & registry = traceRegistry();
+        std::vector<std::shared_ptr<TraceRing> > rings;
+        std::vector<std::string> names;
+        {
+            rp::hal::AutoLocker l(registry.lock);
+            rings = registry.rings;
+            for (size_t pos = 0; pos < rings.size(); ++pos) names.push_back(rings[pos]->name);
+        }
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        char number[128];
+        for (size_t pos = 0; pos < rings.size(); ++pos) {
+            TraceRing & ring = *rings[pos];
+
+            if (!names[pos].empty()) {
+                if (!first) out += ',';
+                first = false;
+                snprintf(number, sizeof(number), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", (unsigned)ring.tid);
+                out += number;
+                appendJsonString(out, names[pos].c_str());
+                out += "}}";
+            }
+
+            std::vector<TraceEvent> events;
+            copyRing(ring, events);
+            for (size_t idx = 0; idx < events.size(); ++idx) {
+                const TraceEvent & event = events[idx];
+                if (!first) out += ',';
+                first = false;
+                out += "{\"ph\":\"X\",\"cat\":\"rplidar\",\"name\":";
+                appendJsonString(out, event.name);
+                snprintf(number, sizeof(number), ",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,\"args\":{\"count\":%llu}}",
+                    (unsigned)ring.tid, (unsigned long long)event.beginUs,
+                    (unsigned long long)(event.endUs > event.beginUs ? event.endUs - event.beginUs : 0), (unsigned long long)event.arg);
+                out += number;
+            }
+        }
+        out += "]}";
+        return out;
+    }
+
+    void clearTrace()
+    {
+        TraceRegistry & registry = traceRegistry();
+        rp::hal::AutoLocker l(registry.lock);
+
+        std::vector<std::shared_ptr<TraceRing> > kept;
+        for (size_t pos = 0; pos < registry.rings.size(); ++pos) {
+            TraceRing & ring = *registry.rings[pos];
+            if (ring.retired) continue;
+            ring.clearedAt.store(ring.published.load(std::memory_order_acquire), std::memory_order_relaxed);
+            kept.push_back(registry.rings[pos]);
+        }
+        registry.rings.swap(kept);
+    }
+
+}
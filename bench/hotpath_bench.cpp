@@ -0,0 +1,703 @@
+/*
+ * Microbenchmarks of the scan hot paths: decoding the stream of every answer type, the HQ capsule CRC, sorting a
+ * rotation, the conversions to Lidar::lidar_sample and Lidar::point, and the whole of Lidar::get_scan_as_xy against
+ * the emulator. Timing follows Google Benchmark: a case runs for a growing number of iterations until it lasts
+ * --min-time, and --json writes the results in its format so that its compare.py and other tooling can read them.
+ *
+ * Every deterministic stage is also checked bit for bit against fixtures/golden.txt, computed from the recorded
+ * streams in fixtures/. An optimisation that changes a single decoded sample fails the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sl_lidar.h"
+#include "sl_lidar_driver.h"
+#include "sl_lidar_emulator.h"
+#include "sl_scan_decoder.h"
+#include "sl_crc.h"
+#include "Lidar.h"
+
+using namespace sl;
+
+typedef sl_lidar_response_measurement_node_hq_t node_hq;
+
+void print_usage(int argc, const char * argv[])
+{
+    printf("Usage:\n"
+           " %s [--fixtures <dir>] [--filter <text>] [--min-time <seconds>] [--json <file>] [--update-golden] [--record]\n"
+           "  --fixtures       directory of the recorded streams and golden.txt (default fixtures)\n"
+           "  --filter         only run the cases whose name contains text\n"
+           "  --min-time       seconds each case runs for at least (default 0.2)\n"
+           "  --json           also write the results to file in the Google Benchmark format\n"
+           "  --update-golden  write the outputs of this build to golden.txt instead of checking them\n"
+           "  --record         record new streams from the emulator first, implies --update-golden\n"
+           , argv[0]);
+}
+
+// Keeps the compiler from dropping a computation whose result is not used
+template <class T>
+static inline void keep(const T & value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static double process_cpu_seconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// What a case sees of its run, as benchmark::State
+class BenchState
+{
+public:
+    explicit BenchState(sl_u64 iterations) : _iterations(iterations), _real(0), _cpu(0), _items(0), _bytes(0), _skipped(false) {}
+
+    sl_u64 iterations() const { return _iterations; }
+
+    // Only the time between resume and pause counts
+    void resume()
+    {
+        _realStart = std::chrono::steady_clock::now();
+        _cpuStart = process_cpu_seconds();
+    }
+
+    void pause()
+    {
+        _real += std::chrono::duration<double>(std::chrono::steady_clock::now() - _realStart).count();
+        _cpu += process_cpu_seconds() - _cpuStart;
+    }
+
+    // For a case that cannot run here, it is left out of the results
+    void skip(const char * reason)
+    {
+        fprintf(stderr, "Skipping, %s\n", reason);
+        _skipped = true;
+    }
+
+    void addItems(sl_u64 items) { _items += items; }
+    void addBytes(sl_u64 bytes) { _bytes += bytes; }
+
+    double realSeconds() const { return _real; }
+    double cpuSeconds() const { return _cpu; }
+    sl_u64 items() const { return _items; }
+    sl_u64 bytes() const { return _bytes; }
+    bool skipped() const { return _skipped; }
+
+private:
+    sl_u64 _iterations;
+    std::chrono::steady_clock::time_point _realStart;
+    double _cpuStart;
+    double _real;
+    double _cpu;
+    sl_u64 _items;
+    sl_u64 _bytes;
+    bool _skipped;
+};
+
+// A case times its own loop, so that it can leave setup out with pause and resume
+typedef std::function<void(BenchState &)> BenchBody;
+
+struct BenchCase
+{
+    std::string name;
+    BenchBody body;
+};
+
+struct BenchResult
+{
+    std::string name;
+    sl_u64 iterations;
+    double real_ns;     // per iteration
+    double cpu_ns;
+    double items_per_second;
+    double bytes_per_second;
+};
+
+// False if the case skipped itself
+static bool run_case(const BenchCase & bench, double minTime, BenchResult & result)
+{
+    sl_u64 iterations = 1;
+    for (;;) {
+        BenchState state(iterations);
+        bench.body(state);
+        if (state.skipped()) return false;
+
+        const double seconds = state.realSeconds();
+        if (seconds >= minTime || iterations >= 1000000000ull) {
+            result.name = bench.name;
+            result.iterations = iterations;
+            result.real_ns = seconds * 1e9 / iterations;
+            result.cpu_ns = state.cpuSeconds() * 1e9 / iterations;
+            result.items_per_second = seconds > 0 ? state.items() / seconds : 0;
+            result.bytes_per_second = seconds > 0 ? state.bytes() / seconds : 0;
+            return true;
+        }
+
+        // Aim past minTime, growing at most tenfold so that a slow first iteration is not extrapolated too far
+        double multiplier = seconds > 0 ? minTime * 1.4 / seconds : 10.0;
+        multiplier = std::min(10.0, std::max(2.0, multiplier));
+        iterations = (sl_u64)(iterations * multiplier);
+    }
+}
+
+// FNV-1a, the golden outputs are kept as a count and a digest of the bytes
+class Digest
+{
+public:
+    Digest() : _value(0xcbf29ce484222325ull) {}
+
+    void add(const void * data, size_t size)
+    {
+        const sl_u8 * bytes = static_cast<const sl_u8 *>(data);
+        for (size_t pos = 0; pos < size; ++pos) {
+            _value = (_value ^ bytes[pos]) * 0x100000001b3ull;
+        }
+    }
+
+    template <class T>
+    void addValue(const T & value) { add(&value, sizeof(value)); }
+
+    sl_u64 value() const { return _value; }
+
+private:
+    sl_u64 _value;
+};
+
+struct GoldenOutput
+{
+    sl_u64 count;
+    sl_u64 digest;
+};
+
+typedef std::map<std::string, GoldenOutput> GoldenOutputs;
+
+static bool load_golden(const std::string & path, GoldenOutputs & golden)
+{
+    FILE * file = fopen(path.c_str(), "r");
+    if (!file) return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[128];
+        unsigned long long count, digest;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%127s %llu %llx", name, &count, &digest) == 3) {
+            GoldenOutput output = {count, digest};
+            golden[name] = output;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool save_golden(const std::string & path, const GoldenOutputs & golden)
+{
+    FILE * file = fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    fprintf(file, "# Outputs of the deterministic stages of hotpath_bench over the streams next to this file: name, count, FNV-1a digest\n");
+    for (GoldenOutputs::const_iterator it = golden.begin(); it != golden.end(); ++it) {
+        fprintf(file, "%s %llu %016llx\n", it->first.c_str(), (unsigned long long)it->second.count, (unsigned long long)it->second.digest);
+    }
+    return fclose(file) == 0;
+}
+
+// Plays recorded bytes back from memory, as in decode_bench
+class MemoryChannel final : public IChannel
+{
+public:
+    explicit MemoryChannel(const std::vector<sl_u8> & data) : _data(data), _pos(0), _drained(false) {}
+
+    bool open() { _pos = 0; _drained = false; return true; }
+    void close() {}
+    void flush() {}
+
+    bool waitForData(size_t size, sl_u32 timeoutInMs, size_t * actualReady)
+    {
+        size_t remaining = _data.size() - _pos;
+        if (actualReady) *actualReady = remaining;
+        _drained = remaining == 0;
+        return !_drained;
+    }
+
+    int write(const void * data, size_t size) { return (int)size; }
+
+    int read(void * buffer, size_t size)
+    {
+        size = std::min(size, _data.size() - _pos);
+        memcpy(buffer, &_data[_pos], size);
+        _pos += size;
+        return (int)size;
+    }
+
+    void clearReadCache() {}
+
+    bool drained() const { return _drained; }
+
+private:
+    const std::vector<sl_u8> & _data;
+    size_t _pos;
+    bool _drained;
+};
+
+// Writes the decoded samples into a buffer sized by a first pass, so that timed passes do not allocate
+struct BufferSink
+{
+    BufferSink(const MemoryChannel & channel, std::vector<node_hq> & nodes) : channel(channel), nodes(nodes), count(0) {}
+
+    bool isScanning() const { return !channel.drained(); }
+
+    void onScanNodes(const node_hq * decoded, size_t decodedCount)
+    {
+        if (count + decodedCount > nodes.size()) nodes.resize(std::max(nodes.size() * 2, count + decodedCount));
+        memcpy(&nodes[count], decoded, decodedCount * sizeof(node_hq));
+        count += decodedCount;
+    }
+
+    const MemoryChannel & channel;
+    std::vector<node_hq> & nodes;
+    size_t count;
+};
+
+template <class TDecoder>
+static size_t decode_with(const std::vector<sl_u8> & stream, std::vector<node_hq> & nodes)
+{
+    MemoryChannel channel(stream);
+    BufferSink sink(channel, nodes);
+    ScanRxWindow window;
+    ScanDecodeStats stats;
+    TDecoder decoder;
+    decodeScanStream(decoder, channel, window, stats, sink, 0);
+    return sink.count;
+}
+
+static size_t decode_stream(sl_u8 ansType, const std::vector<sl_u8> & stream, std::vector<node_hq> & nodes)
+{
+    switch (ansType) {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT:                 return decode_with<StandardScanDecoder>(stream, nodes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:        return decode_with<CapsuleScanDecoder>(stream, nodes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:  return decode_with<DenseCapsuleScanDecoder>(stream, nodes);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:              return decode_with<HqScanDecoder>(stream, nodes);
+    default:                                            return decode_with<UltraCapsuleScanDecoder>(stream, nodes);
+    }
+}
+
+// The bytes the lidar sent after the answer header of the first scan in a capture file, and the answer type of that scan
+static bool load_scan_stream(const std::string & path, std::vector<sl_u8> & stream, sl_u8 & ansType)
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    std::vector<sl_u8> received;
+    sl_u8 magic[8];
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, "SLCAP01", 8) == 0;
+
+    sl_u8 header[8 + 1 + 4];
+    while (valid && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        sl_u32 size = header[9] | (header[10] << 8) | (header[11] << 16) | ((sl_u32)header[12] << 24);
+        std::vector<sl_u8> payload(size);
+        if (fread(payload.data(), 1, size, file) != size) break;
+        if (header[8] == 0) received.insert(received.end(), payload.begin(), payload.end());
+    }
+    fclose(file);
+
+    for (size_t pos = 0; valid && pos + sizeof(sl_lidar_ans_header_t) < received.size(); ++pos) {
+        const sl_lidar_ans_header_t * answer = reinterpret_cast<const sl_lidar_ans_header_t *>(&received[pos]);
+        if (answer->syncByte1 != SL_LIDAR_ANS_SYNC_BYTE1 || answer->syncByte2 != SL_LIDAR_ANS_SYNC_BYTE2) continue;
+        if ((answer->size_q30_subtype >> SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT) != SL_LIDAR_ANS_PKTFLAG_LOOP) continue;
+
+        switch (answer->type) {
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+            ansType = answer->type;
+            stream.assign(received.begin() + pos + sizeof(sl_lidar_ans_header_t), received.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+// Records a few rotations of the emulator in one of its scan modes to a capture file
+static bool record_emulator_scan(sl_u16 scanMode, int rotations, const std::string & path)
+{
+    LidarEmulatorConfig config;
+    config.typical_scan_mode = scanMode;
+    config.rate_scale = 0;
+    Result<ILidarEmulator *> emulator = createLidarEmulator(config);
+    if (!emulator) return false;
+
+    Result<IChannel *> serial = createSerialPortChannel((*emulator)->getDevicePath(), config.baudrate);
+    Result<IChannel *> channel = serial ? createCaptureChannel(*serial, path) : Result<IChannel *>(SL_RESULT_OPERATION_FAIL);
+    Result<ILidarDriver *> drv = createLidarDriver();
+
+    bool recorded = false;
+    if (channel && drv && SL_IS_OK((*drv)->connect(*channel))) {
+        (*drv)->setMotorSpeed();
+        if (SL_IS_OK((*drv)->startScan(0, 1))) {
+            static node_hq nodes[8192];
+            recorded = true;
+            for (int rotation = 0; rotation < rotations && recorded; ++rotation) {
+                size_t count = _countof(nodes);
+                recorded = SL_IS_OK((*drv)->grabScanDataHq(nodes, count));
+            }
+            (*drv)->stop();
+        }
+        (*drv)->setMotorSpeed(0);
+    }
+
+    if (drv) delete *drv;
+    if (channel) delete *channel;
+    delete *emulator;
+    return recorded;
+}
+
+// A recorded stream and what it decodes to
+struct Fixture
+{
+    std::string mode;
+    sl_u8 ansType;
+    std::vector<sl_u8> stream;
+    std::vector<node_hq> nodes;
+    // The first complete rotation of nodes, as the driver hands it out
+    std::vector<node_hq> rotation;
+};
+
+static bool load_fixture(const std::string & dir, const std::string & mode, Fixture & fixture)
+{
+    fixture.mode = mode;
+    if (!load_scan_stream(dir + "/" + mode + ".slcap", fixture.stream, fixture.ansType)) return false;
+
+    fixture.nodes.resize(8192);
+    fixture.nodes.resize(decode_stream(fixture.ansType, fixture.stream, fixture.nodes));
+
+    std::vector<size_t> syncs;
+    for (size_t pos = 0; pos < fixture.nodes.size(); ++pos) {
+        if (fixture.nodes[pos].flag & SL_LIDAR_RESP_MEASUREMENT_SYNCBIT) syncs.push_back(pos);
+    }
+    if (syncs.size() < 2) return false;
+    fixture.rotation.assign(fixture.nodes.begin() + syncs[0], fixture.nodes.begin() + syncs[1]);
+    return true;
+}
+
+static GoldenOutput digest_nodes(const std::vector<node_hq> & nodes)
+{
+    Digest digest;
+    digest.add(nodes.data(), nodes.size() * sizeof(node_hq));
+    GoldenOutput output = {nodes.size(), digest.value()};
+    return output;
+}
+
+// The CRC the HQ decoder checks, over every whole capsule of the stream
+static void hq_capsule_crcs(const std::vector<sl_u8> & stream, std::vector<sl_u32> & crcs)
+{
+    const size_t capsuleSize = sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t);
+    crcs.clear();
+    for (size_t pos = 0; pos + capsuleSize <= stream.size(); pos += capsuleSize) {
+        crcs.push_back(crc32::getResult(const_cast<sl_u8 *>(&stream[pos]), (sl_u32)(capsuleSize - 4)));
+    }
+}
+
+static void add_fixture_cases(const Fixture & fixture, ILidarDriver * drv, std::vector<BenchCase> & cases, GoldenOutputs & outputs)
+{
+    const Fixture * f = &fixture;
+
+    outputs["decode/" + f->mode] = digest_nodes(f->nodes);
+    cases.push_back({"decode/" + f->mode, [f](BenchState & state) {
+        std::vector<node_hq> nodes(f->nodes.size());
+        state.resume();
+        for (sl_u64 i = 0; i < state.iterations(); ++i) {
+            keep(decode_stream(f->ansType, f->stream, nodes));
+        }
+        state.pause();
+        state.addBytes(f->stream.size() * state.iterations());
+        state.addItems(f->nodes.size() * state.iterations());
+    }});
+
+    std::vector<node_hq> sorted(f->rotation);
+    drv->ascendScanData(sorted.data(), sorted.size());
+    outputs["ascend/" + f->mode] = digest_nodes(sorted);
+    cases.push_back({"ascend/" + f->mode, [f, drv](BenchState & state) {
+        std::vector<node_hq> nodes(f->rotation.size());
+        for (sl_u64 i = 0; i < state.iterations(); ++i) {
+            nodes = f->rotation;
+            state.resume();
+            drv->ascendScanData(nodes.data(), nodes.size());
+            keep(nodes.data());
+            state.pause();
+        }
+        state.addItems(f->rotation.size() * state.iterations());
+    }});
+
+    Digest samplesDigest;
+    Digest pointsDigest;
+    for (size_t pos = 0; pos < sorted.size(); ++pos) {
+        // Field by field, the padding of the structs is not part of the output
+        Lidar::lidar_sample sample(sorted[pos]);
+        samplesDigest.addValue(sample.angle);
+        samplesDigest.addValue(sample.distance);
+        samplesDigest.addValue(sample.quality);
+        Lidar::point point(sorted[pos]);
+        pointsDigest.addValue(point.x);
+        pointsDigest.addValue(point.y);
+        pointsDigest.addValue(point.quality);
+    }
+    GoldenOutput samplesOutput = {sorted.size(), samplesDigest.value()};
+    GoldenOutput pointsOutput = {sorted.size(), pointsDigest.value()};
+    outputs["lidar_sample/" + f->mode] = samplesOutput;
+    outputs["point/" + f->mode] = pointsOutput;
+
+    cases.push_back({"lidar_sample/" + f->mode, [sorted](BenchState & state) {
+        std::vector<node_hq> nodes(sorted);
+        std::vector<Lidar::lidar_sample> samples(nodes.size());
+        state.resume();
+        for (sl_u64 i = 0; i < state.iterations(); ++i) {
+            for (size_t pos = 0; pos < nodes.size(); ++pos) samples[pos] = Lidar::lidar_sample(nodes[pos]);
+            keep(samples.data());
+        }
+        state.pause();
+        state.addItems(nodes.size() * state.iterations());
+    }});
+    cases.push_back({"point/" + f->mode, [sorted](BenchState & state) {
+        std::vector<node_hq> nodes(sorted);
+        std::vector<Lidar::point> points(nodes.size());
+        state.resume();
+        for (sl_u64 i = 0; i < state.iterations(); ++i) {
+            for (size_t pos = 0; pos < nodes.size(); ++pos) points[pos] = Lidar::point(nodes[pos]);
+            keep(points.data());
+        }
+        state.pause();
+        state.addItems(nodes.size() * state.iterations());
+    }});
+
+    if (f->ansType == SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ) {
+        std::vector<sl_u32> crcs;
+        hq_capsule_crcs(f->stream, crcs);
+        Digest digest;
+        digest.add(crcs.data(), crcs.size() * sizeof(sl_u32));
+        GoldenOutput output = {crcs.size(), digest.value()};
+        outputs["crc32/" + f->mode] = output;
+
+        const size_t capsules = crcs.size();
+        cases.push_back({"crc32/" + f->mode, [f, capsules](BenchState & state) {
+            std::vector<sl_u32> crcs;
+            crcs.reserve(capsules);
+            state.resume();
+            for (sl_u64 i = 0; i < state.iterations(); ++i) {
+                hq_capsule_crcs(f->stream, crcs);
+                keep(crcs.data());
+            }
+            state.pause();
+            state.addBytes(capsules * sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t) * state.iterations());
+            state.addItems(capsules * state.iterations());
+        }});
+    }
+}
+
+// The whole path of RPLidar.get_scanline_xy: acquisition thread, grab, sort, convert, against an emulator streaming as fast as it is read
+static void bench_get_scan_as_xy(BenchState & state)
+{
+    LidarEmulatorConfig config;
+    config.rate_scale = 0;
+    Result<ILidarEmulator *> emulator = createLidarEmulator(config);
+    if (!emulator) {
+        state.skip("the emulator is not available here");
+        return;
+    }
+
+    {
+        Lidar lidar((*emulator)->getDevicePath(), config.baudrate);
+        lidar.start_motor();
+        // The first rotation includes starting the scan
+        ScanPool::release(lidar.get_scan_as_xy().first);
+
+        state.resume();
+        for (sl_u64 i = 0; i < state.iterations(); ++i) {
+            std::pair<Lidar::point *, size_t> scan = lidar.get_scan_as_xy();
+            ScanPool::release(scan.first);
+            state.addItems(scan.second);
+        }
+        state.pause();
+        lidar.stop_motor();
+    }
+    delete *emulator;
+}
+
+static std::string json_escape(const std::string & text)
+{
+    std::string escaped;
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        if (text[pos] == '"' || text[pos] == '\\') escaped += '\\';
+        escaped += text[pos];
+    }
+    return escaped;
+}
+
+static bool write_json(const std::string & path, const char * executable, const std::vector<BenchResult> & results)
+{
+    FILE * file = fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    char date[64];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    fprintf(file, "{\n  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", date);
+    fprintf(file, "    \"executable\": \"%s\",\n", json_escape(executable).c_str());
+    fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+    fprintf(file, "    \"library_build_type\": \"release\",\n");
+#else
+    fprintf(file, "    \"library_build_type\": \"debug\",\n");
+#endif
+    fprintf(file, "    \"sdk_version\": \"%d.%d.%d\"\n  },\n", SL_LIDAR_SDK_VERSION_MAJOR, SL_LIDAR_SDK_VERSION_MINOR, SL_LIDAR_SDK_VERSION_PATCH);
+    fprintf(file, "  \"benchmarks\": [");
+    for (size_t pos = 0; pos < results.size(); ++pos) {
+        const BenchResult & result = results[pos];
+        fprintf(file, "%s\n    {\n", pos ? "," : "");
+        fprintf(file, "      \"name\": \"%s\",\n", json_escape(result.name).c_str());
+        fprintf(file, "      \"run_name\": \"%s\",\n", json_escape(result.name).c_str());
+        fprintf(file, "      \"run_type\": \"iteration\",\n");
+        fprintf(file, "      \"iterations\": %llu,\n", (unsigned long long)result.iterations);
+        fprintf(file, "      \"real_time\": %.3f,\n", result.real_ns);
+        fprintf(file, "      \"cpu_time\": %.3f,\n", result.cpu_ns);
+        fprintf(file, "      \"time_unit\": \"ns\",\n");
+        fprintf(file, "      \"bytes_per_second\": %.1f,\n", result.bytes_per_second);
+        fprintf(file, "      \"items_per_second\": %.1f\n", result.items_per_second);
+        fprintf(file, "    }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, const char * argv[]) {
+    std::string opt_fixtures = "fixtures";
+    std::string opt_filter;
+    const char * opt_json = NULL;
+    double opt_min_time = 0.2;
+    bool opt_update_golden = false;
+    bool opt_record = false;
+
+    for (int pos = 1; pos < argc; ++pos) {
+        bool hasValue = pos + 1 < argc;
+        if (strcmp(argv[pos], "--fixtures") == 0 && hasValue) {
+            opt_fixtures = argv[++pos];
+        }
+        else if (strcmp(argv[pos], "--filter") == 0 && hasValue) {
+            opt_filter = argv[++pos];
+        }
+        else if (strcmp(argv[pos], "--min-time") == 0 && hasValue) {
+            opt_min_time = atof(argv[++pos]);
+        }
+        else if (strcmp(argv[pos], "--json") == 0 && hasValue) {
+            opt_json = argv[++pos];
+        }
+        else if (strcmp(argv[pos], "--update-golden") == 0) {
+            opt_update_golden = true;
+        }
+        else if (strcmp(argv[pos], "--record") == 0) {
+            opt_record = opt_update_golden = true;
+        }
+        else {
+            print_usage(argc, argv);
+            return -1;
+        }
+    }
+
+    LidarEmulatorConfig config;
+    if (opt_record) {
+        for (sl_u16 mode = 0; mode < config.scan_modes.size(); ++mode) {
+            std::string path = opt_fixtures + "/" + config.scan_modes[mode].name + ".slcap";
+            if (!record_emulator_scan(mode, 3, path)) {
+                fprintf(stderr, "Error, cannot record scan mode %s of the emulator\n", config.scan_modes[mode].name.c_str());
+                return -2;
+            }
+        }
+    }
+
+    Result<ILidarDriver *> drv = createLidarDriver();
+    if (!drv) {
+        fprintf(stderr, "Error, cannot create a driver\n");
+        return -2;
+    }
+
+    // Loaded up front so that the cases can refer to them
+    std::vector<Fixture> fixtures(config.scan_modes.size());
+    std::vector<BenchCase> cases;
+    GoldenOutputs outputs;
+    for (size_t mode = 0; mode < config.scan_modes.size(); ++mode) {
+        if (!load_fixture(opt_fixtures, config.scan_modes[mode].name, fixtures[mode])) {
+            fprintf(stderr, "Error, no complete rotation in %s/%s.slcap\n", opt_fixtures.c_str(), config.scan_modes[mode].name.c_str());
+            return -3;
+        }
+        add_fixture_cases(fixtures[mode], *drv, cases, outputs);
+    }
+    cases.push_back({"get_scan_as_xy/emulator", bench_get_scan_as_xy});
+
+    int status = 0;
+    const std::string goldenPath = opt_fixtures + "/golden.txt";
+    if (opt_update_golden) {
+        if (!save_golden(goldenPath, outputs)) {
+            fprintf(stderr, "Error, cannot write %s\n", goldenPath.c_str());
+            return -4;
+        }
+        printf("Wrote %u golden outputs to %s\n", (unsigned)outputs.size(), goldenPath.c_str());
+    }
+    else {
+        GoldenOutputs golden;
+        if (!load_golden(goldenPath, golden)) {
+            fprintf(stderr, "Error, cannot read %s\n", goldenPath.c_str());
+            return -4;
+        }
+        for (GoldenOutputs::const_iterator it = outputs.begin(); it != outputs.end(); ++it) {
+            GoldenOutputs::const_iterator expected = golden.find(it->first);
+            if (expected == golden.end()) {
+                fprintf(stderr, "MISMATCH %s: no golden output, run with --update-golden\n", it->first.c_str());
+                status = 1;
+            }
+            else if (expected->second.count != it->second.count || expected->second.digest != it->second.digest) {
+                fprintf(stderr, "MISMATCH %s: %llu outputs with digest %016llx, expected %llu with %016llx\n", it->first.c_str(),
+                        (unsigned long long)it->second.count, (unsigned long long)it->second.digest,
+                        (unsigned long long)expected->second.count, (unsigned long long)expected->second.digest);
+                status = 1;
+            }
+        }
+        printf("%s %u golden outputs\n", status ? "Differences from" : "Bit for bit identical to", (unsigned)outputs.size());
+    }
+
+    std::vector<BenchResult> results;
+    printf("%-28s %14s %14s %12s %14s %14s\n", "Benchmark", "Time", "CPU", "Iterations", "items/s", "bytes/s");
+    for (size_t pos = 0; pos < cases.size(); ++pos) {
+        if (cases[pos].name.find(opt_filter) == std::string::npos) continue;
+
+        BenchResult result;
+        if (!run_case(cases[pos], opt_min_time, result)) continue;
+        printf("%-28s %11.0f ns %11.0f ns %12llu %14.4g %14.4g\n", result.name.c_str(), result.real_ns, result.cpu_ns,
+               (unsigned long long)result.iterations, result.items_per_second, result.bytes_per_second);
+        results.push_back(result);
+    }
+
+    if (opt_json && !write_json(opt_json, argv[0], results)) {
+        fprintf(stderr, "Error, cannot write %s\n", opt_json);
+        status = -4;
+    }
+
+    delete *drv;
+    return status;
+}
@@ -0,0 +1,159 @@
+"""End-to-end throughput of the Python bindings against LidarEmulator, no hardware needed.
+
+Each read API is driven at sample rates from 2k to 64k samples/s, and with "max" as fast as the emulator
+is read. For every run it reports:
+  - scans/s and samples/s delivered to Python
+  - p50/p99/max delivery latency, the age of a scan when the call returns it (RPLidar.latency_stats)
+  - CPU time per scan of the whole process, acquisition thread included
+  - Python heap blocks and bytes each scan holds on to, measured with tracemalloc
+
+    python bench/throughput.py [--duration 3] [--rates 2000,32000,max] [--apis get_scanline] [--json out.json]
+"""
+
+import argparse
+import json
+import platform
+import sys
+import time
+import tracemalloc
+
+import numpy
+
+from FastPyRpLidar import LidarEmulator, RPLidar
+
+BAUD_RATE = 1000000
+SCAN_FREQUENCY = 10.0
+
+# Scan modes of LidarEmulator by id, with the samples/s they stream at a rate_scale of 1
+EMULATOR_MODES = [(0, 2000.0), (1, 4000.0), (2, 8000.0), (4, 16000.0), (3, 32000.0)]
+DENSEST_MODE = 3
+
+DEFAULT_RATES = "2000,4000,8000,16000,32000,64000,max"
+
+APIS = {
+    "get_scanline": lambda lidar: lidar.get_scanline(),
+    "get_scanline_xy": lambda lidar: lidar.get_scanline_xy(),
+    "get_scan": lambda lidar: lidar.get_scan(),
+}
+
+WARMUP_SCANS = 3
+ALLOCATION_SCANS = 20
+
+
+def emulator_settings(rate):
+    """The scan mode and rate_scale streaming rate samples/s, the densest mode and no pacing for "max"."""
+    if rate == "max":
+        return DENSEST_MODE, 0.0
+    rate = float(rate)
+    mode, native = EMULATOR_MODES[0]
+    for candidate, candidate_native in EMULATOR_MODES:
+        if candidate_native <= rate:
+            mode, native = candidate, candidate_native
+    return mode, rate / native
+
+
+def python_allocations(read):
+    """Heap blocks and bytes each scan keeps alive, for scans still referenced."""
+    tracemalloc.start()
+    try:
+        before = tracemalloc.take_snapshot()
+        scans = [read() for _ in range(ALLOCATION_SCANS)]
+        after = tracemalloc.take_snapshot()
+    finally:
+        tracemalloc.stop()
+    diff = after.compare_to(before, "filename")
+    blocks = sum(stat.count_diff for stat in diff)
+    size = sum(stat.size_diff for stat in diff)
+    del scans
+    return blocks / ALLOCATION_SCANS, size / ALLOCATION_SCANS
+
+
+def run(api, rate, duration):
+    mode, rate_scale = emulator_settings(rate)
+    emulator = LidarEmulator(scan_frequency=SCAN_FREQUENCY, rate_scale=rate_scale, typical_scan_mode=mode)
+    lidar = RPLidar(emulator.port, BAUD_RATE)
+    read = APIS[api]
+    lidar.start_motor()
+    try:
+        for _ in range(WARMUP_SCANS):
+            read(lidar)
+        lidar.latency_stats()
+
+        scans = 0
+        samples = 0
+        wall_start = time.perf_counter()
+        cpu_start = time.process_time()
+        while time.perf_counter() - wall_start < duration:
+            samples += len(read(lidar))
+            scans += 1
+        cpu = time.process_time() - cpu_start
+        wall = time.perf_counter() - wall_start
+        delivery = lidar.latency_stats()["delivery"]
+
+        blocks, size = python_allocations(lambda: read(lidar))
+    finally:
+        lidar.stop_motor()
+        # The lidar goes before the emulator it talks to
+        del lidar
+        del emulator
+
+    return {
+        "api": api,
+        "sample_rate": rate if rate == "max" else float(rate),
+        "scan_mode": mode,
+        "rate_scale": rate_scale,
+        "scans": scans,
+        "scans_per_second": scans / wall,
+        "samples_per_second": samples / wall,
+        "samples_per_scan": samples / scans if scans else 0.0,
+        "delivery_p50_ms": delivery["p50"] * 1e3,
+        "delivery_p99_ms": delivery["p99"] * 1e3,
+        "delivery_max_ms": delivery["max"] * 1e3,
+        "cpu_ms_per_scan": cpu * 1e3 / scans if scans else 0.0,
+        "python_blocks_per_scan": blocks,
+        "python_bytes_per_scan": size,
+    }
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="End-to-end throughput of the Python bindings against LidarEmulator")
+    parser.add_argument("--duration", type=float, default=3.0, help="seconds each run reads scans for")
+    parser.add_argument("--rates", default=DEFAULT_RATES, help="comma separated samples/s, or max for unpaced")
+    parser.add_argument("--apis", default=",".join(APIS), help="comma separated read methods of RPLidar")
+    parser.add_argument("--json", help="also write the results to this file")
+    args = parser.parse_args(argv)
+
+    apis = args.apis.split(",")
+    for api in apis:
+        if api not in APIS:
+            parser.error("unknown api %s, choose from %s" % (api, ", ".join(APIS)))
+
+    header = "%-16s %8s %9s %11s %9s %9s %9s %10s %9s %10s" % (
+        "api", "rate", "scans/s", "samples/s", "p50 ms", "p99 ms", "max ms", "cpu ms", "py blk", "py bytes")
+    print(header)
+    results = []
+    for rate in args.rates.split(","):
+        for api in apis:
+            result = run(api, rate, args.duration)
+            results.append(result)
+            print("%-16s %8s %9.1f %11.0f %9.2f %9.2f %9.2f %10.3f %9.1f %10.0f" % (
+                api, rate, result["scans_per_second"], result["samples_per_second"], result["delivery_p50_ms"],
+                result["delivery_p99_ms"], result["delivery_max_ms"], result["cpu_ms_per_scan"],
+                result["python_blocks_per_scan"], result["python_bytes_per_scan"]))
+            sys.stdout.flush()
+
+    if args.json:
+        context = {
+            "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+            "python": platform.python_version(),
+            "numpy": numpy.__version__,
+            "platform": platform.platform(),
+            "duration": args.duration,
+        }
+        with open(args.json, "w") as f:
+            json.dump({"context": context, "results": results}, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,186 @@
+#include <algorithm> //std::fill
+#include <cmath>     //std::floor, std::isfinite
+#include <cstdint>   //std::uint64_t
+#include <limits>    //std::numeric_limits
+#include <stdexcept> //std::invalid_argument
+
+#include "AngularGrid.h"
+
+namespace
+{
+    constexpr float NO_RETURN = std::numeric_limits<float>::quiet_NaN();
+
+    // A q14 angle times the bin count puts the bin centres 1 << 16 apart
+    constexpr unsigned BIN_SHIFT = 16;
+    constexpr std::uint64_t BIN_STEP = (std::uint64_t)1 << BIN_SHIFT;
+
+    std::uint64_t grid_position(const sl_lidar_response_measurement_node_hq_t &node, std::size_t bins)
+    {
+        return (std::uint64_t)node.angle_z_q14 * bins;
+    }
+
+    // The bin centre closest to a position, not yet taken around the turn
+    std::uint64_t nearest_centre(std::uint64_t position)
+    {
+        return (position + BIN_STEP / 2) >> BIN_SHIFT;
+    }
+
+    float meters(const sl_lidar_response_measurement_node_hq_t &node)
+    {
+        return node.dist_mm_q2 / 1000.f / (1 << 2);
+    }
+}
+
+AngularGrid::AngularGrid(std::size_t bins, policy_id policy)
+    : m_bins(bins), m_policy(policy)
+{
+    if (bins == 0)
+    {
+        throw std::invalid_argument("An angular grid needs at least one bin");
+    }
+    if (policy != NEAREST && policy != MIN_RANGE && policy != INTERPOLATE)
+    {
+        throw std::invalid_argument("Unknown resampling policy");
+    }
+    m_ranges.assign(bins, NO_RETURN);
+}
+
+std::size_t AngularGrid::bins() const
+{
+    return m_bins;
+}
+
+AngularGrid::policy_id AngularGrid::policy() const
+{
+    return m_policy;
+}
+
+std::size_t AngularGrid::index_of(double degrees) const
+{
+    if (!std::isfinite(degrees))
+    {
+        throw std::invalid_argument("An angle must be finite");
+    }
+    double turns = degrees / 360.0;
+    turns -= std::floor(turns);
+    return (std::size_t)(turns * m_bins + 0.5) % m_bins;
+}
+
+double AngularGrid::angle_of(std::size_t index) const
+{
+    return index * 360.0 / m_bins;
+}
+
+void AngularGrid::resample(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const
+{
+    std::fill(ranges, ranges + m_bins, NO_RETURN);
+    switch (m_policy)
+    {
+    case NEAREST:
+        resample_nearest(nodes, count, ranges);
+        break;
+    case MIN_RANGE:
+        resample_min_range(nodes, count, ranges);
+        break;
+    case INTERPOLATE:
+        resample_interpolate(nodes, count, ranges);
+        break;
+    }
+}
+
+void AngularGrid::resample(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count)
+{
+    resample(nodes, count, m_ranges.data());
+}
+
+float *AngularGrid::ranges()
+{
+    return m_ranges.data();
+}
+
+float AngularGrid::distance_at(double degrees) const
+{
+    return m_ranges[index_of(degrees)];
+}
+
+void AngularGrid::resample_nearest(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const
+{
+    // Sorted samples visit the bins in order, except that the last few may wrap around into bin 0,
+    // so only the best offset of the current bin and of bin 0 need keeping
+    const std::uint64_t NONE = std::numeric_limits<std::uint64_t>::max();
+    std::size_t current = m_bins;
+    std::uint64_t current_offset = NONE;
+    std::uint64_t first_offset = NONE;
+
+    for (std::size_t pos = 0; pos < count; ++pos)
+    {
+        if (nodes[pos].dist_mm_q2 == 0)
+        {
+            continue;
+        }
+
+        const std::uint64_t position = grid_position(nodes[pos], m_bins);
+        const std::uint64_t centre = nearest_centre(position);
+        const std::uint64_t offset = position > (centre << BIN_SHIFT) ? position - (centre << BIN_SHIFT) : (centre << BIN_SHIFT) - position;
+        const std::size_t bin = centre % m_bins;
+
+        if (bin != current)
+        {
+            current = bin;
+            current_offset = bin == 0 ? first_offset : NONE;
+        }
+        if (offset < current_offset)
+        {
+            current_offset = offset;
+            first_offset = bin == 0 ? offset : first_offset;
+            ranges[bin] = meters(nodes[pos]);
+        }
+    }
+}
+
+void AngularGrid::resample_min_range(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const
+{
+    for (std::size_t pos = 0; pos < count; ++pos)
+    {
+        if (nodes[pos].dist_mm_q2 == 0)
+        {
+            continue;
+        }
+
+        float &range = ranges[nearest_centre(grid_position(nodes[pos], m_bins)) % m_bins];
+        const float distance = meters(nodes[pos]);
+        // NaN compares false, so an empty bin takes the first sample
+        if (!(range <= distance))
+        {
+            range = distance;
+        }
+    }
+}
+
+void AngularGrid::resample_interpolate(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const
+{
+    // Each pair of neighbouring samples fills the centres between them, the last pair closes the turn
+    for (std::size_t pos = 0; pos < count; ++pos)
+    {
+        const sl_lidar_response_measurement_node_hq_t &from = nodes[pos];
+        const sl_lidar_response_measurement_node_hq_t &to = nodes[pos + 1 < count ? pos + 1 : 0];
+        if (from.dist_mm_q2 == 0 || to.dist_mm_q2 == 0)
+        {
+            continue;
+        }
+
+        const std::uint64_t begin = grid_position(from, m_bins);
+        const std::uint64_t end = grid_position(to, m_bins) + (pos + 1 < count ? 0 : m_bins << BIN_SHIFT);
+        if (end <= begin)
+        {
+            continue;
+        }
+
+        const float from_range = meters(from);
+        const float slope = (meters(to) - from_range) / (float)(end - begin);
+        for (std::uint64_t centre = (begin + BIN_STEP - 1) >> BIN_SHIFT; (centre << BIN_SHIFT) <= end; ++centre)
+        {
+            ranges[centre % m_bins] = from_range + slope * (float)((centre << BIN_SHIFT) - begin);
+        }
+    }
+}
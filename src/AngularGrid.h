@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <vector>               //std::vector
+
+#include "sl_lidar_cmd.h"		//sl_lidar_response_measurement_node_hq_t
+
+/*
+ * Resamples rotations onto a fixed grid of bins evenly spaced around the turn, bin k centred on k * 360 / bins degrees,
+ * for consumers that want the same number of ranges every rotation. Ranges are float32 meters, NaN where there was no
+ * return. A sample falls in a bin by integer arithmetic on its q14 angle, so binning a rotation is a single pass over
+ * its samples and looking up the bin of an angle is O(1)
+ */
+class AngularGrid
+{
+public: //Classes and structs
+	// How the samples of a bin make its range
+	enum policy_id
+	{
+		NEAREST = 0,	// The valid sample closest in angle to the centre of the bin
+		MIN_RANGE = 1,	// The shortest valid sample in the bin, the conservative choice for obstacle avoidance
+		INTERPOLATE = 2	// Linear in angle between the valid samples either side of the centre, which fills bins narrower than the sample spacing.
+						// Bins next to a sample without return stay NaN
+	};
+
+public: //Ctor Dtor
+	// Throws std::invalid_argument for 0 bins
+	AngularGrid(std::size_t bins, policy_id policy);
+
+public: //Methods
+	std::size_t bins() const;
+
+	policy_id policy() const;
+
+	// The bin an angle in degrees falls in, any angle is taken around the turn
+	std::size_t index_of(double degrees) const;
+
+	// The angle in degrees of the centre of a bin
+	double angle_of(std::size_t index) const;
+
+	// Resamples a rotation in ascending angle order, as Lidar sorts it, into bins ranges
+	void resample(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const;
+
+	// The same into the grid's own buffer, which the next call overwrites
+	void resample(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count);
+
+	// The ranges of the last resample into the grid's own buffer, all NaN before the first
+	float *ranges();
+
+	// The range of the last resample at an angle in degrees
+	float distance_at(double degrees) const;
+
+private:
+	void resample_nearest(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const;
+	void resample_min_range(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const;
+	void resample_interpolate(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, float *ranges) const;
+
+private: //Member Variables
+	const std::size_t m_bins;
+	const policy_id m_policy;
+
+	std::vector<float> m_ranges;
+};
@@ -0,0 +1,141 @@
+#include <cstdio>    //std::snprintf, std::rename, std::remove
+#include <fstream>   //std::ifstream, std::ofstream
+#include <sstream>   //std::istringstream
+#include <vector>    //std::vector
+
+#include "CapabilityCache.h"
+
+namespace
+{
+    // Bumped whenever the layout below changes, older files are then ignored
+    constexpr const char *CACHE_HEADER = "FastPyRpLidar capabilities 1";
+
+    std::string cache_file_path(const std::string &cache_dir, const sl_lidar_response_device_info_t &info)
+    {
+        std::string name;
+        char hex[3] = {};
+        for (std::size_t i = 0; i < sizeof(info.serialnum); ++i)
+        {
+            std::snprintf(hex, sizeof(hex), "%02X", info.serialnum[i]);
+            name += hex;
+        }
+
+        char firmware[32] = {};
+        std::snprintf(firmware, sizeof(firmware), "-fw%d.%02d.caps", info.firmware_version >> 8, info.firmware_version & 0xFF);
+        name += firmware;
+
+        if (cache_dir.empty())
+        {
+            return name;
+        }
+
+        const char last = cache_dir[cache_dir.size() - 1];
+        return (last == '/' || last == '\\') ? cache_dir + name : cache_dir + "/" + name;
+    }
+
+    bool parse_hex(const std::string &text, std::vector<sl_u8> &out)
+    {
+        if (text.size() % 2 != 0)
+        {
+            return false;
+        }
+
+        out.clear();
+        for (std::size_t i = 0; i < text.size(); i += 2)
+        {
+            unsigned int byte = 0;
+            if (std::sscanf(text.c_str() + i, "%2x", &byte) != 1)
+            {
+                return false;
+            }
+            out.push_back((sl_u8)byte);
+        }
+        return true;
+    }
+}
+
+bool load_capabilities(const std::string &cache_dir, const sl_lidar_response_device_info_t &info, sl::LidarCapabilities &caps)
+{
+    std::ifstream file(cache_file_path(cache_dir, info));
+    std::string line;
+
+    if (!file || !std::getline(file, line) || line != CACHE_HEADER)
+    {
+        return false;
+    }
+
+    sl::LidarCapabilities loaded;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "conf_supported")
+        {
+            int supported = 0;
+            if (!(fields >> supported))
+            {
+                return false;
+            }
+            loaded.conf_commands_supported = supported != 0;
+        }
+        else if (key == "conf")
+        {
+            sl_u32 type = 0;
+            sl_u32 mode = 0;
+            std::string payload;
+            std::vector<sl_u8> answer;
+            if (!(fields >> std::hex >> type >> std::dec >> mode >> payload) || !parse_hex(payload, answer) || answer.empty())
+            {
+                return false;
+            }
+            loaded.conf_answers[std::make_pair(type, (sl_u16)mode)] = answer;
+        }
+        else if (!key.empty())
+        {
+            return false;
+        }
+    }
+
+    caps = loaded;
+    return true;
+}
+
+bool store_capabilities(const std::string &cache_dir, const sl_lidar_response_device_info_t &info, const sl::LidarCapabilities &caps)
+{
+    const std::string path = cache_file_path(cache_dir, info);
+    const std::string tmp_path = path + ".tmp";
+
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << CACHE_HEADER << "\n";
+        file << "conf_supported " << (caps.conf_commands_supported ? 1 : 0) << "\n";
+        for (const auto &entry : caps.conf_answers)
+        {
+            file << "conf " << std::hex << entry.first.first << std::dec << " " << entry.first.second << " ";
+            char hex[3] = {};
+            for (sl_u8 byte : entry.second)
+            {
+                std::snprintf(hex, sizeof(hex), "%02X", byte);
+                file << hex;
+            }
+            file << "\n";
+        }
+
+        if (!file.flush())
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    // rename does not replace an existing file on Windows
+    std::remove(path.c_str());
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>               //std::string
+
+#include "sl_lidar_driver.h"	//sl::LidarCapabilities
+
+// On-disk store for the answers a lidar gives while being probed on connect.
+// Every unit gets its own file inside cache_dir, named after its serial number and firmware version,
+// so a firmware update naturally starts from an empty cache.
+
+// Returns false if there is no usable entry for the unit
+bool load_capabilities(const std::string &cache_dir, const sl_lidar_response_device_info_t &info, sl::LidarCapabilities &caps);
+
+// Best effort: returns false if the entry could not be written. cache_dir must already exist
+bool store_capabilities(const std::string &cache_dir, const sl_lidar_response_device_info_t &info, const sl::LidarCapabilities &caps);
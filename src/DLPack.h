@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>              //std::int32_t, std::int64_t, std::uint8_t, std::uint16_t, std::uint64_t
+
+// The parts of the DLPack ABI (dlpack.h, version 0.8) that exporting a CPU tensor takes. Consumers such as
+// PyTorch, JAX and NumPy receive a DLManagedTensor in a PyCapsule named "dltensor" and call its deleter once done
+
+enum DLDeviceType : std::int32_t
+{
+	kDLCPU = 1
+};
+
+typedef struct DLDevice
+{
+	DLDeviceType device_type;
+	std::int32_t device_id;
+} DLDevice;
+
+enum DLDataTypeCode : std::uint8_t
+{
+	kDLInt = 0,
+	kDLUInt = 1,
+	kDLFloat = 2
+};
+
+typedef struct DLDataType
+{
+	std::uint8_t code;
+	std::uint8_t bits;
+	std::uint16_t lanes;
+} DLDataType;
+
+typedef struct DLTensor
+{
+	void *data;
+	DLDevice device;
+	std::int32_t ndim;
+	DLDataType dtype;
+	std::int64_t *shape;
+	std::int64_t *strides;		// In elements, may be null for a compact row-major tensor
+	std::uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor
+{
+	DLTensor dl_tensor;
+	void *manager_ctx;
+	void (*deleter)(struct DLManagedTensor *self);
+} DLManagedTensor;
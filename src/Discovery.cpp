@@ -0,0 +1,247 @@
+#include <algorithm> //std::search, std::sort
+#include <cstdio>    //std::snprintf
+#include <cstring>   //std::memcpy, std::strncmp, std::strlen
+#include <future>    //std::async
+#include <memory>    //std::unique_ptr
+#include <thread>    //std::this_thread
+
+#ifdef _WIN32
+#include <windows.h> //QueryDosDeviceA
+#else
+#include <dirent.h>  //opendir, readdir
+#endif
+
+#include "Discovery.h"
+
+namespace
+{
+    void send_command(sl::IChannel &channel, sl_u8 cmd)
+    {
+        const sl_u8 packet[] = {SL_LIDAR_CMD_SYNC_BYTE, cmd};
+        channel.write(packet, sizeof(packet));
+    }
+
+    // Reads until the answer to GET_DEVICE_INFO shows up, skipping anything the lidar was sending before
+    bool wait_device_info(sl::IChannel &channel, std::chrono::milliseconds timeout, sl_lidar_response_device_info_t &info)
+    {
+        const sl_u32 size = sizeof(sl_lidar_response_device_info_t);
+        const sl_u8 header[] = {SL_LIDAR_ANS_SYNC_BYTE1, SL_LIDAR_ANS_SYNC_BYTE2,
+                                (sl_u8)(size & 0xFF), (sl_u8)((size >> 8) & 0xFF), (sl_u8)((size >> 16) & 0xFF), (sl_u8)((size >> 24) & 0xFF),
+                                SL_LIDAR_ANS_TYPE_DEVINFO};
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::vector<sl_u8> received;
+
+        while (true)
+        {
+            auto found = std::search(received.begin(), received.end(), header, header + sizeof(header));
+            if (found != received.end() && (std::size_t)(received.end() - found) >= sizeof(header) + size)
+            {
+                std::memcpy(&info, &*(found + sizeof(header)), size);
+                return true;
+            }
+
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
+            {
+                return false;
+            }
+
+            std::size_t ready = 0;
+            if (!channel.waitForData(1, (sl_u32)remaining.count(), &ready))
+            {
+                return false;
+            }
+
+            sl_u8 buffer[256];
+            int got = channel.read(buffer, std::max<std::size_t>(1, std::min(ready, sizeof(buffer))));
+            if (got > 0)
+            {
+                received.insert(received.end(), buffer, buffer + got);
+            }
+        }
+    }
+
+#ifdef _WIN32
+    const char *const PORT_PREFIXES[] = {"COM"};
+#elif defined(__APPLE__)
+    const char *const PORT_DIR = "/dev/";
+    const char *const PORT_PREFIXES[] = {"cu.usbserial", "cu.SLAB_USBtoUART", "cu.usbmodem", "cu.wchusbserial"};
+#else
+    const char *const PORT_DIR = "/dev/";
+    const char *const PORT_PREFIXES[] = {"ttyUSB", "ttyACM"};
+#endif
+
+    bool has_port_prefix(const char *name)
+    {
+        for (const char *prefix : PORT_PREFIXES)
+        {
+            if (std::strncmp(name, prefix, std::strlen(prefix)) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool probe(const std::string &port, std::uint32_t baudrate, std::chrono::milliseconds timeout, sl_lidar_response_device_info_t &info)
+    {
+        sl::Result<sl::IChannel *> created = sl::createSerialPortChannel(port, baudrate);
+        if (!created)
+        {
+            return false;
+        }
+
+        std::unique_ptr<sl::IChannel> channel(*created);
+        if (!channel->open())
+        {
+            return false;
+        }
+
+        const bool found = probe_device_info(*channel, timeout, info);
+
+        channel->close();
+        return found;
+    }
+
+    bool negotiate(const std::string &port, std::uint32_t baudrate)
+    {
+        sl::Result<sl::IChannel *> channel = sl::createSerialPortChannel(port, baudrate);
+        if (!channel)
+        {
+            return false;
+        }
+        std::unique_ptr<sl::IChannel> owned_channel(*channel);
+
+        sl::Result<sl::ILidarDriver *> driver = sl::createLidarDriver();
+        if (!driver)
+        {
+            return false;
+        }
+        std::unique_ptr<sl::ILidarDriver> owned_driver(*driver);
+
+        sl_u32 detected = 0;
+        bool negotiated = SL_IS_OK(owned_driver->connect(owned_channel.get())) &&
+                          SL_IS_OK(owned_driver->negotiateSerialBaudRate(baudrate, &detected));
+
+        owned_driver->disconnect();
+        return negotiated;
+    }
+
+    bool probe_port(const std::string &port, const std::vector<std::uint32_t> &baudrates, std::chrono::milliseconds timeout, bool autobaud,
+                    discovered_lidar &out)
+    {
+        for (std::uint32_t baudrate : baudrates)
+        {
+            if (probe(port, baudrate, timeout, out.device_info))
+            {
+                out.port = port;
+                out.baudrate = baudrate;
+                return true;
+            }
+        }
+
+        if (autobaud && !baudrates.empty() && negotiate(port, baudrates[0]) && probe(port, baudrates[0], timeout, out.device_info))
+        {
+            out.port = port;
+            out.baudrate = baudrates[0];
+            return true;
+        }
+
+        return false;
+    }
+}
+
+bool probe_device_info(sl::IChannel &channel, std::chrono::milliseconds timeout, sl_lidar_response_device_info_t &info)
+{
+    // A lidar left scanning ignores every other request, and wants 1ms after STOP before the next one
+    send_command(channel, SL_LIDAR_CMD_STOP);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    channel.flush();
+
+    send_command(channel, SL_LIDAR_CMD_GET_DEVICE_INFO);
+    return wait_device_info(channel, timeout, info);
+}
+
+std::string discovered_lidar::serial_number() const
+{
+    char arr[128] = {};
+    for (int pos = 0; pos < 16; ++pos)
+    {
+        std::snprintf(arr + std::strlen(arr), sizeof(arr) - std::strlen(arr), "%02X", device_info.serialnum[pos]);
+    }
+
+    return arr;
+}
+
+std::string discovered_lidar::firmware_version() const
+{
+    char arr[128] = {};
+    std::snprintf(arr, sizeof(arr), "%d.%02d", device_info.firmware_version >> 8, device_info.firmware_version & 0xFF);
+
+    return arr;
+}
+
+std::vector<std::string> list_serial_ports()
+{
+    std::vector<std::string> ports;
+
+#ifdef _WIN32
+    std::vector<char> devices(65536);
+    DWORD length = QueryDosDeviceA(NULL, devices.data(), (DWORD)devices.size());
+    for (DWORD pos = 0; pos < length && devices[pos]; pos += (DWORD)std::strlen(&devices[pos]) + 1)
+    {
+        if (has_port_prefix(&devices[pos]))
+        {
+            ports.push_back(&devices[pos]);
+        }
+    }
+#else
+    DIR *dir = opendir(PORT_DIR);
+    if (!dir)
+    {
+        return ports;
+    }
+
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (has_port_prefix(entry->d_name))
+        {
+            ports.push_back(std::string(PORT_DIR) + entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+
+    std::sort(ports.begin(), ports.end());
+    return ports;
+}
+
+std::vector<std::uint32_t> default_baudrates()
+{
+    return {1000000, 460800, 256000, 115200};
+}
+
+std::vector<discovered_lidar> discover_lidars(const std::vector<std::string> &ports, const std::vector<std::uint32_t> &baudrates,
+                                              std::chrono::milliseconds probe_timeout, bool autobaud)
+{
+    std::vector<std::future<bool>> probes;
+    std::vector<discovered_lidar> candidates(ports.size());
+
+    for (std::size_t i = 0; i < ports.size(); ++i)
+    {
+        probes.push_back(std::async(std::launch::async, probe_port, std::cref(ports[i]), std::cref(baudrates), probe_timeout, autobaud,
+                                    std::ref(candidates[i])));
+    }
+
+    std::vector<discovered_lidar> found;
+    for (std::size_t i = 0; i < probes.size(); ++i)
+    {
+        if (probes[i].get())
+        {
+            found.push_back(candidates[i]);
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>               //std::string
+#include <vector>               //std::vector
+#include <chrono>               //std::chrono::milliseconds
+#include <cstdint>              //std::uint32_t
+
+#include "sl_lidar_driver.h"	//sl_lidar_response_device_info_t, sl::IChannel
+
+// Finds lidars on the serial ports of this machine without knowing their port or baud rate up front.
+// Every candidate port is talked to, so do not run it while another program is using one of them.
+
+typedef struct discovered_lidar
+{
+	std::string port;
+	std::uint32_t baudrate;
+	sl_lidar_response_device_info_t device_info;
+
+	std::string serial_number() const;
+	std::string firmware_version() const;
+} discovered_lidar;
+
+// Stops whatever the lidar on an open channel is streaming and asks for its device info, which has to arrive within timeout.
+// Cheap enough to tell whether a lidar is listening without setting up a driver
+bool probe_device_info(sl::IChannel &channel, std::chrono::milliseconds timeout, sl_lidar_response_device_info_t &info);
+
+// Serial devices a lidar could be attached to: USB serial adapters on Linux and macOS, COM ports on Windows
+std::vector<std::string> list_serial_ports();
+
+// Baud rates used by the current Slamtec models, fastest first: S2/S3, C1, A3/S1, A1/A2
+std::vector<std::uint32_t> default_baudrates();
+
+// Probes all ports at once, trying each baud rate with a single GET_DEVICE_INFO exchange that has to be
+// answered within probe_timeout. With autobaud, a port that answers none of them additionally gets the lidar
+// to measure the first baud rate (negotiateSerialBaudRate). Only firmware supporting it responds and the
+// measurement takes up to two seconds per silent port, so it is off by default.
+// Returns the lidars found, in the order of ports
+std::vector<discovered_lidar> discover_lidars(const std::vector<std::string> &ports, const std::vector<std::uint32_t> &baudrates,
+											  std::chrono::milliseconds probe_timeout = std::chrono::milliseconds(100), bool autobaud = false);
@@ -1,16 +1,34 @@
-#include <array>     //std::array
 #include <stdexcept> //std::runtime_error, std::invalid_argument, std::bad_alloc
 #include <utility>   //std::pair
 #include <cmath>     //std::sin, std::cos
 #include <vector>    //std::vector
 #include <cstdio>    //std::snprintf
-#include <algorithm> //std::find
-#include <cstring>   //std::strlen
+#include <algorithm> //std::find, std::min, std::max, std::copy
+#include <cstring>   //std::strlen, std::memcmp
+#include <thread>    //std::thread
+#include <mutex>     //std::mutex, std::lock_guard
+#include <atomic>    //std::atomic
 
 #include "Lidar.h"
+#include "ScanFrame.h"
+#include "CapabilityCache.h"
+#include "Discovery.h"
+#include "StatsExposition.h"
+#include "sl_trace.h"
 namespace {
     constexpr double PI = 3.14159265358979323846;
     constexpr double deg_to_rad = PI / 180.0;
+
+    // A connect_async thread, done once on_done has returned
+    struct connect_thread
+    {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    // Threads of connect_async not joined yet. Each call joins those that are done, join_connect_threads the rest
+    std::mutex connect_threads_lock;
+    std::vector<connect_thread> connect_threads;
 }
 
 using std::size_t;
@@ -129,6 +147,16 @@ sl_lidar_response_device_info_t Lidar::init_device_info(){
         m_driver->getDeviceInfo(dev_info),
         "Could not retrive device data during connection");
 
+    sl::LidarCapabilities caps;
+    if (!m_capability_cache.empty() && load_capabilities(m_capability_cache, dev_info, caps))
+    {
+        // A stale or unusable cache only costs the queries it would have saved
+        if (SL_IS_OK(m_driver->importCapabilities(caps)))
+        {
+            m_cached_answers = caps.conf_answers.size();
+        }
+    }
+
     return dev_info;
 
 }
@@ -165,6 +193,52 @@ sl::IChannel* open_channel(std::string& my_port, uint32_t baudrate){
 
 }
 
+sl::IChannel* open_capture_channel(std::string& my_port, uint32_t baudrate, const std::string& capture_path){
+    sl::IChannel* serial = open_channel(my_port, baudrate);
+
+    if (capture_path.empty())
+    {
+        return serial;
+    }
+
+    sl::Result<sl::IChannel*> channel = sl::createCaptureChannel(serial, capture_path);
+
+    if (!channel)
+    {
+        delete serial;
+    }
+
+    error_chk<std::runtime_error>(channel,"Error opening Capture Channel!");
+
+    return *channel;
+
+}
+
+sl::IChannel* open_replay_channel(const std::string& capture_path, bool realtime){
+    sl::Result<sl::IChannel*> channel = sl::createReplayChannel(capture_path, realtime);
+
+    error_chk<std::runtime_error>(channel,"Error opening Replay Channel!");
+
+    return *channel;
+
+}
+
+sl::IChannel* open_fault_channel(std::string& my_port, uint32_t baudrate, const sl::FaultInjectionConfig& config){
+    sl::IChannel* serial = open_channel(my_port, baudrate);
+
+    sl::Result<sl::IFaultInjectionChannel*> channel = sl::createFaultInjectionChannel(serial, config);
+
+    if (!channel)
+    {
+        delete serial;
+    }
+
+    error_chk<std::runtime_error>(channel,"Error opening Fault Injection Channel!");
+
+    return *channel;
+
+}
+
 sl::ILidarDriver* open_lidar_driver(){
     sl::Result<sl::ILidarDriver*> err_res = sl::createLidarDriver();
 
@@ -175,12 +249,150 @@ sl::ILidarDriver* open_lidar_driver(){
 }
 
 // Create the constructor: Here the driver will be created.
-Lidar::Lidar(std::string my_port, uint32_t baudrate) : m_channel(open_channel(my_port, baudrate)), m_driver(open_lidar_driver()), m_device_info(init_device_info()), m_mac_address(init_mac_address()), m_com_port(my_port)
+Lidar::Lidar(std::string my_port, uint32_t baudrate) : Lidar(open_channel(my_port, baudrate), my_port)
+{
+}
+
+Lidar::Lidar(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache) : Lidar(open_capture_channel(my_port, baudrate, capture_path), my_port, capability_cache)
+{
+}
+
+Lidar::Lidar(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache, const sl::LidarThreadConfig &thread_config)
+    : Lidar(checked_port(my_port, thread_config), baudrate, capture_path, capability_cache)
+{
+    // Only stored until the scan starts the thread
+    error_chk<std::runtime_error>(
+        m_driver->setAcquisitionThreadConfig(thread_config),
+        "Could not configure the acquisition thread");
+}
+
+Lidar::Lidar(sl::IChannel *channel, std::string name, std::string capability_cache) : m_channel(channel), m_driver(open_lidar_driver()), m_capability_cache(capability_cache), m_device_info(init_device_info()), m_mac_address(init_mac_address()), m_com_port(name), m_scan_pool(ScanPool::create())
+{
+}
+
+std::unique_ptr<Lidar> Lidar::from_replay(const std::string &capture_path, bool realtime)
+{
+    return std::unique_ptr<Lidar>(new Lidar(open_replay_channel(capture_path, realtime), capture_path));
+}
+
+std::unique_ptr<Lidar> Lidar::with_fault_injection(std::string my_port, uint32_t baudrate, const sl::FaultInjectionConfig &config)
+{
+    return std::unique_ptr<Lidar>(new Lidar(open_fault_channel(my_port, baudrate, config), my_port));
+}
+
+sl::IFaultInjectionChannel &Lidar::fault_channel() const
+{
+    sl::IFaultInjectionChannel *channel = dynamic_cast<sl::IFaultInjectionChannel *>(m_channel.get());
+    if (!channel)
+    {
+        throw std::runtime_error("The lidar was not connected with fault injection");
+    }
+    return *channel;
+}
+
+void Lidar::set_fault_config(const sl::FaultInjectionConfig &config)
+{
+    fault_channel().setFaultConfig(config);
+}
+
+sl::FaultInjectionStats Lidar::get_fault_stats() const
+{
+    return fault_channel().getFaultStats();
+}
+
+void Lidar::connect_async(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache,
+                          std::function<void(connect_result)> on_done)
+{
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    std::thread worker([my_port, baudrate, capture_path, capability_cache, on_done, done]()
+    {
+        connect_result result;
+        try
+        {
+            result.lidar.reset(new Lidar(my_port, baudrate, capture_path, capability_cache));
+        }
+        catch (const std::exception &e)
+        {
+            result.error = e.what();
+        }
+        on_done(std::move(result));
+        *done = true;
+    });
+
+    std::lock_guard<std::mutex> lock(connect_threads_lock);
+    auto finished = std::partition(connect_threads.begin(), connect_threads.end(),
+                                   [](const connect_thread &pending) { return !*pending.done; });
+    for (auto it = finished; it != connect_threads.end(); ++it)
+    {
+        it->thread.join();
+    }
+    connect_threads.erase(finished, connect_threads.end());
+    connect_threads.push_back(connect_thread{std::move(worker), done});
+}
+
+void Lidar::join_connect_threads()
+{
+    std::vector<connect_thread> pending;
+    {
+        std::lock_guard<std::mutex> lock(connect_threads_lock);
+        pending.swap(connect_threads);
+    }
+    for (connect_thread &worker : pending)
+    {
+        worker.thread.join();
+    }
+}
+
+std::future<Lidar::connect_result> Lidar::connect_async(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache)
+{
+    // Shared with the worker so the promise outlives a caller that stopped waiting
+    auto promise = std::make_shared<std::promise<connect_result>>();
+    std::future<connect_result> future = promise->get_future();
+
+    connect_async(my_port, baudrate, capture_path, capability_cache, [promise](connect_result result)
+    {
+        promise->set_value(std::move(result));
+    });
+
+    return future;
+}
+
+std::vector<Lidar::connect_result> Lidar::connect_all(const std::vector<std::string> &ports, uint32_t baudrate, std::chrono::milliseconds timeout,
+                                                      std::string capability_cache)
 {
+    std::vector<std::future<connect_result>> pending;
+    for (const std::string &port : ports)
+    {
+        pending.push_back(connect_async(port, baudrate, "", capability_cache));
+    }
+
+    // All attempts run concurrently, so a common deadline gives each of them the full timeout
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::vector<connect_result> results(ports.size());
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        if (pending[i].wait_until(deadline) == std::future_status::ready)
+        {
+            results[i] = pending[i].get();
+        }
+        else
+        {
+            results[i].error = "Timed out connecting to " + ports[i];
+        }
+    }
+
+    return results;
 }
 
 Lidar::~Lidar()
 {
+    disable_supervisor();
+
+    // The stack goes with this object, while the acquisition thread may still publish until the scan is stopped
+    if (m_driver)
+        m_driver->setScanObserver(nullptr);
+
     if (m_driver)
         m_driver->stop(); //No error checking as it is best effort
 
@@ -191,17 +403,78 @@ Lidar::~Lidar()
 
 void Lidar::start_motor()
 {
+    start_scan();
+    wait_for_spin_up();
+}
+
+void Lidar::start_scan()
+{
+    std::lock_guard<std::mutex> control(m_control_lock);
+
+    // Left disconnected by a recovery that was called off
+    if (!m_driver->isConnected())
+    {
+        error_chk<std::runtime_error>(
+            m_driver->connect(m_channel.get()),
+            "Could not reconnect to Lidar");
+    }
+
+    // Learnt up front so that switching modes later needs no queries, which the lidar ignores while scanning
+    std::vector<sl::LidarScanMode> modes;
+    m_driver->getAllSupportedScanModes(modes); //No error checking as startScan repeats what it needs
+
+    // Spins the motor up early and learns the default speed, which the lidar only tells while idle
     error_chk<std::runtime_error>(
-        m_driver->setMotorSpeed(),
+        m_driver->setMotorSpeed(m_motor_speed),
         "Could not start lidar motor.");
 
     error_chk<std::runtime_error>(
-        m_driver->startScan(false, true),
+        m_driver->startScan(false, true, 0, &m_scan_mode),
         "Could not start scan");
+
+    // Starting the scan sets the driver's own start speed, the one asked for has to follow it
+    error_chk<std::runtime_error>(
+        m_driver->setMotorSpeed(m_motor_speed),
+        "Could not set lidar motor speed.");
+
+    m_scan_mode_id = m_scan_mode.id;
+    m_scan_requested = true;
+
+    // Starting a scan is what probes the scan modes, so the cache is complete from here on
+    update_capability_cache();
+}
+
+void Lidar::wait_for_spin_up()
+{
+    // No error checking, a lidar that has not settled yet still delivers scans
+    m_driver->waitForStableRotation((sl_u32)SPIN_UP_TIMEOUT.count());
+}
+
+void Lidar::update_capability_cache()
+{
+    if (m_capability_cache.empty())
+    {
+        return;
+    }
+
+    sl::LidarCapabilities caps;
+    if (!SL_IS_OK(m_driver->exportCapabilities(caps)) || caps.conf_answers.size() <= m_cached_answers)
+    {
+        return;
+    }
+
+    //No error checking as the cache is best effort
+    if (store_capabilities(m_capability_cache, m_device_info, caps))
+    {
+        m_cached_answers = caps.conf_answers.size();
+    }
 }
 
 void Lidar::stop_motor()
 {
+    std::lock_guard<std::mutex> control(m_control_lock);
+    m_scan_requested = false;
+
     error_chk<std::runtime_error>(
         m_driver->setMotorSpeed(0),
         "Could not stop lidar.");
@@ -209,15 +482,18 @@ void Lidar::stop_motor()
 
 void Lidar::reset()
 {
+    std::lock_guard<std::mutex> control(m_control_lock);
+    m_scan_requested = false;
+
     error_chk<std::runtime_error>(
         m_driver->reset(),
         "Could not reset lidar.");
 }
 
-std::pair<Lidar::lidar_sample *, std::size_t> Lidar::get_scan_as_lidar_samples()
+std::size_t Lidar::grab_scan()
 {
-    // Make a buffer for the scanned data
-    std::array<sl_lidar_response_measurement_node_hq_t, MAX_SCAN_NODES> nodes;
+    // Buffer for the scanned data, kept across calls
+    std::vector<sl_lidar_response_measurement_node_hq_t> &nodes = scan_buffer();
 
     std::size_t count = nodes.size();
 
@@ -231,58 +507,158 @@ std::pair<Lidar::lidar_sample *, std::size_t> Lidar::get_scan_as_lidar_samples()
         throw std::runtime_error("No lidar points retrieved");
     }
 
+    log_scan(&nodes[0], count);
+    return count;
+}
+
+std::size_t Lidar::grab_sorted_scan()
+{
+    const std::size_t count = grab_scan();
+
     // Sort scan
     error_chk<std::runtime_error>(
-        m_driver->ascendScanData(&nodes[0], count),
+        m_driver->ascendScanData(&m_scan_buffer[0], count),
         "Could not ascendScanData.");
 
-    // Create output buffer
-    lidar_sample *output(new lidar_sample[count]);
+    return count;
+}
 
-    std::size_t idx = 0;
-    for (std::size_t pos = 0; pos < count; pos++)
+void Lidar::log_scan(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count)
+{
+    std::lock_guard<std::mutex> log(m_scan_log_lock);
+    if (m_scan_log)
     {
-        const int quality = nodes[pos].quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;
-        output[idx] = lidar_sample(nodes[pos]);
-        idx = pos;
+        m_scan_log->append(m_scan_log_id, m_scan_mode_id, nodes, count); //Dropped rotations are counted by the log
     }
-    return {output, idx + 1};
 }
 
-std::pair<Lidar::point *, size_t> Lidar::get_scan_as_xy()
+void Lidar::set_scan_log(std::shared_ptr<ScanLogWriter> log, std::uint32_t lidar_id)
 {
-    // Make a buffer for the scanned data
-    std::array<sl_lidar_response_measurement_node_hq_t, MAX_SCAN_NODES> nodes;
+    std::lock_guard<std::mutex> lock(m_scan_log_lock);
+    m_scan_log = std::move(log);
+    m_scan_log_id = lidar_id;
+}
 
-    std::size_t count = nodes.size();
+void Lidar::set_range_stack(std::shared_ptr<RangeStack> stack)
+{
+    std::lock_guard<std::mutex> lock(m_range_stack_lock);
+    // The previous stack is only let go once the driver no longer calls it
+    m_driver->setScanObserver(stack.get());
+    m_range_stack = std::move(stack);
+}
 
-    // Grab a scan frame
-    error_chk<std::runtime_error>(
-        m_driver->grabScanDataHq(&nodes[0], count),
-        "Failed to read lidar.");
+void Lidar::record_delivery()
+{
+    m_delivery_latency.recordSince(m_driver->getGrabbedScanTimestamp());
+}
 
-    if (count == 0)
+std::pair<Lidar::lidar_sample *, std::size_t> Lidar::get_scan_as_lidar_samples()
+{
+    const std::size_t count = grab_sorted_scan();
+    std::vector<sl_lidar_response_measurement_node_hq_t> &nodes = m_scan_buffer;
+
+    // Create output buffer
+    lidar_sample *output = acquire_scan<lidar_sample>(count);
+
+    SL_TRACE_SCOPE(trace, "convert");
+    SL_TRACE_ARG(trace, count);
+    for (std::size_t pos = 0; pos < count; pos++)
     {
-        throw std::runtime_error("No lidar points retrieved");
+        output[pos] = lidar_sample(nodes[pos]);
     }
 
-    // Sort scan
-    error_chk<std::runtime_error>(
-        m_driver->ascendScanData(&nodes[0], count),
-        "Could not ascendScanData.");
+    record_delivery();
+    return {output, count};
+}
+
+std::pair<Lidar::point *, size_t> Lidar::get_scan_as_xy()
+{
+    const std::size_t count = grab_sorted_scan();
+    std::vector<sl_lidar_response_measurement_node_hq_t> &nodes = m_scan_buffer;
 
     // Create output buffer
-    point *output(new point[count]);
+    point *output = acquire_scan<point>(count);
 
+    SL_TRACE_SCOPE(trace, "convert");
+    SL_TRACE_ARG(trace, count);
     for (std::size_t pos = 0; pos < count; pos++)
     {
         output[pos] = point(nodes[pos]);
     }
 
+    record_delivery();
     return std::make_pair(output, count);
 
 }
 
+std::shared_ptr<ScanColumns> Lidar::get_scan_as_columns()
+{
+    const std::size_t count = grab_sorted_scan();
+
+    float *buffer = acquire_scan<float>(count, ScanColumns::COLUMNS);
+    std::shared_ptr<ScanColumns> scan;
+    try
+    {
+        SL_TRACE_SCOPE(trace, "convert");
+        SL_TRACE_ARG(trace, count);
+        scan = std::make_shared<ScanColumns>(buffer, m_scan_buffer.data(), count);
+    }
+    catch (...)
+    {
+        ScanPool::release(buffer);
+        throw;
+    }
+
+    record_delivery();
+    return scan;
+}
+
+std::shared_ptr<ScanFrame> Lidar::get_scan_as_frame()
+{
+    const std::size_t count = grab_scan();
+    const std::uint64_t end_us = m_driver->getGrabbedScanTimestamp();
+
+    sl::LidarDriverStats driver_stats;
+    m_driver->getDriverStats(driver_stats);
+    const double rotation_period_us = driver_stats.rotation_frequency > 0 ? 1e6 / driver_stats.rotation_frequency : 0.0;
+
+    // As sent, then sorted
+    sl_lidar_response_measurement_node_hq_t *nodes = acquire_scan<sl_lidar_response_measurement_node_hq_t>(count, 2);
+    std::shared_ptr<ScanFrame> frame;
+    try
+    {
+        std::copy(m_scan_buffer.begin(), m_scan_buffer.begin() + count, nodes);
+        std::copy(nodes, nodes + count, nodes + count);
+        error_chk<std::runtime_error>(
+            m_driver->ascendScanData(nodes + count, count),
+            "Could not ascendScanData.");
+
+        frame = std::make_shared<ScanFrame>(m_scan_pool, pooled_samples(count), nodes, count, end_us, rotation_period_us);
+    }
+    catch (...)
+    {
+        ScanPool::release(nodes);
+        throw;
+    }
+
+    record_delivery();
+    return frame;
+}
+
+std::size_t Lidar::get_scan_resampled(AngularGrid &grid)
+{
+    const std::size_t count = grab_sorted_scan();
+
+    {
+        SL_TRACE_SCOPE(trace, "resample");
+        SL_TRACE_ARG(trace, count);
+        grid.resample(m_scan_buffer.data(), count);
+    }
+
+    record_delivery();
+    return count;
+}
+
 // ------------------------ Device Properties ---------------------------------------
 
 // Serial #
@@ -336,6 +712,8 @@ std::string Lidar::mac_addr() const{
 
 std::pair<Lidar::RPLidar_Status_Code, Lidar::RPLidar_Result_Code> Lidar::get_health()
 {
+    std::lock_guard<std::mutex> control(m_control_lock);
+
     sl_lidar_response_device_health_t health;
     error_chk<std::runtime_error>(
         m_driver->getHealth(health),
@@ -346,6 +724,429 @@ std::pair<Lidar::RPLidar_Status_Code, Lidar::RPLidar_Result_Code> Lidar::get_hea
         from_sl_result(health.status));
 }
 
+std::vector<sl::LidarScanMode> Lidar::scan_modes()
+{
+    std::lock_guard<std::mutex> control(m_control_lock);
+
+    std::vector<sl::LidarScanMode> modes;
+    error_chk<std::runtime_error>(
+        m_driver->getAllSupportedScanModes(modes),
+        "Could not read scan modes");
+
+    return modes;
+}
+
+std::chrono::milliseconds Lidar::switch_mode(sl_u16 mode, sl_u16 motor_speed)
+{
+    std::lock_guard<std::mutex> control(m_control_lock);
+
+    if (!m_scan_requested)
+    {
+        throw std::runtime_error("No scan to switch, call start_motor first");
+    }
+
+    sl::LidarScanMode used_mode;
+    sl_u32 gap_ms = 0;
+    error_chk<std::runtime_error>(
+        m_driver->switchScanMode(mode, motor_speed, &used_mode, &gap_ms),
+        "Could not switch scan mode");
+
+    m_scan_mode = used_mode;
+    m_scan_mode_id = used_mode.id;
+    m_motor_speed = motor_speed;
+
+    return std::chrono::milliseconds(gap_ms);
+}
+
+// ------------------------------ Supervisor ---------------------------------------
+
+constexpr std::chrono::milliseconds Lidar::MIN_STALL_TIMEOUT;
+constexpr std::chrono::milliseconds Lidar::SCAN_START_TIMEOUT;
+constexpr std::chrono::milliseconds Lidar::SPIN_UP_TIMEOUT;
+constexpr std::chrono::milliseconds Lidar::PROBE_TIMEOUT;
+constexpr std::chrono::milliseconds Lidar::MIN_RETRY_DELAY;
+constexpr std::chrono::milliseconds Lidar::MAX_RETRY_DELAY;
+
+void Lidar::enable_supervisor(double stall_multiple)
+{
+    if (stall_multiple <= 0)
+    {
+        throw std::invalid_argument("stall_multiple must be positive");
+    }
+
+    disable_supervisor();
+
+    m_stall_multiple = stall_multiple;
+    m_supervisor_stop = false;
+    m_supervisor = std::thread(&Lidar::supervise, this);
+}
+
+void Lidar::disable_supervisor()
+{
+    if (!m_supervisor.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> wake(m_supervisor_lock);
+        m_supervisor_stop = true;
+    }
+    m_supervisor_wake.notify_all();
+    m_supervisor.join();
+}
+
+Lidar::supervisor_stats Lidar::get_supervisor_stats() const
+{
+    std::lock_guard<std::mutex> stats(m_stats_lock);
+    return m_supervisor_stats;
+}
+
+sl::LidarThreadConfig Lidar::acquisition_thread_config()
+{
+    sl::LidarThreadConfig effective;
+    error_chk<std::runtime_error>(
+        m_driver->getAcquisitionThreadConfig(effective),
+        "No acquisition thread, the scan is not running or served by a group");
+
+    return effective;
+}
+
+void Lidar::set_scan_capacity(std::size_t nodes)
+{
+    if (nodes == 0)
+    {
+        throw std::invalid_argument("The scan capacity must be at least 1");
+    }
+
+    std::lock_guard<std::mutex> control(m_control_lock);
+    if (m_scan_requested)
+    {
+        throw std::runtime_error("The scan capacity can only be changed while the motor is stopped");
+    }
+
+    // stop_motor leaves the driver decoding an idle stream, which keeps it from resizing
+    m_driver->stop(); //No error checking as it is best effort
+
+    error_chk<std::runtime_error>(
+        m_driver->setScanCapacity(nodes),
+        "Could not change the scan capacity");
+
+    // Reallocated by the next grab
+    std::vector<sl_lidar_response_measurement_node_hq_t>().swap(m_scan_buffer);
+}
+
+std::vector<sl_lidar_response_measurement_node_hq_t> &Lidar::scan_buffer()
+{
+    const std::size_t capacity = m_driver->getScanCapacity();
+    if (m_scan_buffer.size() != capacity)
+    {
+        // Swapped rather than resized so that shrinking gives the memory back
+        std::vector<sl_lidar_response_measurement_node_hq_t>(capacity).swap(m_scan_buffer);
+    }
+    return m_scan_buffer;
+}
+
+std::size_t Lidar::pooled_samples(std::size_t count)
+{
+    sl::LidarDriverStats driver_stats;
+    m_driver->getDriverStats(driver_stats);
+
+    // A grab never returns more than the capacity, however long the rotation was
+    const std::size_t largest = std::min<std::size_t>(driver_stats.max_scan_nodes, m_driver->getScanCapacity());
+
+    return std::max(count, largest);
+}
+
+template <typename T>
+T *Lidar::acquire_scan(std::size_t count, std::size_t per_sample)
+{
+    return static_cast<T *>(m_scan_pool->acquire(pooled_samples(count) * per_sample * sizeof(T)));
+}
+
+ScanPool &Lidar::scan_pool()
+{
+    return *m_scan_pool;
+}
+
+Lidar::scan_capacity_stats Lidar::get_scan_capacity_stats() const
+{
+    sl::LidarDriverStats driver_stats;
+    m_driver->getDriverStats(driver_stats);
+
+    scan_capacity_stats stats;
+    stats.capacity = m_driver->getScanCapacity();
+    stats.max_scan_nodes = driver_stats.max_scan_nodes;
+    stats.dropped_nodes = driver_stats.scan_nodes_dropped;
+    return stats;
+}
+
+sl::LidarDriverStats Lidar::get_driver_stats() const
+{
+    sl::LidarDriverStats stats;
+    m_driver->getDriverStats(stats);
+    return stats;
+}
+
+std::string Lidar::stats_exposition() const
+{
+    const sl::LidarDriverStats driver = get_driver_stats();
+    const supervisor_stats supervisor = get_supervisor_stats();
+
+    const double average_nodes = driver.revolutions_published ? (double)driver.published_nodes / driver.revolutions_published : 0.0;
+    const double zero_distance_ratio = driver.nodes_decoded ? (double)driver.zero_distance_nodes / driver.nodes_decoded : 0.0;
+
+    const std::vector<exposition_metric> metrics = {
+        {"rplidar_bytes_read_total", "counter", "Bytes read from the lidar while scanning", (double)driver.bytes_read},
+        {"rplidar_read_calls_total", "counter", "Reads from the lidar while scanning", (double)driver.read_calls},
+        {"rplidar_packets_received_total", "counter", "Measurement capsules decoded, or single samples in standard mode", (double)driver.packets_received},
+        {"rplidar_checksum_failures_total", "counter", "Frames with a valid header that failed their checksum", (double)driver.checksum_failures},
+        {"rplidar_resync_bytes_skipped_total", "counter", "Bytes discarded while searching for the next valid frame", (double)driver.resync_bytes_skipped},
+        {"rplidar_capsules_lost_total", "counter", "Capsules whose samples were never published", (double)driver.capsules_lost},
+        {"rplidar_revolutions_published_total", "counter", "Full rotations published", (double)driver.revolutions_published},
+        {"rplidar_revolutions_overwritten_total", "counter", "Rotations replaced by the next one before being grabbed", (double)driver.revolutions_overwritten},
+        {"rplidar_samples_per_revolution_min", "gauge", "Fewest samples a rotation has held", (double)driver.min_scan_nodes},
+        {"rplidar_samples_per_revolution_avg", "gauge", "Average samples per rotation", average_nodes},
+        {"rplidar_samples_per_revolution_max", "gauge", "Most samples a rotation has held", (double)driver.max_scan_nodes},
+        {"rplidar_samples_dropped_total", "counter", "Samples beyond the scan capacity", (double)driver.scan_nodes_dropped},
+        {"rplidar_samples_decoded_total", "counter", "Samples decoded", (double)driver.nodes_decoded},
+        {"rplidar_zero_distance_samples_total", "counter", "Samples without a distance", (double)driver.zero_distance_nodes},
+        {"rplidar_zero_distance_ratio", "gauge", "Share of the samples decoded without a distance", zero_distance_ratio},
+        {"rplidar_rotation_frequency_hertz", "gauge", "Measured rotations per second of the running scan", driver.rotation_frequency},
+        {"rplidar_reconnects_total", "counter", "Outages the supervisor recovered from", (double)supervisor.reconnects},
+        {"rplidar_in_outage", "gauge", "1 while the supervisor is recovering from an outage", supervisor.in_outage ? 1.0 : 0.0},
+    };
+
+    return format_exposition(metrics, {{"serial", serial_number()}, {"port", m_com_port}});
+}
+
+Lidar::latency_stats Lidar::get_latency_stats(bool reset)
+{
+    sl::LidarLatencyStats driver_stats;
+    m_driver->getLatencyStats(driver_stats, reset);
+
+    latency_stats stats;
+    stats.decode = driver_stats.decode;
+    stats.publish = driver_stats.publish;
+    stats.grab = driver_stats.grab;
+    stats.delivery = m_delivery_latency.summarize(reset);
+    return stats;
+}
+
+void Lidar::write_stats(const std::string &path) const
+{
+    if (!write_exposition_file(path, stats_exposition()))
+    {
+        throw std::runtime_error("Could not write the stats to " + path);
+    }
+}
+
+void Lidar::check_thread_config(const sl::LidarThreadConfig &thread_config)
+{
+    switch (thread_config.policy)
+    {
+    case sl::LidarSchedPolicyInherit:
+        if (thread_config.priority != 0)
+        {
+            throw std::invalid_argument("A priority needs a real-time scheduling policy");
+        }
+        break;
+    case sl::LidarSchedPolicyFifo:
+    case sl::LidarSchedPolicyRoundRobin:
+        if (thread_config.priority < 1 || thread_config.priority > 99)
+        {
+            throw std::invalid_argument("Real-time priorities range from 1 to 99");
+        }
+        break;
+    default:
+        throw std::invalid_argument("Unknown scheduling policy");
+    }
+}
+
+std::string Lidar::checked_port(std::string my_port, const sl::LidarThreadConfig &thread_config)
+{
+    check_thread_config(thread_config);
+    return my_port;
+}
+
+std::chrono::milliseconds Lidar::stall_timeout() const
+{
+    std::size_t samples_per_packet = 1;
+    switch (m_scan_mode.ans_type)
+    {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        samples_per_packet = 32;
+        break;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        samples_per_packet = 40;
+        break;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA:
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        samples_per_packet = 96;
+        break;
+    }
+
+    // Firmware without scan mode queries reports no sample duration, which leaves the floor
+    const double packet_period_ms = m_scan_mode.us_per_sample * samples_per_packet / 1000.0;
+    return std::max(MIN_STALL_TIMEOUT, std::chrono::milliseconds((long long)(packet_period_ms * m_stall_multiple)));
+}
+
+void Lidar::supervise()
+{
+    using clock = std::chrono::steady_clock;
+
+    sl::LidarDriverStats driver_stats;
+    m_driver->getDriverStats(driver_stats);
+
+    std::uint64_t last_packets = driver_stats.packets_received;
+    clock::time_point last_progress = clock::now();
+    bool was_scanning = false;
+    bool stream_seen = false;
+
+    std::unique_lock<std::mutex> wake(m_supervisor_lock);
+    while (!m_supervisor_stop)
+    {
+        std::chrono::milliseconds timeout = MIN_STALL_TIMEOUT;
+        {
+            std::lock_guard<std::mutex> control(m_control_lock);
+            if (m_scan_requested)
+            {
+                timeout = stall_timeout();
+            }
+        }
+
+        m_supervisor_wake.wait_for(wake, timeout / 4);
+        if (m_supervisor_stop)
+        {
+            break;
+        }
+
+        m_driver->getDriverStats(driver_stats);
+        const clock::time_point now = clock::now();
+        const bool scanning = m_scan_requested;
+
+        if (!scanning || !was_scanning || driver_stats.packets_received != last_packets)
+        {
+            // A scan that was just started gets time to spin up before its first packet is due
+            stream_seen = scanning && was_scanning;
+            was_scanning = scanning;
+            last_packets = driver_stats.packets_received;
+            last_progress = now;
+            continue;
+        }
+
+        if (now - last_progress < (stream_seen ? timeout : SCAN_START_TIMEOUT))
+        {
+            continue;
+        }
+
+        wake.unlock();
+        recover(last_progress);
+        wake.lock();
+
+        m_driver->getDriverStats(driver_stats);
+        last_packets = driver_stats.packets_received;
+        last_progress = clock::now();
+        stream_seen = false;
+    }
+}
+
+void Lidar::recover(std::chrono::steady_clock::time_point outage_start)
+{
+    {
+        std::lock_guard<std::mutex> stats(m_stats_lock);
+        m_supervisor_stats.in_outage = true;
+    }
+
+    std::chrono::milliseconds retry_delay = MIN_RETRY_DELAY;
+    while (true)
+    {
+        bool recovered = false;
+        {
+            std::lock_guard<std::mutex> control(m_control_lock);
+            if (!m_scan_requested)
+            {
+                break;
+            }
+            recovered = try_reconnect();
+        }
+
+        if (recovered)
+        {
+            const double outage_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - outage_start).count();
+
+            std::lock_guard<std::mutex> stats(m_stats_lock);
+            ++m_supervisor_stats.reconnects;
+            m_supervisor_stats.last_outage_ms = outage_ms;
+            m_supervisor_stats.max_outage_ms = std::max(m_supervisor_stats.max_outage_ms, outage_ms);
+            m_supervisor_stats.total_outage_ms += outage_ms;
+            // Together with the count, so that a recovery is never seen half done
+            m_supervisor_stats.in_outage = false;
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> stats(m_stats_lock);
+            ++m_supervisor_stats.failed_attempts;
+        }
+
+        std::unique_lock<std::mutex> wake(m_supervisor_lock);
+        if (m_supervisor_wake.wait_for(wake, retry_delay, [this]() { return m_supervisor_stop; }))
+        {
+            break;
+        }
+        retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+    }
+
+    std::lock_guard<std::mutex> stats(m_stats_lock);
+    m_supervisor_stats.in_outage = false;
+}
+
+bool Lidar::try_reconnect()
+{
+    // The caches describe the unit, which is the same one coming back
+    sl::LidarCapabilities caps;
+    const bool has_caps = SL_IS_OK(m_driver->exportCapabilities(caps));
+
+    m_driver->disconnect();
+
+    // Connecting to a lidar that is not there yet costs the driver half a second of timeouts,
+    // a bare device info request tells much sooner whether it is back
+    if (!m_channel->open())
+    {
+        return false;
+    }
+    sl_lidar_response_device_info_t dev_info;
+    const bool answered = probe_device_info(*m_channel, PROBE_TIMEOUT, dev_info);
+    m_channel->close();
+
+    if (!answered || std::memcmp(dev_info.serialnum, m_device_info.serialnum, sizeof(dev_info.serialnum)) != 0)
+    {
+        return false;
+    }
+
+    if (!SL_IS_OK(m_driver->connect(m_channel.get())))
+    {
+        return false;
+    }
+
+    if (has_caps)
+    {
+        m_driver->importCapabilities(caps);
+    }
+
+    // Starting the scan sets the driver's own start speed, so the one asked for follows it as in start_scan
+    if (!SL_IS_OK(m_driver->setMotorSpeed(m_motor_speed)) ||
+        !SL_IS_OK(m_driver->startScanExpress(false, m_scan_mode.id, 0, &m_scan_mode)) ||
+        !SL_IS_OK(m_driver->setMotorSpeed(m_motor_speed)))
+    {
+        return false;
+    }
+
+    m_scan_mode_id = m_scan_mode.id;
+    return true;
+}
+
 // -------------------------- Custom Data Types ------------------------------
 
 Lidar::lidar_sample::lidar_sample(sl_lidar_response_measurement_node_hq_t &node) : angle(node.angle_z_q14 * 90.f / (1 << 14)),
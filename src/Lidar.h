@@ -1,14 +1,34 @@
+#pragma once
+
 #include <string>  				//std::string
 #include <utility> 				//std::pair
 #include <cstdint>				//std::uint8_t
 #include <memory>               //std::unique_ptr
+#include <vector>               //std::vector
+#include <future>               //std::future
+#include <functional>           //std::function
+#include <chrono>               //std::chrono::milliseconds
+#include <thread>               //std::thread
+#include <mutex>                //std::mutex
+#include <condition_variable>   //std::condition_variable
+#include <atomic>               //std::atomic
 
 #include "sl_lidar.h" 			//sl::IChannel
 #include "sl_lidar_driver.h"	//sl::ILidarDriver
+#include "ScanPool.h"			//ScanPool
+#include "ScanColumns.h"		//ScanColumns
+#include "ScanLog.h"			//ScanLogWriter
+#include "AngularGrid.h"		//AngularGrid
+#include "RangeStack.h"			//RangeStack
+
+class ScanFrame;
 
 // The responsability of this class is to interface to the slamtek library and provide easy access to the data of a hardwired lidar
 class Lidar
 {
+	// Pumps the driver of every lidar it holds from its own thread
+	friend class LidarGroup;
+
 public: //Classes and structs
 	typedef struct lidar_sample
 	{
@@ -51,6 +71,42 @@ public: //Classes and structs
 		UNKNOWN
 	};
 
+	// Outcome of a connection made on a background thread: either lidar is set or error says why not
+	typedef struct connect_result
+	{
+		std::unique_ptr<Lidar> lidar;
+		std::string error;
+	} connect_result;
+
+	// Recoveries made by the supervisor. An outage lasts from the last packet before the stall until the scan is restarted
+	typedef struct supervisor_stats
+	{
+		std::uint64_t reconnects;		// Outages recovered from
+		std::uint64_t failed_attempts;	// Reconnection attempts that had to be retried
+		double last_outage_ms;
+		double max_outage_ms;
+		double total_outage_ms;
+		bool in_outage;					// A recovery is under way
+	} supervisor_stats;
+
+	// How well the scan buffers fit the rotations the lidar delivers
+	typedef struct scan_capacity_stats
+	{
+		std::size_t capacity;			// Samples a rotation may hold
+		std::uint64_t max_scan_nodes;	// Most samples a rotation has held, including those beyond the capacity
+		std::uint64_t dropped_nodes;	// Samples discarded because their rotation did not fit
+	} scan_capacity_stats;
+
+	// How stale scans are by the time they move on, from the read of the last byte of a rotation's last sample.
+	// decode, publish and grab are the stages inside the driver, delivery is the whole way to the caller of get_scan_as_*
+	typedef struct latency_stats
+	{
+		sl::LatencySummary decode;
+		sl::LatencySummary publish;
+		sl::LatencySummary grab;
+		sl::LatencySummary delivery;
+	} latency_stats;
+
 	enum class RPLidar_Status_Code : int32_t
 	{
 		OK = (int32_t)SL_LIDAR_STATUS_OK,
@@ -63,6 +119,48 @@ public: //Classes and structs
 public: //Ctor Dtor
 	// Here the driver will be created and the device will be connected
 	Lidar(std::string my_port, uint32_t baudrate);
+
+	// Same as above, but every byte exchanged with the lidar is also recorded to capture_path (unless it is empty),
+	// across the reconnections of the supervisor.
+	// If capability_cache names an existing directory, the unit's static configuration answers are kept there
+	// so reconnecting to the same unit and firmware skips querying them again
+	Lidar(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache = "");
+
+	// Same as above, with the thread decoding the scan stream scheduled as thread_config asks once the scan starts.
+	// Throws std::invalid_argument for a priority the policy does not take. Whether the OS granted the rest
+	// (real-time policies and locked memory need privileges) is up to acquisition_thread_config to tell
+	Lidar(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache, const sl::LidarThreadConfig &thread_config);
+
+	// Connects over an already created channel. Takes ownership of the channel.
+	// name is reported in place of the com port
+	Lidar(sl::IChannel *channel, std::string name, std::string capability_cache = "");
+
+	// Plays back a file recorded with the capture constructor instead of talking to hardware.
+	// When realtime is false the data is delivered as fast as it is read. Once a command differs from the recorded one
+	// nothing more is delivered, so calls waiting on an answer throw
+	static std::unique_ptr<Lidar> from_replay(const std::string &capture_path, bool realtime = false);
+
+	// Connects through a channel corrupting, dropping and inserting bytes read from the lidar as config asks,
+	// to see how the scan stream recovers. set_fault_config changes the faults while running
+	static std::unique_ptr<Lidar> with_fault_injection(std::string my_port, uint32_t baudrate, const sl::FaultInjectionConfig &config);
+
+	// Connects on a thread of its own and hands the outcome to on_done on that thread. The caller never waits for it,
+	// so giving up on a slow connection does not block, the thread is joined by a later call or join_connect_threads
+	static void connect_async(std::string my_port, uint32_t baudrate, std::string capture_path, std::string capability_cache,
+							  std::function<void(connect_result)> on_done);
+
+	// Waits for every connect_async thread still running, so that none outlives whatever its on_done relies on.
+	// To be called at shutdown, and not from an on_done
+	static void join_connect_threads();
+
+	// Same as above, delivered through a future
+	static std::future<connect_result> connect_async(std::string my_port, uint32_t baudrate, std::string capture_path = "", std::string capability_cache = "");
+
+	// Connects to all ports at once, waiting at most timeout for each. Results are in the order of ports.
+	// A port still connecting at the timeout is reported as failed and its lidar is released once it shows up
+	static std::vector<connect_result> connect_all(const std::vector<std::string> &ports, uint32_t baudrate, std::chrono::milliseconds timeout,
+												   std::string capability_cache = "");
+
 	~Lidar();
 
 private: //Member variable initialization methods
@@ -70,10 +168,64 @@ private: //Member variable initialization methods
 
 	std::string init_mac_address();
 
+	// Writes back the capability cache if the driver learnt anything since it was loaded
+	void update_capability_cache();
+
+	// Spins the motor up and requests the scan, start_motor without waiting for the motor to settle
+	void start_scan();
+
+	// Returns once consecutive rotations hold about as many samples, or after SPIN_UP_TIMEOUT, as the scan is usable either way
+	void wait_for_spin_up();
+
+	// Body of the supervisor thread
+	void supervise();
+
+	// Reconnects and restarts the scan after a stall, retrying until it works or the scan is no longer wanted
+	void recover(std::chrono::steady_clock::time_point outage_start);
+
+	// One reconnection, the control lock must be held
+	bool try_reconnect();
+
+	// How long the stream may go without a packet in the scan mode last started
+	std::chrono::milliseconds stall_timeout() const;
+
+	// The channel of a lidar made by with_fault_injection, throws std::runtime_error for any other
+	sl::IFaultInjectionChannel &fault_channel() const;
+
+	// Throws std::invalid_argument unless the priority fits the policy
+	static void check_thread_config(const sl::LidarThreadConfig &thread_config);
+
+	// my_port once check_thread_config passed, so that the connecting constructor is never reached with a bad config
+	static std::string checked_port(std::string my_port, const sl::LidarThreadConfig &thread_config);
+
+	// m_scan_buffer sized for the scan capacity
+	std::vector<sl_lidar_response_measurement_node_hq_t> &scan_buffer();
+
+	// Samples every buffer from m_scan_pool is sized for, count or the largest rotation seen so far if it was larger
+	std::size_t pooled_samples(std::size_t count);
+
+	// A buffer from m_scan_pool for per_sample elements per sample of a rotation of count samples. It is sized for
+	// the largest rotation seen so far, so that the pool settles on a single slab size
+	template <typename T>
+	T *acquire_scan(std::size_t count, std::size_t per_sample = 1);
+
+	// Waits for the next rotation and leaves it in m_scan_buffer in the order the lidar sent it, returns its length
+	std::size_t grab_scan();
+
+	// grab_scan, then sorts m_scan_buffer into ascending angle order
+	std::size_t grab_sorted_scan();
+
+	// Records the age of the rotation last grabbed, once it is ready for the caller
+	void record_delivery();
+
+	// Hands a grabbed rotation to the scan log, if there is one
+	void log_scan(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count);
+
 public: //Methods
 
 	void stop_motor();
 
+	// Starts the scan and returns once the motor has settled, judged from the sample count of consecutive rotations
 	void start_motor();
 
 	void reset();
@@ -90,22 +242,123 @@ public: //Methods
 
 	std::pair<RPLidar_Status_Code, RPLidar_Result_Code> get_health();
 
+	// Scan modes the lidar offers, the ids are what switch_mode takes
+	std::vector<sl::LidarScanMode> scan_modes();
+
+	/*
+	 * Switches the running scan to another mode and motor speed without stopping the motor.
+	 * Blocks until the first rotation in the new mode has arrived and returns how long no rotation was published.
+	 * motor_speed is in rpm, or pwm on lidars with pwm motor control
+	 * */
+	std::chrono::milliseconds switch_mode(sl_u16 mode, sl_u16 motor_speed = DEFAULT_MOTOR_SPEED);
+
+	/*
+	 * Watches the scan stream on a background thread. When no packet arrives for stall_multiple packet periods of the
+	 * running scan mode (but at least MIN_STALL_TIMEOUT), the channel is reopened, the driver reconnected and the scan
+	 * restarted in the same mode and at the same motor speed. A grab waits up to the driver's 2 s timeout, so one made during
+	 * an outage returns the first scan after it if the scan is back by then, and throws otherwise
+	 * */
+	void enable_supervisor(double stall_multiple = 20.0);
+
+	void disable_supervisor();
+
+	supervisor_stats get_supervisor_stats() const;
+
+	/*
+	 * Scheduling the thread decoding the scan stream actually runs with, as read back from the OS.
+	 * Throws if there is no such thread: while not scanning or while served by a LidarGroup
+	 * */
+	sl::LidarThreadConfig acquisition_thread_config();
+
+	/*
+	 * Sizes the scan buffers for nodes samples per rotation, SL_LIDAR_DEFAULT_SCAN_CAPACITY until set. They are allocated
+	 * once, by the driver when set and here on the first get_scan_as_*. Only while the motor is stopped.
+	 * Throws std::invalid_argument for 0
+	 * */
+	void set_scan_capacity(std::size_t nodes);
+
+	scan_capacity_stats get_scan_capacity_stats() const;
+
+	// Only for a lidar made by with_fault_injection, throws std::runtime_error for any other
+	void set_fault_config(const sl::FaultInjectionConfig &config);
+
+	sl::FaultInjectionStats get_fault_stats() const;
+
+	// Throughput and error counters of the scan stream since the lidar was connected
+	sl::LidarDriverStats get_driver_stats() const;
+
+	/*
+	 * The driver and supervisor counters in the Prometheus text exposition format, labelled with the serial number and port.
+	 * write_stats replaces the file at path with them in one step, for the node_exporter textfile collector or anything
+	 * else that scrapes a local file. Throws std::runtime_error if the file cannot be written
+	 * */
+	std::string stats_exposition() const;
+
+	void write_stats(const std::string &path) const;
+
+	/*
+	 * Every rotation grabbed from now on, by get_scan_as_* or a LidarGroup, is also queued to log under lidar_id,
+	 * in the order the lidar sent its samples. Queuing never blocks, see ScanLogWriter. A null log stops logging
+	 * */
+	void set_scan_log(std::shared_ptr<ScanLogWriter> log, std::uint32_t lidar_id = 0);
+
+	/*
+	 * Every rotation the driver publishes from now on, whether it is grabbed or not and also while served by a LidarGroup,
+	 * is resampled into stack on the thread that decoded it. A null stack stops it
+	 * */
+	void set_range_stack(std::shared_ptr<RangeStack> stack);
+
+	// Percentiles of the latency histograms. With reset they are emptied, so that every call covers the time since the previous one
+	latency_stats get_latency_stats(bool reset = true);
+
+	// Where get_scan_as_* take their buffers from
+	ScanPool &scan_pool();
+
 	/*
 	 * This function will be used in fetching the scan data
-	 * The output is a vector of lidar_samples.
+	 * The output is a vector of lidar_samples, in a buffer from scan_pool to be handed back with ScanPool::release
 	 * */
 	std::pair<lidar_sample *, std::size_t> get_scan_as_lidar_samples();
 
 	/*
-	 * Returns scan data in the form of x-y pairs
+	 * Returns scan data in the form of x-y pairs, in a buffer from scan_pool to be handed back with ScanPool::release
 	 * */
 	std::pair<point *, std::size_t> get_scan_as_xy();
 
+	/*
+	 * Returns scan data as float32 columns in a buffer from scan_pool, which gets it back once the last reference is gone
+	 * */
+	std::shared_ptr<ScanColumns> get_scan_as_columns();
+
+	/*
+	 * Returns the next rotation as it was sent and sorted, converting it to samples, points or timestamps only when they
+	 * are first asked for. Its buffers come from scan_pool and go back to it once the last reference is gone
+	 * */
+	std::shared_ptr<ScanFrame> get_scan_as_frame();
+
+	/*
+	 * Resamples the next rotation onto grid, leaving the ranges in the grid's buffer, which is reused every call.
+	 * Returns the number of samples the rotation had
+	 * */
+	std::size_t get_scan_resampled(AngularGrid &grid);
+
 private: //Class Constants
 
-	// It is defined in the internal section of the RPLidar library
-	// But it is not exported in the include headers
-	static constexpr size_t MAX_SCAN_NODES = 8192; 
+	// Shortest stall the supervisor reacts to, the host may well be late by a few ms when it is busy
+	static constexpr std::chrono::milliseconds MIN_STALL_TIMEOUT{50};
+
+	// A freshly started scan may take this long to deliver its first packet while the motor spins up
+	static constexpr std::chrono::milliseconds SCAN_START_TIMEOUT{2000};
+
+	// Longest start_motor waits for the motor to settle after starting the scan
+	static constexpr std::chrono::milliseconds SPIN_UP_TIMEOUT{3000};
+
+	// How long a reconnection attempt waits for the lidar to answer
+	static constexpr std::chrono::milliseconds PROBE_TIMEOUT{50};
+
+	// Pause between failed attempts, doubling up to the max
+	static constexpr std::chrono::milliseconds MIN_RETRY_DELAY{10};
+	static constexpr std::chrono::milliseconds MAX_RETRY_DELAY{100};
 
 private: //Member Variables
 
@@ -113,10 +366,52 @@ private: //Member Variables
 
 	const std::unique_ptr<sl::ILidarDriver> m_driver;
 
+	// Must be initialized before m_device_info, which loads the cache
+	const std::string m_capability_cache;
+
+	// Number of conf answers the cache file currently holds
+	std::size_t m_cached_answers = 0;
+
 	const sl_lidar_response_device_info_t m_device_info;
 
 	//Max size of mac address is 17 chars
 	const std::string m_mac_address;
 
 	const std::string m_com_port;
+
+	// Serializes commands to the driver between the caller and the supervisor
+	std::mutex m_control_lock;
+
+	// What start_motor set up, restored after a reconnection
+	std::atomic<bool> m_scan_requested{false};
+	sl::LidarScanMode m_scan_mode = {};
+	sl_u16 m_motor_speed = DEFAULT_MOTOR_SPEED;
+
+	std::thread m_supervisor;
+	std::mutex m_supervisor_lock;
+	std::condition_variable m_supervisor_wake;
+	bool m_supervisor_stop = false;
+	double m_stall_multiple = 0;
+
+	mutable std::mutex m_stats_lock;
+	supervisor_stats m_supervisor_stats = {};
+
+	// Receives the rotation grabbed by get_scan_as_*. Allocated by the first of them, so lidars served by a LidarGroup never do
+	std::vector<sl_lidar_response_measurement_node_hq_t> m_scan_buffer;
+
+	// Shared with the buffers still handed out, which may outlive this object
+	const std::shared_ptr<ScanPool> m_scan_pool;
+
+	sl::LatencyHistogram m_delivery_latency;
+
+	// Id of the scan mode running, for the scan log. m_scan_mode itself belongs to whoever holds the control lock
+	std::atomic<sl_u16> m_scan_mode_id{0};
+
+	std::mutex m_scan_log_lock;
+	std::shared_ptr<ScanLogWriter> m_scan_log;
+	std::uint32_t m_scan_log_id = 0;
+
+	// Registered with the driver, which only holds a plain pointer
+	std::mutex m_range_stack_lock;
+	std::shared_ptr<RangeStack> m_range_stack;
 };
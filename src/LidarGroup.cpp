@@ -0,0 +1,283 @@
+#include <stdexcept> //std::runtime_error, std::invalid_argument, std::out_of_range
+#include <algorithm> //std::max
+
+#ifndef _WIN32
+#include <poll.h>    //poll
+#endif
+
+#include "LidarGroup.h"
+#include "sl_trace.h"
+
+constexpr std::chrono::milliseconds LidarGroup::POLL_INTERVAL;
+constexpr std::chrono::milliseconds LidarGroup::RETRY_INTERVAL;
+
+LidarGroup::LidarGroup(std::size_t queue_depth, const sl::LidarThreadConfig &thread_config)
+    : m_queue_depth(queue_depth), m_thread_config(thread_config)
+{
+    if (queue_depth == 0)
+    {
+        throw std::invalid_argument("queue_depth must be at least 1");
+    }
+
+    Lidar::check_thread_config(thread_config);
+}
+
+LidarGroup::~LidarGroup()
+{
+    try
+    {
+        stop();
+    }
+    catch (const std::exception &)
+    {
+        //Best effort, the lidars stop their motors when destroyed anyway
+    }
+}
+
+std::size_t LidarGroup::add(std::unique_ptr<Lidar> lidar)
+{
+    if (!lidar)
+    {
+        throw std::invalid_argument("No lidar to add");
+    }
+
+    if (!m_stop)
+    {
+        throw std::runtime_error("Lidars can only be added while the group is stopped");
+    }
+
+    std::lock_guard<std::mutex> control(lidar->m_control_lock);
+    if (!SL_IS_OK(lidar->m_driver->setExternalPump(true)))
+    {
+        throw std::runtime_error("Could not add lidar " + lidar->m_com_port + ", stop its scan first");
+    }
+
+    m_lidars.push_back(std::move(lidar));
+    return m_lidars.size() - 1;
+}
+
+std::size_t LidarGroup::size() const
+{
+    return m_lidars.size();
+}
+
+Lidar &LidarGroup::lidar(std::size_t index)
+{
+    if (index >= m_lidars.size())
+    {
+        throw std::out_of_range("No lidar " + std::to_string(index) + " in the group");
+    }
+
+    return *m_lidars[index];
+}
+
+void LidarGroup::start()
+{
+    if (!m_stop)
+    {
+        return;
+    }
+
+    // Large enough for a full rotation of any of the lidars, only reallocated when their capacities changed
+    std::size_t capacity = 0;
+    for (std::unique_ptr<Lidar> &lidar : m_lidars)
+    {
+        capacity = std::max(capacity, lidar->m_driver->getScanCapacity());
+    }
+    if (m_grab_buffer.size() != capacity)
+    {
+        std::vector<sl_lidar_response_measurement_node_hq_t>(capacity).swap(m_grab_buffer);
+    }
+
+    std::size_t started = 0;
+    try
+    {
+        for (; started < m_lidars.size(); ++started)
+        {
+            m_lidars[started]->start_scan();
+        }
+    }
+    catch (const std::exception &)
+    {
+        // A group that did not start leaves no motor running, including the one that failed part way
+        for (std::size_t index = 0; index <= started && index < m_lidars.size(); ++index)
+        {
+            try
+            {
+                m_lidars[index]->stop_motor();
+            }
+            catch (const std::exception &)
+            {
+                //Best effort, what failed to start is reported below
+            }
+        }
+        throw;
+    }
+
+    m_stop = false;
+
+    std::promise<void> configured;
+    std::future<void> ready = configured.get_future();
+    m_service = std::thread(&LidarGroup::serve, this, std::move(configured));
+    ready.wait();
+
+    // The motors spin up together, only the service thread decodes what tells that they have settled
+    for (std::unique_ptr<Lidar> &lidar : m_lidars)
+    {
+        lidar->wait_for_spin_up();
+    }
+}
+
+void LidarGroup::stop()
+{
+    m_stop = true;
+    if (m_service.joinable())
+    {
+        m_service.join();
+    }
+
+    for (std::unique_ptr<Lidar> &lidar : m_lidars)
+    {
+        lidar->stop_motor();
+    }
+}
+
+bool LidarGroup::next_scan(group_scan &scan, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> queue(m_queue_lock);
+    if (!m_queue_ready.wait_for(queue, timeout, [this]() { return !m_queue.empty(); }))
+    {
+        return false;
+    }
+
+    scan = std::move(m_queue.front());
+    m_queue.pop_front();
+    return true;
+}
+
+void LidarGroup::set_scan_log(std::shared_ptr<ScanLogWriter> log)
+{
+    for (std::size_t index = 0; index < m_lidars.size(); ++index)
+    {
+        m_lidars[index]->set_scan_log(log, (std::uint32_t)index);
+    }
+}
+
+std::uint64_t LidarGroup::dropped_scans() const
+{
+    std::lock_guard<std::mutex> queue(m_queue_lock);
+    return m_dropped_scans;
+}
+
+sl::LidarThreadConfig LidarGroup::thread_config() const
+{
+    if (m_stop)
+    {
+        throw std::runtime_error("The group is not running");
+    }
+
+    return m_effective_thread_config;
+}
+
+void LidarGroup::serve(std::promise<void> configured)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Whatever the OS refused shows in the effective settings, serving the lidars matters more
+    sl::configureCurrentThread(m_thread_config, &m_effective_thread_config);
+    configured.set_value();
+    sl::setTraceThreadName("lidar group");
+
+    // Lidars that are not scanning, e.g. during a mode switch or a reconnection, are left alone for a while
+    // instead of waking the loop for every byte of a command answer
+    std::vector<clock::time_point> resting_until(m_lidars.size());
+
+#ifndef _WIN32
+    std::vector<struct pollfd> ports(m_lidars.size());
+#endif
+
+    while (!m_stop)
+    {
+        clock::time_point now = clock::now();
+
+#ifdef _WIN32
+        // Serial ports offer nothing to wait on together with others here
+        std::this_thread::sleep_for(POLL_INTERVAL);
+#else
+        for (std::size_t i = 0; i < m_lidars.size(); ++i)
+        {
+            // poll skips negative descriptors, ports without one are served every interval
+            ports[i].fd = now < resting_until[i] ? -1 : m_lidars[i]->m_channel->getPollFd();
+            ports[i].events = POLLIN;
+            ports[i].revents = 0;
+        }
+
+        ::poll(ports.data(), ports.size(), (int)POLL_INTERVAL.count());
+#endif
+
+        now = clock::now();
+        for (std::size_t i = 0; i < m_lidars.size(); ++i)
+        {
+            if (now < resting_until[i])
+            {
+                continue;
+            }
+
+#ifndef _WIN32
+            if (ports[i].fd >= 0 && !(ports[i].revents & POLLIN))
+            {
+                if (ports[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+                {
+                    resting_until[i] = now + RETRY_INTERVAL;
+                }
+                continue;
+            }
+#endif
+
+            std::size_t published = 0;
+            if (!SL_IS_OK(m_lidars[i]->m_driver->pumpScanData(&published)))
+            {
+                resting_until[i] = now + RETRY_INTERVAL;
+                continue;
+            }
+
+            if (published)
+            {
+                deliver(i, published);
+            }
+        }
+    }
+}
+
+void LidarGroup::deliver(std::size_t index, std::size_t published)
+{
+    sl::ILidarDriver &driver = *m_lidars[index]->m_driver;
+
+    std::size_t count = m_grab_buffer.size();
+    if (!SL_IS_OK(driver.grabScanDataHq(m_grab_buffer.data(), count, 0)) || count == 0)
+    {
+        return;
+    }
+    m_lidars[index]->log_scan(m_grab_buffer.data(), count);
+    driver.ascendScanData(m_grab_buffer.data(), count); //No error checking, an unsorted scan is still a scan
+
+    group_scan scan;
+    scan.lidar = index;
+    scan.nodes.assign(m_grab_buffer.begin(), m_grab_buffer.begin() + count);
+    scan.received = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> queue(m_queue_lock);
+
+        // The driver only keeps the latest rotation
+        m_dropped_scans += published - 1;
+
+        if (m_queue.size() == m_queue_depth)
+        {
+            m_queue.pop_front();
+            ++m_dropped_scans;
+        }
+        m_queue.push_back(std::move(scan));
+    }
+    m_queue_ready.notify_one();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>              //std::uint64_t
+#include <memory>               //std::unique_ptr
+#include <vector>               //std::vector
+#include <deque>                //std::deque
+#include <chrono>               //std::chrono::milliseconds
+#include <thread>               //std::thread
+#include <mutex>                //std::mutex
+#include <condition_variable>   //std::condition_variable
+#include <atomic>               //std::atomic
+#include <future>               //std::promise
+
+#include "Lidar.h"
+
+// Serves the scan streams of several lidars from a single thread. Rather than each driver running its own
+// data acquisition thread, one poll loop waits on all of their serial ports at once and decodes whichever has
+// data into that lidar's driver, so N lidars cost one thread and one wakeup per batch of ready ports.
+// Every completed rotation goes to one queue shared by the whole group.
+class LidarGroup
+{
+public: //Classes and structs
+	typedef struct group_scan
+	{
+		std::size_t lidar;												 // Index returned by add
+		std::vector<sl_lidar_response_measurement_node_hq_t> nodes;		 // One rotation in ascending angle order
+		std::chrono::steady_clock::time_point received;					 // When its last sample was decoded
+	} group_scan;
+
+public: //Ctor Dtor
+	// At most queue_depth scans wait for next_scan, beyond that the oldest one is dropped.
+	// The thread serving the lidars is scheduled as thread_config asks, see Lidar
+	explicit LidarGroup(std::size_t queue_depth = 16, const sl::LidarThreadConfig &thread_config = sl::LidarThreadConfig());
+
+	~LidarGroup();
+
+	LidarGroup(const LidarGroup &) = delete;
+	LidarGroup &operator=(const LidarGroup &) = delete;
+
+public: //Methods
+	// Takes over a connected lidar that is not scanning and returns its index. Only while the group is stopped
+	std::size_t add(std::unique_ptr<Lidar> lidar);
+
+	std::size_t size() const;
+
+	// The lidars stay usable for everything but grabbing scans, which is up to the group
+	Lidar &lidar(std::size_t index);
+
+	// Starts the motor and scan of every lidar, then the thread serving them, and returns once the motors have settled.
+	// If a lidar fails to start the motors already started are stopped again before the error is rethrown
+	void start();
+
+	// Stops the thread and the motors. Scans still queued can be taken afterwards
+	void stop();
+
+	// Waits up to timeout for the next rotation of any lidar, returns false if none arrived
+	bool next_scan(group_scan &scan, std::chrono::milliseconds timeout);
+
+	// Logs the rotations of every lidar in the group to log, each under its index. A null log stops logging.
+	// Lidars added afterwards are not logged until this is called again
+	void set_scan_log(std::shared_ptr<ScanLogWriter> log);
+
+	// Rotations lost because the queue was full or a lidar completed several in one pass
+	std::uint64_t dropped_scans() const;
+
+	// Scheduling the serving thread actually runs with, as read back from the OS. Throws while the group is stopped
+	sl::LidarThreadConfig thread_config() const;
+
+private:
+	// Body of the service thread, configured tells start once it has scheduled itself
+	void serve(std::promise<void> configured);
+
+	// Takes the rotation a lidar's driver just published and queues it
+	void deliver(std::size_t index, std::size_t published);
+
+private: //Class Constants
+
+	// Longest the service thread sleeps in poll, bounds how late stop is noticed. Ports that cannot be polled
+	// (Windows, network channels) are read once per interval
+	static constexpr std::chrono::milliseconds POLL_INTERVAL{10};
+
+	// How long a lidar that is not scanning or whose port reported an error is left alone
+	static constexpr std::chrono::milliseconds RETRY_INTERVAL{10};
+
+private: //Member Variables
+
+	const std::size_t m_queue_depth;
+
+	const sl::LidarThreadConfig m_thread_config;
+
+	// Written by the service thread before start returns, read only while it runs
+	sl::LidarThreadConfig m_effective_thread_config;
+
+	std::vector<std::unique_ptr<Lidar>> m_lidars;
+
+	std::thread m_service;
+	std::atomic<bool> m_stop{true};
+
+	// Receives the published rotation before it is copied into the queue. Sized by start, then only touched by the service thread
+	std::vector<sl_lidar_response_measurement_node_hq_t> m_grab_buffer;
+
+	mutable std::mutex m_queue_lock;
+	std::condition_variable m_queue_ready;
+	std::deque<group_scan> m_queue;
+	std::uint64_t m_dropped_scans = 0;
+};
@@ -6,11 +6,271 @@
 #include <string>
 #include <limits>
 #include <stdexcept>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 
 #include "Lidar.h"
+#include "LidarGroup.h"
+#include "Discovery.h"
+#include "DLPack.h"
+#include "ScanLog.h"
+#include "ScanCodec.h"
+#include "ScanFrame.h"
+#include "AngularGrid.h"
+#include "RangeStack.h"
+#include "sl_lidar_emulator.h"
+#include "sl_trace.h"
 
 namespace py = pybind11;
 
+namespace
+{
+    // Scheduling options as the Python constructors take them
+    sl::LidarThreadConfig make_thread_config(const std::string &sched_policy, int sched_priority, const std::vector<int> &cpus, bool lock_memory)
+    {
+        sl::LidarThreadConfig config;
+
+        if (sched_policy == "inherit")
+        {
+            config.policy = sl::LidarSchedPolicyInherit;
+        }
+        else if (sched_policy == "fifo")
+        {
+            config.policy = sl::LidarSchedPolicyFifo;
+        }
+        else if (sched_policy == "rr")
+        {
+            config.policy = sl::LidarSchedPolicyRoundRobin;
+        }
+        else
+        {
+            throw std::invalid_argument("sched_policy must be one of inherit, fifo or rr");
+        }
+        config.priority = sched_priority;
+
+        for (int cpu : cpus)
+        {
+            if (cpu < 0 || cpu >= 64)
+            {
+                throw std::invalid_argument("cpus range from 0 to 63");
+            }
+            config.cpu_mask |= (sl_u64)1 << cpu;
+        }
+
+        config.lock_memory = lock_memory;
+        return config;
+    }
+
+    // Resampling policies as AngularGrid takes them
+    AngularGrid::policy_id make_grid_policy(const std::string &policy)
+    {
+        if (policy == "nearest")
+        {
+            return AngularGrid::NEAREST;
+        }
+        else if (policy == "min_range")
+        {
+            return AngularGrid::MIN_RANGE;
+        }
+        else if (policy == "interpolate")
+        {
+            return AngularGrid::INTERPOLATE;
+        }
+        throw std::invalid_argument("policy must be one of nearest, min_range or interpolate");
+    }
+
+    const char *grid_policy_name(AngularGrid::policy_id policy)
+    {
+        switch (policy)
+        {
+        case AngularGrid::MIN_RANGE:
+            return "min_range";
+        case AngularGrid::INTERPOLATE:
+            return "interpolate";
+        default:
+            return "nearest";
+        }
+    }
+
+    // Fault injection settings as the Python methods take them
+    sl::FaultInjectionConfig make_fault_config(float corrupt_rate, float drop_rate, float insert_rate, sl_u32 burst_length, sl_u64 skip_bytes, sl_u32 seed)
+    {
+        sl::FaultInjectionConfig config;
+        config.corrupt_rate = corrupt_rate;
+        config.drop_rate = drop_rate;
+        config.insert_rate = insert_rate;
+        config.burst_length = burst_length;
+        config.skip_bytes = skip_bytes;
+        config.seed = seed;
+        return config;
+    }
+
+    // Durations in seconds, like the rest of the API
+    py::dict latency_summary_to_dict(const sl::LatencySummary &summary)
+    {
+        py::dict out;
+        out["count"] = summary.count;
+        out["p50"] = summary.p50_us / 1e6;
+        out["p99"] = summary.p99_us / 1e6;
+        out["max"] = summary.max_us / 1e6;
+        return out;
+    }
+
+    py::dict thread_config_to_dict(const sl::LidarThreadConfig &config)
+    {
+        const char *policy = "inherit";
+        if (config.policy == sl::LidarSchedPolicyFifo)
+        {
+            policy = "fifo";
+        }
+        else if (config.policy == sl::LidarSchedPolicyRoundRobin)
+        {
+            policy = "rr";
+        }
+
+        py::list cpus;
+        for (int cpu = 0; cpu < 64; ++cpu)
+        {
+            if (config.cpu_mask & ((sl_u64)1 << cpu))
+            {
+                cpus.append(cpu);
+            }
+        }
+
+        py::dict out;
+        out["policy"] = policy;
+        out["priority"] = config.priority;
+        out["cpus"] = cpus;
+        out["memory_locked"] = config.lock_memory;
+        return out;
+    }
+
+    // Wraps a buffer from a ScanPool, which gets it back once numpy is done with the array
+    template <typename T>
+    py::array_t<T> pooled_array(T *data, std::size_t count)
+    {
+        SL_TRACE_SCOPE(trace, "handoff");
+        SL_TRACE_ARG(trace, count);
+
+        py::capsule release_when_done(data, [](void *f)
+                                      { ScanPool::release(f); });
+
+        return py::array_t<T>(
+            {count},             // shape
+            {sizeof(T)},         // C-style contiguous strides
+            data,                // the data pointer
+            release_when_done    // numpy array references this parent
+        );
+    }
+
+    // What a DLPack consumer holds on to, its deleter may run on any thread and without the GIL
+    struct dlpack_export
+    {
+        DLManagedTensor managed;
+        std::int64_t shape[2];
+        std::shared_ptr<ScanColumns> scan;
+    };
+
+    void delete_dlpack_export(DLManagedTensor *managed)
+    {
+        delete static_cast<dlpack_export *>(managed->manager_ctx);
+    }
+
+    void dlpack_capsule_destructor(PyObject *capsule)
+    {
+        // A consumer renames the capsule once it has taken over calling the deleter
+        if (PyCapsule_IsValid(capsule, "used_dltensor"))
+        {
+            return;
+        }
+
+        DLManagedTensor *managed = static_cast<DLManagedTensor *>(PyCapsule_GetPointer(capsule, "dltensor"));
+        if (!managed)
+        {
+            PyErr_WriteUnraisable(capsule);
+            return;
+        }
+        managed->deleter(managed);
+    }
+
+    // What DLPack asks producers to raise for exports they cannot make
+    [[noreturn]] void raise_buffer_error(const char *message)
+    {
+        PyErr_SetString(PyExc_BufferError, message);
+        throw py::error_already_set();
+    }
+
+    // The (3, n) float32 matrix of a scan as a "dltensor" capsule, sharing its memory
+    py::capsule to_dlpack(const std::shared_ptr<ScanColumns> &scan)
+    {
+        dlpack_export *exported = new dlpack_export();
+        exported->scan = scan;
+        exported->shape[0] = ScanColumns::COLUMNS;
+        exported->shape[1] = scan->size();
+
+        DLTensor &tensor = exported->managed.dl_tensor;
+        tensor.data = scan->data();
+        tensor.device = {kDLCPU, 0};
+        tensor.ndim = 2;
+        tensor.dtype = {kDLFloat, 32, 1};
+        tensor.shape = exported->shape;
+        tensor.strides = nullptr;
+        tensor.byte_offset = 0;
+        exported->managed.manager_ctx = exported;
+        exported->managed.deleter = delete_dlpack_export;
+
+        PyObject *capsule = PyCapsule_New(&exported->managed, "dltensor", dlpack_capsule_destructor);
+        if (!capsule)
+        {
+            delete exported;
+            throw py::error_already_set();
+        }
+        return py::reinterpret_steal<py::capsule>(capsule);
+    }
+
+    // Seconds since the epoch as the microseconds of a scan log, times before the epoch as the epoch
+    std::uint64_t seconds_to_us(double seconds)
+    {
+        return seconds > 0.0 ? (std::uint64_t)(seconds * 1e6) : 0;
+    }
+
+    // A column of a scan as a numpy view that keeps the scan alive
+    py::array_t<float> column_view(py::object scan, ScanColumns::column_id which)
+    {
+        ScanColumns &columns = scan.cast<ScanColumns &>();
+        return py::array_t<float>({columns.size()}, {sizeof(float)}, columns.column(which), scan);
+    }
+
+    // The buffer of a grid as a read-only numpy view that keeps the grid alive
+    py::array_t<float> grid_ranges(py::object grid)
+    {
+        AngularGrid &resampler = grid.cast<AngularGrid &>();
+        py::array_t<float> view({resampler.bins()}, {sizeof(float)}, resampler.ranges(), grid);
+        view.attr("setflags")(py::arg("write") = false);
+        return view;
+    }
+
+    // Whether a background thread may still take the GIL. Once finalization has begun taking it hangs or kills the thread
+    bool interpreter_alive()
+    {
+#if PY_VERSION_HEX >= 0x030D0000
+        return Py_IsInitialized() && !Py_IsFinalizing();
+#else
+        return Py_IsInitialized() && !_Py_IsFinalizing();
+#endif
+    }
+
+    // Samples of a frame as a read-only numpy view that keeps the frame alive
+    template <typename T>
+    py::array_t<T> frame_view(py::object frame, const T *data)
+    {
+        py::array_t<T> view({frame.cast<const ScanFrame &>().size()}, {sizeof(T)}, data, frame);
+        view.attr("setflags")(py::arg("write") = false);
+        return view;
+    }
+}
+
 PYBIND11_MODULE(FastPyRpLidar, m)
 {
     /*
@@ -95,7 +355,394 @@ PYBIND11_MODULE(FastPyRpLidar, m)
         "quality", [](Lidar::point &self)
         { return self.quality; },
         "The quality of the datapoint on a scale of [0,255]");
-    
+
+    /*
+    ScanColumns is one rotation as float32 columns, shared without copying with numpy, PyTorch, JAX and anything
+    else taking the buffer protocol or DLPack
+    */
+    constexpr const char* SCAN_DOCSTRING =
+    R"myDelim(One rotation as float32 columns: angle in degrees, distance in meters and quality on a scale of [0,255].
+        The columns follow each other in memory, so the scan is also a C-contiguous float32 matrix of shape (3, len(scan)).
+        numpy.asarray(scan), memoryview(scan), torch.from_dlpack(scan) and jax.dlpack.from_dlpack(scan) all share that memory
+        instead of copying it, and keep the scan alive for as long as they use it
+    )myDelim";
+    auto py_scan = py::class_<ScanColumns, std::shared_ptr<ScanColumns>>(m, "Scan", py::buffer_protocol(), SCAN_DOCSTRING);
+    py_scan.def_buffer(
+        [](ScanColumns &self)
+        {
+            return py::buffer_info(
+                self.data(),
+                sizeof(float),
+                py::format_descriptor<float>::format(),
+                2,
+                {(py::ssize_t)ScanColumns::COLUMNS, (py::ssize_t)self.size()},
+                {(py::ssize_t)(sizeof(float) * self.size()), (py::ssize_t)sizeof(float)});
+        });
+    py_scan.def_property_readonly(
+        "angle", [](py::object self)
+        { return column_view(self, ScanColumns::ANGLE); },
+        "Angles in degrees, a float32 view into the scan");
+    py_scan.def_property_readonly(
+        "distance", [](py::object self)
+        { return column_view(self, ScanColumns::DISTANCE); },
+        "Distances in meters, a float32 view into the scan");
+    py_scan.def_property_readonly(
+        "quality", [](py::object self)
+        { return column_view(self, ScanColumns::QUALITY); },
+        "Qualities on a scale of [0,255], a float32 view into the scan");
+    py_scan.def("__len__", &ScanColumns::size);
+
+    constexpr const char* SCAN_DLPACK_DOCSTRING =
+    R"myDelim(Exports the (3, len(scan)) float32 matrix as a DLPack capsule sharing the memory of the scan
+
+    :param stream: Must be None, the scan lives on the CPU
+    :param max_version: Accepted for DLPack 1.0 consumers, which also take the unversioned capsule returned
+    :param dl_device: None or the CPU, (1, 0)
+    :param copy: None or False, the scan is only exported in place
+    :raises BufferError: For a stream, another device or a copy
+    :rtype: PyCapsule
+    )myDelim";
+    py_scan.def(
+        "__dlpack__",
+        [](const std::shared_ptr<ScanColumns> &self, py::object stream, py::object max_version, py::object dl_device, py::object copy)
+        {
+            if (!stream.is_none())
+            {
+                raise_buffer_error("A scan lives on the CPU, stream must be None");
+            }
+            if (!dl_device.is_none() && dl_device.cast<std::pair<int, int>>() != std::make_pair((int)kDLCPU, 0))
+            {
+                raise_buffer_error("A scan can only be exported to the CPU");
+            }
+            if (!copy.is_none() && copy.cast<bool>())
+            {
+                raise_buffer_error("A scan is only exported in place");
+            }
+            return to_dlpack(self);
+        },
+        py::kw_only(), py::arg("stream") = py::none(), py::arg("max_version") = py::none(), py::arg("dl_device") = py::none(),
+        py::arg("copy") = py::none(), SCAN_DLPACK_DOCSTRING);
+    py_scan.def(
+        "__dlpack_device__", [](const ScanColumns &)
+        { return py::make_tuple((int)kDLCPU, 0); },
+        "Returns the DLPack device of the scan, always the CPU: (1, 0)");
+
+    /*
+    ScanLogWriter and ScanLogReader record rotations to disk for later review and read them back through mmap
+    */
+    PYBIND11_NUMPY_DTYPE(sl_lidar_response_measurement_node_hq_t, angle_z_q14, dist_mm_q2, quality, flag);
+
+    constexpr const char* SCAN_LOG_WRITER_DOCSTRING =
+    R"myDelim(Records the raw HQ nodes of every rotation to a directory of numbered segments, each a data file and a time index. Rotations
+        are queued without blocking the thread reading the lidar and written by a thread of the writer. Attach it with RPLidar.set_scan_log
+        or LidarGroup.set_scan_log
+    )myDelim";
+    auto py_scan_log_writer = py::class_<ScanLogWriter, std::shared_ptr<ScanLogWriter>>(m, "ScanLogWriter", SCAN_LOG_WRITER_DOCSTRING);
+
+    constexpr const char * PY_SCAN_LOG_WRITER_INIT_DOCSTRING =
+    R"myDelim(Starts a new segment in directory, continuing the log already there
+
+    :param directory: An existing directory
+    :type directory: str
+    :param segment_bytes: Size from which the next rotation starts a new segment
+    :type segment_bytes: int
+    :param max_pending_bytes: Memory rotations waiting to be written may hold. Beyond it rotations are dropped and counted
+    :type max_pending_bytes: int
+    :raises RuntimeError: If the segment cannot be created
+    )myDelim";
+    py_scan_log_writer.def(py::init<std::string, std::size_t, std::size_t>(),
+                           py::arg("directory"), py::arg("segment_bytes") = ScanLogWriter::DEFAULT_SEGMENT_BYTES,
+                           py::arg("max_pending_bytes") = ScanLogWriter::DEFAULT_MAX_PENDING_BYTES,
+                           PY_SCAN_LOG_WRITER_INIT_DOCSTRING);
+
+    py_scan_log_writer.def("flush", &ScanLogWriter::flush, py::call_guard<py::gil_scoped_release>(),
+                           "Waits until every rotation queued so far is on disk. Raises RuntimeError if writing failed");
+
+    py_scan_log_writer.def("close", &ScanLogWriter::close, py::call_guard<py::gil_scoped_release>(),
+                           "Writes what is queued and closes the segment, later rotations are dropped. Raises RuntimeError if writing failed");
+
+    py_scan_log_writer.def(
+        "stats",
+        [](ScanLogWriter &self)
+        {
+            ScanLogWriter::log_stats stats = self.stats();
+
+            py::dict out;
+            out["written"] = stats.written;
+            out["dropped"] = stats.dropped;
+            out["pending_bytes"] = stats.pending_bytes;
+            out["bytes_written"] = stats.bytes_written;
+            out["segment"] = stats.segment;
+            return out;
+        },
+        "Returns the rotations written and dropped, the memory held by those waiting, the bytes written and the current segment number");
+
+    constexpr const char* SCAN_LOG_READER_DOCSTRING =
+    R"myDelim(Maps a log written by ScanLogWriter into memory. Rotations are looked up by position or time in O(log n) and their nodes are
+        returned as read-only numpy views into the mapping, without copying. Sees the log as it was when opened
+    )myDelim";
+    auto py_scan_log_reader = py::class_<ScanLogReader>(m, "ScanLogReader", SCAN_LOG_READER_DOCSTRING);
+
+    py_scan_log_reader.def(py::init<const std::string &>(), py::arg("directory"),
+                           "Opens the log in directory. Raises RuntimeError if there is none or a segment is damaged");
+
+    py_scan_log_reader.def("__len__", &ScanLogReader::size);
+
+    constexpr const char * PY_SCAN_LOG_READER_SCAN_DOCSTRING =
+    R"myDelim(Returns a rotation of the log
+
+    :param index: Position of the rotation, in the order they were logged
+    :type index: int
+    :return: Wall-clock time it was logged at in seconds since the epoch, lidar id, scan mode, and its nodes as the lidar sent them,
+        a read-only numpy array with fields angle_z_q14, dist_mm_q2, quality and flag that keeps the reader alive
+    :rtype: tuple[float, int, int, numpy.ndarray]
+    :raises IndexError: If index is past the end
+    )myDelim";
+    py_scan_log_reader.def(
+        "scan",
+        [](py::object self, std::size_t index)
+        {
+            ScanLogReader::scan_entry entry = self.cast<const ScanLogReader &>().scan(index);
+
+            py::array_t<sl_lidar_response_measurement_node_hq_t> nodes(
+                {entry.count}, {sizeof(sl_lidar_response_measurement_node_hq_t)}, entry.nodes, self);
+            nodes.attr("setflags")(py::arg("write") = false);
+            return py::make_tuple(entry.timestamp_us / 1e6, entry.lidar_id, entry.scan_mode, nodes);
+        },
+        py::arg("index"), PY_SCAN_LOG_READER_SCAN_DOCSTRING);
+
+    constexpr const char * PY_SCAN_LOG_READER_TIME_RANGE_DOCSTRING =
+    R"myDelim(Returns the positions of the rotations logged in [start, stop)
+
+    :param start: Wall-clock time in seconds since the epoch
+    :type start: float
+    :param stop: Wall-clock time in seconds since the epoch
+    :type stop: float
+    :rtype: range
+    )myDelim";
+    py_scan_log_reader.def(
+        "time_range",
+        [](const ScanLogReader &self, double start, double stop)
+        {
+            std::size_t first = self.lower_bound(seconds_to_us(start));
+            std::size_t last = std::max(first, self.lower_bound(seconds_to_us(stop)));
+            return py::module_::import("builtins").attr("range")(first, last);
+        },
+        py::arg("start"), py::arg("stop"), PY_SCAN_LOG_READER_TIME_RANGE_DOCSTRING);
+
+    /*
+    ScanEncoder and ScanDecoder compress rotations of HQ nodes losslessly for recording and uploading
+    */
+    constexpr const char* SCAN_ENCODER_DOCSTRING =
+    R"myDelim(Compresses rotations of HQ nodes, such as those of ScanLogReader.scan, without loss into frames of bytes. Angles are predicted
+        from the step between samples, distances from the last valid one or the previous rotation, and quality and flag are run-length
+        coded, which typically takes a rotation to a quarter of its size or less
+    )myDelim";
+    auto py_scan_encoder = py::class_<ScanEncoder>(m, "ScanEncoder", SCAN_ENCODER_DOCSTRING);
+
+    py_scan_encoder.def(py::init<bool>(), py::arg("predict_from_previous") = true,
+                        "Without predict_from_previous every frame can be decoded on its own, at some cost in size");
+
+    constexpr const char* SCAN_ENCODER_ENCODE_DOCSTRING =
+    R"myDelim(Returns the frame of a rotation
+
+    :param nodes: The rotation, an array with fields angle_z_q14, dist_mm_q2, quality and flag
+    :type nodes: numpy.ndarray
+    :rtype: bytes
+    )myDelim";
+    py_scan_encoder.def(
+        "encode",
+        [](ScanEncoder &self, py::array_t<sl_lidar_response_measurement_node_hq_t, py::array::c_style | py::array::forcecast> nodes)
+        {
+            std::vector<std::uint8_t> frame;
+            self.encode(nodes.data(), nodes.size(), frame);
+            return py::bytes(reinterpret_cast<const char *>(frame.data()), frame.size());
+        },
+        py::arg("nodes"), SCAN_ENCODER_ENCODE_DOCSTRING);
+
+    py_scan_encoder.def("reset", &ScanEncoder::reset, "Makes the next frame decodable without the ones before it");
+
+    auto py_scan_decoder = py::class_<ScanDecoder>(m, "ScanDecoder", "Turns frames of ScanEncoder back into rotations, in the order they were encoded");
+
+    py_scan_decoder.def(py::init<>());
+
+    constexpr const char* SCAN_DECODER_DECODE_DOCSTRING =
+    R"myDelim(Returns the rotation of a frame
+
+    :param frame: A frame returned by ScanEncoder.encode
+    :type frame: bytes
+    :return: Its nodes, an array with fields angle_z_q14, dist_mm_q2, quality and flag
+    :rtype: numpy.ndarray
+    :raises RuntimeError: If the frame is damaged, has trailing bytes or refers to a rotation that was not decoded
+    )myDelim";
+    py_scan_decoder.def(
+        "decode",
+        [](ScanDecoder &self, py::buffer frame)
+        {
+            py::buffer_info info = frame.request();
+            if (info.ndim != 1 || info.itemsize != 1 || info.strides[0] != 1)
+            {
+                throw std::invalid_argument("A frame is a contiguous run of bytes");
+            }
+            const std::uint8_t *data = static_cast<const std::uint8_t *>(info.ptr);
+            const std::size_t size = info.size;
+
+            py::array_t<sl_lidar_response_measurement_node_hq_t> nodes((py::ssize_t)ScanDecoder::frame_nodes(data, size));
+            if (self.decode(data, size, nodes.mutable_data()) != size)
+            {
+                throw std::runtime_error("Trailing bytes after the scan frame");
+            }
+            return nodes;
+        },
+        py::arg("frame"), SCAN_DECODER_DECODE_DOCSTRING);
+
+    py_scan_decoder.def("reset", &ScanDecoder::reset, "Forgets the previous rotation, for a stream that starts over after ScanEncoder.reset");
+
+    /*
+    ScanFrame is one rotation read in whichever forms are needed, each converted on first access and kept
+    */
+    constexpr const char* SCAN_FRAME_DOCSTRING =
+    R"myDelim(One rotation, grabbed once and readable as polar samples, x-y points, raw nodes and sample times. Each is converted from the
+        nodes the first time it is read and kept for the next, so forms never read cost nothing. All are read-only numpy views that
+        keep the frame alive. polar, xy and timestamps are in ascending angle order, raw is in the order the lidar sent the samples
+    )myDelim";
+    auto py_scan_frame = py::class_<ScanFrame, std::shared_ptr<ScanFrame>>(m, "ScanFrame", SCAN_FRAME_DOCSTRING);
+    py_scan_frame.def_property_readonly(
+        "raw", [](py::object self)
+        { return frame_view(self, self.cast<const ScanFrame &>().raw()); },
+        "The HQ nodes as the lidar sent them, with fields angle_z_q14, dist_mm_q2, quality and flag");
+    py_scan_frame.def_property_readonly(
+        "polar", [](py::object self)
+        { return frame_view(self, self.cast<const ScanFrame &>().polar()); },
+        "The samples as Lidar_Scan, angle in degrees and distance in meters, as get_scanline returns them");
+    py_scan_frame.def_property_readonly(
+        "xy", [](py::object self)
+        { return frame_view(self, self.cast<const ScanFrame &>().xy()); },
+        "The samples as Point, x and y in meters, as get_scanline_xy returns them");
+    py_scan_frame.def_property_readonly(
+        "timestamps", [](py::object self)
+        { return frame_view(self, self.cast<const ScanFrame &>().timestamps()); },
+        "When each sample was taken in seconds of time.monotonic, spread over the rotation by angle. All equal the frame's timestamp "
+        "until the rotation speed is known");
+    py_scan_frame.def_property_readonly(
+        "timestamp", [](const ScanFrame &self)
+        { return self.timestamp_us() / 1e6; },
+        "When the last sample of the rotation was read, in seconds of time.monotonic");
+    py_scan_frame.def("__len__", &ScanFrame::size);
+
+    /*
+    AngularGrid resamples rotations onto a fixed number of evenly spaced bins
+    */
+    constexpr const char* ANGULAR_GRID_DOCSTRING =
+    R"myDelim(A fixed grid of bins evenly spaced around the turn, bin k centred on k * 360 / bins degrees, that RPLidar.get_scan_resampled
+        bins each rotation into in a single pass. Ranges are float32 meters, NaN where there was no return, and go into a buffer of the
+        grid that every rotation reuses
+    )myDelim";
+    auto py_angular_grid = py::class_<AngularGrid>(m, "AngularGrid", ANGULAR_GRID_DOCSTRING);
+
+    constexpr const char * PY_ANGULAR_GRID_INIT_DOCSTRING =
+    R"myDelim(Makes a grid of bins bins
+
+    :param bins: Number of bins in a turn, e.g. 360, 720 or 1440
+    :type bins: int
+    :param policy: How the samples in a bin make its range. nearest takes the one closest to the centre of the bin, min_range the shortest,
+        interpolate the range linear in angle between the samples either side of the centre, leaving NaN next to samples without return
+    :type policy: str
+    :raises ValueError: For 0 bins or an unknown policy
+    )myDelim";
+    py_angular_grid.def(py::init(
+                            [](std::size_t bins, const std::string &policy)
+                            { return new AngularGrid(bins, make_grid_policy(policy)); }),
+                        py::arg("bins") = 360, py::arg("policy") = "nearest", PY_ANGULAR_GRID_INIT_DOCSTRING);
+
+    py_angular_grid.def_property_readonly("bins", &AngularGrid::bins, "Number of bins in a turn");
+    py_angular_grid.def_property_readonly(
+        "policy", [](const AngularGrid &self)
+        { return grid_policy_name(self.policy()); },
+        "nearest, min_range or interpolate");
+    py_angular_grid.def_property_readonly("ranges", &grid_ranges,
+                                          "The ranges of the last rotation resampled in meters, a read-only float32 view that the next one overwrites");
+    py_angular_grid.def("index_of", &AngularGrid::index_of, py::arg("theta"),
+                        "Returns the bin an angle in degrees falls in, any angle is taken around the turn");
+    py_angular_grid.def("angle_of", &AngularGrid::angle_of, py::arg("index"), "Returns the angle in degrees of the centre of a bin");
+    py_angular_grid.def("distance_at", &AngularGrid::distance_at, py::arg("theta"),
+                        "Returns the range in meters of the last rotation resampled at an angle in degrees, NaN for no return, in O(1)");
+    py_angular_grid.def("__len__", &AngularGrid::bins);
+
+    /*
+    RangeStack keeps the last rotations of a lidar resampled onto an angular grid, for sequence models
+    */
+    constexpr const char* RANGE_STACK_DOCSTRING =
+    R"myDelim(The last depth rotations of a lidar resampled as AngularGrid does, kept up to date by the thread reading the lidar once it is
+        attached with RPLidar.set_range_stack. get returns them as one C-contiguous (depth, bins) float32 range image, oldest row first
+    )myDelim";
+    auto py_range_stack = py::class_<RangeStack, std::shared_ptr<RangeStack>>(m, "RangeStack", RANGE_STACK_DOCSTRING);
+
+    constexpr const char * PY_RANGE_STACK_INIT_DOCSTRING =
+    R"myDelim(Makes an empty stack, every range NaN until rotations arrive
+
+    :param depth: Number of rotations kept
+    :type depth: int
+    :param bins: Number of bins in a turn, as AngularGrid takes it
+    :type bins: int
+    :param policy: nearest, min_range or interpolate, as AngularGrid takes it
+    :type policy: str
+    :raises ValueError: For a depth or bins of 0 or an unknown policy
+    )myDelim";
+    py_range_stack.def(py::init(
+                           [](std::size_t depth, std::size_t bins, const std::string &policy)
+                           { return std::make_shared<RangeStack>(depth, bins, make_grid_policy(policy)); }),
+                       py::arg("depth"), py::arg("bins") = 360, py::arg("policy") = "nearest", PY_RANGE_STACK_INIT_DOCSTRING);
+
+    py_range_stack.def_property_readonly("depth", &RangeStack::depth, "Number of rotations kept");
+    py_range_stack.def_property_readonly("bins", &RangeStack::bins, "Number of bins in a turn");
+    py_range_stack.def_property_readonly(
+        "policy", [](const RangeStack &self)
+        { return grid_policy_name(self.policy()); },
+        "nearest, min_range or interpolate");
+    py_range_stack.def_property_readonly("revolutions", &RangeStack::revolutions, "Rotations pushed so far");
+
+    constexpr const char * PY_RANGE_STACK_GET_DOCSTRING =
+    R"myDelim(Waits for a rotation newer than after, without holding the GIL, and returns the stack as of then
+
+    :param after: The revolution of the previous get, 0 to take the stack as soon as it holds a rotation
+    :type after: int
+    :param timeout: Seconds to wait
+    :type timeout: float
+    :return: The (depth, bins) range image in meters oldest row first, NaN for no return and for rows not filled yet, when the last
+        sample of each row was read in seconds of time.monotonic (NaN for rows not filled yet), and the revolution to pass as after
+        to wait for the next rotation. None if no rotation arrived in time
+    :rtype: tuple[numpy.ndarray[numpy.float32], numpy.ndarray[numpy.float64], int]
+    )myDelim";
+    py_range_stack.def(
+        "get",
+        [](RangeStack &self, std::uint64_t after, double timeout) -> py::object
+        {
+            py::array_t<float> ranges({self.depth(), self.bins()});
+            std::vector<std::uint64_t> timestamps_us(self.depth());
+            float *out = ranges.mutable_data();
+            std::uint64_t revolution = 0;
+            bool received = false;
+            {
+                py::gil_scoped_release release;
+                received = self.copy_newer(after, out, timestamps_us.data(), revolution,
+                                           std::chrono::milliseconds((long long)(timeout * 1000.0)));
+            }
+            if (!received)
+            {
+                return py::none();
+            }
+
+            py::array_t<double> timestamps(self.depth());
+            double *seconds = timestamps.mutable_data();
+            for (std::size_t row = 0; row < timestamps_us.size(); ++row)
+            {
+                seconds[row] = timestamps_us[row] ? timestamps_us[row] / 1e6 : std::numeric_limits<double>::quiet_NaN();
+            }
+            return py::make_tuple(ranges, timestamps, revolution);
+        },
+        py::arg("after") = 0, py::arg("timeout") = 1.0, PY_RANGE_STACK_GET_DOCSTRING);
+
     /*
     Lidar is a class that encapsulates basic functionality of a RPLidar
     */
@@ -114,14 +761,208 @@ PYBIND11_MODULE(FastPyRpLidar, m)
     )myDelim";
     py_lidar.def(py::init<std::string, int>(),
                  "Loads Lidar over a serial connection from given USB port at given baud rate",
-                 py::arg("port"), py::arg("baud_rate"), PY_LIDAR_INIT_DOCSTRING);
+                 py::arg("port"), py::arg("baud_rate"), py::call_guard<py::gil_scoped_release>(), PY_LIDAR_INIT_DOCSTRING);
+
+    constexpr const char * PY_LIDAR_INIT_CAPTURE_DOCSTRING =
+    R"myDelim(Loads Lidar over a serial connection from given USB port at given baud rate, optionally recording every byte exchanged with the lidar to a capture file that can later be loaded with RPLidar.replay
+
+    :param port: A OS specific USB port that is connected to a Lidar. Ex: /dev/ttyUSB0 (Linux and OSX), com3 (Windows)
+    :type port: str
+    :param baud_rate: The baudrate at which to conduct communications. Eg 1000000 (S2 Lidar), 115200 (A2)
+    :type baud_rate: 32 bit unsigned int
+    :param capture_file: Path of the capture file, empty to not record. An existing file is overwritten, the reconnections of the supervisor append to it
+    :type capture_file: str
+    :param capability_cache: Existing directory in which the static configuration of each unit is kept, so that reconnecting to a known unit and firmware skips querying it. Empty to disable
+    :type capability_cache: str
+    :param sched_policy: Scheduling of the thread decoding the scan stream: inherit (from the calling thread), fifo or rr for the real-time policies
+    :type sched_policy: str
+    :param sched_priority: 1 (lowest) to 99 for the real-time policies, 0 for inherit
+    :type sched_priority: int
+    :param cpus: The cpus the decoding thread may run on, empty for those it inherits
+    :type cpus: list[int]
+    :param lock_memory: Lock every page of the process into RAM so the decoding thread never waits on a page fault
+    :type lock_memory: bool
+    :raises OverflowError: If any parameter passed cannot be converted to the propper C++ type resulting in an overflow
+    :raises ValueError: If the scheduling options are out of range
+    :raises RuntimeError: If establishing communication with the lidar fails or the capture file cannot be created
+
+    Real-time policies and locked memory need privileges (CAP_SYS_NICE, CAP_IPC_LOCK or matching rlimits) and are Linux only. Whatever the OS refuses is left as it was, see acquisition_thread
+    )myDelim";
+    py_lidar.def(py::init(
+                     [](std::string port, uint32_t baud_rate, std::string capture_file, std::string capability_cache,
+                        std::string sched_policy, int sched_priority, std::vector<int> cpus, bool lock_memory)
+                     {
+                         return new Lidar(port, baud_rate, capture_file, capability_cache,
+                                          make_thread_config(sched_policy, sched_priority, cpus, lock_memory));
+                     }),
+                 py::arg("port"), py::arg("baud_rate"), py::arg("capture_file") = "", py::arg("capability_cache") = "",
+                 py::arg("sched_policy") = "inherit", py::arg("sched_priority") = 0, py::arg("cpus") = std::vector<int>(),
+                 py::arg("lock_memory") = false, py::call_guard<py::gil_scoped_release>(), PY_LIDAR_INIT_CAPTURE_DOCSTRING);
+
+    constexpr const char * PY_LIDAR_REPLAY_DOCSTRING =
+    R"myDelim(Loads a Lidar that plays back a capture file instead of talking to hardware
+
+    :param capture_file: Path of a file recorded with RPLidar(port, baud_rate, capture_file)
+    :type capture_file: str
+    :param realtime: If true data is delivered with the timing it was recorded with, otherwise as fast as it is read
+    :type realtime: bool
+    :raises RuntimeError: If the capture file cannot be read, or by any later call once a command sent differs from the recorded one
+    :return: A lidar backed by the capture
+    :rtype: RPLidar
+    )myDelim";
+    py_lidar.def_static("replay", &Lidar::from_replay,
+                        py::arg("capture_file"), py::arg("realtime") = false, PY_LIDAR_REPLAY_DOCSTRING);
+
+    constexpr const char * PY_LIDAR_WITH_FAULTS_DOCSTRING =
+    R"myDelim(Loads Lidar from given USB port at given baud rate, corrupting, dropping and inserting bytes read from it, to see how the scan
+    stream recovers. Rates are per-byte probabilities in [0, 1]
+
+    :param port: A OS specific USB port that is connected to a Lidar. Ex: /dev/ttyUSB0 (Linux and OSX), com3 (Windows)
+    :type port: str
+    :param baud_rate: The baudrate at which to conduct communications. Eg 1000000 (S2 Lidar), 115200 (A2)
+    :type baud_rate: 32 bit unsigned int
+    :param corrupt_rate: Probability that a byte gets bits flipped
+    :type corrupt_rate: float
+    :param drop_rate: Probability that a byte is dropped, with burst_length this truncates packets
+    :type drop_rate: float
+    :param insert_rate: Probability that a random byte is inserted before a byte
+    :type insert_rate: float
+    :param burst_length: Consecutive bytes affected once a fault is triggered
+    :type burst_length: int
+    :param skip_bytes: Bytes passed untouched before the faults start, to spare the connection handshake
+    :type skip_bytes: int
+    :param seed: The same seed injects the same faults
+    :type seed: int
+    :raises RuntimeError: If communication with the lidar fails
+    :return: A lidar behind the faulty channel, see set_faults and fault_stats
+    :rtype: RPLidar
+    )myDelim";
+    py_lidar.def_static(
+        "with_faults",
+        [](std::string port, uint32_t baud_rate, float corrupt_rate, float drop_rate, float insert_rate, sl_u32 burst_length, sl_u64 skip_bytes, sl_u32 seed)
+        {
+            return Lidar::with_fault_injection(port, baud_rate, make_fault_config(corrupt_rate, drop_rate, insert_rate, burst_length, skip_bytes, seed));
+        },
+        py::arg("port"), py::arg("baud_rate"), py::arg("corrupt_rate") = 0.0f, py::arg("drop_rate") = 0.0f, py::arg("insert_rate") = 0.0f,
+        py::arg("burst_length") = 1, py::arg("skip_bytes") = 0, py::arg("seed") = 1, py::call_guard<py::gil_scoped_release>(),
+        PY_LIDAR_WITH_FAULTS_DOCSTRING);
+
+    constexpr const char * PY_LIDAR_CONNECT_ASYNC_DOCSTRING =
+    R"myDelim(Connects to a lidar on a background thread without holding the GIL. Connections still running when the interpreter exits are waited for
+
+    :param port: A OS specific USB port that is connected to a Lidar. Ex: /dev/ttyUSB0 (Linux and OSX), com3 (Windows)
+    :type port: str
+    :param baud_rate: The baudrate at which to conduct communications. Eg 1000000 (S2 Lidar), 115200 (A2)
+    :type baud_rate: 32 bit unsigned int
+    :param capture_file: Path of the capture file, empty to not record
+    :type capture_file: str
+    :param capability_cache: Directory in which the static configuration of each unit is kept, empty to disable
+    :type capability_cache: str
+    :return: A future resolving to the connected RPLidar, or raising RuntimeError if the connection failed. Use asyncio.wrap_future to await it
+    :rtype: concurrent.futures.Future
+    )myDelim";
+    py_lidar.def_static(
+        "connect_async",
+        [](std::string port, uint32_t baud_rate, std::string capture_file, std::string capability_cache)
+        {
+            py::object future = py::module_::import("concurrent.futures").attr("Future")();
+            future.attr("set_running_or_notify_cancel")();
+
+            // Owned by the worker, which only touches it with the GIL held
+            py::object *pending = new py::object(future);
+
+            Lidar::connect_async(port, baud_rate, capture_file, capability_cache, [pending](Lidar::connect_result result)
+            {
+                // Too late to deliver, pending is leaked as it cannot be released without the GIL
+                if (!interpreter_alive())
+                {
+                    return;
+                }
+                py::gil_scoped_acquire gil;
+                try
+                {
+                    if (result.lidar)
+                    {
+                        pending->attr("set_result")(py::cast(std::move(result.lidar)));
+                    }
+                    else
+                    {
+                        pending->attr("set_exception")(py::module_::import("builtins").attr("RuntimeError")(result.error));
+                    }
+                }
+                catch (py::error_already_set &e)
+                {
+                    // Nowhere to raise it from a background thread
+                    e.discard_as_unraisable("RPLidar.connect_async");
+                }
+                delete pending;
+            });
+
+            return future;
+        },
+        py::arg("port"), py::arg("baud_rate"), py::arg("capture_file") = "", py::arg("capability_cache") = "",
+        PY_LIDAR_CONNECT_ASYNC_DOCSTRING);
+
+    // Connections still running deliver their result while the interpreter can take it, and none outlives the module
+    py::module_::import("atexit").attr("register")(py::cpp_function(&Lidar::join_connect_threads, py::call_guard<py::gil_scoped_release>()));
+
+    constexpr const char * PY_LIDAR_CONNECT_ALL_DOCSTRING =
+    R"myDelim(Connects to several lidars at once without holding the GIL, so bring-up takes as long as the slowest of them rather than the sum
+
+    :param ports: The ports to connect to
+    :type ports: list[str]
+    :param baud_rate: The baudrate shared by all lidars
+    :type baud_rate: 32 bit unsigned int
+    :param timeout: Seconds each lidar is given to connect
+    :type timeout: float
+    :param capability_cache: Directory in which the static configuration of each unit is kept, empty to disable
+    :type capability_cache: str
+    :param raise_on_error: If False, a lidar that could not be connected is returned as None instead of raising
+    :type raise_on_error: bool
+    :raises RuntimeError: If raise_on_error is set and any lidar failed, naming every port that did
+    :return: The lidars in the order of ports
+    :rtype: list[RPLidar]
+    )myDelim";
+    py_lidar.def_static(
+        "connect_all",
+        [](const std::vector<std::string> &ports, uint32_t baud_rate, double timeout, std::string capability_cache, bool raise_on_error)
+        {
+            std::vector<Lidar::connect_result> results;
+            {
+                py::gil_scoped_release release;
+                results = Lidar::connect_all(ports, baud_rate, std::chrono::milliseconds((long long)(timeout * 1000.0)), capability_cache);
+            }
+
+            std::string errors;
+            py::list lidars;
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                if (results[i].lidar)
+                {
+                    lidars.append(py::cast(std::move(results[i].lidar)));
+                }
+                else
+                {
+                    errors += (errors.empty() ? "" : "; ") + ports[i] + ": " + results[i].error;
+                    lidars.append(py::none());
+                }
+            }
+
+            if (raise_on_error && !errors.empty())
+            {
+                throw std::runtime_error("Could not connect to every lidar. " + errors);
+            }
+            return lidars;
+        },
+        py::arg("ports"), py::arg("baud_rate"), py::arg("timeout") = 5.0, py::arg("capability_cache") = "", py::arg("raise_on_error") = true,
+        PY_LIDAR_CONNECT_ALL_DOCSTRING);
 
     constexpr const char* START_MOTOR_DOC_STRING = 
-    R"myDelim(Starts the lidar motor spinning
+    R"myDelim(Starts the lidar motor spinning and the scan, returning once the motor has settled, at most 3 s
 
     :raises RuntimeError: If communication with the lidar fails
     )myDelim";
-    py_lidar.def("start_motor", &Lidar::start_motor, START_MOTOR_DOC_STRING);
+    py_lidar.def("start_motor", &Lidar::start_motor, py::call_guard<py::gil_scoped_release>(), START_MOTOR_DOC_STRING);
 
     constexpr const char* STOP_MOTOR_DOC_STRING = 
     R"myDelim(Stops the lidar motor from spinning
@@ -149,17 +990,7 @@ PYBIND11_MODULE(FastPyRpLidar, m)
         {
             auto data = self.get_scan_as_xy();
 
-            // Create a Python object that will free the allocated
-            // memory when destroyed:
-            py::capsule del_when_done(data.first, [](void *f)
-                                      { delete[] (Lidar::point *)f; });
-
-            return py::array_t<Lidar::point>(
-                {data.second},            // shape
-                {sizeof(Lidar::point)}, // C-style contiguous strides for double
-                data.first,               // the data pointer
-                del_when_done             // numpy array references this parent
-            );
+            return pooled_array(data.first, data.second);
         },
         GET_SCANLINE_X_Y_DOC_STRING);
 
@@ -175,21 +1006,50 @@ PYBIND11_MODULE(FastPyRpLidar, m)
         {
             auto data = self.get_scan_as_lidar_samples();
 
-            // Create a Python object that will free the allocated
-            // memory when destroyed:
-            py::capsule del_when_done(data.first, [](void *f)
-                                      { delete[] (Lidar::lidar_sample *)f; });
-
-            return py::array_t<Lidar::lidar_sample>(
-                {data.second},                   // shape
-                {sizeof(Lidar::lidar_sample)}, // C-style contiguous strides
-                data.first,                      // the data pointer
-                del_when_done                    // numpy array references this parent
-            );
+            return pooled_array(data.first, data.second);
         },
         GET_SCANLINE_DOC_STRING
     );
 
+    constexpr const char* GET_SCAN_DOC_STRING =
+    R"myDelim(Returns the next rotation as float32 columns, in ascending angle order. Nothing is copied on the way to numpy, PyTorch or JAX,
+    the memory comes from the same pool as get_scanline and goes back to it once the last array or tensor using it is gone
+    :raises RuntimeError: If communication with the lidar fails
+    :return: One scan consisting of a full revolution of the lidar
+    :rtype: Scan
+    )myDelim";
+    py_lidar.def("get_scan", &Lidar::get_scan_as_columns, py::call_guard<py::gil_scoped_release>(), GET_SCAN_DOC_STRING);
+
+    constexpr const char* GET_FRAME_DOC_STRING =
+    R"myDelim(Returns the next rotation as a ScanFrame, from which polar samples, x-y points, raw nodes and sample times of the same rotation
+    are read. Reading both polar and xy takes one rotation, where get_scanline and get_scanline_xy take one each
+    :raises RuntimeError: If communication with the lidar fails
+    :return: One frame consisting of a full revolution of the lidar
+    :rtype: ScanFrame
+    )myDelim";
+    py_lidar.def("get_frame", &Lidar::get_scan_as_frame, py::call_guard<py::gil_scoped_release>(), GET_FRAME_DOC_STRING);
+
+    constexpr const char* GET_SCAN_RESAMPLED_DOC_STRING =
+    R"myDelim(Resamples the next rotation onto a grid, replacing the ranges of the previous one in its buffer
+    :param grid: The grid to bin the rotation into
+    :type grid: AngularGrid
+    :raises RuntimeError: If communication with the lidar fails
+    :return: grid.ranges, len(grid) ranges in meters with NaN for no return, overwritten by the next call with the same grid
+    :rtype: numpy.ndarray[numpy.float32]
+    )myDelim";
+    py_lidar.def(
+        "get_scan_resampled",
+        [](Lidar &self, py::object grid)
+        {
+            AngularGrid &resampler = grid.cast<AngularGrid &>();
+            {
+                py::gil_scoped_release release;
+                self.get_scan_resampled(resampler);
+            }
+            return grid_ranges(grid);
+        },
+        py::arg("grid"), GET_SCAN_RESAMPLED_DOC_STRING);
+
     py_lidar.def_property_readonly("serial_number", &Lidar::serial_number, "Device serial number");
     py_lidar.def_property_readonly("firmware_version", &Lidar::firmware_version, "Device firmware_version");
     py_lidar.def_property_readonly("hardware_version", &Lidar::hardware_version, "Device hardware_version");
@@ -197,5 +1057,554 @@ PYBIND11_MODULE(FastPyRpLidar, m)
     
     py_lidar.def("get_health", &Lidar::get_health, "Returns the health of the Lidar");
 
+    constexpr const char* SCAN_MODES_DOC_STRING =
+    R"myDelim(Returns the scan modes the lidar offers
+
+    :raises RuntimeError: If communication with the lidar fails
+    :return: One dict per mode with id (to pass to switch_mode), name, us_per_sample, max_distance (meters) and ans_type
+    :rtype: list[dict]
+    )myDelim";
+    py_lidar.def(
+        "scan_modes",
+        [](Lidar &self)
+        {
+            std::vector<sl::LidarScanMode> modes;
+            {
+                py::gil_scoped_release release;
+                modes = self.scan_modes();
+            }
+
+            py::list out;
+            for (const sl::LidarScanMode &mode : modes)
+            {
+                py::dict entry;
+                entry["id"] = mode.id;
+                entry["name"] = std::string(mode.scan_mode);
+                entry["us_per_sample"] = mode.us_per_sample;
+                entry["max_distance"] = mode.max_distance;
+                entry["ans_type"] = mode.ans_type;
+                out.append(entry);
+            }
+            return out;
+        },
+        SCAN_MODES_DOC_STRING);
+
+    constexpr const char* SWITCH_MODE_DOC_STRING =
+    R"myDelim(Switches the running scan to another scan mode and motor speed without stopping the motor, and waits for the first full rotation in the new mode. Changing only the motor speed does not interrupt the scan
+
+    :param mode: Id of the scan mode to switch to, see scan_modes
+    :type mode: int
+    :param motor_speed: Motor speed in rpm, or pwm on lidars with pwm motor control. 65535 for the lidar's default
+    :type motor_speed: int
+    :raises RuntimeError: If no scan is running or communication with the lidar fails
+    :return: Seconds between the last rotation before the switch and the first one after it
+    :rtype: float
+    )myDelim";
+    py_lidar.def(
+        "switch_mode",
+        [](Lidar &self, sl_u16 mode, sl_u16 motor_speed)
+        {
+            return self.switch_mode(mode, motor_speed).count() / 1000.0;
+        },
+        py::arg("mode"), py::arg("motor_speed") = DEFAULT_MOTOR_SPEED, py::call_guard<py::gil_scoped_release>(), SWITCH_MODE_DOC_STRING);
+
+    constexpr const char* ENABLE_SUPERVISOR_DOC_STRING =
+    R"myDelim(Watches the scan stream on a background thread and recovers from a stalled or dead link on its own: the port is reopened, the lidar reconnected and the scan restarted in the same mode and at the same motor speed. A get_scanline call waits up to 2 s, so one made during an outage returns the first scan after it if the scan is back by then, and raises RuntimeError otherwise
+
+    :param stall_multiple: The stream counts as stalled after this many packet periods of the running scan mode without a packet, 50ms at the least
+    :type stall_multiple: float
+    :raises ValueError: If stall_multiple is not positive
+    )myDelim";
+    py_lidar.def("enable_supervisor", &Lidar::enable_supervisor, py::arg("stall_multiple") = 20.0, ENABLE_SUPERVISOR_DOC_STRING);
+
+    py_lidar.def("disable_supervisor", &Lidar::disable_supervisor, py::call_guard<py::gil_scoped_release>(), "Stops watching the scan stream");
+
+    constexpr const char* SUPERVISOR_STATS_DOC_STRING =
+    R"myDelim(Returns what the supervisor has recovered from so far. An outage lasts from the last packet before the stall until the scan was restarted
+
+    :return: reconnects and failed_attempts counts, last_outage, max_outage and total_outage in seconds, and in_outage while a recovery is under way
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "supervisor_stats",
+        [](Lidar &self)
+        {
+            Lidar::supervisor_stats stats = self.get_supervisor_stats();
+
+            py::dict out;
+            out["reconnects"] = stats.reconnects;
+            out["failed_attempts"] = stats.failed_attempts;
+            out["last_outage"] = stats.last_outage_ms / 1000.0;
+            out["max_outage"] = stats.max_outage_ms / 1000.0;
+            out["total_outage"] = stats.total_outage_ms / 1000.0;
+            out["in_outage"] = stats.in_outage;
+            return out;
+        },
+        SUPERVISOR_STATS_DOC_STRING);
+
+    constexpr const char* ACQUISITION_THREAD_DOC_STRING =
+    R"myDelim(Returns the scheduling the thread decoding the scan stream actually runs with, as read back from the OS
+
+    :raises RuntimeError: If the scan is not running or the lidar is served by a LidarGroup
+    :return: policy (inherit when not real-time), priority, cpus and memory_locked
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "acquisition_thread",
+        [](Lidar &self)
+        {
+            return thread_config_to_dict(self.acquisition_thread_config());
+        },
+        ACQUISITION_THREAD_DOC_STRING);
+
+    constexpr const char* SET_SCAN_CAPACITY_DOC_STRING =
+    R"myDelim(Sizes the scan buffers for at most nodes samples per rotation, 8192 unless changed at build time. Samples beyond it are dropped.
+    The buffers are allocated once when set, so on memory constrained targets size them from scan_capacity_stats
+
+    :param nodes: Samples per rotation
+    :type nodes: int
+    :raises ValueError: If nodes is 0
+    :raises RuntimeError: If the motor is running or the buffers cannot be allocated
+    )myDelim";
+    py_lidar.def("set_scan_capacity", &Lidar::set_scan_capacity, py::arg("nodes"), py::call_guard<py::gil_scoped_release>(), SET_SCAN_CAPACITY_DOC_STRING);
+
+    constexpr const char* SCAN_CAPACITY_STATS_DOC_STRING =
+    R"myDelim(Returns how well the scan buffers fit the rotations the lidar delivers
+
+    :return: capacity, max_scan_nodes (the most samples a rotation has held, including those beyond the capacity) and dropped_nodes
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "scan_capacity_stats",
+        [](Lidar &self)
+        {
+            Lidar::scan_capacity_stats stats = self.get_scan_capacity_stats();
+
+            py::dict out;
+            out["capacity"] = stats.capacity;
+            out["max_scan_nodes"] = stats.max_scan_nodes;
+            out["dropped_nodes"] = stats.dropped_nodes;
+            return out;
+        },
+        SCAN_CAPACITY_STATS_DOC_STRING);
+
+    constexpr const char* SET_FAULTS_DOC_STRING =
+    R"myDelim(Changes the faults of a lidar loaded with RPLidar.with_faults, which take the same arguments. All rates 0 stops injecting,
+    skip_bytes counts from the connection
+
+    :raises RuntimeError: If the lidar was not loaded with RPLidar.with_faults
+    )myDelim";
+    py_lidar.def(
+        "set_faults",
+        [](Lidar &self, float corrupt_rate, float drop_rate, float insert_rate, sl_u32 burst_length, sl_u64 skip_bytes, sl_u32 seed)
+        {
+            self.set_fault_config(make_fault_config(corrupt_rate, drop_rate, insert_rate, burst_length, skip_bytes, seed));
+        },
+        py::arg("corrupt_rate") = 0.0f, py::arg("drop_rate") = 0.0f, py::arg("insert_rate") = 0.0f,
+        py::arg("burst_length") = 1, py::arg("skip_bytes") = 0, py::arg("seed") = 1, SET_FAULTS_DOC_STRING);
+
+    constexpr const char* FAULT_STATS_DOC_STRING =
+    R"myDelim(Returns the bytes a lidar loaded with RPLidar.with_faults passed, corrupted, dropped and inserted
+
+    :raises RuntimeError: If the lidar was not loaded with RPLidar.with_faults
+    :return: bytes_passed, bytes_corrupted, bytes_dropped, bytes_inserted
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "fault_stats",
+        [](Lidar &self)
+        {
+            sl::FaultInjectionStats stats = self.get_fault_stats();
+
+            py::dict out;
+            out["bytes_passed"] = stats.bytes_passed;
+            out["bytes_corrupted"] = stats.bytes_corrupted;
+            out["bytes_dropped"] = stats.bytes_dropped;
+            out["bytes_inserted"] = stats.bytes_inserted;
+            return out;
+        },
+        FAULT_STATS_DOC_STRING);
+
+    constexpr const char* STATS_DOC_STRING =
+    R"myDelim(Returns the throughput and error counters of the scan stream since the lidar was connected
+
+    :return: bytes_read, read_calls, packets_received (capsules decoded), checksum_failures, resync_bytes_skipped, capsules_lost,
+        revolutions_published, revolutions_overwritten (replaced before being grabbed), min_samples_per_revolution,
+        avg_samples_per_revolution, max_samples_per_revolution, samples_dropped, samples_decoded, zero_distance_samples,
+        zero_distance_ratio and rotation_frequency (Hz, 0 until two rotations have been published)
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "stats",
+        [](Lidar &self)
+        {
+            sl::LidarDriverStats stats = self.get_driver_stats();
+
+            py::dict out;
+            out["bytes_read"] = stats.bytes_read;
+            out["read_calls"] = stats.read_calls;
+            out["packets_received"] = stats.packets_received;
+            out["checksum_failures"] = stats.checksum_failures;
+            out["resync_bytes_skipped"] = stats.resync_bytes_skipped;
+            out["capsules_lost"] = stats.capsules_lost;
+            out["revolutions_published"] = stats.revolutions_published;
+            out["revolutions_overwritten"] = stats.revolutions_overwritten;
+            out["min_samples_per_revolution"] = stats.min_scan_nodes;
+            out["avg_samples_per_revolution"] = stats.revolutions_published ? (double)stats.published_nodes / stats.revolutions_published : 0.0;
+            out["max_samples_per_revolution"] = stats.max_scan_nodes;
+            out["samples_dropped"] = stats.scan_nodes_dropped;
+            out["samples_decoded"] = stats.nodes_decoded;
+            out["zero_distance_samples"] = stats.zero_distance_nodes;
+            out["zero_distance_ratio"] = stats.nodes_decoded ? (double)stats.zero_distance_nodes / stats.nodes_decoded : 0.0;
+            out["rotation_frequency"] = stats.rotation_frequency;
+            return out;
+        },
+        STATS_DOC_STRING);
+
+    constexpr const char* LATENCY_STATS_DOC_STRING =
+    R"myDelim(Returns how stale scans are by the time they move on, measured from when the last byte of a rotation's last sample was read
+
+    The stages are decode (until the decoder hands the samples on), publish (until the rotation is complete, which takes the
+    first sample of the next one), grab (until a reader takes it) and delivery (the whole way to the return of get_scanline,
+    get_scanline_xy or get_scan). Each holds count, p50, p99 and max in seconds, the percentiles within about 3%
+
+    :param reset: Empty the histograms, so that every call covers the time since the previous one
+    :type reset: bool
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "latency_stats",
+        [](Lidar &self, bool reset)
+        {
+            Lidar::latency_stats stats = self.get_latency_stats(reset);
+
+            py::dict out;
+            out["decode"] = latency_summary_to_dict(stats.decode);
+            out["publish"] = latency_summary_to_dict(stats.publish);
+            out["grab"] = latency_summary_to_dict(stats.grab);
+            out["delivery"] = latency_summary_to_dict(stats.delivery);
+            return out;
+        },
+        py::arg("reset") = true,
+        LATENCY_STATS_DOC_STRING);
+
+    constexpr const char* STATS_TEXT_DOC_STRING =
+    R"myDelim(Returns the counters of stats and supervisor_stats in the Prometheus text exposition format, labelled with the serial number and port
+
+    :rtype: str
+    )myDelim";
+    py_lidar.def("stats_text", &Lidar::stats_exposition, STATS_TEXT_DOC_STRING);
+
+    constexpr const char* WRITE_STATS_DOC_STRING =
+    R"myDelim(Replaces the file at path with stats_text in one step, so that a scraper such as the node_exporter textfile collector never reads half of it
+
+    :param path: Where to write, e.g. a .prom file in the textfile collector directory
+    :type path: str
+    :raises RuntimeError: If the file cannot be written
+    )myDelim";
+    py_lidar.def("write_stats", &Lidar::write_stats, py::arg("path"), py::call_guard<py::gil_scoped_release>(), WRITE_STATS_DOC_STRING);
+
+    constexpr const char* SCAN_POOL_STATS_DOC_STRING =
+    R"myDelim(Returns how the arrays of get_scanline, get_scanline_xy and LidarGroup.next_scan are recycled. Their memory comes from a pool of
+    slabs sized for the longest rotation seen, and goes back to it when the array is garbage collected
+
+    :return: hits (arrays served from a recycled slab), misses (arrays that needed a new slab), outstanding arrays and outstanding_bytes
+        still referenced, free_slabs, slab_bytes and max_outstanding_bytes (0 for no limit)
+    :rtype: dict
+    )myDelim";
+    py_lidar.def(
+        "scan_pool_stats",
+        [](Lidar &self)
+        {
+            ScanPool::pool_stats stats = self.scan_pool().stats();
+
+            py::dict out;
+            out["hits"] = stats.hits;
+            out["misses"] = stats.misses;
+            out["outstanding"] = stats.outstanding;
+            out["outstanding_bytes"] = stats.outstanding_bytes;
+            out["free_slabs"] = stats.free_slabs;
+            out["slab_bytes"] = stats.slab_bytes;
+            out["max_outstanding_bytes"] = stats.max_outstanding_bytes;
+            return out;
+        },
+        SCAN_POOL_STATS_DOC_STRING);
+
+    constexpr const char* SET_SCAN_POOL_LIMIT_DOC_STRING =
+    R"myDelim(Caps the memory held by scan arrays that are still referenced. Past it, reading a scan raises instead of growing the pool
+
+    :param max_bytes: The cap in bytes, 0 for no limit
+    :type max_bytes: int
+    )myDelim";
+    py_lidar.def(
+        "set_scan_pool_limit",
+        [](Lidar &self, std::size_t max_bytes)
+        {
+            self.scan_pool().set_max_outstanding_bytes(max_bytes);
+        },
+        py::arg("max_bytes"), SET_SCAN_POOL_LIMIT_DOC_STRING);
+
+    constexpr const char* SET_RANGE_STACK_DOC_STRING =
+    R"myDelim(Resamples every rotation the lidar sends from now on into stack on the thread reading it, whether scans are read or not,
+    and also while the lidar is served by a LidarGroup
+
+    :param stack: The stack to keep up to date, None to stop
+    :type stack: RangeStack
+    )myDelim";
+    py_lidar.def("set_range_stack", &Lidar::set_range_stack, py::arg("stack"), SET_RANGE_STACK_DOC_STRING);
+
+    constexpr const char* SET_SCAN_LOG_DOC_STRING =
+    R"myDelim(Records every rotation get_scanline, get_scanline_xy, get_scan, get_frame and get_scan_resampled read to log, without waiting for it to be written
+
+    :param log: The log to write to, None to stop logging
+    :type log: ScanLogWriter
+    :param lidar_id: Identifies this lidar among those sharing the log
+    :type lidar_id: int
+    )myDelim";
+    py_lidar.def("set_scan_log", &Lidar::set_scan_log, py::arg("log"), py::arg("lidar_id") = 0, SET_SCAN_LOG_DOC_STRING);
+
     py_lidar.def("__str__", &Lidar::to_string);
+
+    /*
+    LidarGroup serves several lidars from one thread and hands out their scans through one queue
+    */
+    auto py_lidar_group = py::class_<LidarGroup>(m, "LidarGroup", "Several lidars whose scans are read by a single background thread and delivered through one queue, instead of a thread per lidar.");
+
+    constexpr const char * PY_LIDAR_GROUP_INIT_DOCSTRING =
+    R"myDelim(Creates an empty group
+
+    :param queue_depth: Scans that may wait for next_scan, the oldest is dropped beyond that
+    :type queue_depth: int
+    :param sched_policy: Scheduling of the thread reading the lidars, as RPLidar takes it
+    :type sched_policy: str
+    :param sched_priority: 1 (lowest) to 99 for the real-time policies, 0 for inherit
+    :type sched_priority: int
+    :param cpus: The cpus the reading thread may run on, empty for those it inherits
+    :type cpus: list[int]
+    :param lock_memory: Lock every page of the process into RAM
+    :type lock_memory: bool
+    :raises ValueError: If queue_depth is 0 or the scheduling options are out of range
+    )myDelim";
+    py_lidar_group.def(py::init(
+                           [](std::size_t queue_depth, std::string sched_policy, int sched_priority, std::vector<int> cpus, bool lock_memory)
+                           {
+                               return new LidarGroup(queue_depth, make_thread_config(sched_policy, sched_priority, cpus, lock_memory));
+                           }),
+                       py::arg("queue_depth") = 16, py::arg("sched_policy") = "inherit", py::arg("sched_priority") = 0,
+                       py::arg("cpus") = std::vector<int>(), py::arg("lock_memory") = false, PY_LIDAR_GROUP_INIT_DOCSTRING);
+
+    constexpr const char * PY_LIDAR_GROUP_ADD_DOCSTRING =
+    R"myDelim(Connects to a lidar and adds it to the group. Only while the group is stopped
+
+    :param port: A OS specific USB port that is connected to a Lidar. Ex: /dev/ttyUSB0 (Linux and OSX), com3 (Windows)
+    :type port: str
+    :param baud_rate: The baudrate at which to conduct communications. Eg 1000000 (S2 Lidar), 115200 (A2)
+    :type baud_rate: 32 bit unsigned int
+    :param capture_file: Path of the capture file, empty to not record
+    :type capture_file: str
+    :param capability_cache: Directory in which the static configuration of each unit is kept, empty to disable
+    :type capability_cache: str
+    :raises RuntimeError: If establishing communication with the lidar fails or the group is running
+    :return: The index of the lidar, which next_scan reports its scans with
+    :rtype: int
+    )myDelim";
+    py_lidar_group.def(
+        "add",
+        [](LidarGroup &self, std::string port, uint32_t baud_rate, std::string capture_file, std::string capability_cache)
+        {
+            return self.add(std::unique_ptr<Lidar>(new Lidar(port, baud_rate, capture_file, capability_cache)));
+        },
+        py::arg("port"), py::arg("baud_rate"), py::arg("capture_file") = "", py::arg("capability_cache") = "",
+        py::call_guard<py::gil_scoped_release>(), PY_LIDAR_GROUP_ADD_DOCSTRING);
+
+    py_lidar_group.def("lidar", &LidarGroup::lidar, py::arg("index"), py::return_value_policy::reference_internal,
+                       "Returns the RPLidar at index for everything but reading scans, which is up to the group");
+
+    py_lidar_group.def("__len__", &LidarGroup::size);
+
+    constexpr const char * PY_LIDAR_GROUP_START_DOCSTRING =
+    R"myDelim(Starts the motor and scan of every lidar, then the thread reading them
+
+    :raises RuntimeError: If communication with a lidar fails
+    )myDelim";
+    py_lidar_group.def("start", &LidarGroup::start, py::call_guard<py::gil_scoped_release>(), PY_LIDAR_GROUP_START_DOCSTRING);
+
+    py_lidar_group.def("stop", &LidarGroup::stop, py::call_guard<py::gil_scoped_release>(),
+                       "Stops the reading thread and the motors. Scans already queued can still be taken");
+
+    constexpr const char * PY_LIDAR_GROUP_NEXT_SCAN_DOCSTRING =
+    R"myDelim(Waits for the next full rotation of any lidar in the group, without holding the GIL
+
+    :param timeout: Seconds to wait
+    :type timeout: float
+    :return: The index of the lidar and its scan line in the format of RPLidar.get_scanline, None if no scan arrived in time
+    :rtype: tuple[int, numpy.ndarray[Lidar_Scan]]
+    )myDelim";
+    py_lidar_group.def(
+        "next_scan",
+        [](LidarGroup &self, double timeout) -> py::object
+        {
+            LidarGroup::group_scan scan;
+            bool received = false;
+            {
+                py::gil_scoped_release release;
+                received = self.next_scan(scan, std::chrono::milliseconds((long long)(timeout * 1000.0)));
+            }
+            if (!received)
+            {
+                return py::none();
+            }
+
+            ScanPool &pool = self.lidar(scan.lidar).scan_pool();
+            Lidar::lidar_sample *out = static_cast<Lidar::lidar_sample *>(pool.acquire(scan.nodes.size() * sizeof(Lidar::lidar_sample)));
+            for (std::size_t pos = 0; pos < scan.nodes.size(); ++pos)
+            {
+                out[pos] = Lidar::lidar_sample(scan.nodes[pos]);
+            }
+            return py::make_tuple(scan.lidar, pooled_array(out, scan.nodes.size()));
+        },
+        py::arg("timeout") = 1.0, PY_LIDAR_GROUP_NEXT_SCAN_DOCSTRING);
+
+    py_lidar_group.def_property_readonly("dropped_scans", &LidarGroup::dropped_scans,
+                                         "Scans lost because the queue was full or a lidar completed several rotations in one pass");
+
+    py_lidar_group.def(
+        "reading_thread",
+        [](LidarGroup &self)
+        {
+            return thread_config_to_dict(self.thread_config());
+        },
+        "Returns the scheduling the thread reading the lidars actually runs with, in the format of RPLidar.acquisition_thread. Raises RuntimeError while the group is stopped");
+
+    py_lidar_group.def("set_scan_log", &LidarGroup::set_scan_log, py::arg("log"),
+                       "Records every rotation the group delivers to log (a ScanLogWriter), each lidar under the index add returned. None stops logging. Lidars added afterwards are not logged until this is called again");
+
+    /*
+    sl::ILidarEmulator answers the lidar protocol on a pseudo terminal so the library can be exercised without hardware
+    */
+    auto py_emulator = py::class_<sl::ILidarEmulator>(m, "LidarEmulator", "An emulated RPLidar on a pseudo terminal (Linux only). Connect to it by passing its port to RPLidar.");
+
+    constexpr const char * PY_EMULATOR_INIT_DOCSTRING =
+    R"myDelim(Starts an emulated S2 class lidar that serves until the object is destroyed
+
+    :param scan_frequency: Revolutions per second
+    :type scan_frequency: float
+    :param rate_scale: Multiplies the sample rate and rotation speed, 0 streams as fast as the reader keeps up
+    :type rate_scale: float
+    :param typical_scan_mode: Scan mode used by start_motor. 0 Standard, 1 Express, 2 Boost, 3 DenseBoost, 4 HQ
+    :type typical_scan_mode: int
+    :raises RuntimeError: If the pseudo terminal cannot be created or the platform is not supported
+    )myDelim";
+    py_emulator.def(py::init(
+                        [](float scan_frequency, float rate_scale, sl_u16 typical_scan_mode)
+                        {
+                            sl::LidarEmulatorConfig config;
+                            config.scan_frequency = scan_frequency;
+                            config.rate_scale = rate_scale;
+                            config.typical_scan_mode = typical_scan_mode;
+
+                            sl::Result<sl::ILidarEmulator *> emulator = sl::createLidarEmulator(config);
+                            if (!emulator)
+                            {
+                                throw std::runtime_error("Could not start the lidar emulator");
+                            }
+                            return *emulator;
+                        }),
+                    py::arg("scan_frequency") = 10.0f, py::arg("rate_scale") = 1.0f, py::arg("typical_scan_mode") = 3,
+                    PY_EMULATOR_INIT_DOCSTRING);
+
+    py_emulator.def_property_readonly("port", &sl::ILidarEmulator::getDevicePath, "The device path to pass to RPLidar, e.g. /dev/pts/3");
+
+    py_emulator.def(
+        "stats",
+        [](sl::ILidarEmulator &self)
+        {
+            sl::LidarEmulatorStats stats;
+            self.getStats(stats);
+
+            py::dict out;
+            out["commands_received"] = stats.commands_received;
+            out["checksum_errors"] = stats.checksum_errors;
+            out["bytes_sent"] = stats.bytes_sent;
+            out["samples_sent"] = stats.samples_sent;
+            out["last_motor_speed"] = stats.last_motor_speed;
+            return out;
+        },
+        "Returns counters of the traffic served so far, and last_motor_speed, the PWM or rpm of the last motor command");
+
+    py_emulator.def(
+        "simulate_dropout",
+        [](sl::ILidarEmulator &self, double duration)
+        {
+            self.simulateDropout((sl_u32)(duration * 1000.0));
+        },
+        py::arg("duration"),
+        "Cuts the link for duration seconds as an unplugged cable would, while the emulated lidar keeps scanning");
+
+    constexpr const char* SET_TRACING_DOC_STRING =
+    R"myDelim(Turns the trace recorder on or off for every lidar in the process. While on, the stages each rotation goes through (serial read,
+    decode, publish, grab, ascend, convert and the handoff to numpy) are recorded per thread, without locks, for trace_json to export.
+    While off a trace point costs a single branch
+
+    :param enabled: Record from now on
+    :type enabled: bool
+    )myDelim";
+    m.def("set_tracing", &sl::setTraceEnabled, py::arg("enabled"), SET_TRACING_DOC_STRING);
+
+    constexpr const char* TRACE_JSON_DOC_STRING =
+    R"myDelim(Returns what the trace recorder holds in the Chrome trace event format, which chrome://tracing and https://ui.perfetto.dev open.
+    Each thread keeps its most recent events, timestamps are in microseconds of a monotonic clock
+
+    :rtype: str
+    )myDelim";
+    m.def("trace_json", &sl::exportChromeTrace, py::call_guard<py::gil_scoped_release>(), TRACE_JSON_DOC_STRING);
+
+    m.def("clear_trace", &sl::clearTrace, "Forgets the events the trace recorder holds");
+
+    m.def("list_serial_ports", &list_serial_ports, "Returns the serial devices a lidar could be attached to (USB serial adapters, COM ports on Windows)");
+
+    constexpr const char * DISCOVER_DOCSTRING =
+    R"myDelim(Finds lidars by probing serial ports concurrently at the common baud rates, without holding the GIL.
+    Every candidate port is talked to, so do not call it while another program is using one of them.
+
+    :param ports: Ports to probe, None for list_serial_ports()
+    :type ports: list[str]
+    :param baud_rates: Baud rates to try in order, None for 1000000, 460800, 256000 and 115200
+    :type baud_rates: list[int]
+    :param timeout: Seconds a port gets to answer at each baud rate
+    :type timeout: float
+    :param autobaud: Also ask lidars that answered at none of the baud rates to measure the first one. Only supporting firmware answers, and each silent port then takes about two more seconds
+    :type autobaud: bool
+    :return: One dict per lidar found with port, baud_rate, serial_number, model, firmware_version and hardware_version, ready to pass port and baud_rate to RPLidar
+    :rtype: list[dict]
+    )myDelim";
+    m.def(
+        "discover",
+        [](py::object ports, py::object baud_rates, double timeout, bool autobaud)
+        {
+            std::vector<std::string> port_list = ports.is_none() ? list_serial_ports() : ports.cast<std::vector<std::string>>();
+            std::vector<std::uint32_t> baud_list = baud_rates.is_none() ? default_baudrates() : baud_rates.cast<std::vector<std::uint32_t>>();
+
+            std::vector<discovered_lidar> found;
+            {
+                py::gil_scoped_release release;
+                found = discover_lidars(port_list, baud_list, std::chrono::milliseconds((long long)(timeout * 1000.0)), autobaud);
+            }
+
+            py::list out;
+            for (const discovered_lidar &lidar : found)
+            {
+                py::dict entry;
+                entry["port"] = lidar.port;
+                entry["baud_rate"] = lidar.baudrate;
+                entry["serial_number"] = lidar.serial_number();
+                entry["model"] = (int)lidar.device_info.model;
+                entry["firmware_version"] = lidar.firmware_version();
+                entry["hardware_version"] = (int)lidar.device_info.hardware_version;
+                out.append(entry);
+            }
+            return out;
+        },
+        py::arg("ports") = py::none(), py::arg("baud_rates") = py::none(), py::arg("timeout") = 0.1, py::arg("autobaud") = false,
+        DISCOVER_DOCSTRING);
 }
@@ -0,0 +1,78 @@
+#include <algorithm> //std::sort, std::copy
+#include <limits>    //std::numeric_limits
+#include <stdexcept> //std::invalid_argument
+
+#include "RangeStack.h"
+
+RangeStack::RangeStack(std::size_t depth, std::size_t bins, AngularGrid::policy_id policy)
+    : m_grid(bins, policy), m_depth(depth)
+{
+    if (depth == 0)
+    {
+        throw std::invalid_argument("A range stack needs at least one row");
+    }
+    m_row.resize(bins);
+    m_ranges.assign(depth * bins, std::numeric_limits<float>::quiet_NaN());
+    m_timestamps_us.assign(depth, 0);
+}
+
+std::size_t RangeStack::depth() const
+{
+    return m_depth;
+}
+
+std::size_t RangeStack::bins() const
+{
+    return m_grid.bins();
+}
+
+AngularGrid::policy_id RangeStack::policy() const
+{
+    return m_grid.policy();
+}
+
+std::uint64_t RangeStack::revolutions() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_revolutions;
+}
+
+bool RangeStack::copy_newer(std::uint64_t after, float *ranges, std::uint64_t *timestamps_us, std::uint64_t &revolution,
+                            std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (!m_pushed.wait_for(lock, timeout, [this, after]() { return m_revolutions > after; }))
+    {
+        return false;
+    }
+
+    // The oldest row is the next to be replaced, the ring unrolls in two runs from there
+    const std::size_t bins = m_grid.bins();
+    const std::size_t oldest = m_revolutions % m_depth;
+    std::copy(m_ranges.begin() + oldest * bins, m_ranges.end(), ranges);
+    std::copy(m_ranges.begin(), m_ranges.begin() + oldest * bins, ranges + (m_depth - oldest) * bins);
+    std::copy(m_timestamps_us.begin() + oldest, m_timestamps_us.end(), timestamps_us);
+    std::copy(m_timestamps_us.begin(), m_timestamps_us.begin() + oldest, timestamps_us + (m_depth - oldest));
+
+    revolution = m_revolutions;
+    return true;
+}
+
+void RangeStack::onScanPublished(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, sl_u64 read_us)
+{
+    // Samples arrive in rotation order, so this is mostly the one wrap around at the sync
+    m_sorted.assign(nodes, nodes + count);
+    std::sort(m_sorted.begin(), m_sorted.end(),
+              [](const sl_lidar_response_measurement_node_hq_t &a, const sl_lidar_response_measurement_node_hq_t &b)
+              { return a.angle_z_q14 < b.angle_z_q14; });
+    m_grid.resample(m_sorted.data(), count, m_row.data());
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const std::size_t row = m_revolutions % m_depth;
+        std::copy(m_row.begin(), m_row.end(), m_ranges.begin() + row * m_grid.bins());
+        m_timestamps_us[row] = read_us;
+        ++m_revolutions;
+    }
+    m_pushed.notify_all();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <cstdint>              //std::uint64_t
+#include <vector>               //std::vector
+#include <chrono>               //std::chrono::milliseconds
+#include <mutex>                //std::mutex
+#include <condition_variable>   //std::condition_variable
+
+#include "sl_lidar_driver.h"	//sl::IScanObserver
+#include "AngularGrid.h"		//AngularGrid
+
+// The last depth rotations of a lidar resampled onto an AngularGrid, a range image of depth rows of bins ranges for
+// models that look at a short history. The driver hands it every rotation it publishes, on the thread that decoded it,
+// so it is kept up to date whether or not anyone grabs scans. Rows live in a ring, copy puts them in order
+class RangeStack : public sl::IScanObserver
+{
+public: //Ctor Dtor
+	// Throws std::invalid_argument for a depth or bins of 0
+	RangeStack(std::size_t depth, std::size_t bins, AngularGrid::policy_id policy);
+
+	RangeStack(const RangeStack &) = delete;
+	RangeStack &operator=(const RangeStack &) = delete;
+
+public: //Methods
+	std::size_t depth() const;
+
+	std::size_t bins() const;
+
+	AngularGrid::policy_id policy() const;
+
+	// Rotations pushed so far
+	std::uint64_t revolutions() const;
+
+	/*
+	 * Waits up to timeout until more than after rotations have been pushed, then copies the stack oldest row first into
+	 * ranges, depth * bins floats, and when the last sample of each row was read into timestamps_us, in latencyClockUs
+	 * time. Rows not pushed yet are NaN with a time of 0. Sets revolution to the rotations pushed as of the copy, the
+	 * after of the next call to wait for the one after it. Returns false, copying nothing, if none came in time
+	 * */
+	bool copy_newer(std::uint64_t after, float *ranges, std::uint64_t *timestamps_us, std::uint64_t &revolution,
+					std::chrono::milliseconds timeout);
+
+	// Resamples a rotation into the next row, replacing the oldest
+	void onScanPublished(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, sl_u64 read_us) override;
+
+private: //Member Variables
+	const AngularGrid m_grid;
+	const std::size_t m_depth;
+
+	// Only touched by the thread pushing rotations, so that the lock is held for the copy alone
+	std::vector<sl_lidar_response_measurement_node_hq_t> m_sorted;
+	std::vector<float> m_row;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_pushed;
+
+	// depth rows of bins ranges, row m_revolutions % depth is the next to be replaced
+	std::vector<float> m_ranges;
+	std::vector<std::uint64_t> m_timestamps_us;
+	std::uint64_t m_revolutions = 0;
+};
@@ -0,0 +1,340 @@
+#include <algorithm> //std::min
+#include <stdexcept> //std::runtime_error
+#include <string>    //std::string
+
+#include "ScanCodec.h"
+
+namespace
+{
+    constexpr std::uint8_t FRAME_VERSION = 1;
+
+    // Set in the frame flags when distance blocks may be predicted from the previous rotation
+    constexpr std::uint8_t FLAG_PREVIOUS_ROTATION = 1;
+
+    // Distances choose their predictor per block of this many nodes
+    constexpr std::size_t DISTANCE_BLOCK_NODES = 32;
+
+    enum distance_predictor : std::uint8_t
+    {
+        LAST_VALID = 0,
+        PREVIOUS_ROTATION = 1
+    };
+
+    // The longest varint of a 64 bit value
+    constexpr std::size_t MAX_VARINT_BYTES = 10;
+
+    std::uint64_t zigzag(std::int64_t value)
+    {
+        return ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+    }
+
+    std::int64_t unzigzag(std::uint64_t value)
+    {
+        return (std::int64_t)(value >> 1) ^ -(std::int64_t)(value & 1);
+    }
+
+    void put_varint(std::vector<std::uint8_t> &out, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((std::uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((std::uint8_t)value);
+    }
+
+    std::size_t varint_bytes(std::uint64_t value)
+    {
+        std::size_t bytes = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++bytes;
+        }
+        return bytes;
+    }
+
+    // 0 for an invalid distance, otherwise one more than the zigzag difference to the prediction
+    std::uint64_t distance_code(std::uint32_t distance, std::uint32_t predicted)
+    {
+        return distance ? zigzag((std::int64_t)distance - (std::int64_t)predicted) + 1 : 0;
+    }
+
+    // The same sample of the previous rotation, when it had one and it was valid
+    std::uint32_t predict_from_previous(const std::vector<std::uint32_t> &previous, std::size_t pos, std::uint32_t last_valid)
+    {
+        return pos < previous.size() && previous[pos] ? previous[pos] : last_valid;
+    }
+
+    [[noreturn]] void damaged(const char *what)
+    {
+        throw std::runtime_error(std::string("Damaged scan frame: ") + what);
+    }
+
+    // Reads a frame, checking every byte against its end
+    class frame_reader
+    {
+    public:
+        frame_reader(const std::uint8_t *data, std::size_t size) : m_begin(data), m_pos(data), m_end(data + size) {}
+
+        std::uint8_t byte()
+        {
+            if (m_pos == m_end)
+            {
+                damaged("truncated");
+            }
+            return *m_pos++;
+        }
+
+        std::uint64_t varint()
+        {
+            std::uint64_t value = 0;
+            if ((std::size_t)(m_end - m_pos) >= MAX_VARINT_BYTES)
+            {
+                // Cannot run past the end, so skip the checks
+                for (unsigned shift = 0; shift < 64; shift += 7)
+                {
+                    std::uint8_t next = *m_pos++;
+                    value |= (std::uint64_t)(next & 0x7f) << shift;
+                    if (!(next & 0x80))
+                    {
+                        return value;
+                    }
+                }
+            }
+            else
+            {
+                for (unsigned shift = 0; shift < 64; shift += 7)
+                {
+                    std::uint8_t next = byte();
+                    value |= (std::uint64_t)(next & 0x7f) << shift;
+                    if (!(next & 0x80))
+                    {
+                        return value;
+                    }
+                }
+            }
+            damaged("varint too long");
+        }
+
+        std::size_t consumed() const
+        {
+            return m_pos - m_begin;
+        }
+
+        std::size_t remaining() const
+        {
+            return m_end - m_pos;
+        }
+
+    private:
+        const std::uint8_t *const m_begin;
+        const std::uint8_t *m_pos;
+        const std::uint8_t *const m_end;
+    };
+
+    typedef struct frame_header
+    {
+        std::uint8_t flags;
+        std::size_t count;
+    } frame_header;
+
+    frame_header read_header(frame_reader &reader)
+    {
+        if (reader.byte() != FRAME_VERSION)
+        {
+            damaged("unknown version");
+        }
+
+        frame_header header;
+        header.flags = reader.byte();
+        header.count = reader.varint();
+        // Every node takes at least a byte for its angle and one for its distance
+        if (header.count > reader.remaining())
+        {
+            damaged("node count past its end");
+        }
+        return header;
+    }
+}
+
+ScanEncoder::ScanEncoder(bool predict_from_previous)
+    : m_predict_from_previous(predict_from_previous)
+{
+}
+
+void ScanEncoder::encode(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, std::vector<std::uint8_t> &out)
+{
+    const bool previous = m_predict_from_previous && m_has_previous;
+
+    out.push_back(FRAME_VERSION);
+    out.push_back(previous ? FLAG_PREVIOUS_ROTATION : 0);
+    put_varint(out, count);
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Angles wrap around at 360 degrees, as 16 bit arithmetic does
+    std::uint16_t angle = nodes[0].angle_z_q14;
+    std::uint16_t step = 0;
+    out.push_back((std::uint8_t)angle);
+    out.push_back((std::uint8_t)(angle >> 8));
+    for (std::size_t pos = 1; pos < count; ++pos)
+    {
+        const std::uint16_t next = nodes[pos].angle_z_q14;
+        put_varint(out, zigzag((std::int16_t)(std::uint16_t)(next - (std::uint16_t)(angle + step))));
+        step = next - angle;
+        angle = next;
+    }
+
+    std::uint32_t last_valid = 0;
+    for (std::size_t block = 0; block < count; block += DISTANCE_BLOCK_NODES)
+    {
+        const std::size_t end = std::min(count, block + DISTANCE_BLOCK_NODES);
+
+        distance_predictor predictor = LAST_VALID;
+        if (previous)
+        {
+            // Costs the block both ways and keeps the cheaper
+            std::size_t last_valid_bytes = 0;
+            std::size_t previous_bytes = 0;
+            std::uint32_t valid = last_valid;
+            for (std::size_t pos = block; pos < end; ++pos)
+            {
+                const std::uint32_t distance = nodes[pos].dist_mm_q2;
+                last_valid_bytes += varint_bytes(distance_code(distance, valid));
+                previous_bytes += varint_bytes(distance_code(distance, predict_from_previous(m_previous, pos, valid)));
+                valid = distance ? distance : valid;
+            }
+            predictor = previous_bytes < last_valid_bytes ? PREVIOUS_ROTATION : LAST_VALID;
+            out.push_back(predictor);
+        }
+
+        for (std::size_t pos = block; pos < end; ++pos)
+        {
+            const std::uint32_t distance = nodes[pos].dist_mm_q2;
+            const std::uint32_t predicted = predictor == PREVIOUS_ROTATION ? predict_from_previous(m_previous, pos, last_valid) : last_valid;
+            put_varint(out, distance_code(distance, predicted));
+            last_valid = distance ? distance : last_valid;
+        }
+    }
+
+    for (std::size_t pos = 0; pos < count;)
+    {
+        std::size_t run = pos + 1;
+        while (run < count && nodes[run].quality == nodes[pos].quality && nodes[run].flag == nodes[pos].flag)
+        {
+            ++run;
+        }
+        put_varint(out, run - pos);
+        out.push_back(nodes[pos].quality);
+        out.push_back(nodes[pos].flag);
+        pos = run;
+    }
+
+    if (m_predict_from_previous)
+    {
+        m_previous.resize(count);
+        for (std::size_t pos = 0; pos < count; ++pos)
+        {
+            m_previous[pos] = nodes[pos].dist_mm_q2;
+        }
+        m_has_previous = true;
+    }
+}
+
+void ScanEncoder::reset()
+{
+    m_has_previous = false;
+    m_previous.clear();
+}
+
+std::size_t ScanDecoder::frame_nodes(const std::uint8_t *data, std::size_t size)
+{
+    frame_reader reader(data, size);
+    return read_header(reader).count;
+}
+
+std::size_t ScanDecoder::decode(const std::uint8_t *data, std::size_t size, sl_lidar_response_measurement_node_hq_t *nodes)
+{
+    frame_reader reader(data, size);
+    const frame_header header = read_header(reader);
+    const std::size_t count = header.count;
+    const bool previous = (header.flags & FLAG_PREVIOUS_ROTATION) != 0;
+    if (previous && !m_has_previous)
+    {
+        throw std::runtime_error("Scan frame refers to a rotation that was not decoded");
+    }
+    if (count == 0)
+    {
+        return reader.consumed();
+    }
+
+    std::uint16_t angle = reader.byte();
+    angle |= (std::uint16_t)(reader.byte() << 8);
+    std::uint16_t step = 0;
+    nodes[0].angle_z_q14 = angle;
+    for (std::size_t pos = 1; pos < count; ++pos)
+    {
+        const std::uint16_t next = (std::uint16_t)(angle + step + (std::uint16_t)unzigzag(reader.varint()));
+        nodes[pos].angle_z_q14 = next;
+        step = next - angle;
+        angle = next;
+    }
+
+    std::uint32_t last_valid = 0;
+    for (std::size_t block = 0; block < count; block += DISTANCE_BLOCK_NODES)
+    {
+        const std::size_t end = std::min(count, block + DISTANCE_BLOCK_NODES);
+
+        const std::uint8_t predictor = previous ? reader.byte() : (std::uint8_t)LAST_VALID;
+        if (predictor != LAST_VALID && predictor != PREVIOUS_ROTATION)
+        {
+            damaged("unknown distance predictor");
+        }
+
+        for (std::size_t pos = block; pos < end; ++pos)
+        {
+            const std::uint64_t code = reader.varint();
+            std::uint32_t distance = 0;
+            if (code)
+            {
+                const std::uint32_t predicted = predictor == PREVIOUS_ROTATION ? predict_from_previous(m_previous, pos, last_valid) : last_valid;
+                distance = (std::uint32_t)(predicted + unzigzag(code - 1));
+                last_valid = distance;
+            }
+            nodes[pos].dist_mm_q2 = distance;
+        }
+    }
+
+    for (std::size_t pos = 0; pos < count;)
+    {
+        const std::uint64_t run = reader.varint();
+        if (run == 0 || run > count - pos)
+        {
+            damaged("quality run past its end");
+        }
+        const std::uint8_t quality = reader.byte();
+        const std::uint8_t flag = reader.byte();
+        for (const std::size_t end = pos + run; pos < end; ++pos)
+        {
+            nodes[pos].quality = quality;
+            nodes[pos].flag = flag;
+        }
+    }
+
+    m_previous.resize(count);
+    for (std::size_t pos = 0; pos < count; ++pos)
+    {
+        m_previous[pos] = nodes[pos].dist_mm_q2;
+    }
+    m_has_previous = true;
+    return reader.consumed();
+}
+
+void ScanDecoder::reset()
+{
+    m_has_previous = false;
+    m_previous.clear();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <cstdint>              //std::uint8_t, std::uint32_t
+#include <vector>               //std::vector
+
+#include "sl_lidar_cmd.h"		//sl_lidar_response_measurement_node_hq_t
+
+/*
+ * Lossless compression of rotations of HQ nodes for recording and uploading. Each rotation becomes one frame of
+ * three streams, each coded against what the lidar makes predictable:
+ *  - angles: the step between the previous two samples is assumed to repeat, which is the step the sample period
+ *    and rotation speed give, so only the jitter and capsule boundaries are stored
+ *  - distances: the difference to the last valid distance, or, block by block when it is smaller, to the same
+ *    sample of the previous rotation. Invalid (zero) distances take a single byte
+ *  - quality and flag: run lengths
+ * Differences are stored as zigzag varints, so a frame is a byte stream independent of the platform's byte order.
+ */
+
+// Turns rotations into frames. Frames that refer to the previous rotation can only be decoded after it,
+// reset makes the next frame stand on its own, e.g. to start a file or a chunk that may be read alone
+class ScanEncoder
+{
+public: //Ctor Dtor
+	// Without predict_from_previous every frame stands on its own
+	explicit ScanEncoder(bool predict_from_previous = true);
+
+public: //Methods
+	// Appends the frame of a rotation to out
+	void encode(const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count, std::vector<std::uint8_t> &out);
+
+	void reset();
+
+private: //Member Variables
+	const bool m_predict_from_previous;
+	bool m_has_previous = false;
+	std::vector<std::uint32_t> m_previous;
+};
+
+// Turns frames back into rotations. Frames must be decoded in the order they were encoded, after the same resets
+class ScanDecoder
+{
+public: //Methods
+	// The number of nodes in the frame at data. Throws std::runtime_error if it is not a frame
+	static std::size_t frame_nodes(const std::uint8_t *data, std::size_t size);
+
+	// Decodes the frame at data into nodes, which holds frame_nodes of them, and returns the bytes it took.
+	// Throws std::runtime_error if the frame is damaged or refers to a rotation this decoder has not seen
+	std::size_t decode(const std::uint8_t *data, std::size_t size, sl_lidar_response_measurement_node_hq_t *nodes);
+
+	void reset();
+
+private: //Member Variables
+	bool m_has_previous = false;
+	std::vector<std::uint32_t> m_previous;
+};
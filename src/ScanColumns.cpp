@@ -0,0 +1,40 @@
+#include "ScanColumns.h"
+#include "ScanPool.h"
+
+constexpr std::size_t ScanColumns::COLUMNS;
+
+ScanColumns::ScanColumns(void *buffer, const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count)
+    : m_data(static_cast<float *>(buffer)), m_count(count)
+{
+    float *angle = column(ANGLE);
+    float *distance = column(DISTANCE);
+    float *quality = column(QUALITY);
+
+    // Same units as Lidar::lidar_sample
+    for (std::size_t pos = 0; pos < count; ++pos)
+    {
+        angle[pos] = nodes[pos].angle_z_q14 * 90.f / (1 << 14);
+        distance[pos] = nodes[pos].dist_mm_q2 / 1000.f / (1 << 2);
+        quality[pos] = nodes[pos].quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;
+    }
+}
+
+ScanColumns::~ScanColumns()
+{
+    ScanPool::release(m_data);
+}
+
+std::size_t ScanColumns::size() const
+{
+    return m_count;
+}
+
+float *ScanColumns::data()
+{
+    return m_data;
+}
+
+float *ScanColumns::column(column_id which)
+{
+    return m_data + which * m_count;
+}
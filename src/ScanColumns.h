@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+
+#include "sl_lidar_cmd.h"		//sl_lidar_response_measurement_node_hq_t
+
+// One rotation as float32 columns for handing to array libraries without copying: angle in degrees,
+// distance in meters and quality on a scale of [0,255]. The columns follow each other in a single ScanPool buffer,
+// so the whole scan is also one C-contiguous (COLUMNS, size) matrix
+class ScanColumns
+{
+public: //Class Constants
+	static constexpr std::size_t COLUMNS = 3;
+
+	enum column_id : std::size_t
+	{
+		ANGLE = 0,
+		DISTANCE = 1,
+		QUALITY = 2
+	};
+
+public: //Ctor Dtor
+	// Takes over a buffer from ScanPool::acquire large enough for COLUMNS * count floats and fills it from nodes
+	ScanColumns(void *buffer, const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count);
+
+	// Hands the buffer back to its pool
+	~ScanColumns();
+
+	ScanColumns(const ScanColumns &) = delete;
+	ScanColumns &operator=(const ScanColumns &) = delete;
+
+public: //Methods
+	std::size_t size() const;
+
+	// The (COLUMNS, size) matrix
+	float *data();
+
+	float *column(column_id which);
+
+private: //Member Variables
+	float *const m_data;
+	const std::size_t m_count;
+};
@@ -0,0 +1,110 @@
+#include <utility> //std::move
+
+#include "ScanFrame.h"
+
+ScanFrame::ScanFrame(std::shared_ptr<ScanPool> pool, std::size_t capacity, sl_lidar_response_measurement_node_hq_t *nodes,
+                     std::size_t count, std::uint64_t end_us, double rotation_period_us)
+    : m_pool(std::move(pool)), m_capacity(capacity), m_nodes(nodes), m_count(count),
+      m_end_us(end_us), m_rotation_period_us(rotation_period_us)
+{
+}
+
+ScanFrame::~ScanFrame()
+{
+    ScanPool::release(m_nodes);
+    if (m_polar)
+    {
+        ScanPool::release(m_polar);
+    }
+    if (m_xy)
+    {
+        ScanPool::release(m_xy);
+    }
+    if (m_timestamps)
+    {
+        ScanPool::release(m_timestamps);
+    }
+}
+
+std::size_t ScanFrame::size() const
+{
+    return m_count;
+}
+
+std::uint64_t ScanFrame::timestamp_us() const
+{
+    return m_end_us;
+}
+
+const sl_lidar_response_measurement_node_hq_t *ScanFrame::raw() const
+{
+    return m_nodes;
+}
+
+const sl_lidar_response_measurement_node_hq_t *ScanFrame::sorted() const
+{
+    return m_nodes + m_count;
+}
+
+template <typename T>
+T *ScanFrame::acquire() const
+{
+    return static_cast<T *>(m_pool->acquire(m_capacity * sizeof(T)));
+}
+
+const Lidar::lidar_sample *ScanFrame::polar() const
+{
+    std::call_once(m_polar_once, &ScanFrame::convert_polar, this);
+    return m_polar;
+}
+
+const Lidar::point *ScanFrame::xy() const
+{
+    std::call_once(m_xy_once, &ScanFrame::convert_xy, this);
+    return m_xy;
+}
+
+const double *ScanFrame::timestamps() const
+{
+    std::call_once(m_timestamps_once, &ScanFrame::convert_timestamps, this);
+    return m_timestamps;
+}
+
+void ScanFrame::convert_polar() const
+{
+    Lidar::lidar_sample *polar = acquire<Lidar::lidar_sample>();
+    sl_lidar_response_measurement_node_hq_t *nodes = m_nodes + m_count;
+    for (std::size_t pos = 0; pos < m_count; ++pos)
+    {
+        polar[pos] = Lidar::lidar_sample(nodes[pos]);
+    }
+    m_polar = polar;
+}
+
+void ScanFrame::convert_xy() const
+{
+    Lidar::point *xy = acquire<Lidar::point>();
+    sl_lidar_response_measurement_node_hq_t *nodes = m_nodes + m_count;
+    for (std::size_t pos = 0; pos < m_count; ++pos)
+    {
+        xy[pos] = Lidar::point(nodes[pos]);
+    }
+    m_xy = xy;
+}
+
+void ScanFrame::convert_timestamps() const
+{
+    double *timestamps = acquire<double>();
+    const sl_lidar_response_measurement_node_hq_t *nodes = m_nodes + m_count;
+
+    // A full turn is 1 << 16 in q14 degrees, so 16 bit arithmetic takes the angles around it
+    const std::uint16_t last_angle = m_nodes[m_count - 1].angle_z_q14;
+    const double end = m_end_us / 1e6;
+    const double seconds_per_step = m_rotation_period_us / 1e6 / (1 << 16);
+    for (std::size_t pos = 0; pos < m_count; ++pos)
+    {
+        const std::uint16_t behind = last_angle - nodes[pos].angle_z_q14;
+        timestamps[pos] = end - behind * seconds_per_step;
+    }
+    m_timestamps = timestamps;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <cstdint>              //std::uint64_t
+#include <memory>               //std::shared_ptr
+#include <mutex>                //std::once_flag
+
+#include "sl_lidar_cmd.h"		//sl_lidar_response_measurement_node_hq_t
+#include "Lidar.h"				//Lidar::lidar_sample, Lidar::point
+#include "ScanPool.h"			//ScanPool
+
+// One rotation, grabbed once and read in whichever forms the caller needs. The nodes are kept as the lidar sent them
+// and in ascending angle order, the conversions are made on first access, each into a buffer of its own from the
+// pool, and kept until the frame is gone. Immutable once made, so it may be read from any thread
+class ScanFrame
+{
+public: //Ctor Dtor
+	/*
+	 * Takes over nodes, a buffer from pool holding the rotation as the lidar sent it followed by the same count nodes in
+	 * ascending angle order. Conversions take buffers of capacity samples from pool, so that it keeps a single slab size.
+	 * end_us is the latencyClockUs time the rotation was read by, rotation_period_us its duration, 0 if unknown
+	 * */
+	ScanFrame(std::shared_ptr<ScanPool> pool, std::size_t capacity, sl_lidar_response_measurement_node_hq_t *nodes,
+			  std::size_t count, std::uint64_t end_us, double rotation_period_us);
+
+	// Hands the buffers back to the pool
+	~ScanFrame();
+
+	ScanFrame(const ScanFrame &) = delete;
+	ScanFrame &operator=(const ScanFrame &) = delete;
+
+public: //Methods
+	std::size_t size() const;
+
+	// When the last sample was read, in latencyClockUs microseconds
+	std::uint64_t timestamp_us() const;
+
+	// The nodes in the order the lidar sent them
+	const sl_lidar_response_measurement_node_hq_t *raw() const;
+
+	// The nodes in ascending angle order, which the conversions follow
+	const sl_lidar_response_measurement_node_hq_t *sorted() const;
+
+	/*
+	 * The conversions, made by the first call. They throw what ScanPool::acquire throws when no buffer can be had,
+	 * and the next call tries again
+	 * */
+	const Lidar::lidar_sample *polar() const;
+
+	const Lidar::point *xy() const;
+
+	/*
+	 * When each sample of sorted was taken, in steady_clock seconds. The rotation is assumed to turn at an even speed
+	 * over its period, so a sample is as much earlier than the last one as its angle is short of the last one's.
+	 * All samples carry the time of the last one until the driver has measured the rotation speed
+	 * */
+	const double *timestamps() const;
+
+private:
+	template <typename T>
+	T *acquire() const;
+
+	// Fill the conversions from the sorted nodes, run once each through their flags
+	void convert_polar() const;
+	void convert_xy() const;
+	void convert_timestamps() const;
+
+private: //Member Variables
+	const std::shared_ptr<ScanPool> m_pool;
+	const std::size_t m_capacity;
+
+	sl_lidar_response_measurement_node_hq_t *const m_nodes;
+	const std::size_t m_count;
+
+	const std::uint64_t m_end_us;
+	const double m_rotation_period_us;
+
+	// Filled once, under their flags
+	mutable std::once_flag m_polar_once;
+	mutable Lidar::lidar_sample *m_polar = nullptr;
+
+	mutable std::once_flag m_xy_once;
+	mutable Lidar::point *m_xy = nullptr;
+
+	mutable std::once_flag m_timestamps_once;
+	mutable double *m_timestamps = nullptr;
+};
@@ -0,0 +1,594 @@
+#include <algorithm> //std::max, std::sort, std::upper_bound
+#include <chrono>    //std::chrono::system_clock
+#include <cstdio>    //std::fopen, std::fwrite, std::snprintf, std::sscanf
+#include <cstring>   //std::memcpy, std::memcmp, std::strncmp
+#include <stdexcept> //std::runtime_error, std::out_of_range
+#include <utility>   //std::swap
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h> //CreateFileMappingA, MapViewOfFile, FindFirstFileA
+#else
+#include <dirent.h>   //opendir, readdir
+#include <fcntl.h>    //open
+#include <sys/mman.h> //mmap, munmap
+#include <sys/stat.h> //fstat
+#include <unistd.h>   //close
+#endif
+
+#include "ScanLog.h"
+
+namespace
+{
+    constexpr char DATA_MAGIC[8] = {'S', 'L', 'S', 'C', 'A', 'N', 'D', '1'};
+    constexpr char INDEX_MAGIC[8] = {'S', 'L', 'S', 'C', 'A', 'N', 'I', '1'};
+
+    // Every segment file starts with its magic and the size of the items that follow, which a reader must agree with
+    typedef struct file_header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t item_bytes;
+    } file_header;
+
+    // In front of the nodes of every rotation in the data file, so that it can be recovered without the index
+    typedef struct record_header
+    {
+        std::uint64_t timestamp_us;
+        std::uint32_t count;
+        std::uint32_t lidar_id;
+        std::uint16_t scan_mode;
+        std::uint16_t reserved[3];
+    } record_header;
+
+    typedef struct index_entry
+    {
+        std::uint64_t timestamp_us;
+        std::uint64_t offset; // Of the record header in the data file
+        std::uint32_t count;
+        std::uint32_t lidar_id;
+        std::uint16_t scan_mode;
+        std::uint16_t reserved[3];
+    } index_entry;
+
+    static_assert(sizeof(file_header) == 16, "segment header layout");
+    static_assert(sizeof(record_header) == 24, "record header layout");
+    static_assert(sizeof(index_entry) == 32, "index entry layout");
+
+    constexpr std::uint32_t FORMAT_VERSION = 1;
+
+    constexpr const char *SEGMENT_PREFIX = "scans-";
+
+    std::string segment_path(const std::string &directory, std::uint32_t number, const char *extension)
+    {
+        char name[32] = {};
+        std::snprintf(name, sizeof(name), "%s%06u.%s", SEGMENT_PREFIX, number, extension);
+
+        if (directory.empty())
+        {
+            return name;
+        }
+
+        const char last = directory[directory.size() - 1];
+        return (last == '/' || last == '\\') ? directory + name : directory + "/" + name;
+    }
+
+    // Numbers of the segments in directory that have an index, in ascending order
+    std::vector<std::uint32_t> list_segments(const std::string &directory)
+    {
+        std::vector<std::string> names;
+#ifdef _WIN32
+        const std::string pattern = (directory.empty() ? std::string(".") : directory) + "/" + SEGMENT_PREFIX + "*.sidx";
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA(pattern.c_str(), &found);
+        if (search != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                names.push_back(found.cFileName);
+            } while (FindNextFileA(search, &found));
+            FindClose(search);
+        }
+#else
+        DIR *dir = opendir(directory.empty() ? "." : directory.c_str());
+        if (dir)
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                names.push_back(entry->d_name);
+            }
+            closedir(dir);
+        }
+#endif
+
+        std::vector<std::uint32_t> numbers;
+        for (const std::string &name : names)
+        {
+            unsigned int number = 0;
+            char extension[8] = {};
+            if (name.compare(0, std::strlen(SEGMENT_PREFIX), SEGMENT_PREFIX) == 0 &&
+                std::sscanf(name.c_str() + std::strlen(SEGMENT_PREFIX), "%u.%7s", &number, extension) == 2 && std::strncmp(extension, "sidx", sizeof(extension)) == 0)
+            {
+                numbers.push_back(number);
+            }
+        }
+        std::sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+    bool write_header(std::FILE *file, const char (&magic)[8], std::uint32_t item_bytes)
+    {
+        file_header header = {};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = FORMAT_VERSION;
+        header.item_bytes = item_bytes;
+        return std::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    bool check_header(const char *data, std::size_t size, const char (&magic)[8], std::uint32_t item_bytes)
+    {
+        if (size < sizeof(file_header))
+        {
+            return false;
+        }
+
+        file_header header;
+        std::memcpy(&header, data, sizeof(header));
+        return std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.version == FORMAT_VERSION && header.item_bytes == item_bytes;
+    }
+
+    std::uint64_t wall_clock_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+// ------------------------ Writer ---------------------------------------
+
+constexpr std::size_t ScanLogWriter::DEFAULT_SEGMENT_BYTES;
+constexpr std::size_t ScanLogWriter::DEFAULT_MAX_PENDING_BYTES;
+
+ScanLogWriter::ScanLogWriter(std::string directory, std::size_t segment_bytes, std::size_t max_pending_bytes)
+    : m_directory(std::move(directory)), m_segment_bytes(segment_bytes), m_pool(ScanPool::create(max_pending_bytes))
+{
+    const std::vector<std::uint32_t> existing = list_segments(m_directory);
+    const std::uint32_t first = existing.empty() ? 0 : existing.back() + 1;
+
+    if (!open_segment(first))
+    {
+        throw std::runtime_error("Could not create scan log segment " + segment_path(m_directory, first, "slog"));
+    }
+
+    m_writer = std::thread(&ScanLogWriter::write_loop, this);
+}
+
+ScanLogWriter::~ScanLogWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::runtime_error &)
+    {
+        // Nobody left to tell, stats still count what was written
+    }
+}
+
+bool ScanLogWriter::append(std::uint32_t lidar_id, std::uint16_t scan_mode, const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    void *buffer = nullptr;
+    try
+    {
+        buffer = m_pool->acquire(count * sizeof(sl_lidar_response_measurement_node_hq_t));
+    }
+    catch (const std::exception &)
+    {
+        // Over the limit or out of memory, either way the caller must not wait
+        std::lock_guard<std::mutex> lock(m_lock);
+        ++m_dropped;
+        return false;
+    }
+    std::memcpy(buffer, nodes, count * sizeof(sl_lidar_response_measurement_node_hq_t));
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_closed || m_failed)
+        {
+            ++m_dropped;
+            ScanPool::release(buffer);
+            return false;
+        }
+
+        // Stamped under the lock, so the queue is in timestamp order
+        m_last_timestamp_us = std::max(m_last_timestamp_us, wall_clock_us());
+        m_queue.push_back({buffer, count, m_last_timestamp_us, lidar_id, scan_mode});
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void ScanLogWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_written.wait(lock, [this]
+                   { return (m_queue.empty() && !m_writing) || m_failed; });
+
+    if (m_failed)
+    {
+        throw std::runtime_error("Writing the scan log to " + m_directory + " failed");
+    }
+}
+
+void ScanLogWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_closed = true;
+    }
+    m_wake.notify_one();
+
+    if (m_writer.joinable())
+    {
+        m_writer.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_failed)
+    {
+        throw std::runtime_error("Writing the scan log to " + m_directory + " failed");
+    }
+}
+
+ScanLogWriter::log_stats ScanLogWriter::stats() const
+{
+    const ScanPool::pool_stats pool = m_pool->stats();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    log_stats stats;
+    stats.written = m_written_scans;
+    stats.dropped = m_dropped;
+    stats.pending_bytes = pool.outstanding_bytes;
+    stats.bytes_written = m_bytes_written;
+    stats.segment = m_segment;
+    return stats;
+}
+
+void ScanLogWriter::write_loop()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true)
+    {
+        m_wake.wait(lock, [this]
+                    { return m_closed || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            break;
+        }
+
+        std::deque<pending_scan> batch;
+        batch.swap(m_queue);
+        m_writing = true;
+        bool ok = !m_failed;
+        lock.unlock();
+
+        std::uint64_t written = 0;
+        for (const pending_scan &scan : batch)
+        {
+            if (ok)
+            {
+                ok = write_scan(scan);
+                written += ok ? 1 : 0;
+            }
+            ScanPool::release(scan.nodes);
+        }
+
+        // What was written is indexed even when a later rotation failed
+        ok = flush_segment() && ok;
+
+        lock.lock();
+        m_writing = false;
+        m_written_scans += written;
+        m_bytes_written += written * sizeof(index_entry) + m_batch_bytes;
+        m_batch_bytes = 0;
+        m_dropped += batch.size() - written;
+        m_failed = m_failed || !ok;
+        m_written.notify_all();
+    }
+    lock.unlock();
+
+    close_segment();
+}
+
+bool ScanLogWriter::write_scan(const pending_scan &scan)
+{
+    const std::uint64_t nodes_bytes = scan.count * sizeof(sl_lidar_response_measurement_node_hq_t);
+    const std::uint64_t record_bytes = sizeof(record_header) + nodes_bytes;
+
+    if (m_segment_size > sizeof(file_header) && m_segment_size + record_bytes > m_segment_bytes)
+    {
+        const bool flushed = flush_segment();
+        close_segment();
+        if (!flushed || !open_segment(m_segment + 1))
+        {
+            return false;
+        }
+    }
+
+    record_header record = {};
+    record.timestamp_us = scan.timestamp_us;
+    record.count = (std::uint32_t)scan.count;
+    record.lidar_id = scan.lidar_id;
+    record.scan_mode = scan.scan_mode;
+
+    index_entry entry = {};
+    entry.timestamp_us = scan.timestamp_us;
+    entry.offset = m_segment_size;
+    entry.count = record.count;
+    entry.lidar_id = scan.lidar_id;
+    entry.scan_mode = scan.scan_mode;
+
+    if (std::fwrite(&record, sizeof(record), 1, m_data) != 1 || std::fwrite(scan.nodes, nodes_bytes, 1, m_data) != 1)
+    {
+        return false;
+    }
+    m_segment_size += record_bytes;
+    m_batch_bytes += record_bytes;
+
+    const std::size_t end = m_batch_index.size();
+    m_batch_index.resize(end + sizeof(entry));
+    std::memcpy(&m_batch_index[end], &entry, sizeof(entry));
+    return true;
+}
+
+bool ScanLogWriter::flush_segment()
+{
+    // The data reaches the file before the index entries pointing at it, stdio alone would not keep that order.
+    // No segment is open once starting one failed
+    const bool ok = m_data && m_index && std::fflush(m_data) == 0 &&
+                    (m_batch_index.empty() || std::fwrite(m_batch_index.data(), m_batch_index.size(), 1, m_index) == 1) &&
+                    std::fflush(m_index) == 0;
+    m_batch_index.clear();
+    return ok;
+}
+
+bool ScanLogWriter::open_segment(std::uint32_t number)
+{
+    // Exclusive, an existing segment is never truncated
+    m_data = std::fopen(segment_path(m_directory, number, "slog").c_str(), "wbx");
+    m_index = m_data ? std::fopen(segment_path(m_directory, number, "sidx").c_str(), "wbx") : nullptr;
+
+    if (!m_index || !write_header(m_data, DATA_MAGIC, sizeof(sl_lidar_response_measurement_node_hq_t)) ||
+        !write_header(m_index, INDEX_MAGIC, sizeof(index_entry)) || std::fflush(m_data) != 0 || std::fflush(m_index) != 0)
+    {
+        close_segment();
+        return false;
+    }
+
+    // The lock keeps stats consistent, the writer thread is the only one changing it
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_segment = number;
+    m_segment_size = sizeof(file_header);
+    return true;
+}
+
+void ScanLogWriter::close_segment()
+{
+    if (m_data)
+    {
+        std::fclose(m_data);
+        m_data = nullptr;
+    }
+    if (m_index)
+    {
+        std::fclose(m_index);
+        m_index = nullptr;
+    }
+}
+
+// ------------------------ Reader ---------------------------------------
+
+// A read-only mapping of a whole file, empty if the file is
+struct ScanLogReader::mapped_file
+{
+    const char *data = nullptr;
+    std::size_t size = 0;
+
+    explicit mapped_file(const std::string &path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Could not read the size of " + path);
+        }
+        size = (std::size_t)file_size.QuadPart;
+
+        if (size)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size)) : nullptr;
+            // The view keeps the mapping alive
+            if (mapping)
+            {
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not read the size of " + path);
+        }
+        size = (std::size_t)info.st_size;
+
+        if (size)
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            data = mapped == MAP_FAILED ? nullptr : static_cast<const char *>(mapped);
+        }
+        ::close(fd);
+#endif
+
+        if (size && !data)
+        {
+            throw std::runtime_error("Could not map " + path);
+        }
+    }
+
+    ~mapped_file()
+    {
+        if (!data)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+};
+
+struct ScanLogReader::segment
+{
+    // Mapped before the data, whose entries a live writer has always written completely by then
+    mapped_file index;
+    mapped_file data;
+    std::size_t first; // Position of its first rotation in the log
+    std::size_t count;
+
+    segment(const std::string &index_path, const std::string &data_path) : index(index_path), data(data_path), first(0), count(0)
+    {
+    }
+
+    index_entry entry(std::size_t local) const
+    {
+        index_entry read;
+        std::memcpy(&read, index.data + sizeof(file_header) + local * sizeof(index_entry), sizeof(read));
+        return read;
+    }
+};
+
+ScanLogReader::ScanLogReader(const std::string &directory)
+{
+    for (std::uint32_t number : list_segments(directory))
+    {
+        const std::string data_path = segment_path(directory, number, "slog");
+        std::unique_ptr<segment> opened(new segment(segment_path(directory, number, "sidx"), data_path));
+
+        // A segment the writer is creating may not have its headers yet, and without an index header it has no entries
+        if (opened->index.size < sizeof(file_header))
+        {
+            continue;
+        }
+        if (!check_header(opened->index.data, opened->index.size, INDEX_MAGIC, sizeof(index_entry)) ||
+            !check_header(opened->data.data, opened->data.size, DATA_MAGIC, sizeof(sl_lidar_response_measurement_node_hq_t)))
+        {
+            throw std::runtime_error(data_path + " is not a scan log segment of this format");
+        }
+
+        opened->first = m_size;
+        opened->count = (opened->index.size - sizeof(file_header)) / sizeof(index_entry);
+        if (opened->count)
+        {
+            m_size += opened->count;
+            m_segments.push_back(std::move(opened));
+        }
+    }
+
+    if (m_segments.empty())
+    {
+        throw std::runtime_error("No scans logged in " + directory);
+    }
+}
+
+ScanLogReader::~ScanLogReader() = default;
+
+std::size_t ScanLogReader::size() const
+{
+    return m_size;
+}
+
+const ScanLogReader::segment &ScanLogReader::segment_of(std::size_t index) const
+{
+    // The last segment starting at or before index
+    auto after = std::upper_bound(m_segments.begin(), m_segments.end(), index, [](std::size_t position, const std::unique_ptr<segment> &candidate)
+                                  { return position < candidate->first; });
+    return **(after - 1);
+}
+
+ScanLogReader::scan_entry ScanLogReader::scan(std::size_t index) const
+{
+    if (index >= m_size)
+    {
+        throw std::out_of_range("Scan " + std::to_string(index) + " is past the end of the log of " + std::to_string(m_size));
+    }
+
+    const segment &holder = segment_of(index);
+    const index_entry entry = holder.entry(index - holder.first);
+
+    const std::uint64_t nodes_bytes = (std::uint64_t)entry.count * sizeof(sl_lidar_response_measurement_node_hq_t);
+    if (entry.offset < sizeof(file_header) || entry.offset + sizeof(record_header) + nodes_bytes > holder.data.size)
+    {
+        throw std::runtime_error("Scan " + std::to_string(index) + " points outside its segment, the log is damaged");
+    }
+
+    scan_entry found;
+    found.timestamp_us = entry.timestamp_us;
+    found.lidar_id = entry.lidar_id;
+    found.scan_mode = entry.scan_mode;
+    found.count = entry.count;
+    found.nodes = reinterpret_cast<const sl_lidar_response_measurement_node_hq_t *>(holder.data.data + entry.offset + sizeof(record_header));
+    return found;
+}
+
+std::uint64_t ScanLogReader::timestamp_at(std::size_t index) const
+{
+    const segment &holder = segment_of(index);
+    return holder.entry(index - holder.first).timestamp_us;
+}
+
+std::size_t ScanLogReader::lower_bound(std::uint64_t timestamp_us) const
+{
+    // The writer keeps timestamps non-decreasing across segments
+    std::size_t first = 0;
+    std::size_t count = m_size;
+    while (count > 0)
+    {
+        const std::size_t half = count / 2;
+        if (timestamp_at(first + half) < timestamp_us)
+        {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else
+        {
+            count = half;
+        }
+    }
+    return first;
+}
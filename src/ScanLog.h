@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <cstdint>              //std::uint16_t, std::uint32_t, std::uint64_t
+#include <cstdio>               //std::FILE
+#include <deque>                //std::deque
+#include <memory>               //std::shared_ptr
+#include <mutex>                //std::mutex
+#include <condition_variable>   //std::condition_variable
+#include <string>               //std::string
+#include <thread>               //std::thread
+#include <vector>               //std::vector
+
+#include "sl_lidar_cmd.h"		//sl_lidar_response_measurement_node_hq_t
+#include "ScanPool.h"			//ScanPool
+
+/*
+ * Append-only log of rotations for incident review. A log is a directory of numbered segments, each a data file
+ * (scans-000000.slog) holding the raw HQ nodes of every rotation behind a small header, and an index file
+ * (scans-000000.sidx) with one fixed size entry per rotation: when it was logged, where it starts, its lidar and scan mode.
+ * Both are in native byte order. A segment is only ever appended to, and an index entry is written after the data it
+ * points at, so a log cut short by a crash loses at most the rotations that were still queued.
+ */
+
+// Queues rotations without blocking and writes them from a thread of its own. When the writer falls behind by more
+// than max_pending_bytes, new rotations are dropped and counted instead of waiting for it
+class ScanLogWriter
+{
+public: //Classes and structs
+	typedef struct log_stats
+	{
+		std::uint64_t written;			// Rotations in the log
+		std::uint64_t dropped;			// Rotations dropped because the writer fell behind
+		std::size_t pending_bytes;		// Memory held by rotations waiting to be written
+		std::uint64_t bytes_written;	// Data and index bytes of this writer
+		std::uint32_t segment;			// Number of the segment being written
+	} log_stats;
+
+public: //Class Constants
+	static constexpr std::size_t DEFAULT_SEGMENT_BYTES = 256u << 20;
+	static constexpr std::size_t DEFAULT_MAX_PENDING_BYTES = 64u << 20;
+
+public: //Ctor Dtor
+	// directory must exist. A log already there is continued in a new segment. Throws std::runtime_error if the
+	// first segment cannot be created
+	explicit ScanLogWriter(std::string directory, std::size_t segment_bytes = DEFAULT_SEGMENT_BYTES,
+						   std::size_t max_pending_bytes = DEFAULT_MAX_PENDING_BYTES);
+
+	// Writes what is still queued
+	~ScanLogWriter();
+
+	ScanLogWriter(const ScanLogWriter &) = delete;
+	ScanLogWriter &operator=(const ScanLogWriter &) = delete;
+
+public: //Methods
+	// Queues a rotation stamped with the current wall-clock time, kept non-decreasing so that the index stays sorted.
+	// Returns false if it was dropped, because the writer fell behind or is closed
+	bool append(std::uint32_t lidar_id, std::uint16_t scan_mode, const sl_lidar_response_measurement_node_hq_t *nodes, std::size_t count);
+
+	// Waits until every rotation queued so far is written. Throws std::runtime_error if writing failed
+	void flush();
+
+	// Writes what is queued and closes the segment, later appends are dropped. Throws std::runtime_error if writing failed
+	void close();
+
+	log_stats stats() const;
+
+private:
+	typedef struct pending_scan
+	{
+		void *nodes;					// From m_pool
+		std::size_t count;
+		std::uint64_t timestamp_us;
+		std::uint32_t lidar_id;
+		std::uint16_t scan_mode;
+	} pending_scan;
+
+	// Body of the writer thread
+	void write_loop();
+
+	// Writes one rotation, starting a new segment first when it would not fit the current one
+	bool write_scan(const pending_scan &scan);
+
+	// Flushes the data file, then writes the index entries of the rotations written since and flushes the index file
+	bool flush_segment();
+
+	bool open_segment(std::uint32_t number);
+
+	void close_segment();
+
+private: //Member Variables
+	const std::string m_directory;
+	const std::size_t m_segment_bytes;
+
+	// Its limit bounds the memory held by queued rotations
+	const std::shared_ptr<ScanPool> m_pool;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_written;
+	std::deque<pending_scan> m_queue;
+	bool m_closed = false;
+	// The writer thread took a batch off the queue and has not written it yet
+	bool m_writing = false;
+	bool m_failed = false;
+	std::uint64_t m_last_timestamp_us = 0;
+	std::uint64_t m_dropped = 0;
+	std::uint64_t m_written_scans = 0;
+	std::uint64_t m_bytes_written = 0;
+
+	// Only touched by the writer thread once it runs, and by the constructor before
+	std::FILE *m_data = nullptr;
+	std::FILE *m_index = nullptr;
+	std::uint32_t m_segment = 0;
+	std::uint64_t m_segment_size = 0;
+	// Data bytes of the batch being written, added to m_bytes_written once it is
+	std::uint64_t m_batch_bytes = 0;
+	// Index entries of the rotations written since the last flush_segment, as they go to the index file
+	std::vector<std::uint8_t> m_batch_index;
+
+	std::thread m_writer;
+};
+
+// Maps a log into memory for reading. Rotations are found by position or time in O(log n) and their nodes are read in
+// place, nothing is copied. Sees the log as it was when opened
+class ScanLogReader
+{
+public: //Classes and structs
+	typedef struct scan_entry
+	{
+		std::uint64_t timestamp_us;		// Wall-clock microseconds since the epoch
+		std::uint32_t lidar_id;
+		std::uint16_t scan_mode;
+		std::size_t count;
+		const sl_lidar_response_measurement_node_hq_t *nodes;	// Valid while the reader lives, in the order the lidar sent them
+	} scan_entry;
+
+public: //Ctor Dtor
+	// Throws std::runtime_error if directory holds no log or a segment is not one
+	explicit ScanLogReader(const std::string &directory);
+
+	~ScanLogReader();
+
+	ScanLogReader(const ScanLogReader &) = delete;
+	ScanLogReader &operator=(const ScanLogReader &) = delete;
+
+public: //Methods
+	std::size_t size() const;
+
+	// Throws std::out_of_range past the end, std::runtime_error if the entry points outside its segment
+	scan_entry scan(std::size_t index) const;
+
+	// Position of the first rotation logged at or after timestamp_us, size() if there is none
+	std::size_t lower_bound(std::uint64_t timestamp_us) const;
+
+private:
+	struct mapped_file;
+	struct segment;
+
+	std::uint64_t timestamp_at(std::size_t index) const;
+
+	const segment &segment_of(std::size_t index) const;
+
+private: //Member Variables
+	std::vector<std::unique_ptr<segment>> m_segments;
+	std::size_t m_size = 0;
+};
@@ -0,0 +1,159 @@
+#include <cstddef>   //std::max_align_t
+#include <new>       //operator new, std::bad_alloc
+#include <stdexcept> //std::runtime_error
+#include <string>    //std::to_string
+
+#include "ScanPool.h"
+
+// Placed in front of the memory of every slab
+struct ScanPool::slab
+{
+    // Set while the slab is handed out, so that release finds a pool that is still alive
+    std::shared_ptr<ScanPool> owner;
+    std::size_t bytes;
+};
+
+const std::size_t ScanPool::SLAB_HEADER_BYTES = (sizeof(ScanPool::slab) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+std::shared_ptr<ScanPool> ScanPool::create(std::size_t max_outstanding_bytes)
+{
+    return std::shared_ptr<ScanPool>(new ScanPool(max_outstanding_bytes));
+}
+
+ScanPool::ScanPool(std::size_t max_outstanding_bytes) : m_max_outstanding_bytes(max_outstanding_bytes)
+{
+}
+
+ScanPool::~ScanPool()
+{
+    // Slabs still handed out hold a reference, so only free ones are left
+    for (slab *unused : m_free)
+    {
+        delete_slab(unused);
+    }
+}
+
+void *ScanPool::acquire(std::size_t bytes)
+{
+    slab *taken = nullptr;
+    std::size_t slab_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (bytes > m_slab_bytes)
+        {
+            // The slabs kept so far are too small for this and for every rotation like it
+            for (slab *unused : m_free)
+            {
+                delete_slab(unused);
+            }
+            m_free.clear();
+            m_slab_bytes = bytes;
+        }
+
+        if (m_max_outstanding_bytes && m_outstanding_bytes + m_slab_bytes > m_max_outstanding_bytes)
+        {
+            throw std::runtime_error("Scan buffer limit of " + std::to_string(m_max_outstanding_bytes) + " bytes reached, " +
+                                     std::to_string(m_outstanding) + " scans are still referenced");
+        }
+
+        slab_bytes = m_slab_bytes;
+        if (!m_free.empty())
+        {
+            taken = m_free.back();
+            m_free.pop_back();
+            ++m_hits;
+        }
+        else
+        {
+            ++m_misses;
+        }
+
+        // Accounted for up front so concurrent callers cannot overshoot the limit while this one allocates
+        ++m_outstanding;
+        m_outstanding_bytes += slab_bytes;
+    }
+
+    if (!taken)
+    {
+        try
+        {
+            taken = new_slab(slab_bytes);
+        }
+        catch (const std::bad_alloc &)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            --m_outstanding;
+            m_outstanding_bytes -= slab_bytes;
+            throw;
+        }
+    }
+
+    taken->owner = shared_from_this();
+    return reinterpret_cast<char *>(taken) + SLAB_HEADER_BYTES;
+}
+
+void ScanPool::release(void *buffer)
+{
+    if (!buffer)
+    {
+        return;
+    }
+
+    slab *released = reinterpret_cast<slab *>(static_cast<char *>(buffer) - SLAB_HEADER_BYTES);
+
+    // Moved out first, this may be the last reference to the pool
+    std::shared_ptr<ScanPool> pool = std::move(released->owner);
+    pool->recycle(released);
+}
+
+void ScanPool::recycle(slab *released)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    --m_outstanding;
+    m_outstanding_bytes -= released->bytes;
+
+    if (released->bytes == m_slab_bytes)
+    {
+        m_free.push_back(released);
+    }
+    else
+    {
+        delete_slab(released);
+    }
+}
+
+void ScanPool::set_max_outstanding_bytes(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_max_outstanding_bytes = bytes;
+}
+
+ScanPool::pool_stats ScanPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    pool_stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.outstanding = m_outstanding;
+    stats.outstanding_bytes = m_outstanding_bytes;
+    stats.free_slabs = m_free.size();
+    stats.slab_bytes = m_slab_bytes;
+    stats.max_outstanding_bytes = m_max_outstanding_bytes;
+    return stats;
+}
+
+ScanPool::slab *ScanPool::new_slab(std::size_t bytes)
+{
+    void *memory = ::operator new(SLAB_HEADER_BYTES + bytes);
+
+    slab *created = new (memory) slab();
+    created->bytes = bytes;
+    return created;
+}
+
+void ScanPool::delete_slab(slab *unused)
+{
+    unused->~slab();
+    ::operator delete(unused);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>              //std::size_t
+#include <cstdint>              //std::uint64_t
+#include <memory>               //std::shared_ptr, std::enable_shared_from_this
+#include <mutex>                //std::mutex
+#include <vector>               //std::vector
+
+// Recycles the buffers scans are handed out in. Every slab is as large as the largest buffer asked for so far,
+// so once a full rotation has been seen the pool settles on a fixed set of slabs and stops calling the allocator.
+// Buffers are handed back with ScanPool::release from any thread, and keep the pool alive until they are
+class ScanPool : public std::enable_shared_from_this<ScanPool>
+{
+public: //Classes and structs
+	typedef struct pool_stats
+	{
+		std::uint64_t hits;					// Buffers served from a recycled slab
+		std::uint64_t misses;				// Buffers that needed a new slab
+		std::size_t outstanding;			// Buffers not released yet
+		std::size_t outstanding_bytes;		// Memory held by them
+		std::size_t free_slabs;				// Slabs waiting to be reused
+		std::size_t slab_bytes;				// Size of the slabs handed out from now on
+		std::size_t max_outstanding_bytes;	// 0 for no limit
+	} pool_stats;
+
+public: //Ctor Dtor
+	// A limit of 0 lets the buffers held at once take any amount of memory
+	static std::shared_ptr<ScanPool> create(std::size_t max_outstanding_bytes = 0);
+
+	~ScanPool();
+
+	ScanPool(const ScanPool &) = delete;
+	ScanPool &operator=(const ScanPool &) = delete;
+
+private:
+	explicit ScanPool(std::size_t max_outstanding_bytes);
+
+public: //Methods
+	// Returns a buffer of at least bytes, aligned for any type. Throws std::runtime_error if the buffers not released yet
+	// would hold more than the limit, std::bad_alloc if a new slab cannot be allocated
+	void *acquire(std::size_t bytes);
+
+	// Hands a buffer returned by acquire back to its pool
+	static void release(void *buffer);
+
+	// Buffers already handed out are not affected, 0 lifts the limit
+	void set_max_outstanding_bytes(std::size_t bytes);
+
+	pool_stats stats() const;
+
+private:
+	struct slab;
+
+	// Keeps a released slab for reuse unless it was outgrown meanwhile
+	void recycle(slab *released);
+
+	static slab *new_slab(std::size_t bytes);
+
+	static void delete_slab(slab *unused);
+
+private: //Class Constants
+
+	// Where the memory handed out starts in a slab, keeping it aligned for any type
+	static const std::size_t SLAB_HEADER_BYTES;
+
+private: //Member Variables
+
+	mutable std::mutex m_lock;
+
+	// All m_slab_bytes large
+	std::vector<slab *> m_free;
+
+	std::size_t m_slab_bytes = 0;
+	std::size_t m_max_outstanding_bytes;
+
+	std::size_t m_outstanding = 0;
+	std::size_t m_outstanding_bytes = 0;
+	std::uint64_t m_hits = 0;
+	std::uint64_t m_misses = 0;
+};
@@ -0,0 +1,113 @@
+#include <cstdio>    //std::snprintf, std::rename, std::remove
+#include <fstream>   //std::ofstream
+
+#include "StatsExposition.h"
+
+namespace
+{
+    std::string escape_label_value(const std::string &value)
+    {
+        std::string escaped;
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::string escape_help(const std::string &help)
+    {
+        std::string escaped;
+        for (char c : help)
+        {
+            if (c == '\\')
+            {
+                escaped += "\\\\";
+            }
+            else if (c == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+}
+
+std::string format_exposition(const std::vector<exposition_metric> &metrics, const std::vector<std::pair<std::string, std::string>> &labels)
+{
+    std::string label_set;
+    for (const auto &label : labels)
+    {
+        label_set += label_set.empty() ? "{" : ",";
+        label_set += label.first + "=\"" + escape_label_value(label.second) + "\"";
+    }
+    if (!label_set.empty())
+    {
+        label_set += "}";
+    }
+
+    std::string text;
+    for (const exposition_metric &metric : metrics)
+    {
+        // Counters stay exact up to 10^15, far beyond what a lidar reaches
+        char value[32] = {};
+        std::snprintf(value, sizeof(value), "%.15g", metric.value);
+
+        text += "# HELP " + metric.name + " " + escape_help(metric.help) + "\n";
+        text += "# TYPE " + metric.name + " " + metric.type + "\n";
+        text += metric.name + label_set + " " + value + "\n";
+    }
+    return text;
+}
+
+bool write_exposition_file(const std::string &path, const std::string &text)
+{
+    const std::string tmp_path = path + ".tmp";
+
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << text;
+        if (!file.flush())
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) == 0)
+    {
+        return true;
+    }
+
+    // rename does not replace an existing file on Windows, where scrapers have to live with the gap
+    std::remove(path.c_str());
+    if (std::rename(tmp_path.c_str(), path.c_str()) == 0)
+    {
+        return true;
+    }
+
+    std::remove(tmp_path.c_str());
+    return false;
+}
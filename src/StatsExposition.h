@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>               //std::string
+#include <utility>              //std::pair
+#include <vector>               //std::vector
+
+// Renders counters in the Prometheus text exposition format, which the node_exporter textfile collector and
+// most other scrapers read. Every metric gets its HELP and TYPE lines followed by a single sample
+
+typedef struct exposition_metric
+{
+	std::string name;
+	const char *type;			// "counter" or "gauge"
+	std::string help;
+	double value;
+} exposition_metric;
+
+// labels are attached to every sample, their values are escaped as the format asks
+std::string format_exposition(const std::vector<exposition_metric> &metrics, const std::vector<std::pair<std::string, std::string>> &labels);
+
+// Replaces the file at path through a temporary file next to it, so a scraper never reads half of it.
+// Returns false if it could not be written
+bool write_exposition_file(const std::string &path, const std::string &text);
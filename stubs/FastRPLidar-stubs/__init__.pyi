@@ -1,18 +1,136 @@
 from __future__ import annotations
 import FastPyRpLidar
+import concurrent.futures
 import typing
 import numpy
 _Shape = typing.Tuple[int, ...]
 
 __all__ = [
+    "AngularGrid",
+    "LidarEmulator",
+    "LidarGroup",
     "Lidar_Scan",
     "Point",
     "RPLidar",
+    "RangeStack",
     "Result_Code",
-    "Status_Code"
+    "Scan",
+    "ScanDecoder",
+    "ScanEncoder",
+    "ScanFrame",
+    "ScanLogReader",
+    "ScanLogWriter",
+    "Status_Code",
+    "clear_trace",
+    "discover",
+    "list_serial_ports",
+    "set_tracing",
+    "trace_json"
 ]
 
 
+class AngularGrid():
+    """
+    A fixed grid of bins evenly spaced around the turn that RPLidar.get_scan_resampled bins rotations into, NaN for no return
+    """
+    def __init__(self, bins: int = 360, policy: str = 'nearest') -> None: 
+        """
+        Makes a grid of bins bins, policy is nearest, min_range or interpolate
+        """
+    def __len__(self) -> int: ...
+    def index_of(self, theta: float) -> int: 
+        """
+        Returns the bin an angle in degrees falls in
+        """
+    def angle_of(self, index: int) -> float: 
+        """
+        Returns the angle in degrees of the centre of a bin
+        """
+    def distance_at(self, theta: float) -> float: 
+        """
+        Returns the range in meters of the last rotation resampled at an angle in degrees, in O(1)
+        """
+    @property
+    def bins(self) -> int:
+        """
+        :type: int
+        """
+    @property
+    def policy(self) -> str:
+        """
+        :type: str
+        """
+    @property
+    def ranges(self) -> numpy.ndarray[numpy.float32]:
+        """
+        The ranges of the last rotation resampled in meters, a read-only view that the next one overwrites
+
+        :type: numpy.ndarray[numpy.float32]
+        """
+    pass
+class LidarEmulator():
+    def __init__(self, scan_frequency: float = 10.0, rate_scale: float = 1.0, typical_scan_mode: int = 3) -> None: 
+        """
+        Starts an emulated lidar on a pseudo terminal (Linux only)
+        """
+    def stats(self) -> typing.Dict[str, int]: 
+        """
+        Returns counters of the traffic served so far, and last_motor_speed, the PWM or rpm of the last motor command
+        """
+    def simulate_dropout(self, duration: float) -> None: 
+        """
+        Cuts the link for duration seconds while the emulated lidar keeps scanning
+        """
+    @property
+    def port(self) -> str:
+        """
+        The device path to pass to RPLidar
+
+        :type: str
+        """
+    pass
+class LidarGroup():
+    def __init__(self, queue_depth: int = 16, sched_policy: str = 'inherit', sched_priority: int = 0, cpus: typing.List[int] = [], lock_memory: bool = False) -> None: 
+        """
+        Creates an empty group of lidars read by a single background thread, scheduled as RPLidar's decoding thread
+        """
+    def add(self, port: str, baud_rate: int, capture_file: str = '', capability_cache: str = '') -> int: 
+        """
+        Connects to a lidar and adds it to the stopped group, returns its index
+        """
+    def lidar(self, index: int) -> RPLidar: 
+        """
+        Returns the RPLidar at index for everything but reading scans
+        """
+    def start(self) -> None: 
+        """
+        Starts every lidar and the thread reading them
+        """
+    def stop(self) -> None: 
+        """
+        Stops the reading thread and the motors
+        """
+    def next_scan(self, timeout: float = 1.0) -> typing.Optional[typing.Tuple[int, numpy.ndarray[Lidar_Scan]]]: 
+        """
+        Waits for the next rotation of any lidar, returns its index and scan line or None on timeout
+        """
+    def reading_thread(self) -> typing.Dict[str, typing.Union[str, int, typing.List[int], bool]]: 
+        """
+        Returns the scheduling the reading thread actually runs with, while the group is started
+        """
+    def set_scan_log(self, log: typing.Optional[ScanLogWriter]) -> None: 
+        """
+        Records every rotation the group delivers to log, each lidar under its index. None stops logging
+        """
+    def __len__(self) -> int: ...
+    @property
+    def dropped_scans(self) -> int:
+        """
+        Scans lost because the queue was full
+
+        :type: int
+        """
+    pass
 class Lidar_Scan():
     @property
     def angle(self) -> float:
@@ -52,16 +170,272 @@ class Point():
         :type: float
         """
     pass
+class Scan():
+    """
+    One rotation as float32 columns (angle in degrees, distance in meters, quality), also a (3, len) matrix through the buffer protocol and DLPack
+    """
+    def __len__(self) -> int: ...
+    def __dlpack__(self, *, stream: typing.Optional[int] = None, max_version: typing.Optional[typing.Tuple[int, int]] = None,
+                   dl_device: typing.Optional[typing.Tuple[int, int]] = None, copy: typing.Optional[bool] = None) -> typing.Any: 
+        """
+        Exports the (3, len) float32 matrix as a DLPack capsule sharing the memory of the scan
+        """
+    def __dlpack_device__(self) -> typing.Tuple[int, int]: ...
+    @property
+    def angle(self) -> numpy.ndarray[numpy.float32]:
+        """
+        Angles in degrees, a view into the scan
+
+        :type: numpy.ndarray[numpy.float32]
+        """
+    @property
+    def distance(self) -> numpy.ndarray[numpy.float32]:
+        """
+        Distances in meters, a view into the scan
+
+        :type: numpy.ndarray[numpy.float32]
+        """
+    @property
+    def quality(self) -> numpy.ndarray[numpy.float32]:
+        """
+        Qualities on a scale of [0,255], a view into the scan
+
+        :type: numpy.ndarray[numpy.float32]
+        """
+    pass
+class ScanFrame():
+    """
+    One rotation read as polar samples, x-y points, raw nodes and sample times, each converted on first access and kept
+    """
+    def __len__(self) -> int: ...
+    @property
+    def raw(self) -> numpy.ndarray:
+        """
+        The HQ nodes as the lidar sent them (angle_z_q14, dist_mm_q2, quality, flag), a read-only view
+
+        :type: numpy.ndarray
+        """
+    @property
+    def polar(self) -> numpy.ndarray[Lidar_Scan]:
+        """
+        The samples in ascending angle order, as get_scanline returns them, a read-only view
+
+        :type: numpy.ndarray[Lidar_Scan]
+        """
+    @property
+    def xy(self) -> numpy.ndarray[Point]:
+        """
+        The samples in ascending angle order, as get_scanline_xy returns them, a read-only view
+
+        :type: numpy.ndarray[Point]
+        """
+    @property
+    def timestamps(self) -> numpy.ndarray[numpy.float64]:
+        """
+        When each sample of polar and xy was taken, in seconds of time.monotonic, a read-only view
+
+        :type: numpy.ndarray[numpy.float64]
+        """
+    @property
+    def timestamp(self) -> float:
+        """
+        When the last sample of the rotation was read, in seconds of time.monotonic
+
+        :type: float
+        """
+    pass
+class ScanLogWriter():
+    """
+    Records the raw HQ nodes of every rotation to segmented files with a time index, from a thread of its own
+    """
+    def __init__(self, directory: str, segment_bytes: int = 268435456, max_pending_bytes: int = 67108864) -> None: 
+        """
+        Starts a new segment in directory, continuing the log already there
+        """
+    def flush(self) -> None: 
+        """
+        Waits until every rotation queued so far is on disk
+        """
+    def close(self) -> None: 
+        """
+        Writes what is queued and closes the segment
+        """
+    def stats(self) -> typing.Dict[str, int]: 
+        """
+        Returns written, dropped, pending_bytes, bytes_written and segment
+        """
+    pass
+class ScanLogReader():
+    """
+    Maps a log written by ScanLogWriter and returns its rotations as read-only numpy views, found by position or time in O(log n)
+    """
+    def __init__(self, directory: str) -> None: ...
+    def __len__(self) -> int: ...
+    def scan(self, index: int) -> typing.Tuple[float, int, int, numpy.ndarray]: 
+        """
+        Returns the time a rotation was logged at, its lidar id, scan mode and nodes (angle_z_q14, dist_mm_q2, quality, flag)
+        """
+    def time_range(self, start: float, stop: float) -> range: 
+        """
+        Returns the positions of the rotations logged in [start, stop), times in seconds since the epoch
+        """
+    pass
+class ScanEncoder():
+    """
+    Compresses rotations of HQ nodes without loss: predicted angles, delta coded distances and run-length coded quality
+    """
+    def __init__(self, predict_from_previous: bool = True) -> None: ...
+    def encode(self, nodes: numpy.ndarray) -> bytes: 
+        """
+        Returns the frame of a rotation with fields angle_z_q14, dist_mm_q2, quality and flag
+        """
+    def reset(self) -> None: 
+        """
+        Makes the next frame decodable without the ones before it
+        """
+    pass
+class ScanDecoder():
+    """
+    Turns frames of ScanEncoder back into rotations, in the order they were encoded
+    """
+    def __init__(self) -> None: ...
+    def decode(self, frame: bytes) -> numpy.ndarray: 
+        """
+        Returns the nodes of a frame
+        """
+    def reset(self) -> None: 
+        """
+        Forgets the previous rotation
+        """
+    pass
 class RPLidar():
+    @typing.overload
     def __init__(self, port: str, baud_rate: int) -> None: 
         """
         Loads Lidar from given USB port at given baud rate
         """
+    @typing.overload
+    def __init__(self, port: str, baud_rate: int, capture_file: str = "", capability_cache: str = "", sched_policy: str = "inherit", sched_priority: int = 0, cpus: typing.List[int] = [], lock_memory: bool = False) -> None: 
+        """
+        Loads Lidar from given USB port at given baud rate, recording all traffic to capture_file if given
+        and keeping the unit's static configuration in the capability_cache directory if given.
+        The thread decoding the scan is scheduled with sched_policy (inherit, fifo or rr) at sched_priority,
+        pinned to cpus if given, and lock_memory keeps the process in RAM
+        """
+    @staticmethod
+    def replay(capture_file: str, realtime: bool = False) -> RPLidar: 
+        """
+        Loads a Lidar that plays back a capture file instead of talking to hardware. Commands have to be sent in the
+        order they were recorded, once one differs calls waiting on an answer raise RuntimeError
+        """
+    @staticmethod
+    def with_faults(port: str, baud_rate: int, corrupt_rate: float = 0.0, drop_rate: float = 0.0, insert_rate: float = 0.0,
+                    burst_length: int = 1, skip_bytes: int = 0, seed: int = 1) -> RPLidar: 
+        """
+        Loads Lidar corrupting, dropping and inserting bytes read from it, to see how the scan stream recovers
+        """
+    def set_faults(self, corrupt_rate: float = 0.0, drop_rate: float = 0.0, insert_rate: float = 0.0,
+                   burst_length: int = 1, skip_bytes: int = 0, seed: int = 1) -> None: 
+        """
+        Changes the faults of a lidar loaded with with_faults, all rates 0 stops injecting
+        """
+    def fault_stats(self) -> typing.Dict[str, int]: 
+        """
+        Returns bytes_passed, bytes_corrupted, bytes_dropped and bytes_inserted
+        """
+    @staticmethod
+    def connect_async(port: str, baud_rate: int, capture_file: str = "", capability_cache: str = "") -> concurrent.futures.Future[RPLidar]: 
+        """
+        Connects on a background thread without holding the GIL. Connections still running when the interpreter exits are waited for
+        """
+    @staticmethod
+    def connect_all(ports: typing.List[str], baud_rate: int, timeout: float = 5.0, capability_cache: str = "", raise_on_error: bool = True) -> typing.List[typing.Optional[RPLidar]]: 
+        """
+        Connects to several lidars at once, each given timeout seconds
+        """
     def __str__(self) -> str: ...
     def get_health(self) -> typing.Tuple[Status_Code, Result_Code]: 
         """
         Returns the health of the Lidar
         """
+    def scan_modes(self) -> typing.List[typing.Dict[str, typing.Union[int, float, str]]]: 
+        """
+        Returns the scan modes the lidar offers with their id, name, us_per_sample, max_distance and ans_type
+        """
+    def switch_mode(self, mode: int, motor_speed: int = 65535) -> float: 
+        """
+        Switches the running scan to another mode and motor speed without stopping the motor, returns the gap in seconds
+        """
+    def enable_supervisor(self, stall_multiple: float = 20.0) -> None: 
+        """
+        Reconnects and restarts the scan on its own when the stream stalls for stall_multiple packet periods
+        """
+    def disable_supervisor(self) -> None: 
+        """
+        Stops watching the scan stream
+        """
+    def supervisor_stats(self) -> typing.Dict[str, typing.Union[int, float, bool]]: 
+        """
+        Returns reconnects, failed_attempts, last_outage, max_outage, total_outage (seconds) and in_outage
+        """
+    def acquisition_thread(self) -> typing.Dict[str, typing.Union[str, int, typing.List[int], bool]]: 
+        """
+        Returns policy, priority, cpus and memory_locked of the running decoding thread, as read back from the OS
+        """
+    def set_scan_capacity(self, nodes: int) -> None: 
+        """
+        Sizes the scan buffers for at most nodes samples per rotation, only while the motor is stopped
+        """
+    def scan_capacity_stats(self) -> typing.Dict[str, int]: 
+        """
+        Returns capacity, max_scan_nodes (high-water mark of samples per rotation) and dropped_nodes
+        """
+    def stats(self) -> typing.Dict[str, typing.Union[int, float]]: 
+        """
+        Returns the throughput and error counters of the scan stream: bytes_read, read_calls, packets_received, checksum_failures,
+        resync_bytes_skipped, capsules_lost, revolutions_published, revolutions_overwritten, min/avg/max_samples_per_revolution,
+        samples_dropped, samples_decoded, zero_distance_samples, zero_distance_ratio and rotation_frequency
+        """
+    def latency_stats(self, reset: bool = True) -> typing.Dict[str, typing.Dict[str, typing.Union[int, float]]]: 
+        """
+        Returns count, p50, p99 and max in seconds for the decode, publish, grab and delivery stages, measured from the read of a rotation's last byte
+        """
+    def stats_text(self) -> str: 
+        """
+        Returns the counters in the Prometheus text exposition format
+        """
+    def write_stats(self, path: str) -> None: 
+        """
+        Replaces the file at path with stats_text in one step, for the node_exporter textfile collector
+        """
+    def scan_pool_stats(self) -> typing.Dict[str, int]: 
+        """
+        Returns hits, misses, outstanding, outstanding_bytes, free_slabs, slab_bytes and max_outstanding_bytes of the pool scan arrays come from
+        """
+    def set_scan_pool_limit(self, max_bytes: int) -> None: 
+        """
+        Caps the memory held by scan arrays still referenced, 0 for no limit
+        """
+    def set_range_stack(self, stack: typing.Optional[RangeStack]) -> None: 
+        """
+        Resamples every rotation the lidar sends from now on into stack, on the thread reading it. None stops
+        """
+    def set_scan_log(self, log: typing.Optional[ScanLogWriter], lidar_id: int = 0) -> None: 
+        """
+        Records every rotation read from now on to log under lidar_id, without waiting for it to be written. None stops logging
+        """
+    def get_scan(self) -> Scan: 
+        """
+        Returns the next rotation as float32 columns that numpy, PyTorch and JAX take without copying
+        """
+    def get_frame(self) -> ScanFrame: 
+        """
+        Returns the next rotation as a ScanFrame, whose polar, xy, raw and timestamps all come from that one rotation
+        """
+    def get_scan_resampled(self, grid: AngularGrid) -> numpy.ndarray[numpy.float32]: 
+        """
+        Resamples the next rotation onto grid and returns grid.ranges, overwritten by the next call
+        """
     def get_scanline(self, filter_low_quality: bool) -> numpy.ndarray[Lidar_Scan]: 
         """
         Returns scan line in the form of x-y pairs with 0-0 as the lidar
@@ -76,7 +450,7 @@ class RPLidar():
         """
     def start_motor(self) -> None: 
         """
-        Starts the Lidar motor and starts scanning procedures
+        Starts the Lidar motor and starts scanning procedures, returning once the motor has settled, at most 3 s
         """
     def stop_motor(self) -> None: 
         """
@@ -104,6 +478,42 @@ class RPLidar():
         :type: str
         """
     pass
+class RangeStack():
+    """
+    The last depth rotations of a lidar resampled onto an angular grid, kept up to date by the thread reading the lidar
+    """
+    def __init__(self, depth: int, bins: int = 360, policy: str = 'nearest') -> None: 
+        """
+        Makes an empty stack, policy is nearest, min_range or interpolate
+        """
+    def get(self, after: int = 0, timeout: float = 1.0) -> typing.Optional[typing.Tuple[numpy.ndarray[numpy.float32], numpy.ndarray[numpy.float64], int]]: 
+        """
+        Waits for a rotation newer than after and returns the (depth, bins) range image oldest row first, the time.monotonic
+        time of each row and the revolution to pass as after next. None if no rotation arrived in time
+        """
+    @property
+    def depth(self) -> int:
+        """
+        :type: int
+        """
+    @property
+    def bins(self) -> int:
+        """
+        :type: int
+        """
+    @property
+    def policy(self) -> str:
+        """
+        :type: str
+        """
+    @property
+    def revolutions(self) -> int:
+        """
+        Rotations pushed so far
+
+        :type: int
+        """
+    pass
 class Result_Code():
     """
     Lidar result enum
@@ -203,3 +613,25 @@ class Status_Code():
     WARNING: FastPyRpLidar.Status_Code # value = <Status_Code.WARNING: 1>
     __members__: dict # value = {'OK': <Status_Code.OK: 0>, 'WARNING': <Status_Code.WARNING: 1>, 'ERROR': <Status_Code.ERROR: 2>, 'UNKNOWN': <Status_Code.UNKNOWN: 3>}
     pass
+
+
+def list_serial_ports() -> typing.List[str]: 
+    """
+    Returns the serial devices a lidar could be attached to
+    """
+def discover(ports: typing.Optional[typing.List[str]] = None, baud_rates: typing.Optional[typing.List[int]] = None, timeout: float = 0.1, autobaud: bool = False) -> typing.List[typing.Dict[str, typing.Union[str, int]]]: 
+    """
+    Probes serial ports concurrently and returns port, baud_rate, serial_number, model, firmware_version and hardware_version of every lidar found
+    """
+def set_tracing(enabled: bool) -> None: 
+    """
+    Turns the per-thread trace recorder of the read, decode, publish, grab, ascend, convert and handoff stages on or off
+    """
+def trace_json() -> str: 
+    """
+    Returns the recorded events in the Chrome trace event format, for chrome://tracing or Perfetto
+    """
+def clear_trace() -> None: 
+    """
+    Forgets the recorded events
+    """
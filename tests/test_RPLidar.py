@@ -1,26 +1,496 @@
+import json
+import os
 import pickle
+import subprocess
+import sys
+import tempfile
 import unittest
 import numpy
 import time
 
-from FastPyRpLidar import RPLidar
+from FastPyRpLidar import AngularGrid, RangeStack, RPLidar, LidarEmulator, LidarGroup, ScanLogWriter, ScanLogReader, ScanEncoder, ScanDecoder, discover, set_tracing, trace_json, clear_trace
+
+# Set RPLIDAR_PORT (and RPLIDAR_BAUD_RATE) to run against real hardware instead of the emulator
+HARDWARE_PORT = os.environ.get("RPLIDAR_PORT")
+BAUD_RATE = int(os.environ.get("RPLIDAR_BAUD_RATE", "1000000"))
 
 
 class TestRPLidar(unittest.TestCase):
+    def setUp(self):
+        self.emulator = None if HARDWARE_PORT else LidarEmulator()
+        self.port = HARDWARE_PORT or self.emulator.port
+
+    def tearDown(self):
+        self.emulator = None
+
     def test_construction(self):
-        l = RPLidar("/dev/ttyUSB0",1000000)
+        l = RPLidar(self.port, BAUD_RATE)
         print(l.serial_number)
         print(l.firmware_version)
         print(l.hardware_version)
         print(l)
 
     def test_scan(self):
-        l = RPLidar("/dev/ttyUSB0",1000000)
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        scan = l.get_scanline_xy()
+        self.assertGreater(len(scan), 0)
+        # The whole sorted rotation, with its first sample and no stale one at the end
+        line = l.get_scanline()
+        self.assertTrue(numpy.all(numpy.diff(line["angle"]) >= 0))
+        l.stop_motor()
+
+    def test_capture_replay(self):
+        with tempfile.TemporaryDirectory() as directory:
+            capture_file = os.path.join(directory, "capture.bin")
+
+            l = RPLidar(self.port, BAUD_RATE, capture_file)
+            serial_number = l.serial_number
+            l.start_motor()
+            l.get_scanline()
+            l.stop_motor()
+            del l
+
+            replayed = RPLidar.replay(capture_file)
+            self.assertEqual(replayed.serial_number, serial_number)
+            replayed.start_motor()
+            self.assertGreater(len(replayed.get_scanline()), 0)
+            del replayed
+
+            # The recording never asked for the health, nothing after it can be answered
+            replayed = RPLidar.replay(capture_file)
+            with self.assertRaises(RuntimeError):
+                replayed.get_health()
+            with self.assertRaises(RuntimeError):
+                replayed.start_motor()
+            del replayed
+
+    def test_fault_injection(self):
+        # Faults only go on once the motor runs, so the handshake and the scan request are clean
+        l = RPLidar.with_faults(self.port, BAUD_RATE, seed=7)
+        l.start_motor()
+        full = len(l.get_scanline())
+        self.assertGreater(full, 0)
+
+        l.set_faults(corrupt_rate=2e-4, drop_rate=2e-4, insert_rate=1e-4, seed=7)
+        for _ in range(10):
+            l.get_scanline()
+        l.set_faults(drop_rate=5e-5, burst_length=40, seed=7)
+        for _ in range(10):
+            l.get_scanline()
+        faults = l.fault_stats()
+        self.assertGreater(faults["bytes_corrupted"], 0)
+        self.assertGreater(faults["bytes_dropped"], 0)
+        self.assertGreater(faults["bytes_inserted"], 0)
+        stats = l.stats()
+        self.assertGreater(stats["checksum_failures"], 0)
+        self.assertGreater(stats["resync_bytes_skipped"], 0)
+        self.assertGreater(stats["capsules_lost"], 0)
+
+        # Once the link is clean again the decoder stays in sync and whole rotations come through
+        l.set_faults()
+        for _ in range(2):
+            l.get_scanline()
+        settled = l.stats()
+        for _ in range(5):
+            self.assertGreaterEqual(len(l.get_scanline()), full * 0.9)
+        recovered = l.stats()
+        for counter in ("checksum_failures", "resync_bytes_skipped", "capsules_lost"):
+            self.assertEqual(recovered[counter], settled[counter])
+        self.assertEqual(l.fault_stats()["bytes_dropped"], faults["bytes_dropped"])
+        l.stop_motor()
+
+    def test_capability_cache(self):
+        with tempfile.TemporaryDirectory() as directory:
+            commands = []
+            for _ in range(2):
+                before = self.emulator.stats()["commands_received"] if self.emulator else 0
+                l = RPLidar(self.port, BAUD_RATE, capability_cache=directory)
+                l.start_motor()
+                self.assertGreater(len(l.get_scanline()), 0)
+                l.stop_motor()
+                del l
+                if self.emulator:
+                    commands.append(self.emulator.stats()["commands_received"] - before)
+
+            self.assertEqual(len(os.listdir(directory)), 1)
+            # The warm connect answers the configuration queries from the cache
+            if self.emulator:
+                cold, warm = commands
+                self.assertLess(warm, cold)
+
+    def test_discover(self):
+        found = discover([self.port])
+        self.assertEqual(len(found), 1)
+        self.assertEqual(found[0]["port"], self.port)
+
+        l = RPLidar(found[0]["port"], found[0]["baud_rate"])
+        self.assertEqual(l.serial_number, found[0]["serial_number"])
+
+    def test_switch_mode(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        previous = len(l.get_scanline())
+
+        # Each mode samples at its own rate, so a rotation the old mode left behind shows in the sample count
+        for mode in l.scan_modes():
+            gap = l.switch_mode(mode["id"])
+            self.assertLess(gap, 1.0)
+            first = len(l.get_scanline())
+            self.assertGreater(first, 0)
+            self.assertNotEqual(first, previous)
+            previous = len(l.get_scanline())
+        l.stop_motor()
+
+    @unittest.skipIf(HARDWARE_PORT, "needs the emulator to cut the link")
+    def test_supervisor(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.enable_supervisor()
+        l.start_motor()
+        self.assertGreater(len(l.get_scanline()), 0)
+
+        # Not the speed the driver starts a scan with, so only a recovery that restores it keeps it
+        speed = 700
+        l.switch_mode(l.scan_modes()[0]["id"], speed)
+        self.assertEqual(self.emulator.stats()["last_motor_speed"], speed)
+        self.assertGreater(len(l.get_scanline()), 0)
+
+        before = l.supervisor_stats()
+        self.assertEqual(before["reconnects"], 0)
+
+        # Wait for the recovery rather than for a fixed time, the deadline only keeps a broken supervisor from hanging the test
+        self.emulator.simulate_dropout(0.3)
+        deadline = time.monotonic() + 10
+        while l.supervisor_stats()["reconnects"] == before["reconnects"] and time.monotonic() < deadline:
+            time.sleep(0.05)
+        self.assertGreater(len(l.get_scanline()), 0)
+
+        stats = l.supervisor_stats()
+        self.assertEqual(stats["reconnects"], before["reconnects"] + 1)
+        self.assertFalse(stats["in_outage"])
+        self.assertGreater(stats["last_outage"], 0)
+        self.assertGreaterEqual(stats["max_outage"], stats["last_outage"])
+        self.assertGreaterEqual(stats["total_outage"], stats["last_outage"])
+        self.assertEqual(self.emulator.stats()["last_motor_speed"], speed)
+        l.stop_motor()
+
+    @unittest.skipIf(HARDWARE_PORT, "needs the emulator to cut the link")
+    def test_capture_supervisor(self):
+        with tempfile.TemporaryDirectory() as directory:
+            capture_file = os.path.join(directory, "capture.bin")
+
+            l = RPLidar(self.port, BAUD_RATE, capture_file)
+            l.enable_supervisor()
+            l.start_motor()
+            self.assertGreater(len(l.get_scanline()), 0)
+            with open(capture_file, "rb") as capture:
+                before_outage = capture.read()
+            self.assertGreater(len(before_outage), 8)
+
+            self.emulator.simulate_dropout(0.3)
+            deadline = time.monotonic() + 10
+            while l.supervisor_stats()["reconnects"] == 0 and time.monotonic() < deadline:
+                time.sleep(0.05)
+            self.assertEqual(l.supervisor_stats()["reconnects"], 1)
+            self.assertGreater(len(l.get_scanline()), 0)
+            l.stop_motor()
+            del l
+
+            # The reconnection appended to what was recorded before the outage
+            with open(capture_file, "rb") as capture:
+                recorded = capture.read()
+            self.assertTrue(recorded.startswith(before_outage))
+            self.assertGreater(len(recorded), len(before_outage))
+
+    def test_acquisition_thread(self):
+        with self.assertRaises(ValueError):
+            RPLidar(self.port, BAUD_RATE, sched_policy="fifo", sched_priority=0)
+
+        cpu = min(os.sched_getaffinity(0))
+        l = RPLidar(self.port, BAUD_RATE, cpus=[cpu])
+        l.start_motor()
+        self.assertGreater(len(l.get_scanline()), 0)
+
+        effective = l.acquisition_thread()
+        self.assertEqual(effective["policy"], "inherit")
+        self.assertEqual(effective["cpus"], [cpu])
+        l.stop_motor()
+
+    def test_scan_capacity(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        with self.assertRaises(ValueError):
+            l.set_scan_capacity(0)
+
+        l.start_motor()
+        self.assertGreater(len(l.get_scanline()), 0)
+        full = l.scan_capacity_stats()
+        self.assertGreater(full["max_scan_nodes"], 100)
+        self.assertEqual(full["dropped_nodes"], 0)
+        with self.assertRaises(RuntimeError):
+            l.set_scan_capacity(100)
+        l.stop_motor()
+
+        l.set_scan_capacity(100)
+        l.start_motor()
+        self.assertLessEqual(len(l.get_scanline()), 100)
+        stats = l.scan_capacity_stats()
+        self.assertEqual(stats["capacity"], 100)
+        self.assertGreater(stats["dropped_nodes"], 0)
+        l.stop_motor()
+
+    def test_stats(self):
+        l = RPLidar(self.port, BAUD_RATE)
         l.start_motor()
-        l.get_scanline_xy()
+        for _ in range(3):
+            self.assertGreater(len(l.get_scanline()), 0)
+        stats = l.stats()
+        self.assertGreater(stats["bytes_read"], 0)
+        self.assertGreater(stats["read_calls"], 0)
+        self.assertGreaterEqual(stats["revolutions_published"], 3)
+        self.assertLessEqual(stats["min_samples_per_revolution"], stats["avg_samples_per_revolution"])
+        self.assertLessEqual(stats["avg_samples_per_revolution"], stats["max_samples_per_revolution"])
+        self.assertGreaterEqual(stats["zero_distance_ratio"], 0.0)
+        self.assertLessEqual(stats["zero_distance_ratio"], 1.0)
+        self.assertIn("rplidar_bytes_read_total{", l.stats_text())
+
+        path = os.path.join(tempfile.mkdtemp(), "rplidar.prom")
+        l.write_stats(path)
+        with open(path) as f:
+            self.assertIn("# TYPE rplidar_revolutions_published_total counter", f.read())
+        l.stop_motor()
+
+    def test_latency_stats(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        l.latency_stats()
+        for _ in range(3):
+            self.assertGreater(len(l.get_scanline()), 0)
+        stats = l.latency_stats()
+        delivery = stats["delivery"]
+        self.assertEqual(delivery["count"], 3)
+        self.assertLessEqual(delivery["p50"], delivery["p99"])
+        self.assertLessEqual(delivery["p99"], delivery["max"])
+        self.assertGreater(stats["decode"]["count"], 0)
+        self.assertEqual(l.latency_stats()["delivery"]["count"], 0)
+        l.stop_motor()
+
+    def test_tracing(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        clear_trace()
+        set_tracing(True)
+        try:
+            for _ in range(2):
+                self.assertGreater(len(l.get_scanline()), 0)
+        finally:
+            set_tracing(False)
+        names = {event["name"] for event in json.loads(trace_json())["traceEvents"]}
+        for stage in ("read", "decode", "publish", "grab", "ascend", "convert", "handoff"):
+            self.assertIn(stage, names)
+        clear_trace()
+        l.stop_motor()
+
+    def test_scan_log(self):
+        directory = tempfile.mkdtemp()
+        log = ScanLogWriter(directory)
+        l = RPLidar(self.port, BAUD_RATE)
+        l.set_scan_log(log, 7)
+        l.start_motor()
+        start = time.time()
+        lengths = [len(l.get_scanline()) for _ in range(3)]
+        l.set_scan_log(None)
+        l.stop_motor()
+        log.close()
+        self.assertEqual(log.stats()["written"], 3)
+
+        reader = ScanLogReader(directory)
+        self.assertEqual(len(reader), 3)
+        timestamp, lidar_id, _, nodes = reader.scan(2)
+        self.assertEqual(lidar_id, 7)
+        self.assertEqual(len(nodes), lengths[2])
+        self.assertFalse(nodes.flags.writeable)
+        self.assertGreaterEqual(timestamp, start - 1.0)
+        self.assertEqual(reader.time_range(timestamp, timestamp + 1.0), range(2, 3))
+        with self.assertRaises(IndexError):
+            reader.scan(3)
+
+    def test_scan_codec(self):
+        dtype = numpy.dtype([("angle_z_q14", "<u2"), ("dist_mm_q2", "<u4"), ("quality", "u1"), ("flag", "u1")])
+        rotations = []
+        for revolution in range(3):
+            nodes = numpy.zeros(3200, dtype=dtype)
+            nodes["angle_z_q14"] = (numpy.arange(3200) * 65536 // 3200 + revolution) % 65536
+            nodes["dist_mm_q2"] = 8000 + (numpy.arange(3200) % 200) * 4
+            nodes["dist_mm_q2"][::17] = 0
+            nodes["quality"] = numpy.where(nodes["dist_mm_q2"] > 0, 188, 0)
+            nodes["flag"][0] = 1
+            rotations.append(nodes)
+
+        encoder = ScanEncoder()
+        frames = [encoder.encode(nodes) for nodes in rotations]
+        self.assertLess(sum(map(len, frames)), sum(nodes.nbytes for nodes in rotations) / 3)
+
+        decoder = ScanDecoder()
+        for nodes, frame in zip(rotations, frames):
+            decoded = decoder.decode(frame)
+            for field in dtype.names:
+                numpy.testing.assert_array_equal(decoded[field], nodes[field])
+        with self.assertRaises(RuntimeError):
+            ScanDecoder().decode(frames[1])
+        with self.assertRaises(RuntimeError):
+            ScanDecoder().decode(frames[0][:len(frames[0]) // 2])
+
+    def test_scan_pool(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        for _ in range(5):
+            self.assertGreater(len(l.get_scanline()), 0)
+        stats = l.scan_pool_stats()
+        self.assertEqual(stats["outstanding"], 0)
+        self.assertGreaterEqual(stats["hits"], 3)
+
+        held = l.get_scanline_xy()
+        l.set_scan_pool_limit(l.scan_pool_stats()["slab_bytes"])
+        with self.assertRaises(RuntimeError):
+            l.get_scanline()
+        del held
+        self.assertGreater(len(l.get_scanline()), 0)
+        l.stop_motor()
+
+    def test_scan_export(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        scan = l.get_scan()
+        self.assertGreater(len(scan), 0)
+
+        matrix = numpy.asarray(scan)
+        self.assertEqual(matrix.dtype, numpy.float32)
+        self.assertEqual(matrix.shape, (3, len(scan)))
+        self.assertTrue(numpy.shares_memory(matrix[1], scan.distance))
+        self.assertEqual(scan.__dlpack_device__(), (1, 0))
+
+        tensor = numpy.from_dlpack(scan)
+        self.assertTrue(numpy.shares_memory(tensor, matrix))
+        self.assertTrue(numpy.all(numpy.diff(tensor[0]) >= 0))
+
+        del scan, matrix
+        self.assertEqual(l.scan_pool_stats()["outstanding"], 1)
+        del tensor
+        self.assertEqual(l.scan_pool_stats()["outstanding"], 0)
+        l.stop_motor()
+
+    def test_frame(self):
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        frame = l.get_frame()
+        self.assertGreater(len(frame), 0)
+        self.assertEqual(l.scan_pool_stats()["outstanding"], 1)
+
+        polar = frame.polar
+        self.assertEqual(l.scan_pool_stats()["outstanding"], 2)
+        self.assertTrue(numpy.shares_memory(frame.polar, polar))
+        self.assertFalse(polar.flags.writeable)
+        self.assertTrue(numpy.all(numpy.diff(polar["angle"]) >= 0))
+
+        xy = frame.xy
+        numpy.testing.assert_allclose(numpy.hypot(xy["x"], xy["y"]), polar["distance"], atol=1e-6)
+        numpy.testing.assert_array_equal(numpy.sort(frame.raw["dist_mm_q2"]), numpy.sort(numpy.round(polar["distance"] * 4000)))
+
+        timestamps = frame.timestamps
+        self.assertEqual(len(timestamps), len(frame))
+        self.assertLessEqual(timestamps.max(), frame.timestamp)
+        self.assertGreater(timestamps.min(), frame.timestamp - 1.0)
+        self.assertLessEqual(frame.timestamp, time.monotonic())
+
+        del frame, polar, xy, timestamps
+        self.assertEqual(l.scan_pool_stats()["outstanding"], 0)
+        l.stop_motor()
+
+    def test_resample(self):
+        with self.assertRaises(ValueError):
+            AngularGrid(360, "mean")
+        grid = AngularGrid(720, "nearest")
+        self.assertEqual(grid.index_of(359.9), 0)
+        self.assertEqual(grid.index_of(-0.5), 719)
+        self.assertEqual(grid.angle_of(grid.index_of(90.2)), 90.0)
+
+        l = RPLidar(self.port, BAUD_RATE)
+        l.start_motor()
+        for policy in ("nearest", "min_range", "interpolate"):
+            grid = AngularGrid(720, policy)
+            ranges = l.get_scan_resampled(grid)
+            self.assertEqual(ranges.shape, (720,))
+            self.assertEqual(ranges.dtype, numpy.float32)
+            self.assertTrue(numpy.shares_memory(ranges, grid.ranges))
+            self.assertGreater(numpy.count_nonzero(~numpy.isnan(ranges)), 0)
+            self.assertTrue(numpy.all(ranges[~numpy.isnan(ranges)] > 0))
+            self.assertTrue(numpy.isnan(grid.distance_at(90.0)) or grid.distance_at(90.0) == ranges[180])
+        l.stop_motor()
+
+    def test_range_stack(self):
+        stack = RangeStack(4, 720, "min_range")
+        self.assertIsNone(stack.get(timeout=0.0))
+
+        l = RPLidar(self.port, BAUD_RATE)
+        l.set_range_stack(stack)
+        l.start_motor()
+        ranges, timestamps, revolution = stack.get(timeout=5.0)
+        while revolution < 6:
+            ranges, timestamps, revolution = stack.get(revolution, timeout=5.0)
+        self.assertEqual(ranges.shape, (4, 720))
+        self.assertEqual(ranges.dtype, numpy.float32)
+        self.assertTrue(ranges.flags.c_contiguous)
+        self.assertTrue(numpy.all(numpy.diff(timestamps) > 0))
+        self.assertLessEqual(timestamps[-1], time.monotonic())
+        self.assertGreater(numpy.count_nonzero(~numpy.isnan(ranges[-1])), 0)
+
+        l.set_range_stack(None)
+        l.stop_motor()
+        self.assertEqual(stack.get(timeout=0.0)[2], stack.revolutions)
+
+    def test_group(self):
+        emulators = [] if HARDWARE_PORT else [LidarEmulator(typical_scan_mode=mode) for mode in (0, 4)]
+        group = LidarGroup()
+        for port in [self.port] + [e.port for e in emulators]:
+            group.add(port, BAUD_RATE)
+        group.start()
+
+        seen = set()
+        while len(seen) < len(group):
+            delivered = group.next_scan(timeout=5.0)
+            self.assertIsNotNone(delivered)
+            index, scan = delivered
+            self.assertGreater(len(scan), 0)
+            seen.add(index)
+        group.stop()
+
+    def test_connect_async(self):
+        future = RPLidar.connect_async(self.port, BAUD_RATE)
+        l = future.result(timeout=10)
+        self.assertTrue(l.serial_number)
+
+    def test_connect_async_at_exit(self):
+        # The interpreter exits while the connection is still being made, which has to neither hang nor crash
+        script = "from FastPyRpLidar import RPLidar; RPLidar.connect_async({!r}, {})".format(self.port, BAUD_RATE)
+        finished = subprocess.run([sys.executable, "-c", script], timeout=30)
+        self.assertEqual(finished.returncode, 0)
+
+    def test_connect_all(self):
+        emulators = [] if HARDWARE_PORT else [LidarEmulator() for _ in range(3)]
+        ports = [self.port] + [e.port for e in emulators]
+
+        lidars = RPLidar.connect_all(ports, BAUD_RATE)
+        self.assertEqual(len(lidars), len(ports))
+        for l in lidars:
+            self.assertTrue(l.serial_number)
+        del lidars
 
+        with tempfile.TemporaryDirectory() as directory:
+            missing = os.path.join(directory, "no_such_port")
+            with self.assertRaises(RuntimeError):
+                RPLidar.connect_all([missing], BAUD_RATE)
+            self.assertEqual(RPLidar.connect_all([missing], BAUD_RATE, raise_on_error=False), [None])
 
 
 if __name__ == '__main__':
     unittest.main()
-    
\ No newline at end of file